@@ -20,6 +20,9 @@
 #include <utils/Log.h>
 #include <utils/Errors.h>
 
+#include <algorithm>
+#include <utility>
+
 #include <binder/Parcel.h>
 #include <camera/CameraMetadata.h>
 #include <camera_metadata_hidden.h>
@@ -32,6 +35,55 @@ namespace android {
 typedef Parcel::WritableBlob WritableBlob;
 typedef Parcel::ReadableBlob ReadableBlob;
 
+// Smaller buffers are scanned; a binary search doesn't pay off for them.
+static const size_t kMinIndexedEntryCount = 16;
+// Lookups on an unindexed buffer before the tag index is built, so that
+// metadata which is only filled in and passed along never pays for it.
+static const uint32_t kLookupsBeforeIndexing = 4;
+
+struct CameraMetadata::TagIndex {
+    // (tag, entry index) pairs. Sorted by index as well, so that like a
+    // linear scan the first of several entries with the same tag is found.
+    std::vector<std::pair<uint32_t, uint32_t>> entries;
+
+    explicit TagIndex(const camera_metadata_t *buffer) {
+        size_t count = get_camera_metadata_entry_count(buffer);
+        entries.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            camera_metadata_ro_entry_t entry;
+            if (get_camera_metadata_ro_entry(buffer, i, &entry) == OK) {
+                entries.emplace_back(entry.tag, i);
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+    }
+
+    ssize_t lookup(uint32_t tag) const {
+        auto it = std::lower_bound(entries.begin(), entries.end(),
+                std::make_pair(tag, 0u));
+        if (it == entries.end() || it->first != tag) {
+            return NAME_NOT_FOUND;
+        }
+        return it->second;
+    }
+
+    // An entry was added at the end of the buffer
+    void insert(uint32_t tag, size_t index) {
+        auto entry = std::make_pair(tag, static_cast<uint32_t>(index));
+        entries.insert(std::upper_bound(entries.begin(), entries.end(), entry), entry);
+    }
+
+    // An entry was deleted and the entries after it were moved down
+    void erase(size_t index) {
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                [index](const std::pair<uint32_t, uint32_t> &e) { return e.second == index; }),
+                entries.end());
+        for (auto &e : entries) {
+            if (e.second > index) e.second--;
+        }
+    }
+};
+
 CameraMetadata::CameraMetadata() :
         mBuffer(NULL), mLocked(false) {
 }
@@ -108,6 +160,7 @@ camera_metadata_t* CameraMetadata::release() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return NULL;
     }
+    invalidateTagIndex();
     camera_metadata_t *released = mBuffer;
     mBuffer = NULL;
     return released;
@@ -118,6 +171,7 @@ void CameraMetadata::clear() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return;
     }
+    invalidateTagIndex();
     if (mBuffer) {
         free_camera_metadata(mBuffer);
         mBuffer = NULL;
@@ -158,6 +212,7 @@ status_t CameraMetadata::append(const camera_metadata_t* other) {
     size_t extraData = get_camera_metadata_data_count(other);
     resizeIfNeeded(extraEntries, extraData);
 
+    invalidateTagIndex();
     return append_camera_metadata(mBuffer, other);
 }
 
@@ -180,6 +235,7 @@ status_t CameraMetadata::sort() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
+    invalidateTagIndex();
     return sort_camera_metadata(mBuffer);
 }
 
@@ -304,6 +360,82 @@ status_t CameraMetadata::update(const camera_metadata_ro_entry &entry) {
     return updateImpl(entry.tag, (const void*)entry.data.u8, entry.count);
 }
 
+status_t CameraMetadata::update(const std::vector<camera_metadata_ro_entry> &entries) {
+    status_t res;
+    if (mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+
+    // Work out the space needed by the whole batch up front, so the buffer
+    // is grown at most once. Repeated tags are counted each time, which can
+    // only overestimate.
+    size_t extraEntries = 0;
+    size_t extraData = 0;
+    for (const auto &entry : entries) {
+        if ( (res = checkType(entry.tag, entry.type)) != OK) {
+            return res;
+        }
+        if (isInBuffer(entry.data.u8)) {
+            ALOGE("%s: Update attempted with data from the same metadata buffer!",
+                    __FUNCTION__);
+            return INVALID_OPERATION;
+        }
+        size_t dataSize = calculate_camera_metadata_entry_data_size(entry.type,
+                entry.count);
+        size_t index;
+        camera_metadata_ro_entry_t existing;
+        if (findEntryIndex(entry.tag, &index) == OK &&
+                get_camera_metadata_ro_entry(mBuffer, index, &existing) == OK) {
+            // An update in place only grows the data by the size difference
+            size_t existingSize = calculate_camera_metadata_entry_data_size(
+                    existing.type, existing.count);
+            if (dataSize > existingSize) {
+                extraData += dataSize - existingSize;
+            }
+        } else {
+            extraEntries++;
+            extraData += dataSize;
+        }
+    }
+
+    res = resizeIfNeeded(extraEntries, extraData);
+    if (res != OK) {
+        return res;
+    }
+
+    for (const auto &entry : entries) {
+        res = writeEntry(entry.tag, (const void*)entry.data.u8, entry.count);
+        if (res != OK) {
+            ALOGE("%s: Unable to update metadata entry %s.%s (%x): %s (%d)",
+                    __FUNCTION__, get_local_camera_metadata_section_name(entry.tag, mBuffer),
+                    get_local_camera_metadata_tag_name(entry.tag, mBuffer), entry.tag,
+                    strerror(-res), res);
+            return res;
+        }
+    }
+
+    IF_ALOGV() {
+        ALOGE_IF(validate_camera_metadata_structure(mBuffer, /*size*/NULL) !=
+                 OK,
+
+                 "%s: Failed to validate metadata structure after update %p",
+                 __FUNCTION__, mBuffer);
+    }
+
+    return OK;
+}
+
+bool CameraMetadata::isInBuffer(const void *data) const {
+    if (mBuffer == NULL) {
+        return false;
+    }
+    size_t bufferSize = get_camera_metadata_size(mBuffer);
+    uintptr_t bufAddr = reinterpret_cast<uintptr_t>(mBuffer);
+    uintptr_t dataAddr = reinterpret_cast<uintptr_t>(data);
+    return dataAddr > bufAddr && dataAddr < (bufAddr + bufferSize);
+}
+
 status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
         size_t data_count) {
     status_t res;
@@ -318,10 +450,7 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
     }
     // Safety check - ensure that data isn't pointing to this metadata, since
     // that would get invalidated if a resize is needed
-    size_t bufferSize = get_camera_metadata_size(mBuffer);
-    uintptr_t bufAddr = reinterpret_cast<uintptr_t>(mBuffer);
-    uintptr_t dataAddr = reinterpret_cast<uintptr_t>(data);
-    if (dataAddr > bufAddr && dataAddr < (bufAddr + bufferSize)) {
+    if (isInBuffer(data)) {
         ALOGE("%s: Update attempted with data from the same metadata buffer!",
                 __FUNCTION__);
         return INVALID_OPERATION;
@@ -333,15 +462,7 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
     res = resizeIfNeeded(1, data_size);
 
     if (res == OK) {
-        camera_metadata_entry_t entry;
-        res = find_camera_metadata_entry(mBuffer, tag, &entry);
-        if (res == NAME_NOT_FOUND) {
-            res = add_camera_metadata_entry(mBuffer,
-                    tag, data, data_count);
-        } else if (res == OK) {
-            res = update_camera_metadata_entry(mBuffer,
-                    entry.index, data, data_count, NULL);
-        }
+        res = writeEntry(tag, data, data_count);
     }
 
     if (res != OK) {
@@ -362,9 +483,99 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
     return res;
 }
 
-bool CameraMetadata::exists(uint32_t tag) const {
+status_t CameraMetadata::writeEntry(uint32_t tag, const void *data,
+        size_t data_count) {
+    // Neither adding nor updating an entry moves the other entries, and
+    // resizeIfNeeded() copies them in order, so the tag index stays valid
+    // apart from the new entry.
+    status_t res;
+    size_t index;
+    res = findEntryIndex(tag, &index);
+    if (res == NAME_NOT_FOUND) {
+        res = add_camera_metadata_entry(mBuffer,
+                tag, data, data_count);
+        if (res == OK) {
+            updateTagIndex(tag, get_camera_metadata_entry_count(mBuffer) - 1,
+                    /*added*/true);
+        }
+    } else if (res == OK) {
+        res = update_camera_metadata_entry(mBuffer,
+                index, data, data_count, NULL);
+    }
+    return res;
+}
+
+const CameraMetadata::TagIndex* CameraMetadata::getTagIndex() const {
+    if (mBuffer == NULL) {
+        return nullptr;
+    }
+    size_t count = get_camera_metadata_entry_count(mBuffer);
+    const TagIndex *tagIndex = mTagIndex.load(std::memory_order_acquire);
+    if (tagIndex != nullptr) {
+        // The buffer may have been changed through a raw pointer; scan it
+        // until the next mutation through this object replaces the index.
+        return tagIndex->entries.size() == count ? tagIndex : nullptr;
+    }
+    if (count < kMinIndexedEntryCount ||
+            mUnindexedLookups.fetch_add(1, std::memory_order_relaxed) + 1 <
+            kLookupsBeforeIndexing) {
+        return nullptr;
+    }
+
+    TagIndex *newIndex = new TagIndex(mBuffer);
+    TagIndex *expected = nullptr;
+    if (!mTagIndex.compare_exchange_strong(expected, newIndex,
+            std::memory_order_acq_rel)) {
+        // Another reader built it first
+        delete newIndex;
+        return expected->entries.size() == count ? expected : nullptr;
+    }
+    return newIndex;
+}
+
+void CameraMetadata::updateTagIndex(uint32_t tag, size_t index, bool added) {
+    TagIndex *tagIndex = mTagIndex.load(std::memory_order_relaxed);
+    if (tagIndex == nullptr) {
+        return;
+    }
+    size_t count = get_camera_metadata_entry_count(mBuffer);
+    size_t indexedCount = tagIndex->entries.size();
+    if (added ? indexedCount + 1 != count : indexedCount != count + 1) {
+        // Already out of date
+        invalidateTagIndex();
+    } else if (added) {
+        tagIndex->insert(tag, index);
+    } else {
+        tagIndex->erase(index);
+    }
+}
+
+void CameraMetadata::invalidateTagIndex() {
+    delete mTagIndex.exchange(nullptr, std::memory_order_relaxed);
+    mUnindexedLookups.store(0, std::memory_order_relaxed);
+}
+
+status_t CameraMetadata::findEntryIndex(uint32_t tag, size_t *index) const {
+    const TagIndex *tagIndex = getTagIndex();
+    if (tagIndex != nullptr) {
+        ssize_t found = tagIndex->lookup(tag);
+        if (found < 0) {
+            return static_cast<status_t>(found);
+        }
+        *index = found;
+        return OK;
+    }
     camera_metadata_ro_entry entry;
-    return find_camera_metadata_ro_entry(mBuffer, tag, &entry) == 0;
+    status_t res = find_camera_metadata_ro_entry(mBuffer, tag, &entry);
+    if (res == OK) {
+        *index = entry.index;
+    }
+    return res;
+}
+
+bool CameraMetadata::exists(uint32_t tag) const {
+    size_t index;
+    return findEntryIndex(tag, &index) == OK;
 }
 
 camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
@@ -375,7 +586,11 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
         entry.count = 0;
         return entry;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    size_t index;
+    res = findEntryIndex(tag, &index);
+    if (res == OK) {
+        res = get_camera_metadata_entry(mBuffer, index, &entry);
+    }
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -386,7 +601,11 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
 camera_metadata_ro_entry_t CameraMetadata::find(uint32_t tag) const {
     status_t res;
     camera_metadata_ro_entry entry;
-    res = find_camera_metadata_ro_entry(mBuffer, tag, &entry);
+    size_t index;
+    res = findEntryIndex(tag, &index);
+    if (res == OK) {
+        res = get_camera_metadata_ro_entry(mBuffer, index, &entry);
+    }
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -395,13 +614,13 @@ camera_metadata_ro_entry_t CameraMetadata::find(uint32_t tag) const {
 }
 
 status_t CameraMetadata::erase(uint32_t tag) {
-    camera_metadata_entry_t entry;
+    size_t index;
     status_t res;
     if (mLocked) {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    res = findEntryIndex(tag, &index);
     if (res == NAME_NOT_FOUND) {
         return OK;
     } else if (res != OK) {
@@ -412,8 +631,10 @@ status_t CameraMetadata::erase(uint32_t tag) {
                 tag, strerror(-res), res);
         return res;
     }
-    res = delete_camera_metadata_entry(mBuffer, entry.index);
-    if (res != OK) {
+    res = delete_camera_metadata_entry(mBuffer, index);
+    if (res == OK) {
+        updateTagIndex(tag, index, /*added*/false);
+    } else {
         ALOGE("%s: Error deleting entry %s.%s (%x): %s %d",
                 __FUNCTION__,
                 get_local_camera_metadata_section_name(tag, mBuffer),
@@ -784,6 +1005,9 @@ void CameraMetadata::swap(CameraMetadata& other) {
 
     other.mBuffer = thisBuf;
     mBuffer = otherBuf;
+
+    invalidateTagIndex();
+    other.invalidateTagIndex();
 }
 
 status_t CameraMetadata::getTagFromName(const char *name,
@@ -19,6 +19,9 @@
 
 #include "system/camera_metadata.h"
 
+#include <atomic>
+#include <vector>
+
 #include <utils/String8.h>
 #include <utils/Vector.h>
 #include <binder/Parcelable.h>
@@ -158,6 +161,13 @@ class CameraMetadata: public Parcelable {
             const String8 &string);
     status_t update(const camera_metadata_ro_entry &entry);
 
+    /**
+     * Update several metadata entries, reallocating the buffer at most once
+     * for the whole batch. Entries are applied in order. The types of all
+     * entries are checked before anything is modified, but if writing an
+     * entry fails, the entries before it remain updated.
+     */
+    status_t update(const std::vector<camera_metadata_ro_entry> &entries);
 
     template<typename T>
     status_t update(uint32_t tag, Vector<T> data) {
@@ -248,9 +258,47 @@ class CameraMetadata: public Parcelable {
     metadata_vendor_id_t getVendorId();
 
   private:
+    struct TagIndex;
+
     camera_metadata_t *mBuffer;
     mutable bool       mLocked;
 
+    /**
+     * Entry indices of mBuffer sorted by tag, so that lookups in large
+     * buffers don't have to scan every entry. Built lazily by const lookups,
+     * which may run concurrently, so it is published atomically. Methods
+     * that add or remove entries keep it up to date or drop it.
+     */
+    mutable std::atomic<TagIndex*> mTagIndex{nullptr};
+    mutable std::atomic<uint32_t>  mUnindexedLookups{0};
+
+    /**
+     * Return the tag index, building it if the buffer is large and has been
+     * searched often enough. Returns nullptr if lookups should scan mBuffer.
+     */
+    const TagIndex* getTagIndex() const;
+
+    /**
+     * Keep the tag index in step with an entry added at or deleted from
+     * the given position.
+     */
+    void updateTagIndex(uint32_t tag, size_t index, bool added);
+
+    /**
+     * Drop the tag index after entries were reordered or replaced.
+     */
+    void invalidateTagIndex();
+
+    /**
+     * Find the position of the first entry with the given tag in mBuffer.
+     */
+    status_t findEntryIndex(uint32_t tag, size_t *index) const;
+
+    /**
+     * Check if data points into the metadata buffer
+     */
+    bool isInBuffer(const void *data) const;
+
     /**
      * Check if tag has a given type
      */
@@ -261,6 +309,11 @@ class CameraMetadata: public Parcelable {
      */
     status_t updateImpl(uint32_t tag, const void *data, size_t data_count);
 
+    /**
+     * Add or update an entry, assuming the buffer already has enough space
+     */
+    status_t writeEntry(uint32_t tag, const void *data, size_t data_count);
+
     /**
      * Resize metadata buffer if needed by reallocating it and copying it over.
      */
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CameraMetadataTests"
+
+#include <camera/CameraMetadata.h>
+#include <system/camera_metadata.h>
+#include <utils/Errors.h>
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+using namespace android;
+
+namespace {
+
+// Lookups done before checking results, enough for the tag index to be built
+const int kLookupPasses = 8;
+
+struct TestEntry {
+    uint32_t tag;
+    uint8_t type;
+    size_t count;
+    std::vector<uint8_t> data;
+
+    camera_metadata_ro_entry_t toEntry() const {
+        camera_metadata_ro_entry_t entry = {};
+        entry.tag = tag;
+        entry.type = type;
+        entry.count = count;
+        entry.data.u8 = data.data();
+        return entry;
+    }
+};
+
+TestEntry makeEntry(uint32_t tag, size_t count, uint8_t seed) {
+    TestEntry e;
+    e.tag = tag;
+    e.type = get_camera_metadata_tag_type(tag);
+    e.count = count;
+    e.data.resize(count * camera_metadata_type_size[e.type]);
+    for (size_t i = 0; i < e.data.size(); i++) {
+        e.data[i] = static_cast<uint8_t>(seed + i);
+    }
+    return e;
+}
+
+// Every defined tag in the Android sections, about 300 of them
+std::vector<uint32_t> allTags() {
+    std::vector<uint32_t> tags;
+    for (uint32_t section = 0; section < ANDROID_SECTION_COUNT; section++) {
+        for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                tag < camera_metadata_section_bounds[section][1]; tag++) {
+            if (get_camera_metadata_tag_type(tag) >= 0) {
+                tags.push_back(tag);
+            }
+        }
+    }
+    return tags;
+}
+
+// Checks find() and exists() against a linear scan of the raw buffer
+void expectMatchesScan(CameraMetadata &metadata, const std::vector<uint32_t> &tags) {
+    for (int pass = 0; pass < kLookupPasses; pass++) {
+        for (uint32_t tag : tags) {
+            metadata.exists(tag);
+        }
+    }
+
+    const camera_metadata_t *buffer = metadata.getAndLock();
+    std::vector<camera_metadata_ro_entry_t> expected(tags.size());
+    std::vector<bool> found(tags.size());
+    for (size_t i = 0; i < tags.size(); i++) {
+        found[i] = find_camera_metadata_ro_entry(buffer, tags[i], &expected[i]) == OK;
+    }
+    metadata.unlock(buffer);
+
+    const CameraMetadata &constMetadata = metadata;
+    for (size_t i = 0; i < tags.size(); i++) {
+        SCOPED_TRACE(testing::Message() << "tag " << std::hex << tags[i]);
+        EXPECT_EQ(found[i], metadata.exists(tags[i]));
+
+        camera_metadata_ro_entry_t roEntry = constMetadata.find(tags[i]);
+        camera_metadata_entry_t entry = metadata.find(tags[i]);
+        if (!found[i]) {
+            EXPECT_EQ(0u, roEntry.count);
+            EXPECT_EQ(0u, entry.count);
+            continue;
+        }
+        EXPECT_EQ(expected[i].index, roEntry.index);
+        EXPECT_EQ(expected[i].count, roEntry.count);
+        EXPECT_EQ(expected[i].data.u8, roEntry.data.u8);
+        EXPECT_EQ(expected[i].index, entry.index);
+        EXPECT_EQ(expected[i].data.u8, entry.data.u8);
+    }
+}
+
+void expectData(const CameraMetadata &metadata, const TestEntry &e) {
+    camera_metadata_ro_entry_t entry = metadata.find(e.tag);
+    ASSERT_EQ(e.count, entry.count) << "tag " << std::hex << e.tag;
+    EXPECT_EQ(0, memcmp(e.data.data(), entry.data.u8, e.data.size()))
+            << "tag " << std::hex << e.tag;
+}
+
+}  // namespace
+
+TEST(CameraMetadataTest, FindMatchesLinearScan) {
+    std::vector<uint32_t> tags = allTags();
+    ASSERT_GT(tags.size(), 100u);
+
+    CameraMetadata metadata;
+    // Leave every third tag out so that misses are covered too
+    for (size_t i = 0; i < tags.size(); i++) {
+        if (i % 3 != 2) {
+            ASSERT_EQ(OK, metadata.update(makeEntry(tags[i], 1 + i % 5, i).toEntry()));
+        }
+    }
+    expectMatchesScan(metadata, tags);
+
+    ASSERT_EQ(OK, metadata.sort());
+    expectMatchesScan(metadata, tags);
+}
+
+TEST(CameraMetadataTest, IndexFollowsUpdateAndErase) {
+    std::vector<uint32_t> tags = allTags();
+    CameraMetadata metadata;
+    for (size_t i = 0; i < tags.size(); i++) {
+        ASSERT_EQ(OK, metadata.update(makeEntry(tags[i], 2, i).toEntry()));
+    }
+    expectMatchesScan(metadata, tags);
+
+    // Erase from the middle of the buffer, which moves the later entries down
+    for (size_t i = 0; i < tags.size(); i += 7) {
+        ASSERT_EQ(OK, metadata.erase(tags[i]));
+        EXPECT_FALSE(metadata.exists(tags[i]));
+    }
+    expectMatchesScan(metadata, tags);
+
+    // Re-add the erased tags at the end, and resize some existing entries
+    std::vector<TestEntry> written;
+    for (size_t i = 0; i < tags.size(); i += 7) {
+        written.push_back(makeEntry(tags[i], 9, i + 1));
+        ASSERT_EQ(OK, metadata.update(written.back().toEntry()));
+    }
+    for (size_t i = 3; i < tags.size(); i += 7) {
+        written.push_back(makeEntry(tags[i], 17, i + 2));
+        ASSERT_EQ(OK, metadata.update(written.back().toEntry()));
+    }
+    expectMatchesScan(metadata, tags);
+    for (const TestEntry &e : written) {
+        expectData(metadata, e);
+    }
+
+    CameraMetadata other;
+    other.swap(metadata);
+    EXPECT_TRUE(metadata.isEmpty());
+    expectMatchesScan(other, tags);
+
+    CameraMetadata appended;
+    appended.update(makeEntry(tags[0], 1, 0).toEntry());
+    appended.append(other);
+    expectMatchesScan(appended, tags);
+}
+
+TEST(CameraMetadataTest, BatchUpdate) {
+    std::vector<uint32_t> tags = allTags();
+    CameraMetadata metadata;
+    std::vector<TestEntry> expected;
+    for (size_t i = 0; i < tags.size(); i += 2) {
+        expected.push_back(makeEntry(tags[i], 3, i));
+        ASSERT_EQ(OK, metadata.update(expected.back().toEntry()));
+    }
+    expectMatchesScan(metadata, tags);
+
+    // New tags, and existing ones that grow, shrink or keep their size
+    std::vector<TestEntry> batch;
+    for (size_t i = 0; i < tags.size(); i++) {
+        batch.push_back(makeEntry(tags[i], 1 + i % 8, i + 5));
+    }
+    std::vector<camera_metadata_ro_entry_t> entries;
+    for (const TestEntry &e : batch) {
+        entries.push_back(e.toEntry());
+    }
+    ASSERT_EQ(OK, metadata.update(entries));
+    EXPECT_EQ(tags.size(), metadata.entryCount());
+    for (const TestEntry &e : batch) {
+        expectData(metadata, e);
+    }
+    expectMatchesScan(metadata, tags);
+
+    // Rewriting the same sizes fits in place, so the buffer is not reallocated
+    const camera_metadata_t *buffer = metadata.getAndLock();
+    metadata.unlock(buffer);
+    for (size_t i = 0; i < batch.size(); i++) {
+        batch[i] = makeEntry(tags[i], 1 + i % 8, i + 11);
+        entries[i] = batch[i].toEntry();
+    }
+    ASSERT_EQ(OK, metadata.update(entries));
+    const camera_metadata_t *sameBuffer = metadata.getAndLock();
+    metadata.unlock(sameBuffer);
+    EXPECT_EQ(buffer, sameBuffer);
+    for (const TestEntry &e : batch) {
+        expectData(metadata, e);
+    }
+}
+
+TEST(CameraMetadataTest, BatchUpdateGrowsOnce) {
+    std::vector<uint32_t> tags = allTags();
+    size_t dataSize = 0;
+    std::vector<TestEntry> batch;
+    for (size_t i = 0; i < tags.size(); i++) {
+        batch.push_back(makeEntry(tags[i], 4, i));
+        dataSize += calculate_camera_metadata_entry_data_size(batch.back().type, 4);
+    }
+    std::vector<camera_metadata_ro_entry_t> entries;
+    for (const TestEntry &e : batch) {
+        entries.push_back(e.toEntry());
+    }
+
+    // Exactly enough room for the batch
+    CameraMetadata metadata(tags.size(), dataSize);
+    const camera_metadata_t *buffer = metadata.getAndLock();
+    metadata.unlock(buffer);
+    ASSERT_EQ(OK, metadata.update(entries));
+    const camera_metadata_t *sameBuffer = metadata.getAndLock();
+    metadata.unlock(sameBuffer);
+    EXPECT_EQ(buffer, sameBuffer);
+    EXPECT_EQ(tags.size(), metadata.entryCount());
+    for (const TestEntry &e : batch) {
+        expectData(metadata, e);
+    }
+}
+
+TEST(CameraMetadataTest, BatchUpdateRejectsBadEntries) {
+    std::vector<uint32_t> tags = allTags();
+    CameraMetadata metadata;
+    TestEntry first = makeEntry(tags[0], 1, 0);
+    ASSERT_EQ(OK, metadata.update(first.toEntry()));
+
+    TestEntry good = makeEntry(tags[1], 1, 1);
+    TestEntry bad = makeEntry(tags[2], 1, 2);
+    bad.type = (bad.type + 1) % NUM_TYPES;
+    std::vector<camera_metadata_ro_entry_t> entries = { good.toEntry(), bad.toEntry() };
+    EXPECT_NE(OK, metadata.update(entries));
+    EXPECT_EQ(1u, metadata.entryCount());
+
+    // Data from the metadata itself could be invalidated by the reallocation
+    camera_metadata_ro_entry_t self =
+            static_cast<const CameraMetadata &>(metadata).find(tags[0]);
+    entries = { good.toEntry(), self };
+    EXPECT_EQ(INVALID_OPERATION, metadata.update(entries));
+    EXPECT_EQ(1u, metadata.entryCount());
+
+    const camera_metadata_t *buffer = metadata.getAndLock();
+    EXPECT_EQ(INVALID_OPERATION, metadata.update(std::vector<camera_metadata_ro_entry_t>()));
+    metadata.unlock(buffer);
+}
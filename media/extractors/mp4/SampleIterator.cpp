@@ -22,6 +22,8 @@
 
 #include <arpa/inet.h>
 
+#include <algorithm>
+
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ByteUtils.h>
 
@@ -69,6 +71,8 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
         return OK;
     }
 
+    mTable->buildSampleIndex_l();
+
     if (!mInitialized || sampleIndex < mFirstChunkSampleIndex) {
         reset();
     }
@@ -161,6 +165,17 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
 status_t SampleIterator::findChunkRange(uint32_t sampleIndex) {
     CHECK(sampleIndex >= mFirstChunkSampleIndex);
 
+    // Skip the stsc entries before the one containing sampleIndex.
+    const std::vector<uint32_t> &startSamples = mTable->mSampleToChunkStartSamples;
+    if (sampleIndex >= mStopChunkSampleIndex && !startSamples.empty()) {
+        uint32_t entry = std::upper_bound(startSamples.begin(), startSamples.end(), sampleIndex)
+                - startSamples.begin() - 1;
+        if (entry > mSampleToChunkIndex) {
+            mSampleToChunkIndex = entry;
+            mStopChunkSampleIndex = startSamples[entry];
+        }
+    }
+
     while (sampleIndex >= mStopChunkSampleIndex) {
         if (mSampleToChunkIndex == mTable->mNumSampleToChunkOffsets) {
             return ERROR_OUT_OF_RANGE;
@@ -312,6 +327,22 @@ status_t SampleIterator::findSampleTimeAndDuration(
         return ERROR_OUT_OF_RANGE;
     }
 
+    // Skip the stts runs before the one containing sampleIndex.
+    const std::vector<SampleTable::TimeToSampleRun> &runs = mTable->mTimeToSampleRuns;
+    if ((uint64_t)sampleIndex >= (uint64_t)mTTSSampleIndex + mTTSCount && !runs.empty()) {
+        uint32_t run = std::upper_bound(runs.begin(), runs.end(), sampleIndex,
+                [](uint32_t index, const SampleTable::TimeToSampleRun &r) {
+                    return index < r.mStartSample;
+                }) - runs.begin() - 1;
+        if (run >= mTimeToSampleIndex) {
+            mTTSSampleIndex = runs[run].mStartSample;
+            mTTSSampleTime = runs[run].mStartTime;
+            mTTSCount = runs[run].mCount;
+            mTTSDuration = runs[run].mDelta;
+            mTimeToSampleIndex = run + 1;
+        }
+    }
+
     while (true) {
         if (mTTSSampleIndex > UINT32_MAX - mTTSCount) {
             return ERROR_OUT_OF_RANGE;
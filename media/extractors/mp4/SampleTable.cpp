@@ -18,6 +18,7 @@
 //#define LOG_NDEBUG 0
 #include <utils/Log.h>
 
+#include <algorithm>
 #include <limits>
 
 #include "SampleTable.h"
@@ -49,6 +50,10 @@ const uint32_t SampleTable::kSampleSizeTypeCompact = FOURCC("stz2");
 
 const off64_t kMaxOffset = std::numeric_limits<off64_t>::max();
 
+// Seeks that need to look at more samples than this to resolve the composition
+// order around the requested time fall back to the sorted sample entry table.
+const uint32_t kMaxIndexSeekWindow = 1024;
+
 struct SampleTable::CompositionDeltaLookup {
     CompositionDeltaLookup();
 
@@ -137,6 +142,11 @@ SampleTable::SampleTable(DataSourceHelper *source)
       mSyncSamples(NULL),
       mLastSyncSampleIndex(0),
       mSampleToChunkEntries(NULL),
+      mMinCompositionDelta(0),
+      mMaxCompositionDelta(0),
+      mMaxCompositionTime(0),
+      mSampleIndexBuilt(false),
+      mSampleIndexSeekable(false),
       mTotalSize(0) {
     mSampleIterator = new SampleIterator(this);
 }
@@ -714,9 +724,372 @@ void SampleTable::buildSampleEntriesTable() {
           CompareIncreasingTime);
 }
 
+void SampleTable::buildSampleIndex() {
+    Mutex::Autolock autoLock(mLock);
+    buildSampleIndex_l();
+}
+
+void SampleTable::buildSampleIndex_l() {
+    if (mSampleIndexBuilt) {
+        return;
+    }
+    mSampleIndexBuilt = true;
+
+    uint64_t indexSize =
+            (uint64_t)mTimeToSampleCount * sizeof(TimeToSampleRun)
+            + ((uint64_t)mNumCompositionTimeDeltaEntries + 1) * sizeof(uint32_t)
+            + (uint64_t)mNumSampleToChunkOffsets * sizeof(uint32_t);
+    mTotalSize += indexSize;
+    if (mTotalSize > kMaxTotalSize) {
+        ALOGE("Sample index size would make sample table too large.\n"
+              "    Requested sample index size = %llu\n"
+              "    Eventual sample table size >= %llu\n"
+              "    Allowed sample table size = %llu\n",
+              (unsigned long long)indexSize,
+              (unsigned long long)mTotalSize,
+              (unsigned long long)kMaxTotalSize);
+        return;
+    }
+
+    // stts runs. A run is only added if SampleIterator could reach it, and the
+    // walk stops at the first run it would reject, so iterators can jump to any
+    // run and still fail the same way a linear walk does.
+    uint32_t sampleIndex = 0;
+    uint64_t sampleTime = 0;
+    bool timeToSampleComplete = true;
+    mTimeToSampleRuns.reserve(mTimeToSampleCount);
+    for (uint32_t i = 0; i < mTimeToSampleCount; ++i) {
+        uint32_t n = mTimeToSample[2 * i];
+        uint32_t delta = mTimeToSample[2 * i + 1];
+
+        mTimeToSampleRuns.push_back({sampleIndex, n, delta, sampleTime});
+
+        if (sampleIndex > UINT32_MAX - n
+                || (delta != 0 && n > UINT64_MAX / delta)
+                || sampleTime > UINT64_MAX - (uint64_t)n * delta) {
+            timeToSampleComplete = false;
+            break;
+        }
+        sampleIndex += n;
+        sampleTime += (uint64_t)n * delta;
+    }
+
+    // stsc entries, with the same checks as SampleIterator::findChunkRange().
+    if (mSampleToChunkEntries != NULL) {
+        uint32_t chunkSampleIndex = 0;
+        mSampleToChunkStartSamples.reserve(mNumSampleToChunkOffsets);
+        for (uint32_t i = 0; i < mNumSampleToChunkOffsets; ++i) {
+            mSampleToChunkStartSamples.push_back(chunkSampleIndex);
+            if (i + 1 == mNumSampleToChunkOffsets) {
+                break;
+            }
+
+            const SampleToChunkEntry &entry = mSampleToChunkEntries[i];
+            uint32_t stopChunk = mSampleToChunkEntries[i + 1].startChunk;
+            if (entry.samplesPerChunk == 0 || stopChunk < entry.startChunk
+                    || (stopChunk - entry.startChunk) > UINT32_MAX / entry.samplesPerChunk
+                    || (stopChunk - entry.startChunk) * entry.samplesPerChunk
+                            > UINT32_MAX - chunkSampleIndex) {
+                break;
+            }
+            chunkSampleIndex += (stopChunk - entry.startChunk) * entry.samplesPerChunk;
+        }
+    }
+
+    // ctts entries, up to the last sample
+    if (mCompositionTimeDeltaEntries != NULL) {
+        uint64_t deltaSampleIndex = 0;
+        bool hasDelta = false;
+        mCompositionDeltaStartSamples.reserve(mNumCompositionTimeDeltaEntries + 1);
+        for (size_t i = 0; i < mNumCompositionTimeDeltaEntries
+                && deltaSampleIndex < mNumSampleSizes; ++i) {
+            uint32_t n = mCompositionTimeDeltaEntries[2 * i];
+            int32_t delta = mCompositionTimeDeltaEntries[2 * i + 1];
+
+            mCompositionDeltaStartSamples.push_back(deltaSampleIndex);
+            if (n != 0) {
+                mMinCompositionDelta = hasDelta ? std::min(mMinCompositionDelta, delta) : delta;
+                mMaxCompositionDelta = hasDelta ? std::max(mMaxCompositionDelta, delta) : delta;
+                hasDelta = true;
+            }
+            deltaSampleIndex += n;
+        }
+        if (deltaSampleIndex < mNumSampleSizes) {
+            // samples not covered by ctts have no offset
+            mMinCompositionDelta = std::min(mMinCompositionDelta, 0);
+            mMaxCompositionDelta = std::max(mMaxCompositionDelta, 0);
+        } else {
+            deltaSampleIndex = mNumSampleSizes;
+        }
+        mCompositionDeltaStartSamples.push_back(deltaSampleIndex);
+    }
+
+    // Composition order can only be derived from the index if every sample has
+    // a decode time and buildSampleEntriesTable() would not clamp anything.
+    if (mNumSampleSizes == 0 || !timeToSampleComplete || sampleIndex < mNumSampleSizes
+            || sampleTime > (uint64_t)INT64_MAX / 2) {
+        return;
+    }
+    for (size_t i = 0; i + 1 < mCompositionDeltaStartSamples.size(); ++i) {
+        int32_t delta = mCompositionTimeDeltaEntries[2 * i + 1];
+        if (mCompositionTimeDeltaEntries[2 * i] == 0) {
+            continue;
+        }
+        if (delta == INT32_MIN || (delta < 0 && getDecodeTimeFromIndex(
+                mCompositionDeltaStartSamples[i]) < -(int64_t)delta)) {
+            return;
+        }
+    }
+
+    int64_t lastDecodeTime = getDecodeTimeFromIndex(mNumSampleSizes - 1);
+    mMaxCompositionTime = lastDecodeTime + std::max(mMaxCompositionDelta, 0);
+    mSampleIndexSeekable = true;
+}
+
+int64_t SampleTable::getDecodeTimeFromIndex(uint32_t sampleIndex) const {
+    auto run = std::upper_bound(
+            mTimeToSampleRuns.begin(), mTimeToSampleRuns.end(), sampleIndex,
+            [](uint32_t index, const TimeToSampleRun &r) { return index < r.mStartSample; });
+    --run;
+    return run->mStartTime + (uint64_t)(sampleIndex - run->mStartSample) * run->mDelta;
+}
+
+int32_t SampleTable::getCompositionDeltaFromIndex(uint32_t sampleIndex) const {
+    const std::vector<uint32_t> &starts = mCompositionDeltaStartSamples;
+    if (starts.empty() || sampleIndex >= starts.back()) {
+        return 0;
+    }
+    size_t entry = std::upper_bound(starts.begin(), starts.end() - 1, sampleIndex)
+            - starts.begin() - 1;
+    return mCompositionTimeDeltaEntries[2 * entry + 1];
+}
+
+// Returns the first sample decoded at or after |time|, or mNumSampleSizes.
+uint32_t SampleTable::findFirstSampleDecodedAt(int64_t time) const {
+    uint32_t left = 0;
+    uint32_t right = mNumSampleSizes;
+    while (left < right) {
+        uint32_t center = left + (right - left) / 2;
+        if (getDecodeTimeFromIndex(center) < time) {
+            left = center + 1;
+        } else {
+            right = center;
+        }
+    }
+    return left;
+}
+
+// The lookups below rely on every composition time being within
+// [mMinCompositionDelta, mMaxCompositionDelta] of the decode time, so only the
+// samples decoded within that span of |time| need to be looked at. They return
+// false if that window is too large to scan.
+bool SampleTable::findSampleWithMinTimeAtOrAfter(
+        int64_t time, uint32_t *sampleIndex, int64_t *compTime, bool *found) const {
+    int64_t span = (int64_t)mMaxCompositionDelta - mMinCompositionDelta;
+
+    // samples decoded before |first| are composed before |time|, the ones from
+    // |bound| on at or after it
+    uint32_t first = findFirstSampleDecodedAt(time - mMaxCompositionDelta);
+    uint32_t bound = findFirstSampleDecodedAt(time - mMinCompositionDelta);
+    uint32_t last = bound < mNumSampleSizes
+            ? findFirstSampleDecodedAt(getDecodeTimeFromIndex(bound) + span + 1)
+            : mNumSampleSizes;
+    if (last - first > kMaxIndexSeekWindow) {
+        return false;
+    }
+
+    *found = false;
+    for (uint32_t i = first; i < last; ++i) {
+        int64_t t = getDecodeTimeFromIndex(i) + getCompositionDeltaFromIndex(i);
+        if (t >= time && (!*found || t < *compTime)) {
+            *sampleIndex = i;
+            *compTime = t;
+            *found = true;
+        }
+    }
+    return true;
+}
+
+bool SampleTable::findSampleWithMaxTimeAtOrBefore(
+        int64_t time, uint32_t *sampleIndex, int64_t *compTime, bool *found) const {
+    *found = false;
+    if (time < 0) {
+        return true;
+    }
+    int64_t span = (int64_t)mMaxCompositionDelta - mMinCompositionDelta;
+
+    // samples decoded before |bound| are composed at or before |time|, the ones
+    // from |last| on after it
+    uint32_t bound = findFirstSampleDecodedAt(time - mMaxCompositionDelta + 1);
+    uint32_t last = findFirstSampleDecodedAt(time - mMinCompositionDelta + 1);
+    uint32_t first = bound > 0
+            ? findFirstSampleDecodedAt(getDecodeTimeFromIndex(bound - 1) - span)
+            : 0;
+    if (last - first > kMaxIndexSeekWindow) {
+        return false;
+    }
+
+    for (uint32_t i = first; i < last; ++i) {
+        int64_t t = getDecodeTimeFromIndex(i) + getCompositionDeltaFromIndex(i);
+        if (t <= time && (!*found || t > *compTime)) {
+            *sampleIndex = i;
+            *compTime = t;
+            *found = true;
+        }
+    }
+    return true;
+}
+
+bool SampleTable::countSamplesAtOrBefore(int64_t time, uint64_t *count) const {
+    uint32_t bound = findFirstSampleDecodedAt(time - mMaxCompositionDelta + 1);
+    uint32_t last = findFirstSampleDecodedAt(time - mMinCompositionDelta + 1);
+    if (last - bound > kMaxIndexSeekWindow) {
+        return false;
+    }
+
+    *count = bound;
+    for (uint32_t i = bound; i < last; ++i) {
+        if (getDecodeTimeFromIndex(i) + getCompositionDeltaFromIndex(i) <= time) {
+            ++*count;
+        }
+    }
+    return true;
+}
+
+// Same as the lookup in findSampleAtTime() on the sorted sample entry table,
+// using the compact index instead. Returns false if the index cannot be used.
+bool SampleTable::findSampleAtTimeFromIndex(
+        uint64_t req_time, uint64_t scale_num, uint64_t scale_den,
+        uint32_t *sample_index, uint32_t flags, status_t *err) const {
+    if (!mSampleIndexSeekable) {
+        return false;
+    }
+
+    if (flags == kFlagFrameIndex) {
+        if (req_time >= mNumSampleSizes) {
+            *err = ERROR_OUT_OF_RANGE;
+            return true;
+        }
+        if (mMinCompositionDelta == mMaxCompositionDelta) {
+            // composition order is decode order
+            *sample_index = req_time;
+            *err = OK;
+            return true;
+        }
+
+        // the earliest composition time with more than req_time samples at or before it
+        int64_t left = 0;
+        int64_t right = mMaxCompositionTime;
+        while (left < right) {
+            int64_t center = left + (right - left) / 2;
+            uint64_t count;
+            if (!countSamplesAtOrBefore(center, &count)) {
+                return false;
+            }
+            if (count > req_time) {
+                right = center;
+            } else {
+                left = center + 1;
+            }
+        }
+
+        int64_t compTime;
+        bool found;
+        if (!findSampleWithMinTimeAtOrAfter(left, sample_index, &compTime, &found) || !found) {
+            return false;
+        }
+        *err = OK;
+        return true;
+    }
+
+    if (scale_num == 0 || scale_den == 0) {
+        return false;
+    }
+    auto scaledTime = [scale_num, scale_den](int64_t t) {
+        return ((uint64_t)t * scale_num) / scale_den;
+    };
+
+    // the earliest composition time that does not scale to before req_time
+    long double estimate = (long double)req_time * scale_den / scale_num;
+    int64_t time = estimate > mMaxCompositionTime ? mMaxCompositionTime + 1 : (int64_t)estimate;
+    while (time > 0 && scaledTime(time - 1) >= req_time) {
+        --time;
+    }
+    while (time <= mMaxCompositionTime && scaledTime(time) < req_time) {
+        ++time;
+    }
+
+    uint32_t after = 0;
+    uint32_t before = 0;
+    int64_t afterTime = 0;
+    int64_t beforeTime = 0;
+    bool hasAfter;
+    bool hasBefore;
+    if (!findSampleWithMinTimeAtOrAfter(time, &after, &afterTime, &hasAfter)
+            || !findSampleWithMaxTimeAtOrBefore(time - 1, &before, &beforeTime, &hasBefore)) {
+        return false;
+    }
+
+    *err = OK;
+    if (hasAfter && scaledTime(afterTime) == req_time) {
+        *sample_index = after;
+        return true;
+    }
+
+    if (!hasAfter) {
+        if (flags == kFlagAfter) {
+            *err = ERROR_OUT_OF_RANGE;
+            return true;
+        }
+        flags = kFlagBefore;
+    } else if (!hasBefore) {
+        flags = kFlagAfter;
+    }
+
+    switch (flags) {
+        case kFlagBefore:
+        {
+            *sample_index = before;
+            break;
+        }
+
+        case kFlagAfter:
+        {
+            *sample_index = after;
+            break;
+        }
+
+        default:
+        {
+            CHECK(flags == kFlagClosest);
+            if (abs_difference(scaledTime(afterTime), req_time) >
+                abs_difference(req_time, scaledTime(beforeTime))) {
+                *sample_index = before;
+            } else {
+                *sample_index = after;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
 status_t SampleTable::findSampleAtTime(
         uint64_t req_time, uint64_t scale_num, uint64_t scale_den,
         uint32_t *sample_index, uint32_t flags) {
+    buildSampleIndex();
+
+    status_t err;
+    if (findSampleAtTimeFromIndex(req_time, scale_num, scale_den, sample_index, flags, &err)) {
+        return err;
+    }
+    return findSampleAtTimeFromEntries(req_time, scale_num, scale_den, sample_index, flags);
+}
+
+// The index cannot resolve this seek, sort all samples by composition time.
+status_t SampleTable::findSampleAtTimeFromEntries(
+        uint64_t req_time, uint64_t scale_num, uint64_t scale_den,
+        uint32_t *sample_index, uint32_t flags) {
     buildSampleEntriesTable();
 
     if (mSampleTimeEntries == NULL) {
@@ -1006,6 +1379,9 @@ status_t SampleTable::getMetaDataForSample(
 }
 
 int32_t SampleTable::getCompositionTimeOffset(uint32_t sampleIndex) {
+    if (!mCompositionDeltaStartSamples.empty()) {
+        return getCompositionDeltaFromIndex(sampleIndex);
+    }
     return mCompositionDeltaLookup->getCompositionTimeOffset(sampleIndex);
 }
 
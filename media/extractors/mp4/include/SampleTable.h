@@ -21,6 +21,8 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+#include <vector>
+
 #include <media/MediaExtractorPluginHelper.h>
 #include <media/stagefright/MediaErrors.h>
 #include <utils/RefBase.h>
@@ -150,10 +152,34 @@ private:
     };
     SampleToChunkEntry *mSampleToChunkEntries;
 
+    // Compact index over the run-length stts, ctts and stsc tables, built lazily by
+    // buildSampleIndex_l(). It lets findSampleAtTime() and SampleIterator locate a
+    // sample with a binary search instead of walking the tables or materializing
+    // one SampleTimeEntry per sample.
+    struct TimeToSampleRun {
+        uint32_t mStartSample;
+        uint32_t mCount;
+        uint32_t mDelta;
+        uint64_t mStartTime;
+    };
+    std::vector<TimeToSampleRun> mTimeToSampleRuns;
+    // First sample of every ctts entry, followed by the first sample not covered.
+    std::vector<uint32_t> mCompositionDeltaStartSamples;
+    // First sample of every stsc entry.
+    std::vector<uint32_t> mSampleToChunkStartSamples;
+    int32_t mMinCompositionDelta;
+    int32_t mMaxCompositionDelta;
+    int64_t mMaxCompositionTime;
+    bool mSampleIndexBuilt;
+    // Whether composition times derived from the index match the ones in
+    // mSampleTimeEntries, i.e. the tables are consistent and need no clamping.
+    bool mSampleIndexSeekable;
+
     // Approximate size of all tables combined.
     uint64_t mTotalSize;
 
     friend struct SampleIterator;
+    friend class SampleTableTest;
 
     // normally we don't round
     inline uint64_t getSampleTime(
@@ -170,6 +196,23 @@ private:
 
     void buildSampleEntriesTable();
 
+    void buildSampleIndex();
+    void buildSampleIndex_l();
+    int64_t getDecodeTimeFromIndex(uint32_t sampleIndex) const;
+    int32_t getCompositionDeltaFromIndex(uint32_t sampleIndex) const;
+    uint32_t findFirstSampleDecodedAt(int64_t time) const;
+    bool findSampleWithMinTimeAtOrAfter(int64_t time, uint32_t *sampleIndex, int64_t *compTime,
+            bool *found) const;
+    bool findSampleWithMaxTimeAtOrBefore(int64_t time, uint32_t *sampleIndex, int64_t *compTime,
+            bool *found) const;
+    bool countSamplesAtOrBefore(int64_t time, uint64_t *count) const;
+    bool findSampleAtTimeFromIndex(
+            uint64_t req_time, uint64_t scale_num, uint64_t scale_den,
+            uint32_t *sample_index, uint32_t flags, status_t *err) const;
+    status_t findSampleAtTimeFromEntries(
+            uint64_t req_time, uint64_t scale_num, uint64_t scale_den,
+            uint32_t *sample_index, uint32_t flags);
+
     SampleTable(const SampleTable &);
     SampleTable &operator=(const SampleTable &);
 };
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Opens and seeks the sample tables of large synthetic MP4 video tracks.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/SampleTableBenchmark/SampleTableBenchmark
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <media/MediaExtractorPluginHelper.h>
+#include <media/stagefright/foundation/ByteUtils.h>
+
+#include "SampleTable.h"
+
+using namespace android;
+
+namespace {
+
+constexpr uint32_t kTimescale = 30000;
+constexpr uint32_t kSampleDelta = 1001;     // 29.97 fps
+constexpr uint32_t kSyncInterval = 60;
+
+// In-memory data source holding the sample table boxes of one track.
+class SyntheticTrackSource : public DataSourceHelper {
+  public:
+    // |reordered| adds a ctts box for an I P B B GOP structure.
+    SyntheticTrackSource(uint32_t numSamples, bool reordered)
+        : DataSourceHelper((CDataSource *)nullptr) {
+        // chunks alternate between 10 and 11 samples, so stsc has one entry per chunk
+        std::vector<uint32_t> chunkSizes;
+        for (uint32_t samples = 0; samples < numSamples; ) {
+            uint32_t n = std::min<uint32_t>(numSamples - samples, 10 + chunkSizes.size() % 2);
+            chunkSizes.push_back(n);
+            samples += n;
+        }
+
+        mStco = beginBox(chunkSizes.size());
+        uint32_t offset = 0;
+        for (uint32_t n : chunkSizes) {
+            append(offset);
+            offset += n * 4096;
+        }
+        mStcoSize = mData.size() - mStco;
+
+        mStsc = beginBox(chunkSizes.size());
+        for (size_t i = 0; i < chunkSizes.size(); ++i) {
+            append(i + 1);
+            append(chunkSizes[i]);
+            append(1);
+        }
+        mStscSize = mData.size() - mStsc;
+
+        mStsz = mData.size();
+        append(0);
+        append(0);
+        append(numSamples);
+        for (uint32_t i = 0; i < numSamples; ++i) {
+            append(i % kSyncInterval == 0 ? 65536 : 4096 + i % 1024);
+        }
+        mStszSize = mData.size() - mStsz;
+
+        mStts = beginBox(1);
+        append(numSamples);
+        append(kSampleDelta);
+        mSttsSize = mData.size() - mStts;
+
+        mCtts = -1;
+        if (reordered) {
+            // decode order I P B B is presented as I B B P
+            static const uint32_t kOffsets[] = { 1, 3, 0, 0 };
+            mCtts = beginBox(numSamples);
+            for (uint32_t i = 0; i < numSamples; ++i) {
+                append(1);
+                append(kOffsets[i % 4] * kSampleDelta);
+            }
+            mCttsSize = mData.size() - mCtts;
+        }
+
+        mStss = beginBox((numSamples + kSyncInterval - 1) / kSyncInterval);
+        for (uint32_t i = 0; i < numSamples; i += kSyncInterval) {
+            append(i + 1);
+        }
+        mStssSize = mData.size() - mStss;
+    }
+
+    ssize_t readAt(off64_t offset, void *data, size_t size) override {
+        if (offset < 0 || (size_t)offset >= mData.size()) {
+            return 0;
+        }
+        size = std::min(size, mData.size() - (size_t)offset);
+        memcpy(data, mData.data() + offset, size);
+        return size;
+    }
+
+    status_t getSize(off64_t *size) override {
+        *size = mData.size();
+        return OK;
+    }
+
+    uint32_t flags() override {
+        return 0;
+    }
+
+    sp<SampleTable> open() {
+        sp<SampleTable> table = new SampleTable(this);
+        table->setChunkOffsetParams(FOURCC("stco"), mStco, mStcoSize);
+        table->setSampleToChunkParams(mStsc, mStscSize);
+        table->setSampleSizeParams(FOURCC("stsz"), mStsz, mStszSize);
+        table->setTimeToSampleParams(mStts, mSttsSize);
+        if (mCtts >= 0) {
+            table->setCompositionTimeToSampleParams(mCtts, mCttsSize);
+        }
+        table->setSyncSampleParams(mStss, mStssSize);
+        return table;
+    }
+
+  private:
+    // appends the version/flags and entry count of a full box and returns its offset
+    off64_t beginBox(uint32_t entries) {
+        off64_t offset = mData.size();
+        append(0);
+        append(entries);
+        return offset;
+    }
+
+    void append(uint32_t value) {
+        uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16),
+                             (uint8_t)(value >> 8), (uint8_t)value };
+        mData.insert(mData.end(), bytes, bytes + sizeof(bytes));
+    }
+
+    std::vector<uint8_t> mData;
+    off64_t mStco, mStsc, mStsz, mStts, mCtts, mStss;
+    size_t mStcoSize, mStscSize, mStszSize, mSttsSize, mCttsSize, mStssSize;
+};
+
+// Same lookups MPEG4Source::read() does for a SEEK_CLOSEST seek.
+void seek(const sp<SampleTable> &table, uint64_t timeUs) {
+    uint32_t sampleIndex;
+    uint32_t syncSampleIndex;
+    off64_t offset;
+    size_t size;
+    uint64_t compositionTime;
+    if (table->findSampleAtTime(timeUs, 1000000, kTimescale, &sampleIndex,
+                                SampleTable::kFlagClosest) != OK
+            || table->findSyncSampleNear(sampleIndex, &syncSampleIndex,
+                                         SampleTable::kFlagBefore) != OK
+            || table->getMetaDataForSample(syncSampleIndex, &offset, &size,
+                                           &compositionTime) != OK) {
+        abort();
+    }
+    benchmark::DoNotOptimize(compositionTime);
+}
+
+uint64_t durationUs(uint32_t numSamples) {
+    return (uint64_t)numSamples * kSampleDelta * 1000000 / kTimescale;
+}
+
+}  // namespace
+
+// Args: number of samples, whether the track has B-frames.
+static void BM_SampleTableOpenAndSeek(benchmark::State &state) {
+    SyntheticTrackSource source(state.range(0), state.range(1));
+    uint64_t timeUs = durationUs(state.range(0)) / 2;
+
+    for (auto _ : state) {
+        sp<SampleTable> table = source.open();
+        seek(table, timeUs);
+    }
+    state.SetLabel(state.range(1) ? "reordered" : "in order");
+}
+
+static void BM_SampleTableSeek(benchmark::State &state) {
+    SyntheticTrackSource source(state.range(0), state.range(1));
+    sp<SampleTable> table = source.open();
+    uint64_t duration = durationUs(state.range(0));
+
+    std::minstd_rand random(42);
+    std::uniform_int_distribution<uint64_t> dist(0, duration);
+    for (auto _ : state) {
+        seek(table, dist(random));
+    }
+    state.SetLabel(state.range(1) ? "reordered" : "in order");
+}
+
+static void SampleTableArgs(benchmark::internal::Benchmark *b) {
+    // one minute, one hour and five hours at 29.97 fps
+    for (int samples : { 1798, 107892, 539460 }) {
+        for (int reordered : { 0, 1 }) {
+            b->Args({samples, reordered});
+        }
+    }
+}
+
+BENCHMARK(BM_SampleTableOpenAndSeek)->Apply(SampleTableArgs);
+BENCHMARK(BM_SampleTableSeek)->Apply(SampleTableArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the seeks resolved by the run-length index of SampleTable with the
+// sorted sample entry table it falls back to, on random stts and ctts tables.
+
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <media/MediaExtractorPluginHelper.h>
+#include <media/stagefright/foundation/ByteUtils.h>
+
+#include "SampleTable.h"
+
+namespace android {
+
+namespace {
+
+constexpr uint64_t kScaleNum = 1000000;
+constexpr uint32_t kTimescales[] = { 600, 90000, 10000000 };
+constexpr uint32_t kSeekFlags[] = { SampleTable::kFlagBefore, SampleTable::kFlagAfter,
+                                    SampleTable::kFlagClosest };
+constexpr uint32_t kNumTracks = 300;
+constexpr uint32_t kNumSeeks = 100;
+
+struct Track {
+    uint32_t numSamples = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> stts;    // sample count, delta
+    bool hasCtts = false;
+    std::vector<std::pair<uint32_t, int32_t>> ctts;     // sample count, offset
+};
+
+// In-memory data source holding the sample table boxes of one track.
+class TrackSource : public DataSourceHelper {
+  public:
+    explicit TrackSource(const Track &track)
+        : DataSourceHelper((CDataSource *)nullptr) {
+        // four samples per chunk, the last chunk holds the remaining ones
+        uint32_t numFullChunks = track.numSamples / 4;
+        uint32_t lastChunkSamples = track.numSamples % 4;
+        uint32_t numChunks = numFullChunks + (lastChunkSamples > 0 ? 1 : 0);
+        mStco = beginBox(numChunks);
+        for (uint32_t i = 0; i < numChunks; ++i) {
+            append(i * 65536);
+        }
+        mStcoSize = mData.size() - mStco;
+
+        mStsc = beginBox((numFullChunks > 0 ? 1 : 0) + (lastChunkSamples > 0 ? 1 : 0));
+        if (numFullChunks > 0) {
+            append(1);
+            append(4);
+            append(1);
+        }
+        if (lastChunkSamples > 0) {
+            append(numFullChunks + 1);
+            append(lastChunkSamples);
+            append(1);
+        }
+        mStscSize = mData.size() - mStsc;
+
+        mStsz = mData.size();
+        append(0);
+        append(4096);
+        append(track.numSamples);
+        mStszSize = mData.size() - mStsz;
+
+        mStts = beginBox(track.stts.size());
+        for (const auto &entry : track.stts) {
+            append(entry.first);
+            append(entry.second);
+        }
+        mSttsSize = mData.size() - mStts;
+
+        mCtts = -1;
+        if (track.hasCtts) {
+            mCtts = beginBox(track.ctts.size());
+            for (const auto &entry : track.ctts) {
+                append(entry.first);
+                append((uint32_t)entry.second);
+            }
+            mCttsSize = mData.size() - mCtts;
+        }
+    }
+
+    ssize_t readAt(off64_t offset, void *data, size_t size) override {
+        if (offset < 0 || (size_t)offset >= mData.size()) {
+            return 0;
+        }
+        size = std::min(size, mData.size() - (size_t)offset);
+        memcpy(data, mData.data() + offset, size);
+        return size;
+    }
+
+    status_t getSize(off64_t *size) override {
+        *size = mData.size();
+        return OK;
+    }
+
+    uint32_t flags() override {
+        return 0;
+    }
+
+    sp<SampleTable> open() {
+        sp<SampleTable> table = new SampleTable(this);
+        EXPECT_EQ(OK, table->setChunkOffsetParams(FOURCC("stco"), mStco, mStcoSize));
+        EXPECT_EQ(OK, table->setSampleToChunkParams(mStsc, mStscSize));
+        EXPECT_EQ(OK, table->setSampleSizeParams(FOURCC("stsz"), mStsz, mStszSize));
+        EXPECT_EQ(OK, table->setTimeToSampleParams(mStts, mSttsSize));
+        if (mCtts >= 0) {
+            EXPECT_EQ(OK, table->setCompositionTimeToSampleParams(mCtts, mCttsSize));
+        }
+        return table;
+    }
+
+  private:
+    // appends the version/flags and entry count of a full box and returns its offset
+    off64_t beginBox(uint32_t entries) {
+        off64_t offset = mData.size();
+        append(0);
+        append(entries);
+        return offset;
+    }
+
+    void append(uint32_t value) {
+        uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16),
+                             (uint8_t)(value >> 8), (uint8_t)value };
+        mData.insert(mData.end(), bytes, bytes + sizeof(bytes));
+    }
+
+    std::vector<uint8_t> mData;
+    off64_t mStco, mStsc, mStsz, mStts, mCtts;
+    size_t mStcoSize, mStscSize, mStszSize, mSttsSize, mCttsSize;
+};
+
+// Random tables the index accepts, with the entries that need care: empty entries,
+// zero deltas, stts and ctts entries past the last sample, ctts ending before it,
+// negative offsets, and large offsets on the first and last samples.
+Track randomTrack(std::minstd_rand &gen) {
+    auto random = [&gen](uint32_t min, uint32_t max) {
+        return std::uniform_int_distribution<uint32_t>(min, max)(gen);
+    };
+    Track track;
+    track.numSamples = random(1, random(0, 9) == 0 ? 5000 : 300);
+
+    std::vector<uint64_t> decodeTimes;
+    uint64_t time = 0;
+    while (decodeTimes.size() < track.numSamples) {
+        uint32_t count = random(0, 9) == 0 ? 0 : random(1, 40);
+        uint32_t delta = random(0, 9) == 0 ? 0 : random(1, 3003);
+        track.stts.push_back({count, delta});
+        for (uint32_t i = 0; i < count; ++i) {
+            decodeTimes.push_back(time);
+            time += delta;
+        }
+    }
+    if (random(0, 3) == 0) {
+        track.stts.push_back({random(0, 10), random(0, 3003)});
+    }
+
+    // no ctts, a constant offset, B-frames, or any offsets
+    uint32_t mode = random(0, 3);
+    track.hasCtts = mode != 0;
+    if (!track.hasCtts) {
+        return track;
+    }
+    uint32_t covered = track.numSamples;
+    if (random(0, 4) == 0) {
+        covered = random(0, track.numSamples);
+    } else if (random(0, 1) == 0) {
+        covered += random(1, 5);
+    }
+    for (uint32_t sample = 0; sample < covered || track.ctts.empty(); ) {
+        uint32_t count = random(0, 9) == 0 ? 0 : std::min(covered - sample, random(1, 4));
+        int32_t offset;
+        switch (mode) {
+            case 1:
+                offset = 1001;
+                break;
+            case 2:
+                offset = random(0, 3) * 1001;
+                break;
+            default:
+                offset = (int32_t)random(0, 8000) - 3000;
+                break;
+        }
+        if ((sample == 0 || sample + count >= track.numSamples) && random(0, 3) == 0) {
+            // a wide reorder window, past the one seeks resolve from the index if large
+            offset = random(0, 9) == 0 ? random(0, 5000000) : random(0, 100000);
+        }
+        // composition times must not be negative for the index to be used
+        uint64_t decodeTime = decodeTimes[std::min<size_t>(sample, decodeTimes.size() - 1)];
+        offset = std::max<int64_t>(offset, -(int64_t)decodeTime);
+        track.ctts.push_back({count, offset});
+        sample += count;
+    }
+    return track;
+}
+
+}  // namespace
+
+class SampleTableTest : public ::testing::Test {
+  protected:
+    static bool isIndexSeekable(const sp<SampleTable> &table) {
+        table->buildSampleIndex();
+        return table->mSampleIndexSeekable;
+    }
+
+    // Composition times of the sorted sample entry table, by sample index.
+    static std::vector<uint64_t> sortedCompositionTimes(const sp<SampleTable> &table) {
+        table->buildSampleEntriesTable();
+        std::vector<uint64_t> times(table->mNumSampleSizes);
+        EXPECT_NE(nullptr, table->mSampleTimeEntries);
+        if (table->mSampleTimeEntries != nullptr) {
+            for (uint32_t i = 0; i < table->mNumSampleSizes; ++i) {
+                const SampleTable::SampleTimeEntry &entry = table->mSampleTimeEntries[i];
+                times[entry.mSampleIndex] = entry.mCompositionTime;
+            }
+        }
+        return times;
+    }
+
+    static uint64_t indexCompositionTime(const sp<SampleTable> &table, uint32_t sampleIndex) {
+        return table->getDecodeTimeFromIndex(sampleIndex)
+                + table->getCompositionDeltaFromIndex(sampleIndex);
+    }
+
+    // Returns false if the index cannot resolve the seek.
+    static bool seekFromIndex(const sp<SampleTable> &table, uint64_t time, uint64_t scaleDen,
+                              uint32_t flags, uint32_t *sampleIndex, status_t *err) {
+        table->buildSampleIndex();
+        return table->findSampleAtTimeFromIndex(time, kScaleNum, scaleDen, sampleIndex, flags,
+                                                err);
+    }
+
+    static status_t seekFromEntries(const sp<SampleTable> &table, uint64_t time,
+                                    uint64_t scaleDen, uint32_t flags, uint32_t *sampleIndex) {
+        return table->findSampleAtTimeFromEntries(time, kScaleNum, scaleDen, sampleIndex, flags);
+    }
+
+    // Seeks both ways and checks that they land on the same scaled composition time.
+    // Samples with the same time may be sorted in any order, so the sample itself
+    // may differ. Returns whether the index resolved the seek.
+    static bool expectSameSeek(const sp<SampleTable> &table,
+                               const std::vector<uint64_t> &compositionTimes, uint64_t time,
+                               uint64_t scaleDen, uint32_t flags) {
+        SCOPED_TRACE(testing::Message() << "time " << time << " flags " << flags);
+        uint32_t indexSample = UINT32_MAX;
+        status_t indexErr;
+        if (!seekFromIndex(table, time, scaleDen, flags, &indexSample, &indexErr)) {
+            return false;
+        }
+        uint32_t entrySample = UINT32_MAX;
+        status_t entryErr = seekFromEntries(table, time, scaleDen, flags, &entrySample);
+        EXPECT_EQ(entryErr, indexErr);
+        if (entryErr == OK && indexErr == OK) {
+            EXPECT_LT(indexSample, compositionTimes.size());
+            EXPECT_LT(entrySample, compositionTimes.size());
+            if (indexSample < compositionTimes.size()
+                    && entrySample < compositionTimes.size()) {
+                auto scaled = [flags, scaleDen](uint64_t t) {
+                    return flags == SampleTable::kFlagFrameIndex ? t : t * kScaleNum / scaleDen;
+                };
+                EXPECT_EQ(scaled(compositionTimes[entrySample]),
+                          scaled(compositionTimes[indexSample]))
+                        << "samples " << entrySample << " and " << indexSample;
+            }
+        }
+        return true;
+    }
+};
+
+TEST_F(SampleTableTest, IndexedTimesMatchSortedTable) {
+    std::minstd_rand gen(1);
+    for (uint32_t i = 0; i < kNumTracks; ++i) {
+        SCOPED_TRACE(testing::Message() << "track " << i);
+        Track track = randomTrack(gen);
+        TrackSource source(track);
+        sp<SampleTable> table = source.open();
+        ASSERT_TRUE(isIndexSeekable(table));
+
+        std::vector<uint64_t> compositionTimes = sortedCompositionTimes(table);
+        for (uint32_t sample = 0; sample < track.numSamples; ++sample) {
+            ASSERT_EQ(compositionTimes[sample], indexCompositionTime(table, sample))
+                    << "sample " << sample;
+        }
+
+        // the iterator looks up the stts run and ctts entry through the index too,
+        // from the first, the last and random samples
+        std::vector<uint32_t> samples = { 0, track.numSamples - 1, track.numSamples / 2, 0 };
+        for (uint32_t j = 0; j < 20; ++j) {
+            samples.push_back(std::uniform_int_distribution<uint32_t>(
+                    0, track.numSamples - 1)(gen));
+        }
+        for (uint32_t sample : samples) {
+            off64_t offset;
+            size_t size;
+            uint64_t compositionTime;
+            ASSERT_EQ(OK, table->getMetaDataForSample(sample, &offset, &size,
+                                                      &compositionTime))
+                    << "sample " << sample;
+            ASSERT_EQ(compositionTimes[sample], compositionTime) << "sample " << sample;
+        }
+    }
+}
+
+TEST_F(SampleTableTest, IndexedSeeksMatchSortedTable) {
+    std::minstd_rand gen(2);
+    uint32_t numSeeks = 0;
+    uint32_t numIndexSeeks = 0;
+    for (uint32_t i = 0; i < kNumTracks; ++i) {
+        SCOPED_TRACE(testing::Message() << "track " << i);
+        Track track = randomTrack(gen);
+        TrackSource source(track);
+        sp<SampleTable> table = source.open();
+        ASSERT_TRUE(isIndexSeekable(table));
+
+        uint64_t timescale = kTimescales[i % std::size(kTimescales)];
+        std::vector<uint64_t> compositionTimes = sortedCompositionTimes(table);
+        uint64_t maxTime = *std::max_element(compositionTimes.begin(), compositionTimes.end());
+        uint64_t maxTimeUs = maxTime * kScaleNum / timescale;
+
+        // the first and last times, exact sample times and the times around them
+        std::vector<uint64_t> times = { 0, 1, maxTimeUs, maxTimeUs + 1, maxTimeUs + 1000000 };
+        for (uint32_t j = 0; j < kNumSeeks; ++j) {
+            times.push_back(std::uniform_int_distribution<uint64_t>(0, maxTimeUs + 1000)(gen));
+            uint32_t sample = std::uniform_int_distribution<uint32_t>(
+                    0, track.numSamples - 1)(gen);
+            uint64_t timeUs = compositionTimes[sample] * kScaleNum / timescale;
+            times.push_back(timeUs);
+            times.push_back(timeUs + 1);
+            if (timeUs > 0) {
+                times.push_back(timeUs - 1);
+            }
+        }
+        for (uint64_t time : times) {
+            for (uint32_t flags : kSeekFlags) {
+                numSeeks++;
+                if (expectSameSeek(table, compositionTimes, time, timescale, flags)) {
+                    numIndexSeeks++;
+                }
+            }
+        }
+
+        for (uint64_t frame = 0; frame <= track.numSamples; ++frame) {
+            numSeeks++;
+            if (expectSameSeek(table, compositionTimes, frame, timescale,
+                               SampleTable::kFlagFrameIndex)) {
+                numIndexSeeks++;
+            }
+        }
+        if (HasFailure()) {
+            return;
+        }
+    }
+    // only wide reorder windows fall back
+    EXPECT_GT(numIndexSeeks, numSeeks * 9 / 10);
+}
+
+// Tables the sorted entry table clamps are not seeked through the index.
+TEST_F(SampleTableTest, InconsistentTablesUseSortedTable) {
+    Track shortStts;
+    shortStts.numSamples = 10;
+    shortStts.stts = { {5, 1000}, {0, 1000}, {4, 500} };
+
+    Track negativeTime;
+    negativeTime.numSamples = 10;
+    negativeTime.stts = { {10, 1000} };
+    negativeTime.hasCtts = true;
+    negativeTime.ctts = { {1, 0}, {1, -1500}, {8, 0} };
+
+    for (const Track &track : { shortStts, negativeTime }) {
+        TrackSource source(track);
+        sp<SampleTable> table = source.open();
+        EXPECT_FALSE(isIndexSeekable(table));
+
+        for (uint32_t flags : kSeekFlags) {
+            uint32_t sample;
+            status_t err;
+            EXPECT_FALSE(seekFromIndex(table, 4000, 1000000, flags, &sample, &err));
+            uint32_t entrySample;
+            EXPECT_EQ(seekFromEntries(table, 4000, 1000000, flags, &entrySample),
+                      table->findSampleAtTime(4000, kScaleNum, 1000000, &sample, flags));
+            EXPECT_EQ(entrySample, sample);
+        }
+    }
+}
+
+}  // namespace android
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+#define LOG_TAG "FifoBufferMultiWriter"
+//#define LOG_NDEBUG 0
+#include <utils/Log.h>
+
+#include <algorithm>
+
+#include "FifoBufferMultiWriter.h"
+
+using android::FifoBufferMultiWriter;
+using android::WrappingBuffer;
+using android::fifo_counter_t;
+using android::fifo_frames_t;
+
+FifoBufferMultiWriter::FifoBufferMultiWriter(int32_t bytesPerFrame,
+                                             fifo_frames_t capacityInFrames)
+        : mBytesPerFrame(bytesPerFrame)
+        , mCapacity(capacityInFrames)
+        , mStorage(std::make_unique<uint8_t[]>(bytesPerFrame * capacityInFrames))
+        , mCommitEnd(std::make_unique<std::atomic<fifo_counter_t>[]>(capacityInFrames))
+{
+    for (fifo_frames_t i = 0; i < capacityInFrames; i++) {
+        mCommitEnd[i].store(0, std::memory_order_relaxed);
+    }
+    ALOGV("%s() capacityInFrames = %d, bytesPerFrame = %d",
+          __func__, capacityInFrames, bytesPerFrame);
+}
+
+void FifoBufferMultiWriter::fillWrappingBuffer(WrappingBuffer *wrappingBuffer,
+                                               fifo_frames_t framesAvailable,
+                                               fifo_counter_t counter) const {
+    wrappingBuffer->data[1] = nullptr;
+    wrappingBuffer->numFrames[1] = 0;
+    if (framesAvailable > 0) {
+        fifo_frames_t startIndex = (fifo_frames_t) (counter % mCapacity);
+        uint8_t *source = &mStorage[convertFramesToBytes(startIndex)];
+        wrappingBuffer->data[0] = source;
+        // Does the range cross the end of the FIFO?
+        if ((startIndex + framesAvailable) > mCapacity) {
+            fifo_frames_t firstFrames = mCapacity - startIndex;
+            wrappingBuffer->numFrames[0] = firstFrames;
+            wrappingBuffer->data[1] = &mStorage[0];
+            wrappingBuffer->numFrames[1] = framesAvailable - firstFrames;
+        } else {
+            wrappingBuffer->numFrames[0] = framesAvailable;
+        }
+    } else {
+        wrappingBuffer->data[0] = nullptr;
+        wrappingBuffer->numFrames[0] = 0;
+    }
+}
+
+FifoBufferMultiWriter::Reservation FifoBufferMultiWriter::reserve(
+        fifo_frames_t numFrames, WrappingBuffer *wrappingBuffer) {
+    Reservation reservation;
+    fifo_counter_t counter = mReserveCounter.load(std::memory_order_relaxed);
+    fifo_counter_t framesToReserve;
+    do {
+        // If counter is stale the room may be overestimated, but then the exchange fails.
+        fifo_counter_t readCounter = mReadCounter.load(std::memory_order_acquire);
+        framesToReserve = std::min<fifo_counter_t>(numFrames,
+                                                   mCapacity - (counter - readCounter));
+        if (framesToReserve <= 0) {
+            reservation.counter = counter;
+            fillWrappingBuffer(wrappingBuffer, 0, counter);
+            return reservation;
+        }
+    } while (!mReserveCounter.compare_exchange_weak(counter, counter + framesToReserve,
+                                                    std::memory_order_acq_rel,
+                                                    std::memory_order_relaxed));
+    reservation.counter = counter;
+    reservation.numFrames = (fifo_frames_t) framesToReserve;
+    fillWrappingBuffer(wrappingBuffer, reservation.numFrames, counter);
+    return reservation;
+}
+
+void FifoBufferMultiWriter::commit(const Reservation &reservation) {
+    if (reservation.numFrames > 0) {
+        mCommitEnd[reservation.counter % mCapacity].store(
+                reservation.counter + reservation.numFrames, std::memory_order_release);
+    }
+}
+
+fifo_frames_t FifoBufferMultiWriter::write(const void *buffer, fifo_frames_t numFrames) {
+    WrappingBuffer wrappingBuffer;
+    const uint8_t *source = (const uint8_t *) buffer;
+    Reservation reservation = reserve(numFrames, &wrappingBuffer);
+
+    // Write data in one or two parts.
+    for (int partIndex = 0; partIndex < WrappingBuffer::SIZE; partIndex++) {
+        int32_t numBytes = convertFramesToBytes(wrappingBuffer.numFrames[partIndex]);
+        if (numBytes > 0) {
+            memcpy(wrappingBuffer.data[partIndex], source, numBytes);
+            source += numBytes;
+        }
+    }
+    commit(reservation);
+    return reservation.numFrames;
+}
+
+fifo_frames_t FifoBufferMultiWriter::getEmptyFramesAvailable() const {
+    fifo_counter_t readCounter = mReadCounter.load(std::memory_order_acquire);
+    fifo_counter_t reserveCounter = mReserveCounter.load(std::memory_order_acquire);
+    return (fifo_frames_t) std::max<fifo_counter_t>(
+            0, mCapacity - (reserveCounter - readCounter));
+}
+
+fifo_frames_t FifoBufferMultiWriter::getFullFramesAvailable() {
+    // Walk the committed reservations in order, stopping at the first one still being written.
+    fifo_counter_t committed = mCommittedCounter;
+    const fifo_counter_t reserved = mReserveCounter.load(std::memory_order_acquire);
+    while (committed < reserved) {
+        fifo_counter_t end = mCommitEnd[committed % mCapacity].load(std::memory_order_acquire);
+        if (end <= committed) {
+            break;
+        }
+        committed = end;
+    }
+    mCommittedCounter = committed;
+    return (fifo_frames_t) (committed - mReadCounter.load(std::memory_order_relaxed));
+}
+
+fifo_frames_t FifoBufferMultiWriter::getFullDataAvailable(WrappingBuffer *wrappingBuffer) {
+    fifo_frames_t framesAvailable = getFullFramesAvailable();
+    fillWrappingBuffer(wrappingBuffer, framesAvailable,
+                       mReadCounter.load(std::memory_order_relaxed));
+    return framesAvailable;
+}
+
+void FifoBufferMultiWriter::advanceReadIndex(fifo_frames_t numFrames) {
+    mReadCounter.store(mReadCounter.load(std::memory_order_relaxed) + numFrames,
+                       std::memory_order_release);
+}
+
+fifo_frames_t FifoBufferMultiWriter::read(void *buffer, fifo_frames_t numFrames) {
+    WrappingBuffer wrappingBuffer;
+    uint8_t *destination = (uint8_t *) buffer;
+    fifo_frames_t framesLeft = numFrames;
+
+    getFullDataAvailable(&wrappingBuffer);
+
+    // Read data in one or two parts.
+    for (int partIndex = 0; framesLeft > 0 && partIndex < WrappingBuffer::SIZE; partIndex++) {
+        fifo_frames_t framesToRead = std::min(framesLeft, wrappingBuffer.numFrames[partIndex]);
+        if (framesToRead <= 0) {
+            break;
+        }
+        int32_t numBytes = convertFramesToBytes(framesToRead);
+        memcpy(destination, wrappingBuffer.data[partIndex], numBytes);
+        destination += numBytes;
+        framesLeft -= framesToRead;
+    }
+    fifo_frames_t framesRead = numFrames - framesLeft;
+    advanceReadIndex(framesRead);
+    return framesRead;
+}
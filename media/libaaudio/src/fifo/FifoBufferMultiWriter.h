@@ -0,0 +1,152 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FIFO_FIFO_BUFFER_MULTI_WRITER_H
+#define FIFO_FIFO_BUFFER_MULTI_WRITER_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+#include "FifoBuffer.h"
+#include "FifoControllerBase.h"
+
+namespace android {
+
+/**
+ * A bounded FIFO with any number of writer threads and a single reader thread.
+ * No mutexes are used.
+ *
+ * A writer first reserves a range of frames, fills it, then commits it.
+ * Reservations are made with a compare-and-swap on a shared counter so a writer
+ * never waits for another writer, it only retries if another writer reserved
+ * at the same moment. Writers may commit out of order; the reader only sees
+ * frames up to the oldest reservation that has not been committed yet.
+ *
+ * Every reservation must eventually be committed, or the reader will stall at it.
+ * A reservation cannot be shrunk, so a writer should only reserve frames it is
+ * about to fill.
+ */
+class FifoBufferMultiWriter {
+public:
+    /**
+     * Range of frames reserved by a writer.
+     */
+    struct Reservation {
+        fifo_counter_t counter = 0;
+        fifo_frames_t numFrames = 0;
+    };
+
+    FifoBufferMultiWriter(int32_t bytesPerFrame, fifo_frames_t capacityInFrames);
+
+    int32_t convertFramesToBytes(fifo_frames_t frames) const {
+        return frames * mBytesPerFrame;
+    }
+
+    int32_t getBytesPerFrame() const {
+        return mBytesPerFrame;
+    }
+
+    fifo_frames_t getBufferCapacityInFrames() const {
+        return mCapacity;
+    }
+
+    // Writer side, may be called from any thread.
+
+    /**
+     * Reserve up to numFrames of empty room.
+     * The room may be split across the end of the FIFO.
+     *
+     * @param numFrames maximum number of frames to reserve
+     * @param wrappingBuffer set to the reserved room
+     * @return reservation to pass to commit(), with zero frames if the FIFO is full
+     */
+    Reservation reserve(fifo_frames_t numFrames, WrappingBuffer *wrappingBuffer);
+
+    /**
+     * Make a reserved range visible to the reader once all older reservations
+     * are committed too.
+     */
+    void commit(const Reservation &reservation);
+
+    /**
+     * Reserve, copy and commit in one call.
+     * @return number of frames written, which may be less than numFrames if the FIFO is full
+     */
+    fifo_frames_t write(const void *buffer, fifo_frames_t numFrames);
+
+    /**
+     * This may change as soon as it returns if other threads are writing.
+     * @return number of frames that can currently be reserved
+     */
+    fifo_frames_t getEmptyFramesAvailable() const;
+
+    // Reader side, must only be called from a single thread.
+
+    /**
+     * @return number of committed frames that can be read
+     */
+    fifo_frames_t getFullFramesAvailable();
+
+    /**
+     * Return pointers to the committed frames, which may be split across the end of the FIFO.
+     * @return total full frames available
+     */
+    fifo_frames_t getFullDataAvailable(WrappingBuffer *wrappingBuffer);
+
+    /**
+     * @param numFrames number of frames to release back to the writers
+     */
+    void advanceReadIndex(fifo_frames_t numFrames);
+
+    fifo_frames_t read(void *buffer, fifo_frames_t numFrames);
+
+    fifo_counter_t getReadCounter() const {
+        return mReadCounter.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @return counter after the last frame reserved by any writer
+     */
+    fifo_counter_t getReserveCounter() const {
+        return mReserveCounter.load(std::memory_order_acquire);
+    }
+
+private:
+    void fillWrappingBuffer(WrappingBuffer *wrappingBuffer,
+                            fifo_frames_t framesAvailable, fifo_counter_t counter) const;
+
+    const int32_t        mBytesPerFrame;
+    const fifo_frames_t  mCapacity;
+    std::unique_ptr<uint8_t[]> mStorage;
+
+    // For each index, the counter just past the end of the last reservation committed
+    // that started at that index. A stale value from an earlier lap is never greater than
+    // the counter of a reservation that starts at the same index now, so the array never
+    // needs to be cleared.
+    std::unique_ptr<std::atomic<fifo_counter_t>[]> mCommitEnd;
+
+    // Written by writers.
+    alignas(64) std::atomic<fifo_counter_t> mReserveCounter{0};
+    // Written by the reader.
+    alignas(64) std::atomic<fifo_counter_t> mReadCounter{0};
+    // Only used by the reader. All frames before this counter are committed.
+    alignas(64) fifo_counter_t mCommittedCounter = 0;
+};
+
+}  // namespace android
+
+#endif //FIFO_FIFO_BUFFER_MULTI_WRITER_H
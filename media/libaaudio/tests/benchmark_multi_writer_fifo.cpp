@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Throughput of FifoBufferMultiWriter with several writer threads feeding one reader,
+// compared with a single-writer FifoBuffer.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/benchmark_multi_writer_fifo/benchmark_multi_writer_fifo
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "fifo/FifoBuffer.h"
+#include "fifo/FifoBufferMultiWriter.h"
+
+using android::fifo_frames_t;
+using android::FifoBufferAllocated;
+using android::FifoBufferMultiWriter;
+
+namespace {
+
+constexpr int32_t kChannelCount = 2;
+constexpr int32_t kBytesPerFrame = kChannelCount * sizeof(float);
+constexpr fifo_frames_t kCapacity = 4096;
+
+// Writes bursts of |burstFrames| until told to stop.
+template <typename Fifo>
+void writeUntilStopped(Fifo *fifo, fifo_frames_t burstFrames, const std::atomic<bool> &stop) {
+    std::vector<float> burst(burstFrames * kChannelCount, 0.5f);
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (fifo->write(burst.data(), burstFrames) == 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Reads |totalFrames| and returns when done.
+template <typename Fifo>
+void readFrames(Fifo *fifo, int64_t totalFrames) {
+    std::vector<float> buffer(kCapacity * kChannelCount);
+    for (int64_t framesRead = 0; framesRead < totalFrames; ) {
+        fifo_frames_t numFrames = fifo->read(buffer.data(), kCapacity);
+        if (numFrames == 0) {
+            std::this_thread::yield();
+        }
+        framesRead += numFrames;
+    }
+    benchmark::DoNotOptimize(buffer.data());
+}
+
+}  // namespace
+
+// Args: number of writers, frames per write.
+static void BM_MultiWriterFifo(benchmark::State &state) {
+    const int numWriters = state.range(0);
+    const fifo_frames_t burstFrames = state.range(1);
+    constexpr int64_t kFramesPerIteration = 1 << 20;
+
+    for (auto _ : state) {
+        FifoBufferMultiWriter fifo(kBytesPerFrame, kCapacity);
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> writers;
+        for (int i = 0; i < numWriters; i++) {
+            writers.emplace_back(writeUntilStopped<FifoBufferMultiWriter>, &fifo, burstFrames,
+                                 std::cref(stop));
+        }
+        readFrames(&fifo, kFramesPerIteration);
+        stop = true;
+        for (std::thread &writer : writers) {
+            writer.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kFramesPerIteration);
+}
+
+// Single writer baseline. Args: frames per write.
+static void BM_SingleWriterFifo(benchmark::State &state) {
+    const fifo_frames_t burstFrames = state.range(0);
+    constexpr int64_t kFramesPerIteration = 1 << 20;
+
+    for (auto _ : state) {
+        FifoBufferAllocated fifo(kBytesPerFrame, kCapacity);
+        std::atomic<bool> stop{false};
+        std::thread writer(writeUntilStopped<FifoBufferAllocated>, &fifo, burstFrames,
+                           std::cref(stop));
+        readFrames(&fifo, kFramesPerIteration);
+        stop = true;
+        writer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * kFramesPerIteration);
+}
+
+static void MultiWriterArgs(benchmark::internal::Benchmark *b) {
+    for (int writers : { 1, 2, 4, 8 }) {
+        for (int burst : { 48, 192 }) {
+            b->Args({writers, burst});
+        }
+    }
+}
+
+BENCHMARK(BM_MultiWriterFifo)->Apply(MultiWriterArgs)->UseRealTime();
+BENCHMARK(BM_SingleWriterFifo)->Arg(48)->Arg(192)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "fifo/FifoBufferMultiWriter.h"
+
+using android::fifo_frames_t;
+using android::FifoBufferMultiWriter;
+using android::WrappingBuffer;
+
+TEST(test_multi_writer_fifo, single_thread_wrap_around) {
+    // Values are arbitrary primes designed to trigger edge cases.
+    constexpr int capacity = 13;
+    FifoBufferMultiWriter fifo(sizeof(int32_t), capacity);
+    ASSERT_EQ(capacity, fifo.getEmptyFramesAvailable());
+    ASSERT_EQ(0, fifo.getFullFramesAvailable());
+
+    int32_t next = 0;
+    int32_t expected = 0;
+    for (int i = 0; i < 50; i++) {
+        int32_t data[7];
+        for (int32_t &sample : data) {
+            sample = next++;
+        }
+        ASSERT_EQ(7, fifo.write(data, 7));
+
+        int32_t output[7] = {};
+        ASSERT_EQ(7, fifo.getFullFramesAvailable());
+        ASSERT_EQ(7, fifo.read(output, 7));
+        for (int32_t sample : output) {
+            ASSERT_EQ(expected++, sample);
+        }
+    }
+}
+
+TEST(test_multi_writer_fifo, full) {
+    constexpr int capacity = 11;
+    FifoBufferMultiWriter fifo(sizeof(int32_t), capacity);
+    int32_t data[capacity + 3] = {};
+
+    ASSERT_EQ(capacity, fifo.write(data, capacity + 3));
+    ASSERT_EQ(0, fifo.getEmptyFramesAvailable());
+    ASSERT_EQ(0, fifo.write(data, 1));
+
+    ASSERT_EQ(5, fifo.read(data, 5));
+    ASSERT_EQ(5, fifo.getEmptyFramesAvailable());
+    ASSERT_EQ(5, fifo.write(data, 7));
+    ASSERT_EQ(capacity, fifo.getFullFramesAvailable());
+}
+
+TEST(test_multi_writer_fifo, out_of_order_commit) {
+    constexpr int capacity = 17;
+    FifoBufferMultiWriter fifo(sizeof(int32_t), capacity);
+
+    WrappingBuffer first;
+    WrappingBuffer second;
+    FifoBufferMultiWriter::Reservation reservation1 = fifo.reserve(5, &first);
+    FifoBufferMultiWriter::Reservation reservation2 = fifo.reserve(8, &second);
+    ASSERT_EQ(5, reservation1.numFrames);
+    ASSERT_EQ(8, reservation2.numFrames);
+    ASSERT_EQ(capacity - 13, fifo.getEmptyFramesAvailable());
+
+    // The second reservation is not visible until the first one is committed.
+    fifo.commit(reservation2);
+    ASSERT_EQ(0, fifo.getFullFramesAvailable());
+    fifo.commit(reservation1);
+    ASSERT_EQ(13, fifo.getFullFramesAvailable());
+
+    // A reservation that wraps is split in two parts.
+    fifo.advanceReadIndex(13);
+    WrappingBuffer wrapped;
+    FifoBufferMultiWriter::Reservation reservation3 = fifo.reserve(10, &wrapped);
+    ASSERT_EQ(10, reservation3.numFrames);
+    ASSERT_EQ(4, wrapped.numFrames[0]);
+    ASSERT_EQ(6, wrapped.numFrames[1]);
+    fifo.commit(reservation3);
+    ASSERT_EQ(10, fifo.getFullFramesAvailable());
+}
+
+// Several writers each write a sequence of frames tagged with the writer id.
+// The reader must see every frame exactly once and each writer's frames in order.
+TEST(test_multi_writer_fifo, stress_multiple_writers) {
+    constexpr int kNumWriters = 4;
+    constexpr int kFramesPerWriter = 200000;
+    constexpr int kCapacity = 257;
+
+    struct Frame {
+        int32_t writer;
+        int32_t sequence;
+    };
+    FifoBufferMultiWriter fifo(sizeof(Frame), kCapacity);
+
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> writers;
+    for (int writer = 0; writer < kNumWriters; writer++) {
+        writers.emplace_back([&fifo, &failed, writer]() {
+            Frame frames[31];
+            int32_t sequence = 0;
+            while (sequence < kFramesPerWriter && !failed) {
+                // Vary the burst size so reservations straddle the end of the buffer.
+                int32_t numFrames = std::min(1 + (sequence + writer) % 31,
+                                             kFramesPerWriter - sequence);
+                for (int32_t i = 0; i < numFrames; i++) {
+                    frames[i] = { writer, sequence + i };
+                }
+                fifo_frames_t written = fifo.write(frames, numFrames);
+                sequence += written;
+                if (written == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<int32_t> nextSequence(kNumWriters, 0);
+    int64_t framesRead = 0;
+    Frame frames[64];
+    while (framesRead < (int64_t) kNumWriters * kFramesPerWriter && !failed) {
+        fifo_frames_t numFrames = fifo.read(frames, 64);
+        for (fifo_frames_t i = 0; i < numFrames; i++) {
+            const Frame &frame = frames[i];
+            if (frame.writer < 0 || frame.writer >= kNumWriters
+                    || frame.sequence != nextSequence[frame.writer]) {
+                failed = true;
+                break;
+            }
+            nextSequence[frame.writer]++;
+        }
+        framesRead += numFrames;
+        if (numFrames == 0) {
+            std::this_thread::yield();
+        }
+    }
+    for (std::thread &writer : writers) {
+        writer.join();
+    }
+
+    ASSERT_FALSE(failed);
+    for (int writer = 0; writer < kNumWriters; writer++) {
+        EXPECT_EQ(kFramesPerWriter, nextSequence[writer]) << "writer " << writer;
+    }
+    EXPECT_EQ(0, fifo.getFullFramesAvailable());
+    EXPECT_EQ(kCapacity, fifo.getEmptyFramesAvailable());
+}
@@ -18,6 +18,7 @@
 #define LOG_TAG "AudioMixer"
 //#define LOG_NDEBUG 0
 
+#include <algorithm>
 #include <array>
 #include <sstream>
 #include <string.h>
@@ -599,6 +600,113 @@ std::string AudioMixerBase::trackNames() const
     return ss.str();
 }
 
+/* Returns a signature of everything the track and process hook selection depends on,
+ * used as the per-track part of the kernel cache key.
+ */
+/* static */
+uint64_t AudioMixerBase::getTrackSignature(const TrackBase *t)
+{
+    uint64_t signature = t->needs;
+    if (t->volumeInc[0] | t->volumeInc[1]) {
+        signature |= 1ull << 32;
+    }
+    if (t->channelMask == AUDIO_CHANNEL_OUT_MONO  // MONO_HACK
+            && isAudioChannelPositionMask(t->mMixerChannelMask)) {
+        signature |= 1ull << 33;
+    }
+    if (t->useStereoVolume()) {
+        signature |= 1ull << 34;
+    }
+    if (t->mMixerInFormat == AUDIO_FORMAT_PCM_FLOAT) {
+        signature |= 1ull << 35;
+    }
+    if (t->mMixerFormat == AUDIO_FORMAT_PCM_FLOAT) {
+        signature |= 1ull << 36;
+    }
+    signature |= (uint64_t)t->mMixerChannelCount << 40;
+    return signature;
+}
+
+/* Returns the track hook for the needs computed by process__validate().
+ */
+/* static */
+AudioMixerBase::hook_t AudioMixerBase::selectTrackHook(int name __unused, const TrackBase *t)
+{
+    const uint32_t n = t->needs;
+    if (n & NEEDS_MUTE) {
+        return &TrackBase::track__nop;
+    }
+    if (n & NEEDS_RESAMPLE) {
+        ALOGV_IF((n & NEEDS_CHANNEL_COUNT__MASK) > NEEDS_CHANNEL_2,
+                "Track %d needs downmix + resample", name);
+        if ((n & NEEDS_CHANNEL_COUNT__MASK) == NEEDS_CHANNEL_1
+                && t->channelMask == AUDIO_CHANNEL_OUT_MONO // MONO_HACK
+                && isAudioChannelPositionMask(t->mMixerChannelMask)) {
+            return TrackBase::getTrackHook(
+                    TRACKTYPE_RESAMPLEMONO, t->mMixerChannelCount,
+                    t->mMixerInFormat, t->mMixerFormat);
+        } else if ((n & NEEDS_CHANNEL_COUNT__MASK) >= NEEDS_CHANNEL_2
+                && t->useStereoVolume()) {
+            return TrackBase::getTrackHook(
+                    TRACKTYPE_RESAMPLESTEREO, t->mMixerChannelCount,
+                    t->mMixerInFormat, t->mMixerFormat);
+        }
+        return TrackBase::getTrackHook(
+                TRACKTYPE_RESAMPLE, t->mMixerChannelCount,
+                t->mMixerInFormat, t->mMixerFormat);
+    }
+    if ((n & NEEDS_CHANNEL_COUNT__MASK) == NEEDS_CHANNEL_1) {
+        return TrackBase::getTrackHook(
+                (isAudioChannelPositionMask(t->mMixerChannelMask)  // TODO: MONO_HACK
+                        && t->channelMask == AUDIO_CHANNEL_OUT_MONO)
+                    ? TRACKTYPE_NORESAMPLEMONO : TRACKTYPE_NORESAMPLE,
+                t->mMixerChannelCount,
+                t->mMixerInFormat, t->mMixerFormat);
+    }
+    ALOGV_IF((n & NEEDS_CHANNEL_COUNT__MASK) > NEEDS_CHANNEL_2,
+            "Track %d needs downmix", name);
+    return TrackBase::getTrackHook(
+            t->useStereoVolume() ? TRACKTYPE_NORESAMPLESTEREO
+                    : TRACKTYPE_NORESAMPLE,
+            t->mMixerChannelCount, t->mMixerInFormat,
+            t->mMixerFormat);
+}
+
+/* Returns the process hook for the enabled tracks, whose track hooks
+ * have already been selected.
+ */
+AudioMixerBase::process_hook_t AudioMixerBase::selectProcessHook(bool resampling,
+        bool all16BitsStereoNoResample, bool volumeRamp, bool allFloat)
+{
+    if (mEnabled.size() == 0) {
+        return &AudioMixerBase::process__nop;
+    }
+    if (resampling) {
+        return &AudioMixerBase::process__genericResampling;
+    }
+    if (all16BitsStereoNoResample && !volumeRamp) {
+        if (mEnabled.size() == 1) {
+            const std::shared_ptr<TrackBase> &t = mTracks[mEnabled[0]];
+            if ((t->needs & NEEDS_MUTE) == 0) {
+                // The check prevents a muted track from acquiring a process hook.
+                //
+                // This is dangerous if the track is MONO as that requires
+                // special case handling due to implicit channel duplication.
+                // Stereo or Multichannel should actually be fine here.
+                return getProcessHook(PROCESSTYPE_NORESAMPLEONETRACK,
+                        t->mMixerChannelCount, t->mMixerInFormat, t->mMixerFormat,
+                        t->useStereoVolume());
+            }
+        }
+    }
+    if (allFloat && !volumeRamp) {
+        // volume ramps are left to the generic hook, which adjusts them every BLOCKSIZE frames.
+        return &AudioMixerBase::process__noResampleFloat;
+    }
+    // we keep temp arrays around.
+    return &AudioMixerBase::process__genericNoResampling;
+}
+
 void AudioMixerBase::process__validate()
 {
     // TODO: fix all16BitsStereNoResample logic to
@@ -607,9 +715,11 @@ void AudioMixerBase::process__validate()
     bool all16BitsStereoNoResample = true;
     bool resampling = false;
     bool volumeRamp = false;
+    bool allFloat = true;
 
     mEnabled.clear();
     mGroups.clear();
+    std::vector<uint64_t> key;
     for (const auto &pair : mTracks) {
         const int name = pair.first;
         const std::shared_ptr<TrackBase> &t = pair.second;
@@ -635,86 +745,56 @@ void AudioMixerBase::process__validate()
         }
         t->needs = n;
 
-        if (n & NEEDS_MUTE) {
-            t->hook = &TrackBase::track__nop;
-        } else {
-            if (n & NEEDS_AUX) {
+        if ((n & NEEDS_MUTE) == 0) {
+            if (n & (NEEDS_AUX | NEEDS_RESAMPLE)) {
                 all16BitsStereoNoResample = false;
             }
             if (n & NEEDS_RESAMPLE) {
-                all16BitsStereoNoResample = false;
                 resampling = true;
-                if ((n & NEEDS_CHANNEL_COUNT__MASK) == NEEDS_CHANNEL_1
-                        && t->channelMask == AUDIO_CHANNEL_OUT_MONO // MONO_HACK
-                        && isAudioChannelPositionMask(t->mMixerChannelMask)) {
-                    t->hook = TrackBase::getTrackHook(
-                            TRACKTYPE_RESAMPLEMONO, t->mMixerChannelCount,
-                            t->mMixerInFormat, t->mMixerFormat);
-                } else if ((n & NEEDS_CHANNEL_COUNT__MASK) >= NEEDS_CHANNEL_2
-                        && t->useStereoVolume()) {
-                    t->hook = TrackBase::getTrackHook(
-                            TRACKTYPE_RESAMPLESTEREO, t->mMixerChannelCount,
-                            t->mMixerInFormat, t->mMixerFormat);
-                } else {
-                    t->hook = TrackBase::getTrackHook(
-                            TRACKTYPE_RESAMPLE, t->mMixerChannelCount,
-                            t->mMixerInFormat, t->mMixerFormat);
-                }
-                ALOGV_IF((n & NEEDS_CHANNEL_COUNT__MASK) > NEEDS_CHANNEL_2,
-                        "Track %d needs downmix + resample", name);
-            } else {
-                if ((n & NEEDS_CHANNEL_COUNT__MASK) == NEEDS_CHANNEL_1){
-                    t->hook = TrackBase::getTrackHook(
-                            (isAudioChannelPositionMask(t->mMixerChannelMask)  // TODO: MONO_HACK
-                                    && t->channelMask == AUDIO_CHANNEL_OUT_MONO)
-                                ? TRACKTYPE_NORESAMPLEMONO : TRACKTYPE_NORESAMPLE,
-                            t->mMixerChannelCount,
-                            t->mMixerInFormat, t->mMixerFormat);
-                    all16BitsStereoNoResample = false;
-                }
-                if ((n & NEEDS_CHANNEL_COUNT__MASK) >= NEEDS_CHANNEL_2){
-                    t->hook = TrackBase::getTrackHook(
-                            t->useStereoVolume() ? TRACKTYPE_NORESAMPLESTEREO
-                                    : TRACKTYPE_NORESAMPLE,
-                            t->mMixerChannelCount, t->mMixerInFormat,
-                            t->mMixerFormat);
-                    ALOGV_IF((n & NEEDS_CHANNEL_COUNT__MASK) > NEEDS_CHANNEL_2,
-                            "Track %d needs downmix", name);
-                }
+            } else if ((n & NEEDS_CHANNEL_COUNT__MASK) == NEEDS_CHANNEL_1) {
+                all16BitsStereoNoResample = false;
             }
         }
+        if (t->mMixerInFormat != AUDIO_FORMAT_PCM_FLOAT
+                || t->mMixerFormat != AUDIO_FORMAT_PCM_FLOAT) {
+            allFloat = false;
+        }
+        key.emplace_back(getTrackSignature(t.get()));
     }
 
-    // select the processing hooks
-    mHook = &AudioMixerBase::process__nop;
-    if (mEnabled.size() > 0) {
-        if (resampling) {
-            if (mOutputTemp.get() == nullptr) {
-                mOutputTemp.reset(new int32_t[MAX_NUM_CHANNELS * mFrameCount]);
-            }
-            if (mResampleTemp.get() == nullptr) {
-                mResampleTemp.reset(new int32_t[MAX_NUM_CHANNELS * mFrameCount]);
-            }
-            mHook = &AudioMixerBase::process__genericResampling;
-        } else {
-            // we keep temp arrays around.
-            mHook = &AudioMixerBase::process__genericNoResampling;
-            if (all16BitsStereoNoResample && !volumeRamp) {
-                if (mEnabled.size() == 1) {
-                    const std::shared_ptr<TrackBase> &t = mTracks[mEnabled[0]];
-                    if ((t->needs & NEEDS_MUTE) == 0) {
-                        // The check prevents a muted track from acquiring a process hook.
-                        //
-                        // This is dangerous if the track is MONO as that requires
-                        // special case handling due to implicit channel duplication.
-                        // Stereo or Multichannel should actually be fine here.
-                        mHook = getProcessHook(PROCESSTYPE_NORESAMPLEONETRACK,
-                                t->mMixerChannelCount, t->mMixerInFormat, t->mMixerFormat,
-                                t->useStereoVolume());
-                    }
-                }
-            }
+    if (resampling) {
+        if (mOutputTemp.get() == nullptr) {
+            mOutputTemp.reset(new int32_t[MAX_NUM_CHANNELS * mFrameCount]);
+        }
+        if (mResampleTemp.get() == nullptr) {
+            mResampleTemp.reset(new int32_t[MAX_NUM_CHANNELS * mFrameCount]);
+        }
+    }
+
+    // The hooks only depend on the key, so reuse the selection of a configuration we have
+    // seen before. Tracks being enabled and disabled typically cycle through a few of them.
+    auto it = std::find_if(mKernelCache.begin(), mKernelCache.end(),
+            [&key](const MixKernel &kernel) { return kernel.key == key; });
+    if (it != mKernelCache.end()) {
+        for (size_t i = 0; i < mEnabled.size(); ++i) {
+            mTracks[mEnabled[i]]->hook = it->trackHooks[i];
+        }
+        mHook = it->processHook;
+    } else {
+        MixKernel kernel;
+        kernel.key = std::move(key);
+        for (const int name : mEnabled) {
+            const std::shared_ptr<TrackBase> &t = mTracks[name];
+            t->hook = selectTrackHook(name, t.get());
+            kernel.trackHooks.emplace_back(t->hook);
+        }
+        mHook = selectProcessHook(resampling, all16BitsStereoNoResample, volumeRamp, allFloat);
+        kernel.processHook = mHook;
+
+        if (mKernelCache.size() >= kMaxCachedKernels) {
+            mKernelCache.erase(mKernelCache.begin());
         }
+        mKernelCache.emplace_back(std::move(kernel));
     }
 
     ALOGV("mixer configuration change: %zu "
@@ -1152,6 +1232,52 @@ void AudioMixerBase::process__genericNoResampling()
     }
 }
 
+// float code without resampling, mixing straight into the main buffers
+void AudioMixerBase::process__noResampleFloat()
+{
+    ALOGVV("process__noResampleFloat\n");
+
+    for (const auto &pair : mGroups) {
+        // process by group of tracks with same output main buffer to
+        // avoid multiple memset() on same buffer
+        const auto &group = pair.second;
+
+        // The mix is accumulated in the main buffer itself, in the same track order as
+        // process__genericNoResampling(), so there is no temp buffer or format conversion.
+        const std::shared_ptr<TrackBase> &t1 = mTracks[group[0]];
+        float *out = reinterpret_cast<float *>(pair.first);
+        memset(out, 0, mFrameCount * t1->mMixerChannelCount * sizeof(float));
+
+        for (const int name : group) {
+            const std::shared_ptr<TrackBase> &t = mTracks[name];
+            TYPE_AUX *aux = nullptr;
+            if (CC_UNLIKELY(t->needs & NEEDS_AUX)) {
+                aux = reinterpret_cast<TYPE_AUX *>(t->auxBuffer);
+            }
+            for (size_t numFrames = 0; numFrames < mFrameCount; ) {
+                t->buffer.frameCount = mFrameCount - numFrames;
+                t->bufferProvider->getNextBuffer(&t->buffer);
+                t->mIn = t->buffer.raw;
+                // t->mIn == nullptr can happen if the track was flushed just after having
+                // been enabled for mixing.
+                if (t->mIn == nullptr) {
+                    break;
+                }
+                const size_t inFrames = t->buffer.frameCount;
+                (t.get()->*t->hook)(
+                        reinterpret_cast<int32_t *>(out + numFrames * t->mMixerChannelCount),
+                        inFrames, mResampleTemp.get() /* naked ptr */,
+                        reinterpret_cast<int32_t *>(aux));
+                if (CC_UNLIKELY(aux != nullptr)) {
+                    aux += inFrames;
+                }
+                numFrames += inFrames;
+                t->bufferProvider->releaseBuffer(&t->buffer);
+            }
+        }
+    }
+}
+
 // generic code with resampling
 void AudioMixerBase::process__genericResampling()
 {
@@ -32,6 +32,7 @@
 #include "AudioResamplerFirProcess.h"
 #include "AudioResamplerFirProcessNeon.h"
 #include "AudioResamplerFirProcessSSE.h"
+#include "AudioResamplerFirProcessAVX2.h"
 #include "AudioResamplerFirGen.h" // requires math.h
 #include "AudioResamplerDyn.h"
 
@@ -549,6 +550,13 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
             "Resampler channels(%d) must be between 1 to %d", mChannelCount, FCC_LIMIT);
     // stride 16 (falls back to stride 2 for machines that do not support NEON)
 
+#if USE_AVX2_DISPATCH
+    constexpr bool kUseAvx2 = isAvx2FirType<TC, TI, TO>();
+    const bool useAvx2 = kUseAvx2 && isAvx2FirSupported();
+#else
+    constexpr bool kUseAvx2 = false;
+    const bool useAvx2 = false;
+#endif
 
 // For now use a #define as a compiler generated function table requires renaming.
 #pragma push_macro("AUDIORESAMPLERDYN_CASE")
@@ -556,6 +564,12 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
 #define AUDIORESAMPLERDYN_CASE(CHANNEL, LOCKED) \
     case CHANNEL: if constexpr (CHANNEL <= FCC_LIMIT) {\
         mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<CHANNEL, LOCKED, 16>; \
+        if constexpr (kUseAvx2) { \
+            if (useAvx2) { \
+                mResampleFunc = \
+                        &AudioResamplerDyn<TC, TI, TO>::resample<CHANNEL, LOCKED, 16, true>; \
+            } \
+        } \
     } break
 
     if (locked) {
@@ -616,9 +630,9 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
 #pragma pop_macro("AUDIORESAMPLERDYN_CASE")
 
 #ifdef DEBUG_RESAMPLER
-    printf("channels:%d  %s  stride:%d  %s  coef:%d  shift:%d\n",
+    printf("channels:%d  %s  stride:%d  %s  coef:%d  shift:%d  avx2:%d\n",
             mChannelCount, locked ? "locked" : "interpolated",
-            stride, useS32 ? "S32" : "S16", 2*c.mHalfNumCoefs, c.mShift);
+            stride, useS32 ? "S32" : "S16", 2*c.mHalfNumCoefs, c.mShift, useAvx2);
 #endif
 }
 
@@ -630,7 +644,7 @@ size_t AudioResamplerDyn<TC, TI, TO>::resample(int32_t* out, size_t outFrameCoun
 }
 
 template<typename TC, typename TI, typename TO>
-template<int CHANNELS, bool LOCKED, int STRIDE>
+template<int CHANNELS, bool LOCKED, int STRIDE, bool AVX2>
 size_t AudioResamplerDyn<TC, TI, TO>::resample(TO* out, size_t outFrameCount,
         AudioBufferProvider* provider)
 {
@@ -719,6 +733,15 @@ size_t AudioResamplerDyn<TC, TI, TO>::resample(TO* out, size_t outFrameCount,
             //        "  phaseFraction:%u  phaseWrapLimit:%u",
             //        inFrameCount, outputIndex, outFrameCount, phaseFraction, phaseWrapLimit);
             ALOG_ASSERT(phaseFraction < phaseWrapLimit);
+#if USE_AVX2_DISPATCH
+            if constexpr (AVX2) {
+                firAVX2<CHANNELS, LOCKED>(
+                        &out[outputIndex],
+                        phaseFraction, phaseWrapLimit,
+                        coefShift, halfNumCoefs, coefs,
+                        impulse, volumeSimd);
+            } else
+#endif
             fir<CHANNELS, LOCKED, STRIDE>(
                     &out[outputIndex],
                     phaseFraction, phaseWrapLimit,
@@ -152,7 +152,8 @@ private:
 
     void createKaiserFir(Constants &c, double stopBandAtten, double fcr);
 
-    template<int CHANNELS, bool LOCKED, int STRIDE>
+    // AVX2 selects firAVX2() instead of fir(), see AudioResamplerFirProcessAVX2.h.
+    template<int CHANNELS, bool LOCKED, int STRIDE, bool AVX2 = false>
     size_t resample(TO* out, size_t outFrameCount, AudioBufferProvider* provider);
 
     // define a pointer to member function type for resample
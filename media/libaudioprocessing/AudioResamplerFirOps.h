@@ -46,7 +46,16 @@ namespace android {
 #include <tmmintrin.h>
 #else
 #define USE_SSE (false)
-#define USE_AVX2(false)
+#define USE_AVX2 (false)
+#endif
+
+// AVX2/FMA is not part of the x86 ABI, so those kernels are compiled separately
+// and selected at runtime (see AudioResamplerFirProcessAVX2.h).
+#if defined(__i386__) || defined(__x86_64__)
+#define USE_AVX2_DISPATCH (true)
+#include <immintrin.h>
+#else
+#define USE_AVX2_DISPATCH (false)
 #endif
 
 
@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_AVX2_H
+#define ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_AVX2_H
+
+namespace android {
+
+// depends on AudioResamplerFirOps.h, AudioResamplerFirProcess.h
+
+#if USE_AVX2_DISPATCH
+
+//
+// AVX2/FMA variants of fir() in AudioResamplerFirProcess.h.
+//
+// Unlike the NEON and SSE specializations these are not selected at compile time:
+// they are built with a function target attribute and AudioResamplerDyn selects them
+// when isAvx2FirSupported() is true.
+//
+// Covered are float and int16_t (int16_t coefficients) resamplers, for any channel count,
+// locked and interpolated phases. The int16_t variants produce bit-exact results with fir(),
+// the float variants differ only by rounding as FMA is used.
+//
+
+#define AVX2_FIR_TARGET __attribute__((target("avx2,fma")))
+
+static inline bool isAvx2FirSupported()
+{
+    static const bool supported =
+            __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+}
+
+// Returns true if there are AVX2 kernels for AudioResamplerDyn<TC, TI, TO>.
+template<typename TC, typename TI, typename TO>
+static constexpr bool isAvx2FirType()
+{
+    return (is_same<TC, float>::value && is_same<TI, float>::value && is_same<TO, float>::value)
+            || (is_same<TC, int16_t>::value && is_same<TI, int16_t>::value
+                    && is_same<TO, int32_t>::value);
+}
+
+AVX2_FIR_TARGET
+static inline float horizontalAddAVX2(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+AVX2_FIR_TARGET
+static inline int32_t horizontalAddAVX2(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xB1));
+    return _mm_cvtsi128_si32(v);
+}
+
+// Same as interpolate<float, float>() for 8 coefficients.
+AVX2_FIR_TARGET
+static inline __m256 interpolateAVX2(__m256 coef0, __m256 coef1, __m256 lerp)
+{
+    return _mm256_fmadd_ps(_mm256_sub_ps(coef1, coef0), lerp, coef0);
+}
+
+// Same as interpolate<int16_t, uint32_t>() for 8 coefficients, bit-exact:
+// the 32-bit product is shifted down by 15 and truncated to 16 bits.
+AVX2_FIR_TARGET
+static inline __m128i interpolateAVX2(__m128i coef0, __m128i coef1, __m128i lerp)
+{
+    const __m128i diff = _mm_sub_epi16(coef1, coef0);
+    const __m128i lo = _mm_mullo_epi16(diff, lerp);
+    const __m128i hi = _mm_mulhi_epi16(diff, lerp);
+    return _mm_add_epi16(_mm_or_si128(_mm_srli_epi16(lo, 15), _mm_slli_epi16(hi, 1)), coef0);
+}
+
+// Loads the next 8 positive and negative side coefficients, interpolated if not FIXED.
+template <bool FIXED>
+AVX2_FIR_TARGET
+static inline void loadCoefsAVX2(__m256& posCoef, __m256& negCoef,
+        const float*& coefsP, const float*& coefsN,
+        const float*& coefsP1, const float*& coefsN1, __m256 interp)
+{
+    posCoef = _mm256_loadu_ps(coefsP);
+    negCoef = _mm256_loadu_ps(coefsN);
+    coefsP += 8;
+    coefsN += 8;
+    if (!FIXED) {
+        posCoef = interpolateAVX2(posCoef, _mm256_loadu_ps(coefsP1), interp);
+        negCoef = interpolateAVX2(_mm256_loadu_ps(coefsN1), negCoef, interp);
+        coefsP1 += 8;
+        coefsN1 += 8;
+    }
+}
+
+template <bool FIXED>
+AVX2_FIR_TARGET
+static inline void loadCoefsAVX2(__m128i& posCoef, __m128i& negCoef,
+        const int16_t*& coefsP, const int16_t*& coefsN,
+        const int16_t*& coefsP1, const int16_t*& coefsN1, __m128i interp)
+{
+    posCoef = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsP));
+    negCoef = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsN));
+    coefsP += 8;
+    coefsN += 8;
+    if (!FIXED) {
+        posCoef = interpolateAVX2(posCoef,
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsP1)), interp);
+        negCoef = interpolateAVX2(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsN1)), negCoef, interp);
+        coefsP1 += 8;
+        coefsN1 += 8;
+    }
+}
+
+template <int CHANNELS, bool FIXED>
+AVX2_FIR_TARGET
+static inline void ProcessAVX2(float* out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* coefsP1,
+        const float* coefsN1,
+        const float* sP,
+        const float* sN,
+        float lerpP,
+        const float* volumeLR)
+{
+    ALOG_ASSERT(count > 0 && (count & 7) == 0); // multiple of 8
+
+    const __m256 interp = _mm256_set1_ps(lerpP);
+    __m256 posCoef, negCoef;
+
+    if (CHANNELS == 1) {
+        const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        __m256 accL = _mm256_setzero_ps();
+        sP -= 8 - 1;
+        do {
+            loadCoefsAVX2<FIXED>(posCoef, negCoef, coefsP, coefsN, coefsP1, coefsN1, interp);
+            const __m256 posSamp = _mm256_permutevar8x32_ps(_mm256_loadu_ps(sP), reverse);
+            const __m256 negSamp = _mm256_loadu_ps(sN);
+            sP -= 8;
+            sN += 8;
+            accL = _mm256_fmadd_ps(posSamp, posCoef, accL);
+            accL = _mm256_fmadd_ps(negSamp, negCoef, accL);
+        } while (count -= 8);
+
+        const float l = horizontalAddAVX2(accL);
+        out[0] += l * volumeLR[0];
+        out[1] += l * volumeLR[1];
+    } else if (CHANNELS == 2) {
+        // after the deinterleaving shuffle the frames are in order 0 1 4 5 2 3 6 7,
+        // and the positive side additionally needs to be reversed.
+        const __m256i posOrder = _mm256_setr_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+        const __m256i negOrder = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+        __m256 accL = _mm256_setzero_ps();
+        __m256 accR = _mm256_setzero_ps();
+        sP -= 2 * (8 - 1);
+        do {
+            loadCoefsAVX2<FIXED>(posCoef, negCoef, coefsP, coefsN, coefsP1, coefsN1, interp);
+            const __m256 posSamp0 = _mm256_loadu_ps(sP);
+            const __m256 posSamp1 = _mm256_loadu_ps(sP + 8);
+            const __m256 negSamp0 = _mm256_loadu_ps(sN);
+            const __m256 negSamp1 = _mm256_loadu_ps(sN + 8);
+            sP -= 16;
+            sN += 16;
+
+            const __m256 posSampL = _mm256_permutevar8x32_ps(
+                    _mm256_shuffle_ps(posSamp0, posSamp1, 0x88), posOrder);
+            const __m256 posSampR = _mm256_permutevar8x32_ps(
+                    _mm256_shuffle_ps(posSamp0, posSamp1, 0xDD), posOrder);
+            const __m256 negSampL = _mm256_permutevar8x32_ps(
+                    _mm256_shuffle_ps(negSamp0, negSamp1, 0x88), negOrder);
+            const __m256 negSampR = _mm256_permutevar8x32_ps(
+                    _mm256_shuffle_ps(negSamp0, negSamp1, 0xDD), negOrder);
+
+            accL = _mm256_fmadd_ps(posSampL, posCoef, accL);
+            accR = _mm256_fmadd_ps(posSampR, posCoef, accR);
+            accL = _mm256_fmadd_ps(negSampL, negCoef, accL);
+            accR = _mm256_fmadd_ps(negSampR, negCoef, accR);
+        } while (count -= 8);
+
+        out[0] += horizontalAddAVX2(accL) * volumeLR[0];
+        out[1] += horizontalAddAVX2(accR) * volumeLR[1];
+    } else {
+        // multichannel: vectorize across the channels of a frame, one tap at a time.
+        constexpr int kVectors = (CHANNELS + 7) / 8;
+        constexpr int kTail = CHANNELS & 7;
+        const __m256i tailMask = _mm256_cmpgt_epi32(
+                _mm256_set1_epi32(kTail), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 acc[kVectors];
+        for (int v = 0; v < kVectors; ++v) {
+            acc[v] = _mm256_setzero_ps();
+        }
+        float posTaps[8] __attribute__((aligned(32)));
+        float negTaps[8] __attribute__((aligned(32)));
+        do {
+            loadCoefsAVX2<FIXED>(posCoef, negCoef, coefsP, coefsN, coefsP1, coefsN1, interp);
+            _mm256_store_ps(posTaps, posCoef);
+            _mm256_store_ps(negTaps, negCoef);
+            for (int i = 0; i < 8; ++i) {
+                const __m256 posTap = _mm256_set1_ps(posTaps[i]);
+                const __m256 negTap = _mm256_set1_ps(negTaps[i]);
+                for (int v = 0; v < kVectors; ++v) {
+                    __m256 posSamp, negSamp;
+                    if (kTail != 0 && v == kVectors - 1) {
+                        posSamp = _mm256_maskload_ps(sP + 8 * v, tailMask);
+                        negSamp = _mm256_maskload_ps(sN + 8 * v, tailMask);
+                    } else {
+                        posSamp = _mm256_loadu_ps(sP + 8 * v);
+                        negSamp = _mm256_loadu_ps(sN + 8 * v);
+                    }
+                    acc[v] = _mm256_fmadd_ps(posSamp, posTap, acc[v]);
+                    acc[v] = _mm256_fmadd_ps(negSamp, negTap, acc[v]);
+                }
+                sP -= CHANNELS;
+                sN += CHANNELS;
+            }
+        } while (count -= 8);
+
+        float sum[kVectors * 8] __attribute__((aligned(32)));
+        for (int v = 0; v < kVectors; ++v) {
+            _mm256_store_ps(sum + 8 * v, acc[v]);
+        }
+        for (int j = 0; j < CHANNELS; ++j) {
+            out[j] += sum[j] * volumeLR[0];
+        }
+    }
+}
+
+// Loads the samples of CHANNELS channels (at most 8) as 8 int16_t, zero filled.
+template <int CHANNELS>
+AVX2_FIR_TARGET
+static inline __m128i loadChannelsAVX2(const int16_t* s)
+{
+    if (CHANNELS == 8) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    }
+    int16_t samples[8] __attribute__((aligned(16))) = {};
+    memcpy(samples, s, CHANNELS * sizeof(int16_t));
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(samples));
+}
+
+// Returns sum(coef0 * s0[j] + coef1 * s1[j]) for 8 channels j, as int32_t.
+AVX2_FIR_TARGET
+static inline __m256i madd2AVX2(__m128i s0, __m128i s1, __m256i coefs)
+{
+    const __m256i samples = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_unpacklo_epi16(s0, s1)), _mm_unpackhi_epi16(s0, s1), 1);
+    return _mm256_madd_epi16(samples, coefs);
+}
+
+// Returns the coefficient pair (coef0, coef1) replicated for _mm256_madd_epi16().
+static inline int32_t coefPairAVX2(int16_t coef0, int16_t coef1)
+{
+    return static_cast<int32_t>((static_cast<uint32_t>(static_cast<uint16_t>(coef1)) << 16)
+            | static_cast<uint16_t>(coef0));
+}
+
+template <int CHANNELS, bool FIXED>
+AVX2_FIR_TARGET
+static inline void ProcessAVX2(int32_t* out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* coefsP1,
+        const int16_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* volumeLR)
+{
+    ALOG_ASSERT(count > 0 && (count & 7) == 0); // multiple of 8
+
+    // the integer products are summed with wraparound, so the order of accumulation
+    // does not change the result.
+    const __m128i interp = _mm_set1_epi16(static_cast<int16_t>(lerpP));
+    __m128i posCoef, negCoef;
+
+    if (CHANNELS == 1) {
+        const __m128i reverse = _mm_setr_epi8(
+                14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+        __m256i acc = _mm256_setzero_si256();
+        sP -= 8 - 1;
+        do {
+            loadCoefsAVX2<FIXED>(posCoef, negCoef, coefsP, coefsN, coefsP1, coefsN1, interp);
+            const __m128i posSamp = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(sP)), reverse);
+            const __m128i negSamp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sN));
+            sP -= 8;
+            sN += 8;
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+                    _mm256_inserti128_si256(_mm256_castsi128_si256(posSamp), negSamp, 1),
+                    _mm256_inserti128_si256(_mm256_castsi128_si256(posCoef), negCoef, 1)));
+        } while (count -= 8);
+
+        const int32_t l = horizontalAddAVX2(_mm_add_epi32(
+                _mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+        out[0] += volumeAdjust(l, volumeLR[0]);
+        out[1] += volumeAdjust(l, volumeLR[1]);
+    } else if (CHANNELS == 2) {
+        // deinterleave 4 frames per 128 bit lane into L0..L3 R0..R3, the positive side
+        // reversed, then gather the L and R halves of both lanes.
+        const __m256i posShuffle = _mm256_setr_epi8(
+                12, 13, 8, 9, 4, 5, 0, 1, 14, 15, 10, 11, 6, 7, 2, 3,
+                12, 13, 8, 9, 4, 5, 0, 1, 14, 15, 10, 11, 6, 7, 2, 3);
+        const __m256i negShuffle = _mm256_setr_epi8(
+                0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+                0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+        __m256i acc = _mm256_setzero_si256();  // L in the low lane, R in the high lane
+        sP -= 2 * (8 - 1);
+        do {
+            loadCoefsAVX2<FIXED>(posCoef, negCoef, coefsP, coefsN, coefsP1, coefsN1, interp);
+            const __m256i posSamp = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sP)), posShuffle), 0x72);
+            const __m256i negSamp = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sN)), negShuffle), 0xD8);
+            sP -= 16;
+            sN += 16;
+            acc = _mm256_add_epi32(acc,
+                    _mm256_madd_epi16(posSamp, _mm256_broadcastsi128_si256(posCoef)));
+            acc = _mm256_add_epi32(acc,
+                    _mm256_madd_epi16(negSamp, _mm256_broadcastsi128_si256(negCoef)));
+        } while (count -= 8);
+
+        out[0] += volumeAdjust(horizontalAddAVX2(_mm256_castsi256_si128(acc)), volumeLR[0]);
+        out[1] += volumeAdjust(horizontalAddAVX2(_mm256_extracti128_si256(acc, 1)),
+                volumeLR[1]);
+    } else {
+        // multichannel: vectorize across the channels of a frame, two taps at a time.
+        constexpr int kVectors = (CHANNELS + 7) / 8;
+        constexpr int kTail = CHANNELS & 7;
+        __m256i acc[kVectors];
+        for (int v = 0; v < kVectors; ++v) {
+            acc[v] = _mm256_setzero_si256();
+        }
+        int16_t posTaps[8] __attribute__((aligned(16)));
+        int16_t negTaps[8] __attribute__((aligned(16)));
+        do {
+            loadCoefsAVX2<FIXED>(posCoef, negCoef, coefsP, coefsN, coefsP1, coefsN1, interp);
+            _mm_store_si128(reinterpret_cast<__m128i*>(posTaps), posCoef);
+            _mm_store_si128(reinterpret_cast<__m128i*>(negTaps), negCoef);
+            for (int i = 0; i < 8; i += 2) {
+                const __m256i posPair = _mm256_set1_epi32(
+                        coefPairAVX2(posTaps[i], posTaps[i + 1]));
+                const __m256i negPair = _mm256_set1_epi32(
+                        coefPairAVX2(negTaps[i], negTaps[i + 1]));
+                for (int v = 0; v < kVectors; ++v) {
+                    __m128i posSamp0, posSamp1, negSamp0, negSamp1;
+                    if (kTail != 0 && v == kVectors - 1) {
+                        posSamp0 = loadChannelsAVX2<kTail>(sP + 8 * v);
+                        posSamp1 = loadChannelsAVX2<kTail>(sP - CHANNELS + 8 * v);
+                        negSamp0 = loadChannelsAVX2<kTail>(sN + 8 * v);
+                        negSamp1 = loadChannelsAVX2<kTail>(sN + CHANNELS + 8 * v);
+                    } else {
+                        posSamp0 = loadChannelsAVX2<8>(sP + 8 * v);
+                        posSamp1 = loadChannelsAVX2<8>(sP - CHANNELS + 8 * v);
+                        negSamp0 = loadChannelsAVX2<8>(sN + 8 * v);
+                        negSamp1 = loadChannelsAVX2<8>(sN + CHANNELS + 8 * v);
+                    }
+                    acc[v] = _mm256_add_epi32(acc[v], madd2AVX2(posSamp0, posSamp1, posPair));
+                    acc[v] = _mm256_add_epi32(acc[v], madd2AVX2(negSamp0, negSamp1, negPair));
+                }
+                sP -= 2 * CHANNELS;
+                sN += 2 * CHANNELS;
+            }
+        } while (count -= 8);
+
+        int32_t sum[kVectors * 8] __attribute__((aligned(32)));
+        for (int v = 0; v < kVectors; ++v) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(sum + 8 * v), acc[v]);
+        }
+        for (int j = 0; j < CHANNELS; ++j) {
+            out[j] += volumeAdjust(sum[j], volumeLR[0]);
+        }
+    }
+}
+
+/*
+ * AVX2 version of fir(), see AudioResamplerFirProcess.h. Only valid for the types
+ * where isAvx2FirType() is true, and a multiple of 8 halfNumCoefs.
+ */
+template<int CHANNELS, bool LOCKED, typename TC, typename TI, typename TO>
+AVX2_FIR_TARGET
+static void firAVX2(TO* const out,
+        const uint32_t phase, const uint32_t phaseWrapLimit,
+        const int coefShift, const int halfNumCoefs, const TC* const coefs,
+        const TI* const samples, const TO* const volumeLR)
+{
+    static_assert(isAvx2FirType<TC, TI, TO>(), "no AVX2 kernel for these types");
+
+    const TI* sP = samples;
+    const TI* sN = samples + CHANNELS;
+    if (LOCKED) {
+        // locked polyphase (no interpolation)
+        uint32_t indexP = phase >> coefShift;
+        uint32_t indexN = (phaseWrapLimit - phase) >> coefShift;
+        const TC* coefsP = coefs + indexP*halfNumCoefs;
+        const TC* coefsN = coefs + indexN*halfNumCoefs;
+
+        ProcessAVX2<CHANNELS, true>(out, halfNumCoefs, coefsP, coefsN,
+                nullptr /* coefsP1 */, nullptr /* coefsN1 */, sP, sN, 0 /* lerpP */, volumeLR);
+    } else {
+        // interpolated polyphase
+        uint32_t indexP = phase >> coefShift;
+        uint32_t indexN = (phaseWrapLimit - phase - 1) >> coefShift; // one's complement.
+        const TC* coefsP = coefs + indexP*halfNumCoefs;
+        const TC* coefsN = coefs + indexN*halfNumCoefs;
+        const TC* coefsP1 = coefsP + halfNumCoefs;
+        const TC* coefsN1 = coefsN + halfNumCoefs;
+
+        if constexpr (is_same<TC, float>::value) {
+            static const float scale = 1. / (65536. * 65536.); // scale phase bits to [0.0, 1.0)
+            float lerpP = float(phase << (sizeof(phase)*8 - coefShift)) * scale;
+
+            ProcessAVX2<CHANNELS, false>(out, halfNumCoefs, coefsP, coefsN,
+                    coefsP1, coefsN1, sP, sN, lerpP, volumeLR);
+        } else {
+            uint32_t lerpP = phase << (sizeof(phase)*8 - coefShift)
+                    >> ((sizeof(phase)-sizeof(*coefs))*8 + 1);
+
+            ProcessAVX2<CHANNELS, false>(out, halfNumCoefs, coefsP, coefsN,
+                    coefsP1, coefsN1, sP, sN, lerpP, volumeLR);
+        }
+    }
+}
+
+#undef AVX2_FIR_TARGET
+
+#endif // USE_AVX2_DISPATCH
+
+} // namespace android
+
+#endif /*ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_AVX2_H*/
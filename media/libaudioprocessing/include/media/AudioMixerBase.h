@@ -330,6 +330,7 @@ public:
     void process__validate();
     void process__nop();
     void process__genericNoResampling();
+    void process__noResampleFloat();
     void process__genericResampling();
     void process__oneTrack16BitsStereoNoResampling();
 
@@ -340,6 +341,11 @@ public:
             audio_format_t mixerInFormat, audio_format_t mixerOutFormat,
             bool useStereoVolume);
 
+    static uint64_t getTrackSignature(const TrackBase *t);
+    static hook_t selectTrackHook(int name, const TrackBase *t);
+    process_hook_t selectProcessHook(bool resampling, bool all16BitsStereoNoResample,
+            bool volumeRamp, bool allFloat);
+
     static void convertMixerFormat(void *out, audio_format_t mixerOutFormat,
             void *in, audio_format_t mixerInFormat, size_t sampleCount);
 
@@ -363,6 +369,18 @@ public:
 
     // track smart pointers, by name, in increasing order of name.
     std::map<int /* name */, std::shared_ptr<TrackBase>> mTracks;
+
+    // Hooks selected by process__validate() for a given configuration of enabled tracks.
+    // The key holds getTrackSignature() of each enabled track, in mEnabled order.
+    struct MixKernel {
+        std::vector<uint64_t> key;
+        process_hook_t processHook;
+        std::vector<hook_t> trackHooks;     // in mEnabled order
+    };
+
+    // most recently selected configurations, oldest first.
+    static constexpr size_t kMaxCachedKernels = 8;
+    std::vector<MixKernel> mKernelCache;
 };
 
 }  // namespace android
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "mixer_tests"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <log/log.h>
+#include <media/AudioBufferProvider.h>
+#include <media/AudioMixerBase.h>
+
+using namespace android;
+
+namespace {
+
+constexpr size_t kFrameCount = 256;
+constexpr uint32_t kSampleRate = 48000;
+// Frames handed out per getNextBuffer() call, so that the mixer has to come back for more
+// in the middle of a block.
+constexpr size_t kMaxProviderFrames = 100;
+
+// Provides float samples that only depend on the seed and the position in the stream, so
+// two mixers reading in different chunk sizes see the same audio.
+class SignalProvider : public AudioBufferProvider {
+public:
+    SignalProvider(uint32_t seed, uint32_t channelCount)
+        : mSeed(seed), mChannelCount(channelCount) {}
+
+    status_t getNextBuffer(Buffer* buffer) override {
+        const size_t frames = std::min(buffer->frameCount, kMaxProviderFrames);
+        mData.resize(frames * mChannelCount);
+        for (size_t i = 0; i < mData.size(); ++i) {
+            // A small LCG step over the absolute sample index, scaled to [-1, 1).
+            uint32_t x = (uint32_t)(mPosition * mChannelCount + i) * 1664525u + mSeed;
+            x ^= x >> 15;
+            mData[i] = (int32_t)(x * 2654435761u) / 2147483648.f;
+        }
+        buffer->raw = mData.data();
+        buffer->frameCount = frames;
+        return OK;
+    }
+
+    void releaseBuffer(Buffer* buffer) override {
+        mPosition += buffer->frameCount;
+        buffer->raw = nullptr;
+        buffer->frameCount = 0;
+    }
+
+private:
+    const uint32_t mSeed;
+    const uint32_t mChannelCount;
+    size_t mPosition = 0;
+    std::vector<float> mData;
+};
+
+}  // namespace
+
+// Exposes the hooks of the mixer. The reference mixer selects the hooks from scratch on
+// every configuration change and mixes float tracks with process__genericNoResampling(),
+// which is how it was done before the kernel cache and process__noResampleFloat().
+class TestMixer : public AudioMixerBase {
+public:
+    TestMixer(bool reference) : AudioMixerBase(kFrameCount, kSampleRate), mReference(reference) {}
+
+    // AudioMixer::setBufferProvider() also sets up the format conversions, which the tracks
+    // here don't need.
+    void setBufferProvider(int name, AudioBufferProvider* bufferProvider) {
+        mTracks[name]->bufferProvider = bufferProvider;
+    }
+
+    bool usesNoResampleFloat() const {
+        return mHook == &TestMixer::process__noResampleFloat;
+    }
+
+    std::vector<hook_t> enabledTrackHooks() {
+        std::vector<hook_t> hooks;
+        for (const int name : mEnabled) {
+            hooks.push_back(mTracks[name]->hook);
+        }
+        return hooks;
+    }
+
+protected:
+    void preProcess() override {
+        if (!mReference) {
+            return;
+        }
+        mKernelCache.clear();
+        if (mHook == &TestMixer::process__noResampleFloat) {
+            mHook = &TestMixer::process__genericNoResampling;
+        }
+    }
+
+private:
+    const bool mReference;
+};
+
+// A set of tracks mixed by both the reference mixer and the mixer under test.
+class MixerPair {
+public:
+    explicit MixerPair(audio_channel_mask_t mixerChannelMask)
+        : mMixerChannelCount(audio_channel_count_from_out_mask(mixerChannelMask)),
+          mMixerChannelMask(mixerChannelMask) {
+        setMixerFormat(AUDIO_FORMAT_PCM_FLOAT);
+    }
+
+    void addTrack(audio_channel_mask_t channelMask, float volume) {
+        const int name = mNextName++;
+        // Without a downmixer, the track hooks read mixer channel count samples per frame,
+        // except for mono tracks.
+        const uint32_t channelCount = channelMask == AUDIO_CHANNEL_OUT_MONO
+                ? 1 : mMixerChannelCount;
+        for (size_t i = 0; i < 2; ++i) {
+            TestMixer& mixer = *mMixers[i];
+            mProviders[i].emplace_back(new SignalProvider(name + 1, channelCount));
+            ASSERT_EQ(OK, mixer.create(name, channelMask, AUDIO_FORMAT_PCM_FLOAT,
+                    AUDIO_SESSION_OUTPUT_MIX));
+            mixer.setBufferProvider(name, mProviders[i].back().get());
+            mixer.setParameter(name, AudioMixerBase::TRACK, AudioMixerBase::MIXER_CHANNEL_MASK,
+                    (void *)(uintptr_t)mMixerChannelMask);
+            mixer.setParameter(name, AudioMixerBase::TRACK, AudioMixerBase::MIXER_FORMAT,
+                    (void *)(uintptr_t)mMixerFormat);
+            mixer.setParameter(name, AudioMixerBase::TRACK, AudioMixerBase::MAIN_BUFFER,
+                    mOutputs[i].data());
+            mixer.enable(name);
+        }
+        setVolume(name, AudioMixerBase::VOLUME, volume, volume / 2);
+    }
+
+    int trackCount() const { return mNextName; }
+
+    void setVolume(int name, int target, float left, float right) {
+        for (auto& mixer : mMixers) {
+            mixer->setParameter(name, target, AudioMixerBase::VOLUME0, &left);
+            mixer->setParameter(name, target, AudioMixerBase::VOLUME1, &right);
+        }
+    }
+
+    void setEnabled(int name, bool enabled) {
+        for (auto& mixer : mMixers) {
+            if (enabled) {
+                mixer->enable(name);
+            } else {
+                mixer->disable(name);
+            }
+        }
+    }
+
+    // The format of the mix. A new main buffer goes with it, which invalidates the mixer.
+    void setMixerFormat(audio_format_t format) {
+        mMixerFormat = format;
+        for (size_t i = 0; i < 2; ++i) {
+            // A newly allocated buffer, so that the mixer sees the change.
+            mOutputs[i] = std::vector<uint8_t>(
+                    kFrameCount * mMixerChannelCount * audio_bytes_per_sample(format));
+            for (int name = 0; name < mNextName; ++name) {
+                mMixers[i]->setParameter(name, AudioMixerBase::TRACK,
+                        AudioMixerBase::MIXER_FORMAT, (void *)(uintptr_t)format);
+                mMixers[i]->setParameter(name, AudioMixerBase::TRACK,
+                        AudioMixerBase::MAIN_BUFFER, mOutputs[i].data());
+            }
+        }
+    }
+
+    void setTrackFormat(int name, audio_format_t format) {
+        for (auto& mixer : mMixers) {
+            mixer->setParameter(name, AudioMixerBase::TRACK, AudioMixerBase::FORMAT,
+                    (void *)(uintptr_t)format);
+        }
+    }
+
+    // Mixes a few buffers with both mixers and checks that the output is bit-exact.
+    void mixAndCompare(const char *step) {
+        SCOPED_TRACE(step);
+        for (int i = 0; i < 3; ++i) {
+            mMixers[0]->process();
+            mMixers[1]->process();
+            ASSERT_EQ(0, memcmp(mOutputs[0].data(), mOutputs[1].data(), mOutputs[0].size()))
+                    << "buffer " << i;
+            EXPECT_TRUE(mMixers[0]->enabledTrackHooks() == mMixers[1]->enabledTrackHooks())
+                    << "buffer " << i;
+        }
+    }
+
+    TestMixer& mixerUnderTest() { return *mMixers[1]; }
+
+private:
+    const uint32_t mMixerChannelCount;
+    const audio_channel_mask_t mMixerChannelMask;
+    audio_format_t mMixerFormat;
+    std::unique_ptr<TestMixer> mMixers[2] = {
+            std::make_unique<TestMixer>(true /*reference*/),
+            std::make_unique<TestMixer>(false /*reference*/)};
+    std::vector<std::unique_ptr<SignalProvider>> mProviders[2];
+    std::vector<uint8_t> mOutputs[2];
+    int mNextName = 0;
+};
+
+// Parameters: track count, and the track and mixer channel masks.
+using ChannelMasks = std::pair<audio_channel_mask_t, audio_channel_mask_t>;
+using MixerTestParam = std::tuple<int, ChannelMasks>;
+
+class MixerTest : public ::testing::TestWithParam<MixerTestParam> {
+protected:
+    void SetUp() override {
+        const int trackCount = std::get<0>(GetParam());
+        const audio_channel_mask_t trackChannelMask = std::get<1>(GetParam()).first;
+        mMixers = std::make_unique<MixerPair>(std::get<1>(GetParam()).second);
+        for (int i = 0; i < trackCount; ++i) {
+            mMixers->addTrack(trackChannelMask, 1.f / (i + 2));
+        }
+    }
+
+    std::unique_ptr<MixerPair> mMixers;
+};
+
+TEST_P(MixerTest, MatchesGenericMix) {
+    mMixers->mixAndCompare("initial");
+    if (mMixers->trackCount() > 1) {
+        EXPECT_TRUE(mMixers->mixerUnderTest().usesNoResampleFloat());
+    }
+}
+
+TEST_P(MixerTest, MatchesGenericMixAfterChanges) {
+    const int last = mMixers->trackCount() - 1;
+    mMixers->mixAndCompare("initial");
+
+    mMixers->setVolume(last, AudioMixerBase::VOLUME, 0.7f, 0.3f);
+    mMixers->mixAndCompare("volume");
+
+    // A ramp takes the generic path, until the next configuration change.
+    mMixers->setVolume(0, AudioMixerBase::RAMP_VOLUME, 0.2f, 0.9f);
+    mMixers->mixAndCompare("volume ramp");
+    mMixers->setVolume(0, AudioMixerBase::VOLUME, 0.5f, 0.5f);
+    mMixers->mixAndCompare("after ramp");
+
+    // Back to a configuration seen before, from the cache.
+    mMixers->setEnabled(last, false);
+    mMixers->mixAndCompare("disabled");
+    mMixers->setEnabled(last, true);
+    mMixers->mixAndCompare("enabled");
+
+    mMixers->setMixerFormat(AUDIO_FORMAT_PCM_16_BIT);
+    mMixers->mixAndCompare("16 bit mix");
+    mMixers->setMixerFormat(AUDIO_FORMAT_PCM_FLOAT);
+    mMixers->mixAndCompare("float mix");
+
+    // Any format change invalidates the mixer, even one that is undone before mixing.
+    mMixers->setTrackFormat(last, AUDIO_FORMAT_PCM_16_BIT);
+    mMixers->setTrackFormat(last, AUDIO_FORMAT_PCM_FLOAT);
+    mMixers->mixAndCompare("track format");
+
+    mMixers->setVolume(last, AudioMixerBase::VOLUME, 0.f, 0.f);
+    mMixers->mixAndCompare("muted");
+    mMixers->setVolume(last, AudioMixerBase::VOLUME, 1.f, 1.f);
+    mMixers->mixAndCompare("unmuted");
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        MixerTestAll, MixerTest,
+        ::testing::Combine(
+                ::testing::Values(1, 2, 3, 5, 8),
+                ::testing::Values(
+                        ChannelMasks(AUDIO_CHANNEL_OUT_MONO, AUDIO_CHANNEL_OUT_STEREO),
+                        ChannelMasks(AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_OUT_STEREO),
+                        ChannelMasks(AUDIO_CHANNEL_OUT_QUAD, AUDIO_CHANNEL_OUT_QUAD),
+                        ChannelMasks(AUDIO_CHANNEL_OUT_5POINT1, AUDIO_CHANNEL_OUT_5POINT1),
+                        ChannelMasks(AUDIO_CHANNEL_OUT_7POINT1, AUDIO_CHANNEL_OUT_7POINT1))));
+
+TEST(MixerTest, MixedChannelMasks) {
+    MixerPair mixers(AUDIO_CHANNEL_OUT_STEREO);
+    mixers.addTrack(AUDIO_CHANNEL_OUT_STEREO, 0.8f);
+    mixers.addTrack(AUDIO_CHANNEL_OUT_MONO, 0.6f);
+    mixers.addTrack(AUDIO_CHANNEL_OUT_STEREO, 0.4f);
+    mixers.addTrack(AUDIO_CHANNEL_OUT_MONO, 1.f);
+    mixers.mixAndCompare("initial");
+    EXPECT_TRUE(mixers.mixerUnderTest().usesNoResampleFloat());
+
+    mixers.setEnabled(1, false);
+    mixers.mixAndCompare("mono track disabled");
+    mixers.setVolume(3, AudioMixerBase::VOLUME, 0.25f, 0.75f);
+    mixers.mixAndCompare("volume");
+    mixers.setEnabled(1, true);
+    mixers.mixAndCompare("mono track enabled");
+}
@@ -15,10 +15,18 @@
  */
 
 #include <inttypes.h>
+#include <random>
 #include <type_traits>
+#include <vector>
 #define LOG_ALWAYS_FATAL(...)
 
+#include <log/log.h>
 #include <../AudioMixerOps.h>
+#include <../AudioResamplerFirOps.h>
+#include <../AudioResamplerFirProcess.h>
+#include <../AudioResamplerFirProcessNeon.h>
+#include <../AudioResamplerFirProcessSSE.h>
+#include <../AudioResamplerFirProcessAVX2.h>
 #include <benchmark/benchmark.h>
 
 using namespace android;
@@ -101,4 +109,65 @@ BENCHMARK_TEMPLATE(BM_VolumeMulti, MIXTYPE_MULTI_SAVEONLY_MONOVOL, 8);
 BENCHMARK_TEMPLATE(BM_VolumeMulti, MIXTYPE_MULTI_STEREOVOL, 8);
 BENCHMARK_TEMPLATE(BM_VolumeMulti, MIXTYPE_MULTI_SAVEONLY_STEREOVOL, 8);
 
+// Filter of the AudioResamplerDyn medium quality, computing one output frame per call.
+template <int CHANNELS, bool LOCKED, typename TC, typename TI, typename TO, bool AVX2>
+static void BM_ResamplerFir(benchmark::State& state) {
+    constexpr int HALF_NUM_COEFS = 32;
+    constexpr int COEF_SHIFT = 20;
+    constexpr uint32_t PHASES = 64;
+    constexpr uint32_t PHASE_WRAP_LIMIT = PHASES << COEF_SHIFT;
+    constexpr uint32_t PHASE_INCREMENT = LOCKED ? 1u << COEF_SHIFT : 0x1234567;
+
+    std::minstd_rand random(42);
+    std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+    std::vector<TC> coefs((PHASES + 1) * HALF_NUM_COEFS);
+    std::vector<TI> samples((2 * HALF_NUM_COEFS + 1) * CHANNELS);
+    for (TC &coef : coefs) coef = std::is_same_v<TC, float> ? dist(random) : dist(random) * 1024;
+    for (TI &sample : samples) {
+        sample = std::is_same_v<TI, float> ? dist(random) : dist(random) * 32767;
+    }
+    const TO unity = std::is_same_v<TO, float> ? 1 : 0x1000 << 16; // U4.12 for int32_t
+    const TO volumeLR[2] __attribute__((aligned(8))) = {unity, unity};
+    TO out[CHANNELS < 2 ? 2 : CHANNELS]{};
+    const TI *impulse = samples.data() + HALF_NUM_COEFS * CHANNELS;
+
+#if USE_AVX2_DISPATCH
+    if (AVX2 && !isAvx2FirSupported()) {
+        state.SkipWithError("AVX2/FMA not supported");
+        return;
+    }
+#endif
+    uint32_t phase = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(impulse);
+        benchmark::DoNotOptimize(out);
+#if USE_AVX2_DISPATCH
+        if constexpr (AVX2) {
+            firAVX2<CHANNELS, LOCKED>(out, phase, PHASE_WRAP_LIMIT,
+                    COEF_SHIFT, HALF_NUM_COEFS, coefs.data(), impulse, volumeLR);
+        } else
+#endif
+        fir<CHANNELS, LOCKED, 16>(out, phase, PHASE_WRAP_LIMIT,
+                COEF_SHIFT, HALF_NUM_COEFS, coefs.data(), impulse, volumeLR);
+        phase = (phase + PHASE_INCREMENT) % PHASE_WRAP_LIMIT;
+        benchmark::ClobberMemory();
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 1, false, float, float, float, false);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 2, true, float, float, float, false);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 2, false, float, float, float, false);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 8, false, float, float, float, false);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 2, false, int16_t, int16_t, int32_t, false);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 8, false, int16_t, int16_t, int32_t, false);
+
+#if USE_AVX2_DISPATCH
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 1, false, float, float, float, true);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 2, true, float, float, float, true);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 2, false, float, float, float, true);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 8, false, float, float, float, true);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 2, false, int16_t, int16_t, int32_t, true);
+BENCHMARK_TEMPLATE(BM_ResamplerFir, 8, false, int16_t, int16_t, int32_t, true);
+#endif
+
 BENCHMARK_MAIN();
@@ -30,6 +30,7 @@
 
 #include <iostream>
 #include <memory>
+#include <random>
 #include <utility>
 #include <vector>
 
@@ -40,6 +41,9 @@
 #include <media/AudioResampler.h>
 #include "../AudioResamplerDyn.h"
 #include "../AudioResamplerFirGen.h"
+#include "../AudioResamplerFirOps.h"
+#include "../AudioResamplerFirProcess.h"
+#include "../AudioResamplerFirProcessAVX2.h"
 #include "test_utils.h"
 
 template <typename T>
@@ -601,3 +605,89 @@ TEST(audioflinger_resampler, generalresponse) {
         }
     }
 }
+
+#if USE_AVX2_DISPATCH
+/* AVX2 filter test
+ *
+ * Compares firAVX2() against the portable fir() for random filters and input,
+ * for locked and interpolated phases. The int16_t kernels must be bit-exact,
+ * the float kernels only differ by rounding (FMA and summation order).
+ */
+template <int CHANNELS, bool LOCKED, typename TC, typename TI, typename TO>
+void testFirAVX2(int halfNumCoefs)
+{
+    constexpr int kCoefShift = 20;
+    constexpr uint32_t kPhases = 64;
+    constexpr uint32_t kPhaseWrapLimit = kPhases << kCoefShift;
+    constexpr int kOutputChannels = CHANNELS < 2 ? 2 : CHANNELS;
+    constexpr bool kFloat = std::is_same_v<TO, float>;
+
+    std::minstd_rand random(42);
+    std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+    // one extra set of coefficients for the interpolated phase
+    std::vector<TC> coefs((kPhases + 1) * halfNumCoefs);
+    std::vector<TI> samples((2 * halfNumCoefs + 1) * CHANNELS);
+    // int16_t coefficients are kept small enough that the sums cannot overflow.
+    for (TC &coef : coefs) {
+        coef = kFloat ? dist(random) : dist(random) * 1024;
+    }
+    for (TI &sample : samples) {
+        sample = kFloat ? dist(random) : dist(random) * 32767;
+    }
+    TO volumeLR[2];
+    if constexpr (kFloat) {
+        volumeLR[0] = 0.75f;
+        volumeLR[1] = 0.25f;
+    } else {
+        volumeLR[0] = 0x3000 << 16; // U4.12 in the top 16 bits, see volumeAdjust()
+        volumeLR[1] = 0x1000 << 16;
+    }
+    const TI *impulse = samples.data() + halfNumCoefs * CHANNELS;
+
+    for (int i = 0; i < 100; ++i) {
+        uint32_t phase = random() % kPhaseWrapLimit;
+        if (LOCKED) {
+            phase = phase >> kCoefShift << kCoefShift;
+        }
+        TO expected[kOutputChannels] = {};
+        TO actual[kOutputChannels] = {};
+        android::fir<CHANNELS, LOCKED, 16>(expected, phase, kPhaseWrapLimit,
+                kCoefShift, halfNumCoefs, coefs.data(), impulse, volumeLR);
+        android::firAVX2<CHANNELS, LOCKED>(actual, phase, kPhaseWrapLimit,
+                kCoefShift, halfNumCoefs, coefs.data(), impulse, volumeLR);
+        for (int j = 0; j < kOutputChannels; ++j) {
+            if constexpr (kFloat) {
+                ASSERT_NEAR(expected[j], actual[j], 1e-5 * halfNumCoefs)
+                        << "channels " << CHANNELS << " phase " << phase << " channel " << j;
+            } else {
+                ASSERT_EQ(expected[j], actual[j])
+                        << "channels " << CHANNELS << " phase " << phase << " channel " << j;
+            }
+        }
+    }
+}
+
+template <int CHANNELS>
+void testFirAVX2AllTypes()
+{
+    for (int halfNumCoefs : {8, 16, 32, 64}) {
+        testFirAVX2<CHANNELS, true, float, float, float>(halfNumCoefs);
+        testFirAVX2<CHANNELS, false, float, float, float>(halfNumCoefs);
+        testFirAVX2<CHANNELS, true, int16_t, int16_t, int32_t>(halfNumCoefs);
+        testFirAVX2<CHANNELS, false, int16_t, int16_t, int32_t>(halfNumCoefs);
+    }
+}
+
+TEST(audioflinger_resampler, fir_avx2) {
+    if (!android::isAvx2FirSupported()) {
+        GTEST_SKIP() << "AVX2/FMA not supported";
+    }
+    testFirAVX2AllTypes<1>();
+    testFirAVX2AllTypes<2>();
+    testFirAVX2AllTypes<3>();
+    testFirAVX2AllTypes<6>();
+    testFirAVX2AllTypes<8>();
+    testFirAVX2AllTypes<11>();
+    testFirAVX2AllTypes<FCC_LIMIT>();
+}
+#endif // USE_AVX2_DISPATCH
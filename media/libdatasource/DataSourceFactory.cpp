@@ -110,7 +110,12 @@ sp<DataSource> DataSourceFactory::CreateFromURI(
 
 sp<DataSource> DataSourceFactory::CreateFromFd(int fd, int64_t offset, int64_t length) {
     sp<FileSource> source = new FileSource(fd, offset, length);
-    return source->initCheck() != OK ? nullptr : source;
+    if (source->initCheck() != OK) {
+        return nullptr;
+    }
+    // only regular files get mapped, anything else keeps using read()
+    source->enableMmap();
+    return source;
 }
 
 sp<DataSource> DataSourceFactory::CreateMediaHTTP(const sp<MediaHTTPService> &httpService) {
@@ -23,18 +23,96 @@
 #include <media/stagefright/FoundationUtils.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <mutex>
 
 namespace android {
 
+// Files larger than this are mapped through a window of this size on 32-bit processes.
+static const int64_t kMmapWindowSize = 64 * 1024 * 1024;
+
+// Reading a page of a mapping past the end of a file that was truncated after it was
+// mapped raises SIGBUS. Copies out of a mapping run under a guard that turns the signal
+// into a failed copy, and the read is then served by read() instead.
+struct MmapCopyGuard {
+    sigjmp_buf mJmpBuf;
+    uintptr_t mBegin;
+    uintptr_t mEnd;
+};
+
+// volatile so that setting it around the copy is not optimized away
+static thread_local MmapCopyGuard * volatile tMmapCopyGuard = nullptr;
+static struct sigaction sPreviousSigbusAction;
+
+static void handleSigbus(int signal, siginfo_t *info, void *context) {
+    MmapCopyGuard *guard = tMmapCopyGuard;
+    uintptr_t address = (uintptr_t)info->si_addr;
+    if (guard != nullptr && address >= guard->mBegin && address < guard->mEnd) {
+        siglongjmp(guard->mJmpBuf, 1);
+    }
+
+    // not a guarded copy, pass it on
+    if (sPreviousSigbusAction.sa_flags & SA_SIGINFO) {
+        sPreviousSigbusAction.sa_sigaction(signal, info, context);
+    } else if (sPreviousSigbusAction.sa_handler != SIG_DFL
+            && sPreviousSigbusAction.sa_handler != SIG_IGN) {
+        sPreviousSigbusAction.sa_handler(signal);
+    } else {
+        // the faulting access runs again on return and takes the default action
+        struct sigaction action = {};
+        action.sa_handler = SIG_DFL;
+        sigaction(SIGBUS, &action, nullptr);
+    }
+}
+
+static void installSigbusHandler() {
+    struct sigaction action = {};
+    action.sa_sigaction = handleSigbus;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGBUS, &action, &sPreviousSigbusAction) != 0) {
+        ALOGE("failed to install SIGBUS handler (%s)", strerror(errno));
+    }
+}
+
+// Returns false if |src| can't be read because the file shrank under the mapping.
+static bool copyFromMapping(void *dst, const uint8_t *src, size_t size) {
+    static std::once_flag sInstallOnce;
+    std::call_once(sInstallOnce, installSigbusHandler);
+
+    // whole pages, since copies may read a little outside the range they write
+    const uintptr_t pageMask = getpagesize() - 1;
+    MmapCopyGuard guard;
+    guard.mBegin = (uintptr_t)src & ~pageMask;
+    guard.mEnd = ((uintptr_t)src + size + pageMask) & ~pageMask;
+    if (sigsetjmp(guard.mJmpBuf, 1 /* savemask */) != 0) {
+        tMmapCopyGuard = nullptr;
+        return false;
+    }
+    tMmapCopyGuard = &guard;
+    memcpy(dst, src, size);
+    tMmapCopyGuard = nullptr;
+    return true;
+}
+
 FileSource::FileSource(const char *filename)
     : mFd(-1),
       mUri(filename),
       mOffset(0),
       mLength(-1),
-      mName("<null>") {
+      mName("<null>"),
+      mMapBase(nullptr),
+      mMapSize(0),
+      mMapFileOffset(0),
+      mWholeFileMapped(false),
+      mMmapTruncated(false) {
 
     if (filename) {
         mName = String8::format("FileSource(%s)", filename);
@@ -53,7 +131,12 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
     : mFd(fd),
       mOffset(offset),
       mLength(length),
-      mName("<null>") {
+      mName("<null>"),
+      mMapBase(nullptr),
+      mMapSize(0),
+      mMapFileOffset(0),
+      mWholeFileMapped(false),
+      mMmapTruncated(false) {
     ALOGV("fd=%d (%s), offset=%lld, length=%lld",
             fd, nameForFd(fd).c_str(), (long long) offset, (long long) length);
 
@@ -92,6 +175,10 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
 }
 
 FileSource::~FileSource() {
+    if (mMapBase != nullptr) {
+        munmap(mMapBase, mMapSize);
+        mMapBase = nullptr;
+    }
     if (mFd >= 0) {
         ::close(mFd);
         mFd = -1;
@@ -107,6 +194,22 @@ ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
         return NO_INIT;
     }
 
+    if (mWholeFileMapped && !mMmapTruncated) {
+        // the mapping never changes, so reads need not be serialized
+        if (offset < 0) {
+            return UNKNOWN_ERROR;
+        }
+        if (offset >= mLength) {
+            return 0;  // read beyond EOF.
+        }
+        size = std::min<uint64_t>(size, mLength - offset);
+        if (copyFromMapping(data, mappedData(offset, size), size)) {
+            return size;
+        }
+        ALOGW("%s was truncated, reading it with read()", mName.string());
+        mMmapTruncated = true;
+    }
+
     Mutex::Autolock autoLock(mLock);
     if (mLength >= 0) {
         if (offset < 0) {
@@ -124,6 +227,27 @@ ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
 }
 
 ssize_t FileSource::readAt_l(off64_t offset, void *data, size_t size) {
+    if (mMapBase != nullptr && !mMmapTruncated && offset >= 0 && offset < mLength
+            && size <= (uint64_t)(mLength - offset)) {
+        const uint8_t *src = mappedData(offset, size);
+        if (src == nullptr && !mWholeFileMapped && size <= kMmapWindowSize / 2) {
+            // move the window so that it starts at the page holding |offset|
+            int64_t fileOffset = mOffset + offset;
+            fileOffset -= fileOffset % getpagesize();
+            int64_t windowSize = std::min(kMmapWindowSize, mOffset + mLength - fileOffset);
+            if (mapRange(fileOffset, windowSize)) {
+                src = mappedData(offset, size);
+            }
+        }
+        if (src != nullptr) {
+            if (copyFromMapping(data, src, size)) {
+                return size;
+            }
+            ALOGW("%s was truncated, reading it with read()", mName.string());
+            mMmapTruncated = true;
+        }
+    }
+
     off64_t result = lseek64(mFd, offset + mOffset, SEEK_SET);
     if (result == -1) {
         ALOGE("seek to %lld failed", (long long)(offset + mOffset));
@@ -145,6 +269,54 @@ status_t FileSource::getSize(off64_t *size) {
     return OK;
 }
 
+bool FileSource::enableMmap() {
+    struct stat s;
+    if (mFd < 0 || mLength <= 0 || fstat(mFd, &s) != 0 || !S_ISREG(s.st_mode)) {
+        return false;
+    }
+
+    int64_t fileOffset = mOffset - mOffset % getpagesize();
+    int64_t mapSize = mOffset + mLength - fileOffset;
+    if ((sizeof(void *) >= 8 || mapSize <= kMmapWindowSize)
+            && (uint64_t)mapSize <= SIZE_MAX && mapRange(fileOffset, mapSize)) {
+        mWholeFileMapped = true;
+        return true;
+    }
+
+    // too large for the address space, map a window at the start
+    return mapRange(fileOffset, std::min(kMmapWindowSize, mapSize));
+}
+
+bool FileSource::mapRange(int64_t fileOffset, size_t size) {
+    if (mMapBase != nullptr) {
+        munmap(mMapBase, mMapSize);
+        mMapBase = nullptr;
+        mMapSize = 0;
+    }
+
+    void *base = mmap64(nullptr, size, PROT_READ, MAP_SHARED, mFd, fileOffset);
+    if (base == MAP_FAILED) {
+        ALOGW("mmap of %zu bytes at %lld failed (%s)",
+                size, (long long)fileOffset, strerror(errno));
+        return false;
+    }
+    mMapBase = (uint8_t *)base;
+    mMapSize = size;
+    mMapFileOffset = fileOffset;
+    return true;
+}
+
+const uint8_t *FileSource::mappedData(off64_t offset, size_t size) const {
+    // callers have checked that the range is inside [0, mLength)
+    int64_t fileOffset = mOffset + offset;
+    if (mMapBase == nullptr || fileOffset < mMapFileOffset
+            || (uint64_t)(fileOffset - mMapFileOffset) > mMapSize
+            || size > mMapSize - (size_t)(fileOffset - mMapFileOffset)) {
+        return nullptr;
+    }
+    return mMapBase + (fileOffset - mMapFileOffset);
+}
+
 void FileSource::fetchUriFromFd(int fd) {
     ssize_t len = 0;
     char path[PATH_MAX] = {0};
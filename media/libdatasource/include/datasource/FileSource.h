@@ -20,6 +20,8 @@
 
 #include <stdio.h>
 
+#include <atomic>
+
 #include <media/DataSource.h>
 #include <media/stagefright/MediaErrors.h>
 #include <utils/threads.h>
@@ -50,6 +52,14 @@ public:
         return mUri;
     }
 
+    // Serves reads with memcpy() from a mapping of the file instead of with read() calls.
+    // The whole file is mapped if it fits the address space comfortably, otherwise a window
+    // that follows the reads. Must be called before the source is shared. Returns false if
+    // the file can't be mapped, in which case reads keep going through read().
+    // If someone else truncates the file, the SIGBUS raised by reading past its new end is
+    // caught, and from then on reads go through read().
+    bool enableMmap();
+
 protected:
     virtual ~FileSource();
     virtual ssize_t readAt_l(off64_t offset, void *data, size_t size);
@@ -63,6 +73,19 @@ protected:
 private:
     String8 mName;
 
+    // The mapping covers file offsets [mMapFileOffset, mMapFileOffset + mMapSize), which are
+    // absolute, not relative to mOffset. With mWholeFileMapped the mapping never changes and
+    // reads don't need mLock.
+    uint8_t *mMapBase;
+    size_t mMapSize;
+    int64_t mMapFileOffset;
+    bool mWholeFileMapped;
+    // Set once a copy from the mapping faulted.
+    std::atomic<bool> mMmapTruncated;
+
+    bool mapRange(int64_t fileOffset, size_t size);
+    const uint8_t *mappedData(off64_t offset, size_t size) const;
+
     FileSource(const FileSource &);
     FileSource &operator=(const FileSource &);
 
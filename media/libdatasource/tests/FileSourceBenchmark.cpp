@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares FileSource reads through read() with reads served from a mapping, using the
+// access pattern of an extractor parsing a large local file.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/FileSourceBenchmark/FileSourceBenchmark
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <datasource/FileSource.h>
+
+using namespace android;
+
+namespace {
+
+constexpr size_t kBoxSize = 64 * 1024;
+
+// Creates an unlinked temporary file of |size| bytes and returns its fd.
+int createFile(int64_t size) {
+    char path[] = "/data/local/tmp/FileSourceBenchmark-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        abort();
+    }
+    unlink(path);
+
+    std::vector<uint8_t> chunk(1024 * 1024);
+    std::minstd_rand random(42);
+    for (uint8_t &byte : chunk) {
+        byte = random();
+    }
+    for (int64_t written = 0; written < size; written += chunk.size()) {
+        if (write(fd, chunk.data(), chunk.size()) != (ssize_t)chunk.size()) {
+            abort();
+        }
+    }
+    return fd;
+}
+
+sp<FileSource> openSource(int fd, int64_t size, bool mmap) {
+    sp<FileSource> source = new FileSource(dup(fd), 0, size);
+    if (source->initCheck() != OK || (mmap && !source->enableMmap())) {
+        abort();
+    }
+    return source;
+}
+
+}  // namespace
+
+// Open the file and walk a chain of 8-byte box headers spread through it, as an extractor
+// does to find the moov box. Args: file size in MB, whether to map the file.
+static void BM_FileSourceOpenAndWalkHeaders(benchmark::State &state) {
+    int64_t size = state.range(0) * 1024 * 1024;
+    int fd = createFile(size);
+
+    for (auto _ : state) {
+        sp<FileSource> source = openSource(fd, size, state.range(1));
+        uint8_t header[8];
+        for (off64_t offset = 0; offset + (off64_t)sizeof(header) <= size; offset += kBoxSize) {
+            if (source->readAt(offset, header, sizeof(header)) != sizeof(header)) {
+                abort();
+            }
+            benchmark::DoNotOptimize(header);
+        }
+    }
+    state.SetLabel(state.range(1) ? "mmap" : "read");
+    close(fd);
+}
+
+// Small reads at random offsets, as done when seeking through sample tables.
+static void BM_FileSourceRandomReads(benchmark::State &state) {
+    int64_t size = state.range(0) * 1024 * 1024;
+    int fd = createFile(size);
+    sp<FileSource> source = openSource(fd, size, state.range(1));
+
+    std::minstd_rand random(42);
+    std::uniform_int_distribution<off64_t> dist(0, size - 16);
+    uint8_t entry[16];
+    for (auto _ : state) {
+        if (source->readAt(dist(random), entry, sizeof(entry)) != sizeof(entry)) {
+            abort();
+        }
+        benchmark::DoNotOptimize(entry);
+    }
+    state.SetLabel(state.range(1) ? "mmap" : "read");
+    close(fd);
+}
+
+static void FileSourceArgs(benchmark::internal::Benchmark *b) {
+    for (int sizeMb : { 16, 256 }) {
+        for (int mmap : { 0, 1 }) {
+            b->Args({sizeMb, mmap});
+        }
+    }
+}
+
+BENCHMARK(BM_FileSourceOpenAndWalkHeaders)->Apply(FileSourceArgs);
+BENCHMARK(BM_FileSourceRandomReads)->Apply(FileSourceArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FileSourceTest"
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <datasource/DataSourceFactory.h>
+#include <datasource/FileSource.h>
+#include <gtest/gtest.h>
+
+using namespace android;
+
+namespace {
+
+// Not a multiple of the page size, so that the last page of the mapping is partial
+constexpr size_t kFileSize = 3 * 1000 * 1000 + 17;
+
+}  // namespace
+
+// Reads through a mapped FileSource must return the same bytes and counts as pread() on
+// the file, for sources that start at any offset in the file.
+// Params: offset of the source in the file, bytes left out at the end of the file.
+class FileSourceTest : public ::testing::TestWithParam<std::tuple<int64_t, int64_t>> {
+  public:
+    FileSourceTest()
+        : mSourceOffset(std::get<0>(GetParam())),
+          mSourceLength(kFileSize - mSourceOffset - std::get<1>(GetParam())) {}
+
+    void SetUp() override {
+        char path[] = "/data/local/tmp/FileSourceTest-XXXXXX";
+        mFd = mkstemp(path);
+        ASSERT_GE(mFd, 0) << "failed to create " << path;
+        unlink(path);
+
+        std::vector<uint8_t> data(kFileSize);
+        std::minstd_rand random(42);
+        for (uint8_t &byte : data) {
+            byte = random();
+        }
+        ASSERT_EQ((ssize_t)data.size(), write(mFd, data.data(), data.size()));
+
+        mPlain = new FileSource(dup(mFd), mSourceOffset, mSourceLength);
+        mMapped = new FileSource(dup(mFd), mSourceOffset, mSourceLength);
+        ASSERT_EQ(OK, mPlain->initCheck());
+        ASSERT_EQ(OK, mMapped->initCheck());
+        ASSERT_TRUE(mMapped->enableMmap());
+    }
+
+    void TearDown() override {
+        mPlain.clear();
+        mMapped.clear();
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+
+    // Reads |size| bytes at |offset| of the source through the mapping and checks the
+    // result against pread() on the file and against the unmapped source.
+    void checkRead(int64_t offset, size_t size) {
+        SCOPED_TRACE(testing::Message() << "offset " << offset << " size " << size);
+        std::vector<uint8_t> mapped(size + 1, 0xa5);
+        ssize_t mappedRead = mMapped->readAt(offset, mapped.data(), size);
+
+        std::vector<uint8_t> plain(size + 1, 0xa5);
+        ssize_t plainRead = mPlain->readAt(offset, plain.data(), size);
+        ASSERT_EQ(plainRead, mappedRead);
+        if (offset < 0) {
+            ASSERT_LT(mappedRead, 0);
+            return;
+        }
+
+        const size_t expected =
+                offset >= mSourceLength ? 0 : std::min<int64_t>(size, mSourceLength - offset);
+        ASSERT_EQ((ssize_t)expected, mappedRead);
+        std::vector<uint8_t> reference(size + 1, 0xa5);
+        if (expected > 0) {
+            ASSERT_EQ((ssize_t)expected,
+                      pread64(mFd, reference.data(), expected, mSourceOffset + offset));
+        }
+        // nothing is written past the bytes read
+        ASSERT_EQ(reference, mapped);
+        ASSERT_EQ(reference, plain);
+    }
+
+    const int64_t mSourceOffset;
+    const int64_t mSourceLength;
+    int mFd = -1;
+    sp<FileSource> mPlain;
+    sp<FileSource> mMapped;
+};
+
+TEST_P(FileSourceTest, ReadsAroundEnd) {
+    for (int64_t offset : {mSourceLength - 1, mSourceLength, mSourceLength + 1,
+                           mSourceLength + 4096}) {
+        for (size_t size : {0, 1, 2, 4096, 70000}) {
+            ASSERT_NO_FATAL_FAILURE(checkRead(offset, size));
+        }
+    }
+    // reads that start before the end and cross it
+    for (int64_t before : {1, 2, 7, 4096, 4097}) {
+        ASSERT_NO_FATAL_FAILURE(checkRead(mSourceLength - before, before + 1));
+        ASSERT_NO_FATAL_FAILURE(checkRead(mSourceLength - before, before + 10000));
+    }
+}
+
+TEST_P(FileSourceTest, ReadsAroundStart) {
+    for (int64_t offset : {-4096, -1, 0, 1}) {
+        for (size_t size : {0, 1, 8, 4096}) {
+            ASSERT_NO_FATAL_FAILURE(checkRead(offset, size));
+        }
+    }
+    ASSERT_NO_FATAL_FAILURE(checkRead(0, mSourceLength));
+    ASSERT_NO_FATAL_FAILURE(checkRead(0, mSourceLength + 1));
+}
+
+TEST_P(FileSourceTest, RandomReads) {
+    std::minstd_rand random(mSourceOffset);
+    std::uniform_int_distribution<int64_t> offsets(-16, mSourceLength + 16);
+    std::uniform_int_distribution<size_t> sizes(0, 70000);
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_NO_FATAL_FAILURE(checkRead(offsets(random), sizes(random)));
+    }
+}
+
+// Truncating the file under a mapping must not crash readers, the source falls back to
+// read() and returns what is left of the file like an unmapped source does.
+TEST_P(FileSourceTest, ReadsAfterTruncation) {
+    const int64_t truncatedLength = mSourceLength / 2;
+    ASSERT_EQ(0, ftruncate(mFd, mSourceOffset + truncatedLength));
+
+    std::minstd_rand random(mSourceOffset);
+    std::uniform_int_distribution<int64_t> offsets(0, mSourceLength + 16);
+    std::uniform_int_distribution<size_t> sizes(0, 70000);
+    // the first read is past the pages still backed by the file, so it always faults
+    std::vector<std::pair<int64_t, size_t>> reads = {{mSourceLength - 8192, 4096}};
+    for (int i = 0; i < 200; ++i) {
+        reads.emplace_back(offsets(random), sizes(random));
+    }
+    for (const auto &[offset, size] : reads) {
+        SCOPED_TRACE(testing::Message() << "offset " << offset << " size " << size);
+        std::vector<uint8_t> mapped(size, 0xa5);
+        std::vector<uint8_t> plain(size, 0xa5);
+        ASSERT_EQ(mPlain->readAt(offset, plain.data(), size),
+                  mMapped->readAt(offset, mapped.data(), size));
+        ASSERT_EQ(plain, mapped);
+    }
+}
+
+// Sources made for fds of regular files are mapped, and read like unmapped ones.
+TEST_P(FileSourceTest, CreateFromFdReads) {
+    sp<DataSource> source =
+            DataSourceFactory::getInstance()->CreateFromFd(dup(mFd), mSourceOffset, mSourceLength);
+    ASSERT_NE(nullptr, source);
+    mMapped = static_cast<FileSource *>(source.get());
+    ASSERT_NO_FATAL_FAILURE(checkRead(0, mSourceLength));
+    ASSERT_NO_FATAL_FAILURE(checkRead(mSourceLength - 5, 10));
+}
+
+INSTANTIATE_TEST_SUITE_P(FileSourceTestAll, FileSourceTest,
+                         ::testing::Combine(::testing::Values(0, 1, 4096, 5000),
+                                            ::testing::Values(0, 3)));
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DownmixMatrix"
+//#define LOG_NDEBUG 0
+#include <log/log.h>
+
+#include <array>
+#include <math.h>
+#include <string.h>
+#include <utility>
+
+#include "DownmixMatrix.h"
+
+namespace android {
+
+namespace {
+
+/*
+ * Generic vector types, lowered by the compiler to NEON on ARM and SSE on x86.
+ */
+typedef float Float4 __attribute__((vector_size(4 * sizeof(float))));
+typedef float Float2 __attribute__((vector_size(2 * sizeof(float))));
+typedef int32_t Int4 __attribute__((vector_size(4 * sizeof(int32_t))));
+
+#define DOWNMIX_ALWAYS_INLINE inline __attribute__((always_inline))
+
+constexpr float COEF_25 = 0.2508909536f;
+constexpr float COEF_35 = 0.3543928915f;
+constexpr float COEF_36 = 0.3552343859f;
+constexpr float COEF_61 = 0.6057043428f;
+
+// Left and right coefficients of each channel position, indexed by the bit of the channel.
+constexpr float kScaleFromChannelIdx[FCC_26][FCC_2] = {
+    {1.f, 0.f},              // AUDIO_CHANNEL_OUT_FRONT_LEFT            = 0x1u,
+    {0.f, 1.f},              // AUDIO_CHANNEL_OUT_FRONT_RIGHT           = 0x2u,
+    {M_SQRT1_2, M_SQRT1_2},  // AUDIO_CHANNEL_OUT_FRONT_CENTER          = 0x4u,
+    {0.5f, 0.5f},            // AUDIO_CHANNEL_OUT_LOW_FREQUENCY         = 0x8u,
+    {M_SQRT1_2, 0.f},        // AUDIO_CHANNEL_OUT_BACK_LEFT             = 0x10u,
+    {0.f, M_SQRT1_2},        // AUDIO_CHANNEL_OUT_BACK_RIGHT            = 0x20u,
+    {COEF_61, COEF_25},      // AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER  = 0x40u,
+    {COEF_25, COEF_61},      // AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER = 0x80u,
+    {0.5f, 0.5f},            // AUDIO_CHANNEL_OUT_BACK_CENTER           = 0x100u,
+    {M_SQRT1_2, 0.f},        // AUDIO_CHANNEL_OUT_SIDE_LEFT             = 0x200u,
+    {0.f, M_SQRT1_2},        // AUDIO_CHANNEL_OUT_SIDE_RIGHT            = 0x400u,
+    {COEF_36, COEF_36},      // AUDIO_CHANNEL_OUT_TOP_CENTER            = 0x800u,
+    {1.f, 0.f},              // AUDIO_CHANNEL_OUT_TOP_FRONT_LEFT        = 0x1000u,
+    {M_SQRT1_2, M_SQRT1_2},  // AUDIO_CHANNEL_OUT_TOP_FRONT_CENTER      = 0x2000u,
+    {0.f, 1.f},              // AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT       = 0x4000u,
+    {M_SQRT1_2, 0.f},        // AUDIO_CHANNEL_OUT_TOP_BACK_LEFT         = 0x8000u,
+    {COEF_35, COEF_35},      // AUDIO_CHANNEL_OUT_TOP_BACK_CENTER       = 0x10000u,
+    {0.f, M_SQRT1_2},        // AUDIO_CHANNEL_OUT_TOP_BACK_RIGHT        = 0x20000u,
+    {COEF_61, 0.f},          // AUDIO_CHANNEL_OUT_TOP_SIDE_LEFT         = 0x40000u,
+    {0.f, COEF_61},          // AUDIO_CHANNEL_OUT_TOP_SIDE_RIGHT        = 0x80000u,
+    {1.f, 0.f},              // AUDIO_CHANNEL_OUT_BOTTOM_FRONT_LEFT     = 0x100000u,
+    {M_SQRT1_2, M_SQRT1_2},  // AUDIO_CHANNEL_OUT_BOTTOM_FRONT_CENTER   = 0x200000u,
+    {0.f, 1.f},              // AUDIO_CHANNEL_OUT_BOTTOM_FRONT_RIGHT    = 0x400000u,
+    {0.f, M_SQRT1_2},        // AUDIO_CHANNEL_OUT_LOW_FREQUENCY_2       = 0x800000u,
+    {M_SQRT1_2, 0.f},        // AUDIO_CHANNEL_OUT_FRONT_WIDE_LEFT       = 0x1000000u,
+    {0.f, M_SQRT1_2},        // AUDIO_CHANNEL_OUT_FRONT_WIDE_RIGHT      = 0x2000000u,
+};
+
+constexpr uint32_t kMaximumChannelMask = (1u << FCC_26) - 1;
+
+// Loads the chunk-th group of 4 channels of a frame, with the lanes past the last channel
+// cleared. With OVERREAD the last group is read whole, which is only allowed when the
+// buffer holds at least 3 more floats, and the extra lanes are masked off.
+template <size_t N, bool OVERREAD>
+DOWNMIX_ALWAYS_INLINE void loadChunk(Float4& v, const float* frame, size_t chunk) {
+    constexpr size_t kTail = N % 4;
+    if (chunk < N / 4) {
+        memcpy(&v, frame + 4 * chunk, sizeof(v));
+    } else if constexpr (OVERREAD) {
+        constexpr Int4 kMask = {-(kTail > 0), -(kTail > 1), -(kTail > 2), 0};
+        memcpy(&v, frame + 4 * chunk, sizeof(v));
+        v = (Float4)((Int4)v & kMask);
+    } else {
+        v = Float4{};
+        memcpy(&v, frame + 4 * chunk, kTail * sizeof(float));
+    }
+}
+
+template <typename V>
+DOWNMIX_ALWAYS_INLINE void clampToUnity(V& v) {
+    const V one = V{} + 1.f;
+    v = v > one ? one : v;
+    v = v < -one ? -one : v;
+}
+
+/*
+ * Folds pairCount pairs of N channel frames to stereo. The left and right sums of a frame
+ * are each kept in a 4 lane vector, and the two frames are reduced together so that their
+ * four outputs end up in one vector, which is also the layout of two stereo frames.
+ */
+template <size_t N, bool ACCUMULATE, bool OVERREAD>
+DOWNMIX_ALWAYS_INLINE void foldFramePairs(const float*& src, float*& dst, size_t pairCount,
+                                          const Float4* cl, const Float4* cr) {
+    constexpr size_t kChunks = (N + 3) / 4;
+    for (; pairCount > 0; --pairCount) {
+        Float4 aL{}, aR{}, bL{}, bR{};
+        for (size_t c = 0; c < kChunks; ++c) {
+            Float4 a, b;
+            loadChunk<N, OVERREAD>(a, src, c);
+            loadChunk<N, OVERREAD>(b, src + N, c);
+            aL += a * cl[c];
+            aR += a * cr[c];
+            bL += b * cl[c];
+            bR += b * cr[c];
+        }
+        // (aL0 + aL2, aR0 + aR2, aL1 + aL3, aR1 + aR3), same for b
+        const Float4 a = __builtin_shufflevector(aL, aR, 0, 4, 1, 5)
+                + __builtin_shufflevector(aL, aR, 2, 6, 3, 7);
+        const Float4 b = __builtin_shufflevector(bL, bR, 0, 4, 1, 5)
+                + __builtin_shufflevector(bL, bR, 2, 6, 3, 7);
+        Float4 out = __builtin_shufflevector(a, b, 0, 1, 4, 5)
+                + __builtin_shufflevector(a, b, 2, 3, 6, 7);
+        if constexpr (ACCUMULATE) {
+            Float4 previous;
+            memcpy(&previous, dst, sizeof(previous));
+            out += previous;
+        }
+        clampToUnity(out);
+        memcpy(dst, &out, sizeof(out));
+        src += 2 * N;
+        dst += 2 * FCC_2;
+    }
+}
+
+template <size_t N, bool ACCUMULATE>
+void fold(const float* src, float* dst, size_t frameCount, const float* left,
+          const float* right) {
+    constexpr size_t kChunks = (N + 3) / 4;
+    Float4 cl[kChunks];
+    Float4 cr[kChunks];
+    for (size_t c = 0; c < kChunks; ++c) {
+        memcpy(&cl[c], left + 4 * c, sizeof(Float4));
+        memcpy(&cr[c], right + 4 * c, sizeof(Float4));
+    }
+
+    // Frames that must follow a pair for the whole vector reads of its last channels to
+    // stay inside the buffer. The last frames are read exactly.
+    constexpr size_t kOverreadFrames = N % 4 == 0 ? 0 : (3 + N - 1) / N;
+    const size_t fastPairs =
+            frameCount >= 2 + kOverreadFrames ? (frameCount - kOverreadFrames) / 2 : 0;
+    foldFramePairs<N, ACCUMULATE, true>(src, dst, fastPairs, cl, cr);
+    frameCount -= 2 * fastPairs;
+    foldFramePairs<N, ACCUMULATE, false>(src, dst, frameCount / 2, cl, cr);
+
+    if (frameCount & 1) {
+        Float4 aL{}, aR{};
+        for (size_t c = 0; c < kChunks; ++c) {
+            Float4 a;
+            loadChunk<N, false>(a, src, c);
+            aL += a * cl[c];
+            aR += a * cr[c];
+        }
+        const Float4 a = __builtin_shufflevector(aL, aR, 0, 4, 1, 5)
+                + __builtin_shufflevector(aL, aR, 2, 6, 3, 7);
+        Float2 out = __builtin_shufflevector(a, a, 0, 1) + __builtin_shufflevector(a, a, 2, 3);
+        if constexpr (ACCUMULATE) {
+            Float2 previous;
+            memcpy(&previous, dst, sizeof(previous));
+            out += previous;
+        }
+        clampToUnity(out);
+        memcpy(dst, &out, sizeof(out));
+    }
+}
+
+using FoldFunction = void (*)(const float* src, float* dst, size_t frameCount,
+                              const float* left, const float* right);
+
+// Kernels indexed by channel count - 1, then by accumulate.
+template <size_t... I>
+constexpr auto makeFoldTable(std::index_sequence<I...>) {
+    return std::array<std::array<FoldFunction, 2>, sizeof...(I)>{
+            {{fold<I + 1, false>, fold<I + 1, true>}...}};
+}
+
+constexpr auto kFoldTable =
+        makeFoldTable(std::make_index_sequence<DownmixMatrix::kMaxInputChannels>());
+
+}  // namespace
+
+bool DownmixMatrix::setInputChannelMask(audio_channel_mask_t inputChannelMask) {
+    if (inputChannelMask == mInputChannelMask && mInputChannelCount != 0) {
+        return true;
+    }
+    if (inputChannelMask == AUDIO_CHANNEL_NONE || (inputChannelMask & ~kMaximumChannelMask)) {
+        ALOGE("%s: unsupported channel mask %#x", __func__, inputChannelMask);
+        return false;
+    }
+
+    // With a second LFE channel, each LFE goes to one side only.
+    const bool hasLfe2 = (inputChannelMask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY_2) != 0;
+    memset(mMatrix, 0, sizeof(mMatrix));
+    size_t channel = 0;
+    for (uint32_t mask = inputChannelMask; mask != 0; ++channel) {
+        const int index = __builtin_ctz(mask);
+        const uint32_t channelBit = 1u << index;
+        mask &= ~channelBit;
+        if (hasLfe2 && channelBit == AUDIO_CHANNEL_OUT_LOW_FREQUENCY) {
+            mMatrix[0][channel] = M_SQRT1_2;
+            mMatrix[1][channel] = 0.f;
+        } else {
+            mMatrix[0][channel] = kScaleFromChannelIdx[index][0];
+            mMatrix[1][channel] = kScaleFromChannelIdx[index][1];
+        }
+    }
+    mInputChannelMask = inputChannelMask;
+    mInputChannelCount = channel;
+    ALOGV("%s: mask %#x, %zu channels", __func__, inputChannelMask, channel);
+    return true;
+}
+
+bool DownmixMatrix::process(const float* src, float* dst, size_t frameCount,
+                            bool accumulate) const {
+    if (mInputChannelCount == 0) {
+        return false;
+    }
+    kFoldTable[mInputChannelCount - 1][accumulate](src, dst, frameCount, mMatrix[0],
+                                                   mMatrix[1]);
+    return true;
+}
+
+}  // namespace android
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DOWNMIXMATRIX_H_
+#define ANDROID_DOWNMIXMATRIX_H_
+
+#include <stddef.h>
+
+#include <system/audio.h>
+
+namespace android {
+
+/*
+ * Folds an interleaved multichannel float stream to stereo.
+ *
+ * The left and right coefficients of every input channel are computed once when the
+ * input channel mask is set, so processing is a plain 2 x N matrix multiply. The kernel
+ * is instantiated for every channel count up to FCC_26 and works on two frames at a time
+ * with 4 lane vectors, so all the masks accepted by the downmix effect take the same
+ * vectorized path. The output is clamped to [-1, 1].
+ *
+ * The object holds no pointers and is valid when zero initialized, with no input mask.
+ */
+class DownmixMatrix {
+  public:
+    static constexpr size_t kMaxInputChannels = FCC_26;
+
+    /*
+     * Computes the matrix for a channel position mask. Returns false, leaving the
+     * object unchanged, if the mask is empty or has channels above FCC_26.
+     */
+    bool setInputChannelMask(audio_channel_mask_t inputChannelMask);
+
+    audio_channel_mask_t getInputChannelMask() const { return mInputChannelMask; }
+    size_t getInputChannelCount() const { return mInputChannelCount; }
+
+    /*
+     * Coefficient of the inputChannel-th channel of the mask on output channel 0 (left)
+     * or 1 (right).
+     */
+    float getCoefficient(size_t inputChannel, size_t outputChannel) const {
+        return mMatrix[outputChannel][inputChannel];
+    }
+
+    /*
+     * Folds frameCount frames from src to the stereo buffer dst, adding to its contents
+     * if accumulate is true. Returns false if no input mask is set.
+     */
+    bool process(const float* src, float* dst, size_t frameCount, bool accumulate) const;
+
+  private:
+    // Rows are padded with zeros to a whole number of vectors
+    static constexpr size_t kMaxPaddedChannels = (kMaxInputChannels + 3) & ~size_t(3);
+
+    audio_channel_mask_t mInputChannelMask = AUDIO_CHANNEL_NONE;
+    size_t mInputChannelCount = 0;
+    float mMatrix[FCC_2][kMaxPaddedChannels] = {};
+};
+
+}  // namespace android
+
+#endif  // ANDROID_DOWNMIXMATRIX_H_
@@ -18,8 +18,8 @@
 //#define LOG_NDEBUG 0
 #include <log/log.h>
 
+#include "DownmixMatrix.h"
 #include "EffectDownmix.h"
-#include <audio_utils/ChannelMix.h>
 
 // Do not submit with DOWNMIX_TEST_CHANNEL_INDEX defined, strictly for testing
 //#define DOWNMIX_TEST_CHANNEL_INDEX 0
@@ -40,7 +40,7 @@ struct downmix_object_t {
     downmix_type_t type;
     bool apply_volume_correction;
     uint8_t input_channel_count;
-    android::audio_utils::channels::ChannelMix channelMix;
+    android::DownmixMatrix matrix;   // fold coefficients for the input channel mask
 };
 
 typedef struct downmix_module_s {
@@ -343,8 +343,6 @@ static int32_t Downmix_Process(effect_handle_t self,
 
     const bool accumulate =
             (pDwmModule->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE);
-    const audio_channel_mask_t downmixInputChannelMask =
-            (audio_channel_mask_t)pDwmModule->config.inputCfg.channels;
 
     switch(pDownmixer->type) {
 
@@ -369,10 +367,9 @@ static int32_t Downmix_Process(effect_handle_t self,
           break;
 
       case DOWNMIX_TYPE_FOLD: {
-            if (!pDownmixer->channelMix.process(
-                    pSrc, pDst, numFrames, accumulate, downmixInputChannelMask)) {
+            if (!pDownmixer->matrix.process(pSrc, pDst, numFrames, accumulate)) {
                 ALOGE("Multichannel configuration %#x is not supported",
-                      downmixInputChannelMask);
+                      pDwmModule->config.inputCfg.channels);
                 return -EINVAL;
             }
         }
@@ -656,6 +653,12 @@ static int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pCon
         return -EINVAL;
     }
 
+    // the fold matrix only depends on the input channel mask, compute it once here
+    if (!pDownmixer->matrix.setInputChannelMask(
+            (audio_channel_mask_t)pConfig->inputCfg.channels)) {
+        return -EINVAL;
+    }
+
     if (&pDwmModule->config != pConfig) {
         memcpy(&pDwmModule->config, pConfig, sizeof(effect_config_t));
     }
@@ -18,6 +18,7 @@
 #include <vector>
 
 #include <audio_effects/effect_downmix.h>
+#include <audio_utils/ChannelMix.h>
 #include <audio_utils/channels.h>
 #include <audio_utils/primitives.h>
 #include <audio_utils/Statistics.h>
@@ -60,7 +61,7 @@ static constexpr effect_uuid_t downmix_uuid = {
 static constexpr size_t kFrameCount = 1000;
 
 /*
-Pixel 4XL
+Pixel 4XL, with the fold done by audio_utils ChannelMix (now BM_ChannelMix)
 $ adb shell /data/benchmarktest/downmix_benchmark/vendor/downmix_benchmark
 
 --------------------------------------------------------
@@ -90,6 +91,13 @@ BM_Downmix/20      16693 ns        16624 ns        42109 AUDIO_CHANNEL_OUT_13POI
 BM_Downmix/21      28267 ns        28116 ns        24982 AUDIO_CHANNEL_OUT_22POINT2
 */
 
+// Time per input frame, to compare layouts with each other.
+static void setFrameTimeCounter(benchmark::State& state) {
+    state.counters["time/frame"] = benchmark::Counter(
+            kFrameCount, benchmark::Counter::kIsIterationInvariantRate
+                    | benchmark::Counter::kInvert);
+}
+
 static void BM_Downmix(benchmark::State& state) {
     const audio_channel_mask_t channelMask = kChannelPositionMasks[state.range(0)];
     const size_t channelCount = audio_channel_count_from_out_mask(channelMask);
@@ -163,6 +171,7 @@ static void BM_Downmix(benchmark::State& state) {
 
     state.SetComplexityN(channelCount);
     state.SetLabel(audio_channel_out_mask_to_string(channelMask));
+    setFrameTimeCounter(state);
 
     if (int status = AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effectHandle); status != 0) {
         ALOGE("release_effect returned an error = %d\n", status);
@@ -178,4 +187,37 @@ static void DownmixArgs(benchmark::internal::Benchmark* b) {
 
 BENCHMARK(BM_Downmix)->Apply(DownmixArgs);
 
+// Reference: the same fold through audio_utils ChannelMix, which the effect used before
+// the per mask coefficient matrix.
+static void BM_ChannelMix(benchmark::State& state) {
+    const audio_channel_mask_t channelMask = kChannelPositionMasks[state.range(0)];
+    const size_t channelCount = audio_channel_count_from_out_mask(channelMask);
+
+    std::minstd_rand gen(channelMask);
+    std::uniform_real_distribution<> dis(-1.0f, 1.0f);
+    std::vector<float> input(kFrameCount * channelCount);
+    std::vector<float> output(kFrameCount * FCC_2);
+    for (auto& in : input) {
+        in = dis(gen);
+    }
+
+    android::audio_utils::channels::ChannelMix channelMix;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(input.data());
+        benchmark::DoNotOptimize(output.data());
+        if (!channelMix.process(input.data(), output.data(), kFrameCount,
+                false /* accumulate */, channelMask)) {
+            state.SkipWithError("unsupported channel mask");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.SetComplexityN(channelCount);
+    state.SetLabel(audio_channel_out_mask_to_string(channelMask));
+    setFrameTimeCounter(state);
+}
+
+BENCHMARK(BM_ChannelMix)->Apply(DownmixArgs);
+
 BENCHMARK_MAIN();
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <random>
 #include <vector>
 
 #include "EffectDownmix.h"
@@ -229,6 +230,59 @@ public:
         }
     }
 
+    // Compares every output sample with the fold of the input through the coefficients
+    // of the channel positions. The frame count is split in blocks with an odd tail.
+    void testMatrix(int sampleRate, audio_channel_mask_t channelMask, bool accumulate) {
+        constexpr size_t frames = 1001;
+        const unsigned inChannels = audio_channel_count_from_out_mask(channelMask);
+        std::vector<float> input(frames * inChannels);
+        std::vector<float> output(frames * FCC_2);
+
+        // Small enough for the sums to never be clamped.
+        std::minstd_rand gen(channelMask);
+        std::uniform_real_distribution<float> dis(-0.03f, 0.03f);
+        for (auto& in : input) {
+            in = dis(gen);
+        }
+        for (auto& out : output) {
+            out = dis(gen);
+        }
+
+        std::vector<float> expected(frames * FCC_2);
+        for (size_t i = 0; i < frames; ++i) {
+            double sums[FCC_2]{};
+            if (accumulate) {
+                sums[0] = output[i * FCC_2];
+                sums[1] = output[i * FCC_2 + 1];
+            }
+            unsigned k = 0;
+            for (unsigned channel = channelMask; channel != 0; ++k) {
+                const int index = __builtin_ctz(channel);
+                const unsigned channelBit = 1u << index;
+                channel &= ~channelBit;
+                double left = kScaleFromChannelIdxLeft[index];
+                double right = kScaleFromChannelIdxRight[index];
+                // With a second LFE channel, each LFE goes to one side only.
+                if (channelBit == AUDIO_CHANNEL_OUT_LOW_FREQUENCY
+                        && (channelMask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY_2)) {
+                    left = M_SQRT1_2;
+                    right = 0.;
+                }
+                sums[0] += left * input[i * inChannels + k];
+                sums[1] += right * input[i * inChannels + k];
+            }
+            expected[i * FCC_2] = sums[0];
+            expected[i * FCC_2 + 1] = sums[1];
+        }
+
+        accumulate_ = accumulate;
+        run(sampleRate, channelMask, input, output, frames);
+        accumulate_ = false;
+        for (size_t i = 0; i < output.size(); ++i) {
+            ASSERT_NEAR(expected[i], output[i], 1e-5f) << "sample " << i;
+        }
+    }
+
     void run(int sampleRate, audio_channel_mask_t channelMask,
             std::vector<float>& input, std::vector<float>& output, size_t frames) {
         reconfig(sampleRate, channelMask);
@@ -290,7 +344,8 @@ private:
         config_.inputCfg.bufferProvider.cookie = nullptr;
         config_.inputCfg.mask = EFFECT_CONFIG_ALL;
 
-        config_.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
+        config_.outputCfg.accessMode =
+                accumulate_ ? EFFECT_BUFFER_ACCESS_ACCUMULATE : EFFECT_BUFFER_ACCESS_WRITE;
         config_.outputCfg.format = AUDIO_FORMAT_PCM_FLOAT;
         config_.outputCfg.bufferProvider.getBuffer = nullptr;
         config_.outputCfg.bufferProvider.releaseBuffer = nullptr;
@@ -323,6 +378,7 @@ private:
 
     effect_handle_t handle_{};
     effect_config_t config_{};
+    bool accumulate_ = false;
     int outputChannelCount_{};
     int inputChannelCount_{};
 };
@@ -342,6 +398,16 @@ TEST_P(DownmixTest, basic) {
             kChannelPositionMasks[std::get<1>(GetParam())]);
 }
 
+TEST_P(DownmixTest, matrix) {
+    testMatrix(kSampleRates[std::get<0>(GetParam())],
+            kChannelPositionMasks[std::get<1>(GetParam())], false /* accumulate */);
+}
+
+TEST_P(DownmixTest, matrixAccumulate) {
+    testMatrix(kSampleRates[std::get<0>(GetParam())],
+            kChannelPositionMasks[std::get<1>(GetParam())], true /* accumulate */);
+}
+
 INSTANTIATE_TEST_SUITE_P(
         DownmixTestAll, DownmixTest,
         ::testing::Combine(
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <dsp/DPFrequency.h>
+
+// Same block as the effect with its default 10 ms frame duration at 48 kHz
+constexpr size_t kSampleRate = 48000;
+constexpr size_t kBlockSize = 512;
+constexpr size_t kOverlapSize = kBlockSize / 2;
+// Frames per iteration, a whole number of blocks past the overlap
+constexpr size_t kFrameCount = 4 * (kBlockSize - kOverlapSize);
+
+constexpr size_t kChannelCounts[] = {1, 2, 6, 8};
+constexpr size_t kBandCounts[] = {3, 6};
+
+// Cutoff frequencies of the bands, the last one reaches the Nyquist bin
+constexpr float kCutoffs3Bands[] = {250, 4000, 24000};
+constexpr float kCutoffs6Bands[] = {100, 250, 1000, 4000, 10000, 24000};
+
+// All the stages in use and enabled, with every band changing the signal.
+static void configureStages(dp_fx::DPFrequency& dp, size_t channelCount, size_t bandCount) {
+    const float* cutoffs = bandCount == 3 ? kCutoffs3Bands : kCutoffs6Bands;
+    dp.init(channelCount, true /* preEqInUse */, bandCount, true /* mbcInUse */, bandCount,
+            true /* postEqInUse */, bandCount, true /* limiterInUse */);
+    for (size_t ch = 0; ch < channelCount; ch++) {
+        dp_fx::DPChannel* channel = dp.getChannel(ch);
+        channel->setInputGain(-3);
+        channel->setOutputGain(1);
+        channel->getPreEq()->setEnabled(true);
+        channel->getMbc()->setEnabled(true);
+        channel->getPostEq()->setEnabled(true);
+        for (size_t b = 0; b < bandCount; b++) {
+            dp_fx::DPEqBand eqBand;
+            eqBand.init(true /* enabled */, cutoffs[b], (b % 2) ? 3 : -2);
+            channel->getPreEq()->setBand(b, eqBand);
+            eqBand.setGain((b % 2) ? -1 : 2);
+            channel->getPostEq()->setBand(b, eqBand);
+
+            dp_fx::DPMbcBand mbcBand;
+            mbcBand.init(true /* enabled */, cutoffs[b], 3 /* attackTime */,
+                    80 /* releaseTime */, 4 /* ratio */, -24 /* threshold */,
+                    6 /* kneeWidth */, -70 /* noiseGateThreshold */, 2 /* expanderRatio */,
+                    1 /* preGain */, 2 /* postGain */);
+            channel->getMbc()->setBand(b, mbcBand);
+        }
+        dp_fx::DPLimiter limiter;
+        limiter.init(true /* inUse */, true /* enabled */, 0 /* linkGroup */,
+                1 /* attackTime */, 60 /* releaseTime */, 10 /* ratio */, -6 /* threshold */,
+                0 /* postGain */);
+        channel->setLimiter(limiter);
+    }
+    dp.configure(kBlockSize, kOverlapSize, kSampleRate);
+}
+
+/*
+ * Processes kFrameCount frames per iteration with pre EQ, MBC and post EQ using the same
+ * band count, and the limiters linked. "time/block" is the CPU time of one block of all
+ * the channels.
+ * The first parameter is the channel count, the second one the band count.
+ */
+static void BM_DPFrequency(benchmark::State& state) {
+    const size_t channelCount = state.range(0);
+    const size_t bandCount = state.range(1);
+
+    std::minstd_rand gen(channelCount * 10 + bandCount);
+    std::uniform_real_distribution<> dis(-1.0f, 1.0f);
+    std::vector<float> input(kFrameCount * channelCount);
+    std::vector<float> output(kFrameCount * channelCount);
+    for (auto& in : input) {
+        in = dis(gen);
+    }
+
+    dp_fx::DPFrequency dp;
+    configureStages(dp, channelCount, bandCount);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(input.data());
+        benchmark::DoNotOptimize(output.data());
+        dp.processSamples(input.data(), output.data(), input.size());
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["time/block"] = benchmark::Counter(
+            kFrameCount / (kBlockSize - kOverlapSize),
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+    state.SetComplexityN(channelCount * bandCount);
+}
+
+static void DPFrequencyArgs(benchmark::internal::Benchmark* b) {
+    for (size_t channelCount : kChannelCounts) {
+        for (size_t bandCount : kBandCounts) {
+            b->Args({(int)channelCount, (int)bandCount});
+        }
+    }
+}
+
+BENCHMARK(BM_DPFrequency)->Apply(DPFrequencyArgs);
+
+BENCHMARK_MAIN();
@@ -46,6 +46,42 @@ template <> bool compareEquality<float>(float a, float b) {
     return isZero(a - b);
 }
 
+//== Spectrum helpers
+//The complex bins are accessed as interleaved real and imaginary floats, so that the loops
+//vectorize. All the stages only scale the bins by real gains, so they are folded into one
+//gain per bin and the spectrum is scaled once, after the linked limiters.
+
+//squared magnitude of the first binCount bins
+static void computePower(float *power, const std::complex<float> *spectrum, size_t binCount) {
+    const float *pSpectrum = reinterpret_cast<const float *>(spectrum);
+    for (size_t k = 0; k < binCount; k++) {
+        const float re = pSpectrum[2 * k];
+        const float im = pSpectrum[2 * k + 1];
+        power[k] = re * re + im * im;
+    }
+}
+
+//energy of the bins [binStart, binStop) once their gain is applied
+static float weightedEnergy(const FloatVec &power, const FloatVec &gain, size_t binStart,
+        size_t binStop) {
+    if (binStop <= binStart) {
+        return 0;
+    }
+    Eigen::Map<const Eigen::ArrayXf> ePower(&power[binStart], binStop - binStart);
+    Eigen::Map<const Eigen::ArrayXf> eGain(&gain[binStart], binStop - binStart);
+    return (ePower * eGain.square()).sum();
+}
+
+static void scaleSpectrum(std::complex<float> *spectrum, const float *gain, float factor,
+        size_t binCount) {
+    float *pSpectrum = reinterpret_cast<float *>(spectrum);
+    for (size_t k = 0; k < binCount; k++) {
+        const float g = gain[k] * factor;
+        pSpectrum[2 * k] *= g;
+        pSpectrum[2 * k + 1] *= g;
+    }
+}
+
 //TODO: avoid using macro for estimating change and assignment.
 #define IS_CHANGED(c, a, b) { c |= !compareEquality(a,b); \
     (a) = (b); }
@@ -70,6 +106,8 @@ void ChannelBuffer::initBuffers(unsigned int blockSize, unsigned int overlapSize
     //module vectors
     mPreEqFactorVector.resize(halfFftSize, 1.0);
     mPostEqFactorVector.resize(halfFftSize, 1.0);
+    mPowerVector.resize(halfFftSize);
+    mGainVector.resize(halfFftSize, 1.0);
 
     mPreEqBands.resize(dpBase.getPreEqBandCount());
     mMbcBands.resize(dpBase.getMbcBandCount());
@@ -164,6 +202,9 @@ void DPFrequency::configure(size_t blockSize, size_t overlapSize,
     mBlocksPerSecond = (float)mSamplingRate / (mBlockSize - mOverlapSize);
 
     fill_window(mVWindow, RDSP_WINDOW_HANNING_FLAT_TOP, mBlockSize, mOverlapSize);
+    mWindowedInput.resize(mBlockSize);
+    mFftServer.SetFlag(Eigen::FFT<float>::HalfSpectrum);
+    mFftServer.SetFlag(Eigen::FFT<float>::Unscaled);
 
     //split window into analysis and synthesis. Both are the sqrt() of original
     //window
@@ -434,6 +475,9 @@ size_t DPFrequency::processChannelBuffers(CBufferVector &channelBuffers) {
 
     while (available >= processFrames) {
         //First pass
+        //Each channel has its own EQ and MBC bands and gain vector, so the per bin stages
+        //share no work across channels and run over one channel at a time. The FFTs take
+        //most of the block time.
         for (int ch = 0; ch < channelCount; ch++) {
             ChannelBuffer * pCb = &channelBuffers[ch];
             //move tail of previous
@@ -480,37 +524,51 @@ size_t DPFrequency::processFirstStages(ChannelBuffer &cb) {
     Eigen::Map<Eigen::VectorXf> eWindow(&mVWindow[0], mVWindow.size());
     Eigen::Map<Eigen::VectorXf> eInput(&cb.input[0], cb.input.size());
 
-    Eigen::VectorXf eWin = eInput.cwiseProduct(eWindow); //apply window
+    mWindowedInput = eInput.cwiseProduct(eWindow); //apply window
 
     //##fft
-    //Note: we are using eigen with the default scaling, which ensures that
-    //  IFFT( FFT(x) ) = x.
-    // TODO: optimize by using the noscale option, and compensate with dB scale offsets
-    mFftServer.fwd(cb.complexTemp, eWin);
-
-    size_t cSize = cb.complexTemp.size();
-    size_t maxBin = std::min(cSize/2, mHalfFFTSize);
-
-    //== EqPre (always runs)
-    for (size_t k = 0; k < maxBin; k++) {
-        cb.complexTemp[k] *= cb.mPreEqFactorVector[k];
+    //Note: the server only computes the first half of the spectrum, up to the Nyquist bin,
+    //  and is unscaled: the 1/mBlockSize factor which ensures that IFFT( FFT(x) ) = x is
+    //  applied with the gains in processLastStages().
+    mFftServer.fwd(cb.complexTemp, mWindowedInput);
+
+    const size_t maxBin = mBlockSize / 2; //Nyquist bin, not processed by the EQs
+    const bool mbcActive = cb.mMbcInUse && cb.mMbcEnabled;
+    const bool limiterActive = cb.mLimiterInUse && cb.mLimiterEnabled;
+
+    //The energies are measured on the unprocessed power spectrum weighted by the squared
+    //gain of each bin, the spectrum itself is only scaled in processLastStages().
+    if (mbcActive || limiterActive) {
+        computePower(&cb.mPowerVector[0], cb.complexTemp.data(), mHalfFFTSize);
     }
 
+    //== EqPre (always runs) on the bins below maxBin, the Nyquist bin only gets the MBC gain.
+    std::copy(cb.mPreEqFactorVector.begin(), cb.mPreEqFactorVector.begin() + maxBin,
+            cb.mGainVector.begin());
+    std::fill(cb.mGainVector.begin() + maxBin, cb.mGainVector.end(), 1.0f);
+
     //== MBC
-    if (cb.mMbcInUse && cb.mMbcEnabled) {
+    if (mbcActive) {
         for (size_t band = 0; band < cb.mMbcBands.size(); band++) {
             ChannelBuffer::MbcBandParams *pMbcBandParams = &cb.mMbcBands[band];
-            float fEnergySum = 0;
 
             //apply pre gain.
             float preGainFactor = dBtoLinear(pMbcBandParams->gainPreDb);
             float preGainSquared = preGainFactor * preGainFactor;
 
-            for (size_t k = pMbcBandParams->binStart; k <= pMbcBandParams->binStop; k++) {
-                fEnergySum += std::norm(cb.complexTemp[k]) * preGainSquared; //mag squared
+            //Bands going past the Nyquist bin extend into the mirrored half of the
+            //spectrum, which has the same power and is not scaled by the other stages.
+            const size_t binStart = pMbcBandParams->binStart;
+            const size_t binStop = std::min(pMbcBandParams->binStop + 1, mBlockSize);
+            const size_t halfBinStop = std::min(binStop, mHalfFFTSize);
+            float fEnergySum = weightedEnergy(cb.mPowerVector, cb.mGainVector,
+                    binStart, halfBinStop);
+            for (size_t k = std::max(binStart, mHalfFFTSize); k < binStop; k++) {
+                fEnergySum += cb.mPowerVector[mBlockSize - k];
             }
+            fEnergySum *= preGainSquared; //mag squared
 
-            //Eigen FFT is full spectrum, even if the source was real data.
+            //The spectrum of real data is symmetric, only its first half is measured.
             // Each half spectrum has half the energy. This is taken into account with the * 2
             // factor in the energy computations.
             // energy = sqrt(sum_components_squared) number_points
@@ -567,8 +625,10 @@ size_t DPFrequency::processFirstStages(ChannelBuffer &cb) {
             newFactor *= dBtoLinear(pMbcBandParams->gainPostDb);
 
             //apply to this band
-            for (size_t k = pMbcBandParams->binStart; k <= pMbcBandParams->binStop; k++) {
-                cb.complexTemp[k] *= newFactor;
+            if (binStart < halfBinStop) {
+                Eigen::Map<Eigen::ArrayXf> eGain(&cb.mGainVector[binStart],
+                        halfBinStop - binStart);
+                eGain *= newFactor;
             }
 
         } //end per band process
@@ -577,17 +637,14 @@ size_t DPFrequency::processFirstStages(ChannelBuffer &cb) {
 
     //== EqPost
     if (cb.mPostEqInUse && cb.mPostEqEnabled) {
-        for (size_t k = 0; k < maxBin; k++) {
-            cb.complexTemp[k] *= cb.mPostEqFactorVector[k];
-        }
+        Eigen::Map<Eigen::ArrayXf> eGain(&cb.mGainVector[0], maxBin);
+        Eigen::Map<const Eigen::ArrayXf> ePostEq(&cb.mPostEqFactorVector[0], maxBin);
+        eGain *= ePostEq;
     }
 
     //== Limiter. First Pass
-    if (cb.mLimiterInUse && cb.mLimiterEnabled) {
-        float fEnergySum = 0;
-        for (size_t k = 0; k < maxBin; k++) {
-            fEnergySum += std::norm(cb.complexTemp[k]);
-        }
+    if (limiterActive) {
+        float fEnergySum = weightedEnergy(cb.mPowerVector, cb.mGainVector, 0, maxBin);
 
         //see explanation above for energy computation logic
         fEnergySum = sqrt(fEnergySum * 2) / (mBlockSize * mWindowRms);
@@ -654,14 +711,16 @@ size_t DPFrequency::processLastStages(ChannelBuffer &cb) {
         outputGainFactor *= factor;
     }
 
-    //apply to all if != 1.0
-    if (!compareEquality(outputGainFactor, 1.0f)) {
-        size_t cSize = cb.complexTemp.size();
-        size_t maxBin = std::min(cSize/2, mHalfFFTSize);
-        for (size_t k = 0; k < maxBin; k++) {
-            cb.complexTemp[k] *= outputGainFactor;
-        }
+    //apply all the stages at once, the output gain only if != 1.0, with the ifft scaling
+    if (compareEquality(outputGainFactor, 1.0f)) {
+        outputGainFactor = 1.0f;
     }
+    const float ifftScale = 1.0f / mBlockSize;
+    const size_t maxBin = mBlockSize / 2;
+    scaleSpectrum(cb.complexTemp.data(), &cb.mGainVector[0], outputGainFactor * ifftScale,
+            maxBin);
+    scaleSpectrum(cb.complexTemp.data() + maxBin, &cb.mGainVector[maxBin], ifftScale,
+            mHalfFFTSize - maxBin);
 
     //##ifft directly to output.
     Eigen::Map<Eigen::VectorXf> eOutput(&cb.output[0], cb.output.size());
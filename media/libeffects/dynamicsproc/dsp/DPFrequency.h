@@ -39,7 +39,7 @@ public:
     FloatVec output;    // time domain temp vector for output
     FloatVec outTail;   // time domain temp vector for output tail (for overlap-add method)
 
-    Eigen::VectorXcf complexTemp; // complex temp vector for frequency domain operations
+    Eigen::VectorXcf complexTemp; // half spectrum, up to the Nyquist bin, of the block
 
     //Current parameters
     float inputGainDb;
@@ -98,6 +98,8 @@ public:
     LimiterParams mLimiterParams;
     FloatVec mPreEqFactorVector; // temp pre-computed vector to shape spectrum at preEQ stage
     FloatVec mPostEqFactorVector; // temp pre-computed vector to shape spectrum at postEQ stage
+    FloatVec mPowerVector; // squared magnitude of the unprocessed spectrum, up to Nyquist
+    FloatVec mGainVector;  // combined gain of all the stages, applied once to the spectrum
 
     void initBuffers(unsigned int blockSize, unsigned int overlapSize, unsigned int halfFftSize,
             unsigned int samplingRate, DPBase &dpBase);
@@ -152,6 +154,7 @@ private:
     //dsp
     FloatVec mVWindow;  //window class.
     float mWindowRms;
+    Eigen::VectorXf mWindowedInput; //windowed block, fft input
     Eigen::FFT<float> mFftServer;
 };
 
@@ -0,0 +1,457 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <complex>
+#include <deque>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <unsupported/Eigen/FFT>
+
+#include <dsp/DPFrequency.h>
+
+using dp_fx::DPBase;
+using dp_fx::DPChannel;
+using dp_fx::DPFrequency;
+
+constexpr size_t kSampleRate = 48000;
+constexpr size_t kBlockSize = 512;
+constexpr size_t kOverlapSize = kBlockSize / 2;
+// Frames per call, not a multiple of the block advance
+constexpr size_t kFrameCount = 480;
+constexpr size_t kNumCalls = 60;
+constexpr float kTolerance = 1e-5f;
+
+constexpr float kMinEnvelope = 1e-6f;
+constexpr float kEpsilon = 0.0000001f;
+
+constexpr size_t kChannelCounts[] = {1, 2, 3};
+
+// Frequency domain engine written the plain way, as DPFrequency was before its stages were
+// folded into one gain per bin: the full spectrum of each block is scaled by each stage in
+// turn, and the energies are measured on the scaled spectrum.
+// The parameters are read once, on construction.
+class ReferenceDPFrequency {
+  public:
+    ReferenceDPFrequency(DPBase& dp, size_t blockSize, size_t overlapSize, size_t sampleRate)
+        : mBlockSize(blockSize),
+          mOverlapSize(overlapSize),
+          mBlocksPerSecond((float)sampleRate / (blockSize - overlapSize)) {
+        fill_window(mWindow, RDSP_WINDOW_HANNING_FLAT_TOP, mBlockSize, mOverlapSize);
+        float sumSquares = 0;
+        for (float& w : mWindow) {
+            w = sqrt(w);
+            sumSquares += w * w;
+        }
+        mWindowRms = std::max(sqrt(sumSquares / mBlockSize), kMinEnvelope);
+
+        mChannels.resize(dp.getChannelCount());
+        for (size_t ch = 0; ch < mChannels.size(); ch++) {
+            initChannel(mChannels[ch], dp, ch, sampleRate);
+        }
+    }
+
+    void process(const float* in, float* out, size_t frames) {
+        const size_t channelCount = mChannels.size();
+        const size_t processFrames = mBlockSize - mOverlapSize;
+        for (size_t k = 0; k < frames; k++) {
+            for (size_t ch = 0; ch < channelCount; ch++) {
+                mChannels[ch].inputQueue.push_back(in[k * channelCount + ch]);
+            }
+        }
+
+        while (mChannels[0].inputQueue.size() >= processFrames) {
+            for (Channel& c : mChannels) {
+                std::copy(c.input.begin() + processFrames, c.input.end(), c.input.begin());
+                for (size_t k = 0; k < processFrames; k++) {
+                    c.input[mOverlapSize + k] = c.inputQueue.front();
+                    c.inputQueue.pop_front();
+                }
+                processFirstStages(c);
+            }
+            for (const auto& group : mLimiterGroups) {
+                float minFactor = 1.0f;
+                for (size_t ch : group.second) {
+                    minFactor = std::min(minFactor, mChannels[ch].limiterNewFactor);
+                }
+                for (size_t ch : group.second) {
+                    mChannels[ch].limiterLinkFactor = minFactor;
+                }
+            }
+            for (Channel& c : mChannels) {
+                processLastStages(c);
+                for (size_t k = 0; k < mOverlapSize; k++) {
+                    c.output[k] += c.outTail[k];
+                    c.outTail[k] = c.output[processFrames + k];
+                }
+                c.outputQueue.insert(c.outputQueue.end(), c.output.begin(),
+                                     c.output.begin() + processFrames);
+            }
+        }
+
+        // Zeroes first until the output is available, like the engine
+        const size_t available = std::min(mChannels[0].outputQueue.size(), frames);
+        std::fill(out, out + (frames - available) * channelCount, 0.0f);
+        out += (frames - available) * channelCount;
+        for (size_t k = 0; k < available; k++) {
+            for (Channel& c : mChannels) {
+                *out++ = c.outputQueue.front();
+                c.outputQueue.pop_front();
+            }
+        }
+    }
+
+  private:
+    struct MbcBand {
+        size_t binStart;
+        size_t binStop;
+        float preGainDb;
+        float postGainDb;
+        float attackTimeMs;
+        float releaseTimeMs;
+        float ratio;
+        float thresholdDb;
+        float kneeWidthDb;
+        float noiseGateThresholdDb;
+        float expanderRatio;
+        float envelope = 0;
+    };
+
+    struct Channel {
+        std::deque<float> inputQueue;
+        std::deque<float> outputQueue;
+        FloatVec input;
+        FloatVec output;
+        FloatVec outTail;
+        Eigen::VectorXcf spectrum;
+
+        FloatVec preEqFactors;
+        bool postEqActive = false;
+        FloatVec postEqFactors;
+        bool mbcActive = false;
+        std::vector<MbcBand> mbcBands;
+        bool limiterActive = false;
+        float limiterAttackTimeMs = 0;
+        float limiterReleaseTimeMs = 0;
+        float limiterRatio = 0;
+        float limiterThresholdDb = 0;
+        float limiterPostGainDb = 0;
+        float limiterEnvelope = 0;
+        float limiterNewFactor = 0;
+        float limiterLinkFactor = 0;
+        float outputGainDb = 0;
+    };
+
+    size_t binOf(float frequencyHz, size_t sampleRate) const {
+        return (int)(0.5 + frequencyHz * mBlockSize / sampleRate);
+    }
+
+    // Per bin factors of an EQ, up to the Nyquist bin. The bins past the last band keep
+    // a factor of 1.
+    template <typename Factor>
+    FloatVec eqFactors(dp_fx::DPEq* eq, size_t bandCount, size_t sampleRate, Factor factor) {
+        FloatVec factors(mBlockSize / 2 + 1, 1.0f);
+        size_t binStart = 0;
+        for (size_t b = 0; b < bandCount; b++) {
+            dp_fx::DPEqBand* band = eq->getBand(b);
+            const size_t binStop = binOf(band->getCutoffFrequency(), sampleRate);
+            for (size_t k = binStart; k <= binStop && k < factors.size(); k++) {
+                factors[k] = factor(*band);
+            }
+            binStart = binStop + 1;
+        }
+        return factors;
+    }
+
+    void initChannel(Channel& c, DPBase& dp, size_t ch, size_t sampleRate) {
+        DPChannel* channel = dp.getChannel(ch);
+        c.input.resize(mBlockSize);
+        c.output.resize(mBlockSize);
+        c.outTail.resize(mOverlapSize);
+        c.outputGainDb = channel->getOutputGain();
+
+        const float inputGain = dBtoLinear(channel->getInputGain());
+        if (channel->getPreEq()->isInUse() && channel->getPreEq()->isEnabled()) {
+            // a disabled band applies the input gain twice, as the engine does
+            c.preEqFactors = eqFactors(
+                    channel->getPreEq(), dp.getPreEqBandCount(), sampleRate,
+                    [inputGain](const dp_fx::DPEqBand& band) {
+                        return (band.isEnabled() ? dBtoLinear(band.getGain()) : inputGain) *
+                               inputGain;
+                    });
+        } else {
+            c.preEqFactors.assign(mBlockSize / 2 + 1, inputGain);
+        }
+
+        c.postEqActive = channel->getPostEq()->isInUse() && channel->getPostEq()->isEnabled();
+        if (c.postEqActive) {
+            c.postEqFactors = eqFactors(channel->getPostEq(), dp.getPostEqBandCount(), sampleRate,
+                                        [](const dp_fx::DPEqBand& band) {
+                                            return band.isEnabled() ? dBtoLinear(band.getGain())
+                                                                    : 1.0f;
+                                        });
+        }
+
+        c.mbcActive = channel->getMbc()->isInUse() && channel->getMbc()->isEnabled();
+        if (c.mbcActive) {
+            size_t binStart = 0;
+            for (size_t b = 0; b < dp.getMbcBandCount(); b++) {
+                dp_fx::DPMbcBand* band = channel->getMbc()->getBand(b);
+                MbcBand mbcBand;
+                mbcBand.binStart = binStart;
+                mbcBand.binStop = binOf(band->getCutoffFrequency(), sampleRate);
+                mbcBand.preGainDb = band->getPreGain();
+                mbcBand.postGainDb = band->getPostGain();
+                mbcBand.attackTimeMs = band->getAttackTime();
+                mbcBand.releaseTimeMs = band->getReleaseTime();
+                mbcBand.ratio = band->getRatio();
+                mbcBand.thresholdDb = band->getThreshold();
+                mbcBand.kneeWidthDb = band->getKneeWidth();
+                mbcBand.noiseGateThresholdDb = band->getNoiseGateThreshold();
+                mbcBand.expanderRatio = band->getExpanderRatio();
+                c.mbcBands.push_back(mbcBand);
+                binStart = mbcBand.binStop + 1;
+            }
+        }
+
+        dp_fx::DPLimiter* limiter = channel->getLimiter();
+        c.limiterActive = limiter->isInUse() && limiter->isEnabled();
+        if (c.limiterActive) {
+            c.limiterAttackTimeMs = limiter->getAttackTime();
+            c.limiterReleaseTimeMs = limiter->getReleaseTime();
+            c.limiterRatio = limiter->getRatio();
+            c.limiterThresholdDb = limiter->getThreshold();
+            c.limiterPostGainDb = limiter->getPostGain();
+            mLimiterGroups[limiter->getLinkGroup()].push_back(ch);
+        }
+    }
+
+    float envelope(float energy, float previousEnvelope, float attackTimeMs,
+                   float releaseTimeMs) const {
+        const float timeSec = (energy > previousEnvelope ? attackTimeMs : releaseTimeMs) / 1000;
+        const float theta = exp(-1.0 / (timeSec * mBlocksPerSecond));
+        return (1.0 - theta) * energy + theta * previousEnvelope;
+    }
+
+    void processFirstStages(Channel& c) {
+        Eigen::Map<Eigen::VectorXf> eInput(&c.input[0], c.input.size());
+        Eigen::Map<Eigen::VectorXf> eWindow(&mWindow[0], mWindow.size());
+        Eigen::VectorXf windowed = eInput.cwiseProduct(eWindow);
+        // full spectrum, the inverse is scaled
+        mFftServer.fwd(c.spectrum, windowed);
+
+        const size_t maxBin = mBlockSize / 2;
+        for (size_t k = 0; k < maxBin; k++) {
+            c.spectrum[k] *= c.preEqFactors[k];
+        }
+
+        if (c.mbcActive) {
+            for (MbcBand& band : c.mbcBands) {
+                const float preGain = dBtoLinear(band.preGainDb);
+                // bands past the Nyquist bin extend into the mirrored half of the spectrum
+                const size_t binStop = std::min(band.binStop, mBlockSize - 1);
+                float energy = 0;
+                for (size_t k = band.binStart; k <= binStop; k++) {
+                    energy += std::norm(c.spectrum[k]) * preGain * preGain;
+                }
+                energy = sqrt(energy * 2) / (mBlockSize * mWindowRms);
+
+                float env = envelope(energy, band.envelope, band.attackTimeMs,
+                                     band.releaseTimeMs);
+                band.envelope = env;
+                env = std::max(env, kMinEnvelope);
+
+                const float envDb = linearToDb(env);
+                const float kneeWidthDbHalf = band.kneeWidthDb / 2;
+                float newLevelDb = envDb;
+                if (envDb > band.thresholdDb + kneeWidthDbHalf) {
+                    newLevelDb = envDb + ((1 / band.ratio) - 1) * (envDb - band.thresholdDb);
+                } else if (envDb > band.thresholdDb - kneeWidthDbHalf) {
+                    const float temp = envDb - band.thresholdDb + kneeWidthDbHalf;
+                    newLevelDb = envDb + ((1 / band.ratio) - 1) * temp * temp /
+                                                 (kneeWidthDbHalf * 4);
+                } else if (envDb < band.noiseGateThresholdDb) {
+                    newLevelDb = band.noiseGateThresholdDb -
+                                 band.expanderRatio * (band.noiseGateThresholdDb - envDb);
+                }
+                const float factor =
+                        dBtoLinear(newLevelDb - envDb) * dBtoLinear(band.postGainDb);
+                for (size_t k = band.binStart; k <= binStop; k++) {
+                    c.spectrum[k] *= factor;
+                }
+            }
+        }
+
+        if (c.postEqActive) {
+            for (size_t k = 0; k < maxBin; k++) {
+                c.spectrum[k] *= c.postEqFactors[k];
+            }
+        }
+
+        if (c.limiterActive) {
+            float energy = 0;
+            for (size_t k = 0; k < maxBin; k++) {
+                energy += std::norm(c.spectrum[k]);
+            }
+            energy = sqrt(energy * 2) / (mBlockSize * mWindowRms);
+            const float env = envelope(energy, c.limiterEnvelope, c.limiterAttackTimeMs,
+                                       c.limiterReleaseTimeMs);
+            c.limiterEnvelope = env;
+            const float envDb = linearToDb(env);
+            float newFactorDb = 0;
+            if (envDb > c.limiterThresholdDb) {
+                newFactorDb = ((1 / c.limiterRatio) - 1) * (envDb - c.limiterThresholdDb);
+            }
+            c.limiterNewFactor = dBtoLinear(newFactorDb);
+        }
+    }
+
+    void processLastStages(Channel& c) {
+        float outputGain = dBtoLinear(c.outputGainDb);
+        if (c.limiterActive) {
+            outputGain *= c.limiterLinkFactor * dBtoLinear(c.limiterPostGainDb);
+        }
+        if (fabs(outputGain - 1.0f) > kEpsilon) {
+            for (size_t k = 0; k < mBlockSize / 2; k++) {
+                c.spectrum[k] *= outputGain;
+            }
+        }
+
+        Eigen::Map<Eigen::VectorXf> eOutput(&c.output[0], c.output.size());
+        mFftServer.inv(eOutput, c.spectrum);
+        Eigen::Map<Eigen::VectorXf> eWindow(&mWindow[0], mWindow.size());
+        eOutput = eOutput.cwiseProduct(eWindow);
+    }
+
+    const size_t mBlockSize;
+    const size_t mOverlapSize;
+    const float mBlocksPerSecond;
+    FloatVec mWindow;
+    float mWindowRms;
+    std::vector<Channel> mChannels;
+    std::map<uint32_t, std::vector<size_t>> mLimiterGroups;
+    Eigen::FFT<float> mFftServer;
+};
+
+struct StageConfig {
+    const char* name;
+    bool preEq;
+    bool mbc;
+    bool postEq;
+    bool limiter;
+    // Cutoff frequencies of the bands, in Hz
+    std::vector<float> cutoffs;
+};
+
+const StageConfig kStageConfigs[] = {
+        {"PreEq", true, false, false, false, {300, 2000, 9000}},
+        {"Mbc", false, true, false, false, {300, 2000, 9000}},
+        {"PostEq", false, false, true, false, {300, 2000, 9000}},
+        {"Limiter", false, false, false, true, {300, 2000, 9000}},
+        {"AllStages", true, true, true, true, {300, 2000, 9000, 24000}},
+        // The last MBC band reaches past the Nyquist bin, and past the block size
+        {"MbcPastNyquist", true, true, true, true, {1000, 8000, 30000, 60000}},
+};
+
+class DPFrequencyTest
+    : public ::testing::TestWithParam<std::tuple<StageConfig, size_t /* channelCount */>> {
+  public:
+    DPFrequencyTest()
+        : mConfig(std::get<0>(GetParam())), mChannelCount(std::get<1>(GetParam())) {}
+
+    // Every band changes the signal, and the channels differ so that the linked limiters
+    // don't all see the same levels.
+    void configure(DPFrequency& dp) {
+        const size_t bandCount = mConfig.cutoffs.size();
+        dp.init(mChannelCount, mConfig.preEq, bandCount, mConfig.mbc, bandCount,
+                mConfig.postEq, bandCount, mConfig.limiter);
+        for (size_t ch = 0; ch < mChannelCount; ch++) {
+            DPChannel* channel = dp.getChannel(ch);
+            channel->setInputGain(-1.0f - 2.0f * ch);
+            channel->setOutputGain(ch == 1 ? 0.0f : 1.5f);
+            channel->getPreEq()->setEnabled(true);
+            channel->getMbc()->setEnabled(true);
+            channel->getPostEq()->setEnabled(true);
+            for (size_t b = 0; b < bandCount; b++) {
+                dp_fx::DPEqBand eqBand;
+                eqBand.init(b != 1 /* enabled */, mConfig.cutoffs[b], (b % 2) ? 4 : -3);
+                channel->getPreEq()->setBand(b, eqBand);
+                eqBand.setGain((b % 2) ? -2 : 1);
+                channel->getPostEq()->setBand(b, eqBand);
+
+                dp_fx::DPMbcBand mbcBand;
+                mbcBand.init(true /* enabled */, mConfig.cutoffs[b], 3 /* attackTime */,
+                             80 /* releaseTime */, 4 /* ratio */, -30.0f + b /* threshold */,
+                             6 /* kneeWidth */, -50 /* noiseGateThreshold */,
+                             2 /* expanderRatio */, 1 /* preGain */, 2 /* postGain */);
+                channel->getMbc()->setBand(b, mbcBand);
+            }
+            dp_fx::DPLimiter limiter;
+            limiter.init(mConfig.limiter /* inUse */, true /* enabled */, ch % 2 /* linkGroup */,
+                         1 /* attackTime */, 60 /* releaseTime */, 10 /* ratio */,
+                         -10 /* threshold */, 1 /* postGain */);
+            channel->setLimiter(limiter);
+        }
+        dp.configure(kBlockSize, kOverlapSize, kSampleRate);
+    }
+
+  protected:
+    const StageConfig mConfig;
+    const size_t mChannelCount;
+};
+
+// Loud and quiet stretches, so that the MBC and the limiter both attack and release
+TEST_P(DPFrequencyTest, MatchesReference) {
+    DPFrequency dp;
+    configure(dp);
+    ReferenceDPFrequency reference(dp, kBlockSize, kOverlapSize, kSampleRate);
+
+    std::minstd_rand gen(42);
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+    std::vector<float> input(kFrameCount * mChannelCount);
+    std::vector<float> output(input.size());
+    std::vector<float> referenceOutput(input.size());
+    for (size_t call = 0; call < kNumCalls; call++) {
+        const float level = (call % 10 < 5) ? 0.9f : 0.01f;
+        for (size_t k = 0; k < kFrameCount; k++) {
+            for (size_t ch = 0; ch < mChannelCount; ch++) {
+                const float phase = 0.01f * (k + call * kFrameCount) * (ch + 1);
+                input[k * mChannelCount + ch] = level * (0.5f * dis(gen) + 0.5f * sin(phase));
+            }
+        }
+        dp.processSamples(input.data(), output.data(), input.size());
+        reference.process(input.data(), referenceOutput.data(), kFrameCount);
+
+        for (size_t i = 0; i < output.size(); i++) {
+            ASSERT_NEAR(referenceOutput[i], output[i], kTolerance)
+                    << "call " << call << " frame " << i / mChannelCount << " channel "
+                    << i % mChannelCount;
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        DPFrequencyTestAll, DPFrequencyTest,
+        ::testing::Combine(::testing::ValuesIn(kStageConfigs), ::testing::ValuesIn(kChannelCounts)),
+        [](const testing::TestParamInfo<DPFrequencyTest::ParamType>& info) {
+            return std::string(std::get<0>(info.param).name) + "_" +
+                   std::to_string(std::get<1>(info.param)) + "Channels";
+        });
@@ -16,13 +16,16 @@
 
 #include <array>
 #include <climits>
+#include <cmath>
 #include <cstdlib>
 #include <random>
 #include <vector>
 #include <log/log.h>
+#include <audio_utils/BiquadFilter.h>
 #include <benchmark/benchmark.h>
 #include <hardware/audio_effect.h>
 #include <system/audio.h>
+#include <LVM_BiquadCascade.h>
 
 extern audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM;
 constexpr effect_uuid_t kEffectUuids[] = {
@@ -54,6 +57,16 @@ constexpr audio_channel_mask_t kChMasks[] = {
 constexpr size_t kNumChMasks = std::size(kChMasks);
 constexpr int kSampleRate = 44100;
 
+// Channel counts of the equalizer band benchmark
+constexpr size_t kEqChannelCounts[] = {FCC_1, FCC_2, 6, FCC_8};
+
+// Reports the processing time of one frame
+static void setFrameTimeCounter(benchmark::State& state, size_t frameCount) {
+    state.counters["time/frame"] =
+            benchmark::Counter(frameCount, benchmark::Counter::kIsIterationInvariantRate |
+                                                   benchmark::Counter::kInvert);
+}
+
 /*******************************************************************
  * A test result running on Pixel 3 for comparison.
  * The first parameter indicates the number of channels.
@@ -218,6 +231,7 @@ static void BM_LVM(benchmark::State& state) {
     }
 
     state.SetComplexityN(state.range(0));
+    setFrameTimeCounter(state, kFrameCount);
 
     if (int status = AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effectHandle); status != 0) {
         ALOGE("release_effect returned an error = %d\n", status);
@@ -235,4 +249,82 @@ static void LVMArgs(benchmark::internal::Benchmark* b) {
 
 BENCHMARK(BM_LVM)->Apply(LVMArgs);
 
+/*******************************************************************
+ * The five bands of the equalizer, each one adding a band pass
+ * filtered copy of its input, as done by LVEQNB_Process.
+ * The first parameter is the number of channels, the second one the
+ * implementation:
+ * 0: one BiquadFilter and gain pass per band
+ * 1: LVM_BiquadCascade
+ *******************************************************************/
+
+static void BM_EqBands(benchmark::State& state) {
+    const size_t channelCount = state.range(0);
+    const bool useCascade = state.range(1) != 0;
+    constexpr float kFrequencies[] = {60.0f, 230.0f, 910.0f, 3600.0f, 14000.0f};
+    constexpr float kGainsDb[] = {5.0f, -3.0f, 12.0f, -15.0f, 7.0f};
+    constexpr float kQFactor = 0.96f;
+
+    std::vector<LVM_BiquadCascade::Coefs> sections;
+    std::vector<float> gains;
+    for (size_t i = 0; i < std::size(kFrequencies); i++) {
+        const float w = 2.0f * M_PI * kFrequencies[i] / kSampleRate;
+        const float alpha = sinf(w) / (2.0f * kQFactor);
+        const float a0 = 1.0f + alpha;
+        sections.push_back({alpha / a0, 0.0f, -alpha / a0, -2.0f * cosf(w) / a0,
+                            (1.0f - alpha) / a0});
+        gains.push_back(powf(10.0f, kGainsDb[i] / 20.0f) - 1.0f);
+    }
+
+    std::vector<android::audio_utils::BiquadFilter<float>> biquads;
+    for (const auto& coefs : sections) {
+        biquads.emplace_back(channelCount, coefs);
+    }
+    LVM_BiquadCascade cascade(channelCount);
+    cascade.setSections(sections.data(), sections.size(), gains.data());
+
+    // Initialize input buffer with deterministic pseudo-random values
+    std::minstd_rand gen(channelCount);
+    std::uniform_real_distribution<> dis(-1.0f, 1.0f);
+    const size_t sampleCount = kFrameCount * channelCount;
+    std::vector<float> input(sampleCount);
+    for (auto& in : input) {
+        in = dis(gen);
+    }
+    std::vector<float> output(sampleCount);
+    std::vector<float> filtered(sampleCount);
+
+    // Run the test
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(input.data());
+        benchmark::DoNotOptimize(output.data());
+
+        if (useCascade) {
+            cascade.process(output.data(), input.data(), kFrameCount);
+        } else {
+            std::copy(input.begin(), input.end(), output.begin());
+            for (size_t i = 0; i < biquads.size(); i++) {
+                biquads[i].process(filtered.data(), output.data(), kFrameCount);
+                for (size_t j = 0; j < sampleCount; j++) {
+                    output[j] += filtered[j] * gains[i];
+                }
+            }
+        }
+
+        benchmark::ClobberMemory();
+    }
+
+    setFrameTimeCounter(state, kFrameCount);
+}
+
+static void EqBandsArgs(benchmark::internal::Benchmark* b) {
+    for (size_t channelCount : kEqChannelCounts) {
+        for (int j = 0; j <= 1; j++) {
+            b->Args({(int64_t)channelCount, j});
+        }
+    }
+}
+
+BENCHMARK(BM_EqBands)->Apply(EqBandsArgs);
+
 BENCHMARK_MAIN();
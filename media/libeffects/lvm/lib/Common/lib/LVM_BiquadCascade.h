@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LVM_BIQUADCASCADE_H__
+#define __LVM_BIQUADCASCADE_H__
+
+#include <array>
+#include <vector>
+
+#include <audio_utils/BiquadFilter.h>
+#include "LVM_Types.h"
+
+/****************************************************************************************/
+/*                                                                                      */
+/*  Header file for the LVM_BiquadCascade class                                         */
+/*                                                                                      */
+/*  Functionality:                                                                      */
+/*  Runs a chain of biquad sections over interleaved multi-channel data in a single     */
+/*  pass, with the filter state loaded into vectors once per block.                     */
+/*  Two layouts are used:                                                               */
+/*  - channels in lanes: each vector lane holds one channel and all the sections are    */
+/*    applied to a frame before moving to the next one. Used for 2 channels or more.    */
+/*  - sections in lanes: for mono, each lane holds one section and lane k works on      */
+/*    the sample k frames behind lane 0, so all the sections run in parallel.           */
+/*  On x86 the 8 lane kernels are compiled for AVX2 as well and selected at run time.   */
+/*  A section can also add its filtered signal to its input with a gain, so the         */
+/*  equaliser bands run as they are without being merged into peaking filters.         */
+/*  The output is the same as running the sections one after the other with            */
+/*  android::audio_utils::BiquadFilter, to within float rounding.                       */
+/*                                                                                      */
+/****************************************************************************************/
+
+class LVM_BiquadCascade {
+  public:
+    /* Coefficients of one section: b0, b1, b2, a1, a2, like audio_utils::BiquadFilter */
+    using Coefs = std::array<LVM_FLOAT, android::audio_utils::kBiquadNumCoefs>;
+
+    LVM_BiquadCascade() = default;
+    explicit LVM_BiquadCascade(size_t channelCount);
+
+    /*
+     * Changes the number of interleaved channels. The filter history is cleared if the
+     * count changes.
+     */
+    void setChannelCount(size_t channelCount);
+
+    /*
+     * Sets the sections of the cascade, in processing order. The history is kept if the
+     * number of sections is unchanged and cleared otherwise. With no sections the cascade
+     * copies its input.
+     * If pGains is not null, section k outputs its input plus pGains[k] times the biquad
+     * output instead of the biquad output, like the band pass sections of the equaliser.
+     */
+    void setSections(const Coefs* pCoefs, size_t sectionCount,
+                     const LVM_FLOAT* pGains = nullptr);
+
+    /* Clears the filter history of all the sections */
+    void clear();
+
+    /* Filters frameCount frames from pIn to pOut, which may be the same buffer */
+    void process(LVM_FLOAT* pOut, const LVM_FLOAT* pIn, size_t frameCount);
+
+    size_t getChannelCount() const { return mChannelCount; }
+    size_t getSectionCount() const { return mSectionCount; }
+
+  private:
+    size_t mChannelCount = FCC_2;
+    size_t mSectionCount = 0;
+    /* Coefficients of each section followed by its dry and wet gains */
+    std::vector<LVM_FLOAT> mSections;
+    /* Delay line of each section: state 1 of all the channels, then state 2 */
+    std::vector<LVM_FLOAT> mState;
+};
+
+#endif /* __LVM_BIQUADCASCADE_H__ */
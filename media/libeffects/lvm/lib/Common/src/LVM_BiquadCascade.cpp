@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/****************************************************************************************/
+/*  INCLUDE FILES                                                                       */
+/****************************************************************************************/
+
+#include <algorithm>
+#include <string.h>
+
+#include "LVM_BiquadCascade.h"
+
+/****************************************************************************************/
+/*  VECTOR TYPES                                                                        */
+/****************************************************************************************/
+
+/*
+ * Generic vector types, lowered by the compiler to NEON on ARM and SSE on x86. The lane
+ * count only depends on the type so that every variant does the same operations per lane
+ * and a channel is filtered identically whatever the channel count.
+ */
+typedef LVM_FLOAT Float2 __attribute__((vector_size(2 * sizeof(LVM_FLOAT))));
+typedef LVM_FLOAT Float4 __attribute__((vector_size(4 * sizeof(LVM_FLOAT))));
+typedef LVM_FLOAT Float8 __attribute__((vector_size(8 * sizeof(LVM_FLOAT))));
+
+#if defined(__i386__) || defined(__x86_64__)
+/* No FMA, so that the AVX2 kernels round like the SSE ones */
+#define LVM_AVX2_TARGET __attribute__((target("avx2")))
+#define LVM_HAVE_AVX2_KERNELS
+
+static bool isAvx2Supported() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+#define LVM_ALWAYS_INLINE inline __attribute__((always_inline))
+
+namespace {
+
+/* Layout of a section in mSections: the biquad coefficients then the dry and wet gains */
+constexpr size_t kNumCoefs = android::audio_utils::kBiquadNumCoefs;
+constexpr size_t kDry = kNumCoefs;
+constexpr size_t kWet = kNumCoefs + 1;
+constexpr size_t kSectionSize = kNumCoefs + 2;
+/* Longer cascades are run in several passes over the data */
+constexpr size_t kMaxSectionsPerPass = 8;
+
+/*
+ * The helpers take the vectors by reference: passing 32 byte vectors by value to a
+ * function built without AVX has a different ABI.
+ */
+template <typename V>
+LVM_ALWAYS_INLINE void splat(V& v, LVM_FLOAT value) {
+    v = V{} + value;
+}
+
+template <typename V>
+LVM_ALWAYS_INLINE void load(V& v, const LVM_FLOAT* p) {
+    memcpy(&v, p, sizeof(V));
+}
+
+template <typename V>
+LVM_ALWAYS_INLINE void store(LVM_FLOAT* p, const V& v) {
+    memcpy(p, &v, sizeof(V));
+}
+
+/* Moves every lane up by one, lane 0 is left for the caller to fill */
+LVM_ALWAYS_INLINE void shiftLanes(Float4& v) {
+    v = __builtin_shufflevector(v, v, 0, 0, 1, 2);
+}
+
+LVM_ALWAYS_INLINE void shiftLanes(Float8& v) {
+    v = __builtin_shufflevector(v, v, 0, 0, 1, 2, 3, 4, 5, 6);
+}
+
+/*
+ * One section: a transposed direct form II biquad with coefficients b0, b1, b2, a1, a2,
+ * mixed with its input. x is replaced by the output.
+ */
+template <typename V>
+LVM_ALWAYS_INLINE void section(V& x, V& s1, V& s2, const V* c) {
+    const V y = c[0] * x + s1;
+    s1 = c[1] * x - c[3] * y + s2;
+    s2 = c[2] * x - c[4] * y;
+    x = c[kDry] * x + y * c[kWet];
+}
+
+/*
+ * Channels in lanes: filters the channels of one group, pIn, pOut and pState point to the
+ * first channel of the group. The frame stride is the channel count, as is the distance
+ * between the state rows of the sections.
+ */
+template <typename V>
+LVM_ALWAYS_INLINE void processChannelGroup(LVM_FLOAT* pOut, const LVM_FLOAT* pIn,
+                                           size_t frameCount, size_t channelCount,
+                                           const LVM_FLOAT* pSections, size_t sectionCount,
+                                           LVM_FLOAT* pState) {
+    V coefs[kMaxSectionsPerPass][kSectionSize];
+    V s1[kMaxSectionsPerPass];
+    V s2[kMaxSectionsPerPass];
+    for (size_t k = 0; k < sectionCount; k++) {
+        for (size_t i = 0; i < kSectionSize; i++) {
+            splat(coefs[k][i], pSections[k * kSectionSize + i]);
+        }
+        load(s1[k], pState + 2 * k * channelCount);
+        load(s2[k], pState + (2 * k + 1) * channelCount);
+    }
+
+    for (size_t n = 0; n < frameCount; n++) {
+        V x;
+        load(x, pIn);
+        for (size_t k = 0; k < sectionCount; k++) {
+            section(x, s1[k], s2[k], coefs[k]);
+        }
+        store(pOut, x);
+        pIn += channelCount;
+        pOut += channelCount;
+    }
+
+    for (size_t k = 0; k < sectionCount; k++) {
+        store(pState + 2 * k * channelCount, s1[k]);
+        store(pState + (2 * k + 1) * channelCount, s2[k]);
+    }
+}
+
+/*
+ * Sections in lanes, for mono: lane k runs section k on the sample k frames behind lane 0
+ * and hands its output to lane k + 1 for the next step. The first and last steps of a
+ * block only have some of the lanes working on real samples, the state of the others is
+ * left unchanged so the result matches running the sections one after the other.
+ * The unused lanes above sectionCount pass their input through.
+ */
+template <typename V>
+LVM_ALWAYS_INLINE void processSectionLanes(LVM_FLOAT* pOut, const LVM_FLOAT* pIn,
+                                           size_t frameCount, const LVM_FLOAT* pSections,
+                                           size_t sectionCount, LVM_FLOAT* pState) {
+    constexpr size_t kLanes = sizeof(V) / sizeof(LVM_FLOAT);
+    V coefs[kSectionSize] = {};
+    V s1 = {};
+    V s2 = {};
+    splat(coefs[kDry], 1.0f);
+    for (size_t k = 0; k < sectionCount; k++) {
+        for (size_t i = 0; i < kSectionSize; i++) {
+            coefs[i][k] = pSections[k * kSectionSize + i];
+        }
+        s1[k] = pState[2 * k];
+        s2[k] = pState[2 * k + 1];
+    }
+
+    const size_t last = sectionCount - 1;
+    const size_t stepCount = frameCount + last;
+    V x = {};
+    auto step = [&](size_t n, bool partial) {
+        x[0] = n < frameCount ? pIn[n] : 0.0f;
+        const V prev1 = s1;
+        const V prev2 = s2;
+        section(x, s1, s2, coefs);
+        if (partial) {
+            for (size_t k = 0; k < kLanes; k++) {
+                if (k > n || n - k >= frameCount) {
+                    s1[k] = prev1[k];
+                    s2[k] = prev2[k];
+                }
+            }
+        }
+        if (n >= last) {
+            pOut[n - last] = x[last];
+        }
+        shiftLanes(x);
+    };
+
+    size_t n = 0;
+    for (; n < std::min(last, stepCount); n++) {
+        step(n, true);
+    }
+    for (; n < frameCount; n++) {
+        step(n, false);
+    }
+    for (; n < stepCount; n++) {
+        step(n, true);
+    }
+
+    for (size_t k = 0; k < sectionCount; k++) {
+        pState[2 * k] = s1[k];
+        pState[2 * k + 1] = s2[k];
+    }
+}
+
+/* Non inlined instances, one per vector type and instruction set */
+
+#define LVM_CHANNEL_GROUP_KERNEL(name, type, target)                                          \
+    target void name(LVM_FLOAT* pOut, const LVM_FLOAT* pIn, size_t frameCount,               \
+                     size_t channelCount, const LVM_FLOAT* pSections, size_t sectionCount,   \
+                     LVM_FLOAT* pState) {                                                    \
+        processChannelGroup<type>(pOut, pIn, frameCount, channelCount, pSections,            \
+                                  sectionCount, pState);                                     \
+    }
+
+#define LVM_SECTION_LANES_KERNEL(name, type, target)                                         \
+    target void name(LVM_FLOAT* pOut, const LVM_FLOAT* pIn, size_t frameCount,              \
+                     const LVM_FLOAT* pSections, size_t sectionCount, LVM_FLOAT* pState) {  \
+        processSectionLanes<type>(pOut, pIn, frameCount, pSections, sectionCount, pState);  \
+    }
+
+LVM_CHANNEL_GROUP_KERNEL(processChannels1, LVM_FLOAT, )
+LVM_CHANNEL_GROUP_KERNEL(processChannels2, Float2, )
+LVM_CHANNEL_GROUP_KERNEL(processChannels4, Float4, )
+LVM_CHANNEL_GROUP_KERNEL(processChannels8, Float8, )
+LVM_SECTION_LANES_KERNEL(processSections4, Float4, )
+LVM_SECTION_LANES_KERNEL(processSections8, Float8, )
+#ifdef LVM_HAVE_AVX2_KERNELS
+LVM_CHANNEL_GROUP_KERNEL(processChannels8Avx2, Float8, LVM_AVX2_TARGET)
+LVM_SECTION_LANES_KERNEL(processSections8Avx2, Float8, LVM_AVX2_TARGET)
+#endif
+
+}  // namespace
+
+/****************************************************************************************/
+/*  CLASS LVM_BiquadCascade                                                             */
+/****************************************************************************************/
+
+LVM_BiquadCascade::LVM_BiquadCascade(size_t channelCount) : mChannelCount(channelCount) {}
+
+void LVM_BiquadCascade::setChannelCount(size_t channelCount) {
+    if (channelCount != mChannelCount) {
+        mChannelCount = channelCount;
+        mState.assign(2 * mSectionCount * mChannelCount, 0.0f);
+    }
+}
+
+void LVM_BiquadCascade::setSections(const Coefs* pCoefs, size_t sectionCount,
+                                    const LVM_FLOAT* pGains) {
+    if (sectionCount != mSectionCount) {
+        mSectionCount = sectionCount;
+        mState.assign(2 * mSectionCount * mChannelCount, 0.0f);
+    }
+    mSections.resize(mSectionCount * kSectionSize);
+    for (size_t k = 0; k < mSectionCount; k++) {
+        LVM_FLOAT* pSection = &mSections[k * kSectionSize];
+        std::copy(pCoefs[k].begin(), pCoefs[k].end(), pSection);
+        pSection[kDry] = pGains != nullptr ? 1.0f : 0.0f;
+        pSection[kWet] = pGains != nullptr ? pGains[k] : 1.0f;
+    }
+}
+
+void LVM_BiquadCascade::clear() {
+    std::fill(mState.begin(), mState.end(), 0.0f);
+}
+
+void LVM_BiquadCascade::process(LVM_FLOAT* pOut, const LVM_FLOAT* pIn, size_t frameCount) {
+    if (mSectionCount == 0) {
+        if (pOut != pIn) {
+            memmove(pOut, pIn, frameCount * mChannelCount * sizeof(LVM_FLOAT));
+        }
+        return;
+    }
+#ifdef LVM_HAVE_AVX2_KERNELS
+    const bool avx2 = isAvx2Supported();
+#endif
+
+    for (size_t first = 0; first < mSectionCount; first += kMaxSectionsPerPass) {
+        const size_t count = std::min(mSectionCount - first, kMaxSectionsPerPass);
+        const LVM_FLOAT* pSections = &mSections[first * kSectionSize];
+
+        if (mChannelCount == FCC_1 && count > 1) {
+            /* Mono: the sections in lanes */
+            LVM_FLOAT* pState = &mState[2 * first];
+            if (count <= 4) {
+                processSections4(pOut, pIn, frameCount, pSections, count, pState);
+#ifdef LVM_HAVE_AVX2_KERNELS
+            } else if (avx2) {
+                processSections8Avx2(pOut, pIn, frameCount, pSections, count, pState);
+#endif
+            } else {
+                processSections8(pOut, pIn, frameCount, pSections, count, pState);
+            }
+            pIn = pOut;
+            continue;
+        }
+
+        /* The channels in lanes, split in groups of 8, 4, 2 and 1 channels */
+        size_t channel = 0;
+        while (channel < mChannelCount) {
+            const size_t remaining = mChannelCount - channel;
+            LVM_FLOAT* pGroupOut = pOut + channel;
+            const LVM_FLOAT* pGroupIn = pIn + channel;
+            LVM_FLOAT* pState = &mState[2 * first * mChannelCount + channel];
+            if (remaining >= 8) {
+#ifdef LVM_HAVE_AVX2_KERNELS
+                if (avx2) {
+                    processChannels8Avx2(pGroupOut, pGroupIn, frameCount, mChannelCount,
+                                         pSections, count, pState);
+                } else
+#endif
+                {
+                    processChannels8(pGroupOut, pGroupIn, frameCount, mChannelCount, pSections,
+                                     count, pState);
+                }
+                channel += 8;
+            } else if (remaining >= 4) {
+                processChannels4(pGroupOut, pGroupIn, frameCount, mChannelCount, pSections,
+                                 count, pState);
+                channel += 4;
+            } else if (remaining >= 2) {
+                processChannels2(pGroupOut, pGroupIn, frameCount, mChannelCount, pSections,
+                                 count, pState);
+                channel += 2;
+            } else {
+                processChannels1(pGroupOut, pGroupIn, frameCount, mChannelCount, pSections,
+                                 count, pState);
+                channel += 1;
+            }
+        }
+        pIn = pOut;
+    }
+}
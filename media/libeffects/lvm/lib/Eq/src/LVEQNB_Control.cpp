@@ -177,8 +177,9 @@ void LVEQNB_SetFilters(LVEQNB_Instance_t* pInstance, LVEQNB_Params_t* pParams) {
 void LVEQNB_SetCoefficients(LVEQNB_Instance_t* pInstance) {
     LVM_UINT16 i;                    /* Filter band index */
     LVEQNB_BiquadType_en BiquadType; /* Filter biquad type */
+    std::vector<LVM_BiquadCascade::Coefs> sections;
+    std::vector<LVM_FLOAT> gains;
 
-    pInstance->gain.resize(pInstance->Params.NBands);
     /*
      * Set the coefficients for each band by the init function
      */
@@ -189,6 +190,12 @@ void LVEQNB_SetCoefficients(LVEQNB_Instance_t* pInstance) {
         BiquadType = pInstance->pBiquadType[i];
         switch (BiquadType) {
             case LVEQNB_SinglePrecision_Float: {
+                /*
+                 * Bands with 0dB gain are bypassed
+                 */
+                if (pInstance->pBandDefinitions[i].Gain == 0) {
+                    break;
+                }
                 PK_FLOAT_Coefs_t Coefficients;
                 /*
                  * Calculate the single precision coefficients
@@ -196,22 +203,22 @@ void LVEQNB_SetCoefficients(LVEQNB_Instance_t* pInstance) {
                 LVEQNB_SinglePrecCoefs((LVM_UINT16)pInstance->Params.SampleRate,
                                        &pInstance->pBandDefinitions[i], &Coefficients);
                 /*
-                 * Set the coefficients
+                 * The band adds G times the band pass output to its input
                  */
-                pInstance->gain[i] = Coefficients.G;
-                std::array<LVM_FLOAT, android::audio_utils::kBiquadNumCoefs> coefs = {
-                        Coefficients.A0, 0.0, -(Coefficients.A0), -(Coefficients.B1),
-                        -(Coefficients.B2)};
-                pInstance->eqBiquad[i]
-                        .setCoefficients<
-                                std::array<LVM_FLOAT, android::audio_utils::kBiquadNumCoefs>>(
-                                coefs);
+                sections.push_back({Coefficients.A0, 0.0, -(Coefficients.A0), -(Coefficients.B1),
+                                    -(Coefficients.B2)});
+                gains.push_back(Coefficients.G);
                 break;
             }
             default:
                 break;
         }
     }
+
+    /*
+     * Set the coefficients
+     */
+    pInstance->eqCascade.setSections(sections.data(), sections.size(), gains.data());
 }
 
 /************************************************************************************/
@@ -226,9 +233,7 @@ void LVEQNB_SetCoefficients(LVEQNB_Instance_t* pInstance) {
 /*                                                                                  */
 /************************************************************************************/
 void LVEQNB_ClearFilterHistory(LVEQNB_Instance_t* pInstance) {
-    for (size_t i = 0; i < pInstance->eqBiquad.size(); i++) {
-        pInstance->eqBiquad[i].clear();
-    }
+    pInstance->eqCascade.clear();
 }
 /****************************************************************************************/
 /*                                                                                      */
@@ -307,10 +312,9 @@ LVEQNB_ReturnStatus_en LVEQNB_Control(LVEQNB_Handle_t hInstance, LVEQNB_Params_t
              LVC_Mixer_GetTarget(&pInstance->BypassMixer.MixerStream[0]) == 0);
 
     /*
-     * Create biquad instance
+     * Set the channel count of the filters
      */
-    pInstance->eqBiquad.resize(pParams->NBands,
-                               android::audio_utils::BiquadFilter<LVM_FLOAT>(pParams->NrChannels));
+    pInstance->eqCascade.setChannelCount(pParams->NrChannels);
 
     if (bChange || modeChange) {
         LVEQNB_ClearFilterHistory(pInstance);
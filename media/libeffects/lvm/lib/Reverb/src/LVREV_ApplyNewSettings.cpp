@@ -25,6 +25,49 @@
 #include "LVREV_Private.h"
 #include "Filter.h"
 
+/****************************************************************************************/
+/*                                                                                      */
+/* FUNCTION:                LVREV_GetDelaySizes                                         */
+/*                                                                                      */
+/* DESCRIPTION:                                                                         */
+/*  Calculates the fixed delay and the all-pass delay of each delay line, in samples    */
+/*                                                                                      */
+/* PARAMETERS:                                                                          */
+/*  SampleRate              Sample rate                                                 */
+/*  RoomSizeInms            Room size in msec                                           */
+/*  pFixedDelaySize         Fixed delay of the four delay lines                         */
+/*  pAPDelaySize            All-pass delay of the four delay lines                      */
+/*                                                                                      */
+/* NOTES:                                                                               */
+/*  1. A delay line needs the sum of both delays                                        */
+/*                                                                                      */
+/****************************************************************************************/
+void LVREV_GetDelaySizes(LVM_Fs_en SampleRate, LVM_INT32 RoomSizeInms,
+                         LVM_INT32* pFixedDelaySize, LVM_INT32* pAPDelaySize) {
+    LVM_UINT32 Temp;
+    LVM_INT32 Fs = LVM_GetFsFromTable(SampleRate);
+    LVM_UINT32 DelayLengthSamples = (LVM_UINT32)(Fs * RoomSizeInms);
+    LVM_INT16 i;
+    LVM_FLOAT ScaleTable[] = {LVREV_T_3_Power_minus0_on_4, LVREV_T_3_Power_minus1_on_4,
+                              LVREV_T_3_Power_minus2_on_4, LVREV_T_3_Power_minus3_on_4};
+
+    /*
+     * For each delay line
+     */
+    for (i = 0; i < LVREV_DELAYLINES_4; i++) {
+        if (i != 0) {
+            LVM_FLOAT Temp1; /* to avoid QAC warning on type conversion */
+
+            Temp1 = (LVM_FLOAT)DelayLengthSamples;
+            Temp = (LVM_UINT32)(Temp1 * ScaleTable[i]);
+        } else {
+            Temp = DelayLengthSamples;
+        }
+        pAPDelaySize[i] = Temp / 1500;
+        pFixedDelaySize[i] = (LVREV_MAX_T_DELAY[i] - LVREV_MAX_AP_DELAY[i]) * Fs / 192000;
+    }
+}
+
 /****************************************************************************************/
 /*                                                                                      */
 /* FUNCTION:                LVREV_ApplyNewSettings                                      */
@@ -38,6 +81,7 @@
 /* RETURNS:                                                                             */
 /*  LVREV_Success           Succeeded                                                   */
 /*  LVREV_NULLADDRESS       When pPrivate is NULL                                       */
+/*  LVREV_NULLADDRESS       When the delay lines for the sample rate are not allocated  */
 /*                                                                                      */
 /* NOTES:                                                                               */
 /*                                                                                      */
@@ -52,6 +96,15 @@ LVREV_ReturnStatus_en LVREV_ApplyNewSettings(LVREV_Instance_st* pPrivate) {
         return LVREV_NULLADDRESS;
     }
 
+    /*
+     * A new sample rate needs the delay lines allocated for it by LVREV_SetControlParameters
+     */
+    if (((pPrivate->NewParams.SampleRate != pPrivate->CurrentParams.SampleRate) ||
+         (pPrivate->bFirstControl == LVM_TRUE)) &&
+        (pPrivate->NewDelaySampleRate != pPrivate->NewParams.SampleRate)) {
+        return LVREV_NULLADDRESS;
+    }
+
     OperatingMode = pPrivate->NewParams.OperatingMode;
 
     if (pPrivate->InstanceParams.NumDelays == LVREV_DELAYLINES_4) {
@@ -126,32 +179,39 @@ LVREV_ReturnStatus_en LVREV_ApplyNewSettings(LVREV_Instance_st* pPrivate) {
         (pPrivate->NewParams.SampleRate != pPrivate->CurrentParams.SampleRate) ||
         (pPrivate->bFirstControl == LVM_TRUE)) {
         LVM_UINT32 Temp;
-        LVM_INT32 APDelaySize;
-        LVM_INT32 Fs = LVM_GetFsFromTable(pPrivate->NewParams.SampleRate);
-        LVM_UINT32 DelayLengthSamples = (LVM_UINT32)(Fs * pPrivate->RoomSizeInms);
+        LVM_INT32 APDelaySize[LVREV_DELAYLINES_4];
+        LVM_INT32 FixedDelaySize[LVREV_DELAYLINES_4];
+        LVM_CHAR bNewRate =
+                (pPrivate->NewParams.SampleRate != pPrivate->CurrentParams.SampleRate) ||
+                (pPrivate->bFirstControl == LVM_TRUE);
         LVM_INT16 i;
-        LVM_FLOAT ScaleTable[] = {LVREV_T_3_Power_minus0_on_4, LVREV_T_3_Power_minus1_on_4,
-                                  LVREV_T_3_Power_minus2_on_4, LVREV_T_3_Power_minus3_on_4};
+
+        LVREV_GetDelaySizes(pPrivate->NewParams.SampleRate, pPrivate->RoomSizeInms,
+                            FixedDelaySize, APDelaySize);
 
         /*
-         * For each delay line
+         * Swap in the delay lines allocated for the new sample rate, the previous ones
+         * are released by the next LVREV_SetControlParameters call
          */
-        for (i = 0; i < NumberOfDelayLines; i++) {
-            if (i != 0) {
-                LVM_FLOAT Temp1; /* to avoid QAC warning on type conversion */
-
-                Temp1 = (LVM_FLOAT)DelayLengthSamples;
-                Temp = (LVM_UINT32)(Temp1 * ScaleTable[i]);
-            } else {
-                Temp = DelayLengthSamples;
+        if (bNewRate) {
+            for (i = 0; i < LVREV_DELAYLINES_4; i++) {
+                LVM_FLOAT* pDelay_T = pPrivate->pDelay_T[i];
+                LVM_INT32 T = pPrivate->T[i];
+
+                pPrivate->pDelay_T[i] = pPrivate->pNewDelay_T[i];
+                pPrivate->T[i] = pPrivate->NewT[i];
+                pPrivate->pNewDelay_T[i] = pDelay_T;
+                pPrivate->NewT[i] = T;
             }
-            APDelaySize = Temp / 1500;
+            pPrivate->NewDelaySampleRate = pPrivate->CurrentParams.SampleRate;
+        }
 
+        for (i = 0; i < NumberOfDelayLines; i++) {
             /*
              * Set the fixed delay
              */
 
-            Temp = (LVREV_MAX_T_DELAY[i] - LVREV_MAX_AP_DELAY[i]) * Fs / 192000;
+            Temp = FixedDelaySize[i];
             pPrivate->Delay_AP[i] = pPrivate->T[i] - Temp;
 
             /*
@@ -159,18 +219,29 @@ LVREV_ReturnStatus_en LVREV_ApplyNewSettings(LVREV_Instance_st* pPrivate) {
              */
             if (pPrivate->AB_Selection) {
                 /* Smooth from tap A to tap B */
-                pPrivate->pOffsetB[i] = &pPrivate->pDelay_T[i][pPrivate->T[i] - Temp - APDelaySize];
-                pPrivate->B_DelaySize[i] = APDelaySize;
+                pPrivate->pOffsetB[i] =
+                        &pPrivate->pDelay_T[i][pPrivate->T[i] - Temp - APDelaySize[i]];
+                pPrivate->B_DelaySize[i] = APDelaySize[i];
                 pPrivate->Mixer_APTaps[i].Target1 = 0;
                 pPrivate->Mixer_APTaps[i].Target2 = 1.0f;
             } else {
                 /* Smooth from tap B to tap A */
-                pPrivate->pOffsetA[i] = &pPrivate->pDelay_T[i][pPrivate->T[i] - Temp - APDelaySize];
-                pPrivate->A_DelaySize[i] = APDelaySize;
+                pPrivate->pOffsetA[i] =
+                        &pPrivate->pDelay_T[i][pPrivate->T[i] - Temp - APDelaySize[i]];
+                pPrivate->A_DelaySize[i] = APDelaySize[i];
                 pPrivate->Mixer_APTaps[i].Target2 = 0;
                 pPrivate->Mixer_APTaps[i].Target1 = 1.0f;
             }
 
+            /*
+             * The delay lines were swapped, smooth from the same tap
+             */
+            if (bNewRate) {
+                pPrivate->pOffsetA[i] = pPrivate->pOffsetB[i] =
+                        &pPrivate->pDelay_T[i][pPrivate->T[i] - Temp - APDelaySize[i]];
+                pPrivate->A_DelaySize[i] = pPrivate->B_DelaySize[i] = APDelaySize[i];
+            }
+
             /*
              * Set the maximum block size to the smallest delay size
              */
@@ -229,10 +300,10 @@ LVREV_ReturnStatus_en LVREV_ApplyNewSettings(LVREV_Instance_st* pPrivate) {
                 Coeffs.A1 = 0;
                 Coeffs.B1 = 0;
             }
-            const std::array<LVM_FLOAT, android::audio_utils::kBiquadNumCoefs> coefs = {
-                    Coeffs.A0, Coeffs.A1, 0.0, -(Coeffs.B1), 0.0};
-            pPrivate->revLPFBiquad[i].reset(
-                    new android::audio_utils::BiquadFilter<LVM_FLOAT>(FCC_1, coefs));
+            pPrivate->RevLPFCoefs[0][i] = Coeffs.A0;
+            pPrivate->RevLPFCoefs[1][i] = Coeffs.A1;
+            pPrivate->RevLPFCoefs[2][i] = Coeffs.B1;
+            pPrivate->RevLPFState[i] = 0;
         }
     }
 
@@ -59,9 +59,11 @@ LVREV_ReturnStatus_en LVREV_ClearAudioBuffers(LVREV_Handle_t hInstance) {
     pLVREV_Private->pRevHPFBiquad->clear();
     pLVREV_Private->pRevLPFBiquad->clear();
     for (size_t i = 0; i < pLVREV_Private->InstanceParams.NumDelays; i++) {
-        pLVREV_Private->revLPFBiquad[i]->clear();
-        memset(pLVREV_Private->pDelay_T[i], 0, LVREV_MAX_T_DELAY[i] *
-                sizeof(pLVREV_Private->pDelay_T[i][0]));
+        pLVREV_Private->RevLPFState[i] = 0;
+        if (pLVREV_Private->pDelay_T[i] != LVM_NULL) {
+            memset(pLVREV_Private->pDelay_T[i], 0,
+                   pLVREV_Private->T[i] * sizeof(pLVREV_Private->pDelay_T[i][0]));
+        }
     }
     return LVREV_SUCCESS;
 }
@@ -95,14 +95,17 @@ LVREV_ReturnStatus_en LVREV_GetInstanceHandle(LVREV_Handle_t* phInstance,
      * Set the data, coefficient and temporary memory pointers
      */
     for (size_t i = 0; i < pInstanceParams->NumDelays; i++) {
-        pLVREV_Private->pDelay_T[i] = (LVM_FLOAT*)calloc(LVREV_MAX_T_DELAY[i], sizeof(LVM_FLOAT));
         /* Scratch for each delay line output */
         pLVREV_Private->pScratchDelayLine[i] = (LVM_FLOAT*)calloc(MaxBlockSize, sizeof(LVM_FLOAT));
     }
-    /* All-pass delay buffer addresses and sizes */
+    /* All-pass delay buffers, allocated for the sample rate by LVREV_SetControlParameters */
     for (size_t i = 0; i < LVREV_DELAYLINES_4; i++) {
-        pLVREV_Private->T[i] = LVREV_MAX_T_DELAY[i];
+        pLVREV_Private->pDelay_T[i] = LVM_NULL;
+        pLVREV_Private->T[i] = 0;
+        pLVREV_Private->pNewDelay_T[i] = LVM_NULL;
+        pLVREV_Private->NewT[i] = 0;
     }
+    pLVREV_Private->NewDelaySampleRate = LVM_FS_INVALID;
     pLVREV_Private->AB_Selection = 1; /* Select smoothing A to B */
 
     /* General purpose scratch */
@@ -213,10 +216,6 @@ LVREV_ReturnStatus_en LVREV_GetInstanceHandle(LVREV_Handle_t* phInstance,
             new android::audio_utils::BiquadFilter<LVM_FLOAT>(LVM_MAX_CHANNELS));
     pLVREV_Private->pRevLPFBiquad.reset(
             new android::audio_utils::BiquadFilter<LVM_FLOAT>(LVM_MAX_CHANNELS));
-    for (int i = 0; i < LVREV_DELAYLINES_4; i++) {
-        pLVREV_Private->revLPFBiquad[i].reset(
-                new android::audio_utils::BiquadFilter<LVM_FLOAT>(LVM_MAX_CHANNELS));
-    }
 
     LVREV_ClearAudioBuffers(*phInstance);
 
@@ -250,6 +249,10 @@ LVREV_ReturnStatus_en LVREV_FreeInstance(LVREV_Handle_t hInstance) {
             free(pLVREV_Private->pDelay_T[i]);
             pLVREV_Private->pDelay_T[i] = LVM_NULL;
         }
+        if (pLVREV_Private->pNewDelay_T[i]) {
+            free(pLVREV_Private->pNewDelay_T[i]);
+            pLVREV_Private->pNewDelay_T[i] = LVM_NULL;
+        }
         if (pLVREV_Private->pScratchDelayLine[i]) {
             free(pLVREV_Private->pScratchDelayLine[i]);
             pLVREV_Private->pScratchDelayLine[i] = LVM_NULL;
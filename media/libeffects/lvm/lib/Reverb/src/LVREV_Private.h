@@ -124,8 +124,9 @@ typedef struct {
             pRevHPFBiquad; /* Biquad filter instance for HPF */
     std::unique_ptr<android::audio_utils::BiquadFilter<LVM_FLOAT>>
             pRevLPFBiquad; /* Biquad filter instance for LPF */
-    std::array<std::unique_ptr<android::audio_utils::BiquadFilter<LVM_FLOAT>>, LVREV_DELAYLINES_4>
-            revLPFBiquad; /* Biquad filter instance for Reverb LPF */
+    LVM_FLOAT RevLPFCoefs[3][LVREV_DELAYLINES_4]; /* Delay line LPF coefficients A0, A1
+                                                     and B1, one column per delay line */
+    LVM_FLOAT RevLPFState[LVREV_DELAYLINES_4];    /* Delay line LPF state */
     LVM_FLOAT* pScratchDelayLine[LVREV_DELAYLINES_4]; /* Delay line scratch memory */
     LVM_FLOAT* pScratch;             /* Multi ussge scratch */
     LVM_FLOAT* pInputSave;           /* Reverb block input save for dry/wet
@@ -136,8 +137,16 @@ typedef struct {
                                              caused by feedback Gain */
 
     /* All-Pass Filter */
-    LVM_INT32 T[LVREV_DELAYLINES_4];                          /* Maximum delay size of buffer */
+    LVM_INT32 T[LVREV_DELAYLINES_4];                          /* Delay buffer size, for the \
+                                                                 sample rate */
     LVM_FLOAT* pDelay_T[LVREV_DELAYLINES_4];                  /* Pointer to delay buffers */
+    LVM_INT32 NewT[LVREV_DELAYLINES_4];                       /* Delay buffer size for the new \
+                                                                 sample rate */
+    LVM_FLOAT* pNewDelay_T[LVREV_DELAYLINES_4];               /* Delay buffers for the new \
+                                                                 sample rate, swapped in when \
+                                                                 the parameters are applied */
+    LVM_Fs_en NewDelaySampleRate;                             /* Sample rate of the new delay \
+                                                                 buffers */
     LVM_INT32 Delay_AP[LVREV_DELAYLINES_4];                   /* Offset to AP delay buffer start */
     LVM_INT16 AB_Selection;                     /* Smooth from tap A to B when 1 \
                                                    otherwise B to A */
@@ -164,6 +173,10 @@ typedef struct {
 /****************************************************************************************/
 
 LVREV_ReturnStatus_en LVREV_ApplyNewSettings(LVREV_Instance_st* pPrivate);
+void LVREV_GetDelaySizes(LVM_Fs_en SampleRate, LVM_INT32 RoomSizeInms,
+                         LVM_INT32* pFixedDelaySize, LVM_INT32* pAPDelaySize);
+void LVREV_FeedbackNetwork(LVREV_Instance_st* pPrivate, const LVM_FLOAT* pInput,
+                           LVM_FLOAT* pOutput, LVM_INT16 NumSamples);
 void ReverbBlock(LVM_FLOAT* pInput, LVM_FLOAT* pOutput, LVREV_Instance_st* pPrivate,
                  LVM_UINT16 NumSamples);
 LVM_INT32 BypassMixer_Callback(void* pCallbackData, void* pGeneralPurpose,
@@ -20,9 +20,26 @@
 /* Includes                                                                             */
 /*                                                                                      */
 /****************************************************************************************/
+#include <string.h>
 #include "LVREV_Private.h"
 #include "VectorArithmetic.h"
 
+/*
+ * Generic vector type, lowered by the compiler to NEON on ARM and SSE on x86. Each lane
+ * holds one delay line of the feedback network.
+ */
+typedef LVM_FLOAT Float4 __attribute__((vector_size(4 * sizeof(LVM_FLOAT))));
+
+#define LVREV_ALWAYS_INLINE inline __attribute__((always_inline))
+
+/* Same as LVM_Clamp on every lane */
+static LVREV_ALWAYS_INLINE Float4 LVREV_Clamp(Float4 v) {
+    const Float4 one = Float4{} + 1.0f;
+    v = v < -one ? -one : v;
+    v = v > one ? one : v;
+    return v;
+}
+
 /****************************************************************************************/
 /*                                                                                      */
 /* FUNCTION:                LVREV_Process                                               */
@@ -40,6 +57,8 @@
 /*  LVREV_Success           Succeeded                                                   */
 /*  LVREV_INVALIDNUMSAMPLES NumSamples was larger than the maximum block size           */
 /*  LVREV_NULLADDRESS       When one of hInstance, pInData or pOutData is NULL          */
+/*  LVREV_NULLADDRESS       When the new settings could not be applied, they are        */
+/*                          retried on the next call                                    */
 /*                                                                                      */
 /* NOTES:                                                                               */
 /*  1. The input and output buffers must be 32-bit aligned                              */
@@ -52,6 +71,7 @@ LVREV_ReturnStatus_en LVREV_Process(LVREV_Handle_t hInstance, const LVM_FLOAT* p
     LVM_FLOAT* pOutput = pOutData;
     LVM_INT32 SamplesToProcess, RemainingSamples;
     LVM_INT32 format = 1;
+    LVREV_ReturnStatus_en errorCode = LVREV_SUCCESS;
 
     /*
      * Check for error conditions
@@ -66,17 +86,14 @@ LVREV_ReturnStatus_en LVREV_Process(LVREV_Handle_t hInstance, const LVM_FLOAT* p
      * Apply the new controls settings if required
      */
     if (pLVREV_Private->bControlPending == LVM_TRUE) {
-        LVREV_ReturnStatus_en errorCode;
-
         /*
-         * Clear the pending flag and update the control settings
+         * Update the control settings and clear the pending flag, the flag stays set on
+         * failure so the settings are applied by a later call
          */
-        pLVREV_Private->bControlPending = LVM_FALSE;
-
         errorCode = LVREV_ApplyNewSettings(pLVREV_Private);
 
-        if (errorCode != LVREV_SUCCESS) {
-            return errorCode;
+        if (errorCode == LVREV_SUCCESS) {
+            pLVREV_Private->bControlPending = LVM_FALSE;
         }
     }
 
@@ -84,18 +101,25 @@ LVREV_ReturnStatus_en LVREV_Process(LVREV_Handle_t hInstance, const LVM_FLOAT* p
      * Trap the case where the number of samples is zero.
      */
     if (NumSamples == 0) {
-        return LVREV_SUCCESS;
+        return errorCode;
     }
 
     /*
-     * If OFF copy and reformat the data as necessary
+     * If OFF, or no settings were applied yet so there are no delay lines, copy and
+     * reformat the data as necessary
      */
-    if (pLVREV_Private->CurrentParams.OperatingMode == LVM_MODE_OFF) {
+    if ((pLVREV_Private->CurrentParams.OperatingMode == LVM_MODE_OFF) ||
+        (pLVREV_Private->pDelay_T[0] == LVM_NULL)) {
+        LVM_Format_en SourceFormat = pLVREV_Private->CurrentParams.SourceFormat;
+
+        if (pLVREV_Private->bFirstControl == LVM_TRUE) {
+            SourceFormat = pLVREV_Private->NewParams.SourceFormat;
+        }
         if (pInput != pOutput) {
             /*
              * Copy the data to the output buffer, convert to stereo is required
              */
-            if (pLVREV_Private->CurrentParams.SourceFormat == LVM_MONO) {
+            if (SourceFormat == LVM_MONO) {
                 MonoTo2I_Float(pInput, pOutput, NumSamples);
             } else {
                 Copy_Float(pInput, pOutput,
@@ -103,7 +127,7 @@ LVREV_ReturnStatus_en LVREV_Process(LVREV_Handle_t hInstance, const LVM_FLOAT* p
             }
         }
 
-        return LVREV_SUCCESS;
+        return errorCode;
     }
 
     RemainingSamples = (LVM_INT32)NumSamples;
@@ -130,7 +154,132 @@ LVREV_ReturnStatus_en LVREV_Process(LVREV_Handle_t hInstance, const LVM_FLOAT* p
         pOutput = (LVM_FLOAT*)(pOutput + (SamplesToProcess * 2));  // Always stereo output
     }
 
-    return LVREV_SUCCESS;
+    return errorCode;
+}
+
+/****************************************************************************************/
+/*                                                                                      */
+/* FUNCTION:                FeedbackNetwork                                             */
+/*                                                                                      */
+/* DESCRIPTION:                                                                         */
+/*  Low pass filters the all-pass outputs, mixes them through the rotation matrix into  */
+/*  the delay line inputs and creates the stereo output, one sample of every delay line */
+/*  at a time.                                                                          */
+/*                                                                                      */
+/* PARAMETERS:                                                                          */
+/*  pPrivate                Pointer to the instance private parameters                  */
+/*  pInput                  Pointer to the filtered mono input                          */
+/*  pOutput                 Pointer to the stereo output                                */
+/*  NumSamples              Number of samples to process                                */
+/*                                                                                      */
+/* NOTES:                                                                               */
+/*  1. NumberOfDelayLines is 1, 2 or 4. The unused lanes are zero.                      */
+/*  2. The sums are saturated in the same order as the Add2_Sat_Float and               */
+/*     Mac3s_Sat_Float calls it replaces, so the output is unchanged.                   */
+/*                                                                                      */
+/****************************************************************************************/
+template <LVM_INT32 NumberOfDelayLines>
+static void FeedbackNetwork(LVREV_Instance_st* pPrivate, const LVM_FLOAT* pInput,
+                            LVM_FLOAT* pOutput, LVM_INT16 NumSamples) {
+    const LVM_FLOAT* pDelayLine[LVREV_DELAYLINES_4];
+    LVM_FLOAT* pDelayLineInput[LVREV_DELAYLINES_4];
+    Float4 A0, A1, B1, State;
+    LVM_INT16 i, j;
+
+    memcpy(&A0, pPrivate->RevLPFCoefs[0], sizeof(A0));
+    memcpy(&A1, pPrivate->RevLPFCoefs[1], sizeof(A1));
+    memcpy(&B1, pPrivate->RevLPFCoefs[2], sizeof(B1));
+    memcpy(&State, pPrivate->RevLPFState, sizeof(State));
+    for (j = 0; j < NumberOfDelayLines; j++) {
+        pDelayLine[j] = pPrivate->pScratchDelayLine[j];
+        pDelayLineInput[j] = &pPrivate->pDelay_T[j][pPrivate->T[j] - NumSamples];
+    }
+
+    for (i = 0; i < NumSamples; i++) {
+        Float4 In = Float4{} + pInput[i];
+        Float4 Line = {};
+        Float4 Mix;
+
+        for (j = 0; j < NumberOfDelayLines; j++) {
+            Line[j] = pDelayLine[j][i];
+        }
+
+        /*
+         *  Low pass filter
+         */
+        const Float4 Filtered = A0 * Line + State;
+        State = A1 * Line + B1 * Filtered;
+
+        /*
+         *  Rotation matrix mix and stereo output
+         */
+        if constexpr (NumberOfDelayLines == 4) {
+            /* In - 1 + 2, In - 0 + 3, In - 0 - 3, In - 1 - 2 */
+            Mix = LVREV_Clamp(In - __builtin_shufflevector(Filtered, Filtered, 1, 0, 0, 1));
+            Mix = LVREV_Clamp(Mix + __builtin_shufflevector(Filtered, Filtered, 2, 3, 3, 2) *
+                                            Float4{1.0f, 1.0f, -1.0f, -1.0f});
+            /* 0 + 3, 1 + 2 */
+            const Float4 Out = LVREV_Clamp(
+                    Filtered + __builtin_shufflevector(Filtered, Filtered, 3, 2, 1, 0));
+            pOutput[2 * i] = Out[0];
+            pOutput[2 * i + 1] = Out[1];
+        } else if constexpr (NumberOfDelayLines == 2) {
+            /* In + 0 - 1, In - 0 - 1 */
+            Mix = LVREV_Clamp(In + __builtin_shufflevector(Filtered, Filtered, 0, 0, 0, 0) *
+                                           Float4{1.0f, -1.0f, 0.0f, 0.0f});
+            Mix = LVREV_Clamp(Mix - __builtin_shufflevector(Filtered, Filtered, 1, 1, 1, 1));
+            /* 1 + 0, 1 - 0 */
+            const Float4 Out =
+                    LVREV_Clamp(__builtin_shufflevector(Filtered, Filtered, 1, 1, 1, 1) +
+                                __builtin_shufflevector(Filtered, Filtered, 0, 0, 0, 0) *
+                                        Float4{1.0f, -1.0f, 0.0f, 0.0f});
+            pOutput[2 * i] = Out[0];
+            pOutput[2 * i + 1] = Out[1];
+        } else {
+            /* In + 0 */
+            Mix = LVREV_Clamp(In + Filtered);
+            pOutput[2 * i] = Filtered[0];
+            pOutput[2 * i + 1] = Filtered[0];
+        }
+
+        /*
+         *  Delay samples
+         */
+        for (j = 0; j < NumberOfDelayLines; j++) {
+            pDelayLineInput[j][i] = Mix[j];
+        }
+    }
+
+    memcpy(pPrivate->RevLPFState, &State, sizeof(State));
+}
+
+/****************************************************************************************/
+/*                                                                                      */
+/* FUNCTION:                LVREV_FeedbackNetwork                                       */
+/*                                                                                      */
+/* DESCRIPTION:                                                                         */
+/*  Runs the feedback network for the number of delay lines of the instance.            */
+/*                                                                                      */
+/* PARAMETERS:                                                                          */
+/*  pPrivate                Pointer to the instance private parameters                  */
+/*  pInput                  Pointer to the filtered mono input                          */
+/*  pOutput                 Pointer to the stereo output                                */
+/*  NumSamples              Number of samples to process                                */
+/*                                                                                      */
+/****************************************************************************************/
+void LVREV_FeedbackNetwork(LVREV_Instance_st* pPrivate, const LVM_FLOAT* pInput,
+                           LVM_FLOAT* pOutput, LVM_INT16 NumSamples) {
+    switch (pPrivate->InstanceParams.NumDelays) {
+        case LVREV_DELAYLINES_4:
+            FeedbackNetwork<4>(pPrivate, pInput, pOutput, NumSamples);
+            break;
+        case LVREV_DELAYLINES_2:
+            FeedbackNetwork<2>(pPrivate, pInput, pOutput, NumSamples);
+            break;
+        default:
+            FeedbackNetwork<1>(pPrivate, pInput, pOutput, NumSamples);
+            break;
+    }
 }
 
 /****************************************************************************************/
@@ -159,7 +308,6 @@ void ReverbBlock(LVM_FLOAT* pInput, LVM_FLOAT* pOutput, LVREV_Instance_st* pPriv
                  LVM_UINT16 NumSamples) {
     LVM_INT16 j, size;
     LVM_FLOAT* pDelayLine;
-    LVM_FLOAT* pDelayLineInput = pPrivate->pScratch;
     LVM_FLOAT* pScratch = pPrivate->pScratch;
     LVM_FLOAT* pIn;
     LVM_FLOAT* pTemp = pPrivate->pInputSave;
@@ -207,9 +355,9 @@ void ReverbBlock(LVM_FLOAT* pInput, LVM_FLOAT* pOutput, LVREV_Instance_st* pPriv
     pPrivate->pRevHPFBiquad->process(pTemp, pTemp, NumSamples);
 
     /*
-     *  Low pass filter
+     *  Low pass filter, into the scratch as pTemp receives the stereo output
      */
-    pPrivate->pRevLPFBiquad->process(pTemp, pTemp, NumSamples);
+    pPrivate->pRevLPFBiquad->process(pScratch, pTemp, NumSamples);
 
     /*
      *  Process all delay lines
@@ -250,134 +398,13 @@ void ReverbBlock(LVM_FLOAT* pInput, LVM_FLOAT* pOutput, LVREV_Instance_st* pPriv
          *  Feedback gain
          */
         MixSoft_1St_D32C31_WRA(&pPrivate->FeedbackMixer[j], pDelayLine, pDelayLine, NumSamples);
-
-        /*
-         *  Low pass filter
-         */
-        pPrivate->revLPFBiquad[j]->process(pDelayLine, pDelayLine, NumSamples);
-    }
-
-    /*
-     *  Apply rotation matrix and delay samples
-     */
-    for (j = 0; j < NumberOfDelayLines; j++) {
-        Copy_Float(pTemp, pDelayLineInput, (LVM_INT16)(NumSamples));
-        /*
-         *  Rotation matrix mix
-         */
-        switch (j) {
-            case 3:
-                /*
-                 *  Add delay line 1 and 2 contribution
-                 */
-                Mac3s_Sat_Float(pPrivate->pScratchDelayLine[1], -1.0f, pDelayLineInput,
-                                (LVM_INT16)NumSamples);
-                Mac3s_Sat_Float(pPrivate->pScratchDelayLine[2], -1.0f, pDelayLineInput,
-                                (LVM_INT16)NumSamples);
-
-                break;
-            case 2:
-
-                /*
-                 *  Add delay line 0 and 3 contribution
-                 */
-                Mac3s_Sat_Float(pPrivate->pScratchDelayLine[0], -1.0f, pDelayLineInput,
-                                (LVM_INT16)NumSamples);
-                Mac3s_Sat_Float(pPrivate->pScratchDelayLine[3], -1.0f, pDelayLineInput,
-                                (LVM_INT16)NumSamples);
-
-                break;
-            case 1:
-                if (pPrivate->InstanceParams.NumDelays == LVREV_DELAYLINES_4) {
-                    /*
-                     *  Add delay line 0 and 3 contribution
-                     */
-                    Mac3s_Sat_Float(pPrivate->pScratchDelayLine[0], -1.0f, pDelayLineInput,
-                                    (LVM_INT16)NumSamples);
-                    Add2_Sat_Float(pPrivate->pScratchDelayLine[3], pDelayLineInput,
-                                   (LVM_INT16)NumSamples);
-
-                } else {
-                    /*
-                     *  Add delay line 0 and 1 contribution
-                     */
-                    Mac3s_Sat_Float(pPrivate->pScratchDelayLine[0], -1.0f, pDelayLineInput,
-                                    (LVM_INT16)NumSamples);
-                    Mac3s_Sat_Float(pPrivate->pScratchDelayLine[1], -1.0f, pDelayLineInput,
-                                    (LVM_INT16)NumSamples);
-                }
-                break;
-            case 0:
-                if (pPrivate->InstanceParams.NumDelays == LVREV_DELAYLINES_4) {
-                    /*
-                     *  Add delay line 1 and 2 contribution
-                     */
-                    Mac3s_Sat_Float(pPrivate->pScratchDelayLine[1], -1.0f, pDelayLineInput,
-                                    (LVM_INT16)NumSamples);
-                    Add2_Sat_Float(pPrivate->pScratchDelayLine[2], pDelayLineInput,
-                                   (LVM_INT16)NumSamples);
-
-                } else if (pPrivate->InstanceParams.NumDelays == LVREV_DELAYLINES_2) {
-                    /*
-                     *  Add delay line 0 and 1 contribution
-                     */
-                    Add2_Sat_Float(pPrivate->pScratchDelayLine[0], pDelayLineInput,
-                                   (LVM_INT16)NumSamples);
-                    Mac3s_Sat_Float(pPrivate->pScratchDelayLine[1], -1.0f, pDelayLineInput,
-                                    (LVM_INT16)NumSamples);
-
-                } else {
-                    /*
-                     *  Add delay line 0 contribution
-                     */
-
-                    /*             SOURCE                          DESTINATION*/
-                    Add2_Sat_Float(pPrivate->pScratchDelayLine[0], pDelayLineInput,
-                                   (LVM_INT16)NumSamples);
-                }
-                break;
-            default:
-                break;
-        }
-
-        /*
-         *  Delay samples
-         */
-        Copy_Float(pDelayLineInput, &pPrivate->pDelay_T[j][pPrivate->T[j] - NumSamples],
-                   (LVM_INT16)(NumSamples)); /* 32-bit data */
     }
 
     /*
-     *  Create stereo output
+     *  Low pass filter the delay lines, apply rotation matrix, delay samples and
+     *  create stereo output
      */
-    switch (pPrivate->InstanceParams.NumDelays) {
-        case LVREV_DELAYLINES_4:
-            Add2_Sat_Float(pPrivate->pScratchDelayLine[3], pPrivate->pScratchDelayLine[0],
-                           (LVM_INT16)NumSamples);
-            Add2_Sat_Float(pPrivate->pScratchDelayLine[2], pPrivate->pScratchDelayLine[1],
-                           (LVM_INT16)NumSamples);
-
-            JoinTo2i_Float(pPrivate->pScratchDelayLine[0], pPrivate->pScratchDelayLine[1], pTemp,
-                           (LVM_INT16)NumSamples);
-
-            break;
-        case LVREV_DELAYLINES_2:
-
-            Copy_Float(pPrivate->pScratchDelayLine[1], pScratch, (LVM_INT16)(NumSamples));
-
-            Mac3s_Sat_Float(pPrivate->pScratchDelayLine[0], -1.0f, pScratch, (LVM_INT16)NumSamples);
-
-            Add2_Sat_Float(pPrivate->pScratchDelayLine[1], pPrivate->pScratchDelayLine[0],
-                           (LVM_INT16)NumSamples);
-
-            JoinTo2i_Float(pPrivate->pScratchDelayLine[0], pScratch, pTemp, (LVM_INT16)NumSamples);
-            break;
-        case LVREV_DELAYLINES_1:
-            MonoTo2I_Float(pPrivate->pScratchDelayLine[0], pTemp, (LVM_INT16)NumSamples);
-            break;
-        default:
-            break;
-    }
+    LVREV_FeedbackNetwork(pPrivate, pScratch, pTemp, (LVM_INT16)NumSamples);
 
     /*
      *  Dry/wet mixer
@@ -20,8 +20,84 @@
 /*  Includes                                                                            */
 /*                                                                                      */
 /****************************************************************************************/
+#include <string.h>
 #include "LVREV_Private.h"
 
+/****************************************************************************************/
+/*                                                                                      */
+/* FUNCTION:                LVREV_PrepareDelayLines                                     */
+/*                                                                                      */
+/* DESCRIPTION:                                                                         */
+/*  Makes the new delay buffers ready for a sample rate. They are sized for the largest */
+/*  room so room size changes only move the taps, and are swapped in by                 */
+/*  LVREV_ApplyNewSettings so the processing path never allocates.                      */
+/*                                                                                      */
+/* PARAMETERS:                                                                          */
+/*  pPrivate                Pointer to the instance                                     */
+/*  SampleRate              Sample rate of the new parameters                           */
+/*                                                                                      */
+/* RETURNS:                                                                             */
+/*  LVREV_Success           Succeeded                                                   */
+/*  LVREV_NULLADDRESS       When a delay buffer could not be allocated                  */
+/*                                                                                      */
+/* NOTES:                                                                               */
+/*  1. LVREV_Process must not apply new settings while this function runs              */
+/*                                                                                      */
+/****************************************************************************************/
+static LVREV_ReturnStatus_en LVREV_PrepareDelayLines(LVREV_Instance_st* pPrivate,
+                                                     LVM_Fs_en SampleRate) {
+    LVM_INT32 FixedDelaySize[LVREV_DELAYLINES_4];
+    LVM_INT32 APDelaySize[LVREV_DELAYLINES_4];
+    LVM_FLOAT* pDelay_T[LVREV_DELAYLINES_4] = {};
+    LVM_INT32 i;
+
+    /*
+     * The buffers in use already match, the new ones are not needed
+     */
+    if (SampleRate == pPrivate->CurrentParams.SampleRate) {
+        for (i = 0; i < LVREV_DELAYLINES_4; i++) {
+            free(pPrivate->pNewDelay_T[i]);
+            pPrivate->pNewDelay_T[i] = LVM_NULL;
+            pPrivate->NewT[i] = 0;
+        }
+        pPrivate->NewDelaySampleRate = LVM_FS_INVALID;
+        return LVREV_SUCCESS;
+    }
+
+    /*
+     * The new buffers match already, they may hold the history of an earlier use
+     */
+    if (SampleRate == pPrivate->NewDelaySampleRate) {
+        for (i = 0; i < (LVM_INT32)pPrivate->InstanceParams.NumDelays; i++) {
+            memset(pPrivate->pNewDelay_T[i], 0, pPrivate->NewT[i] * sizeof(LVM_FLOAT));
+        }
+        return LVREV_SUCCESS;
+    }
+
+    /*
+     * 100% room size -- 120ms
+     */
+    LVREV_GetDelaySizes(SampleRate, 10 + (((LVREV_MAX_ROOMSIZE * 11) + 5) / 10), FixedDelaySize,
+                        APDelaySize);
+    for (i = 0; i < (LVM_INT32)pPrivate->InstanceParams.NumDelays; i++) {
+        pDelay_T[i] = (LVM_FLOAT*)calloc(FixedDelaySize[i] + APDelaySize[i], sizeof(LVM_FLOAT));
+        if (pDelay_T[i] == LVM_NULL) {
+            while (i-- > 0) {
+                free(pDelay_T[i]);
+            }
+            return LVREV_NULLADDRESS;
+        }
+    }
+    for (i = 0; i < LVREV_DELAYLINES_4; i++) {
+        free(pPrivate->pNewDelay_T[i]);
+        pPrivate->pNewDelay_T[i] = pDelay_T[i];
+        pPrivate->NewT[i] = (pDelay_T[i] == LVM_NULL) ? 0 : FixedDelaySize[i] + APDelaySize[i];
+    }
+    pPrivate->NewDelaySampleRate = SampleRate;
+
+    return LVREV_SUCCESS;
+}
+
 /****************************************************************************************/
 /*                                                                                      */
 /* FUNCTION:                LVREV_SetControlParameters                                  */
@@ -37,9 +113,13 @@
 /*  LVM_Success             Succeeded                                                   */
 /*  LVREV_NULLADDRESS       When hInstance or pNewParams is NULL                        */
 /*  LVREV_OUTOFRANGE        When any of the new parameters is out of range              */
+/*  LVREV_NULLADDRESS       When the delay buffers for the sample rate could not be     */
+/*                          allocated, the previous parameters stay in use              */
 /*                                                                                      */
 /* NOTES:                                                                               */
 /*  1.  This function may be interrupted by the LVREV_Process function                  */
+/*  2.  The delay buffers for a new sample rate are allocated here, not in the          */
+/*      LVREV_Process function                                                          */
 /*                                                                                      */
 /****************************************************************************************/
 LVREV_ReturnStatus_en LVREV_SetControlParameters(LVREV_Handle_t hInstance,
@@ -99,6 +179,20 @@ LVREV_ReturnStatus_en LVREV_SetControlParameters(LVREV_Handle_t hInstance,
         return LVREV_OUTOFRANGE;
     }
 
+    /*
+     * Hold back any pending parameters while the delay buffers are prepared
+     */
+    LVM_CHAR bControlPending = pLVREV_Private->bControlPending;
+    pLVREV_Private->bControlPending = LVM_FALSE;
+
+    if (LVREV_PrepareDelayLines(pLVREV_Private, pNewParams->SampleRate) != LVREV_SUCCESS) {
+        /*
+         * A pending sample rate keeps its own buffers, see LVREV_PrepareDelayLines
+         */
+        pLVREV_Private->bControlPending = bControlPending;
+        return LVREV_NULLADDRESS;
+    }
+
     /*
      * Copy the new parameters and set the flag to indicate they are available
      */
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <audio_utils/BiquadFilter.h>
+#include <gtest/gtest.h>
+#include <LVM_BiquadCascade.h>
+
+using android::audio_utils::BiquadFilter;
+
+constexpr size_t kChannelCounts[] = {1, 2, 3, 4, 5, 6, 7, 8, 12, 24};
+constexpr size_t kSectionCounts[] = {0, 1, 2, 3, 4, 5, 8, 9, 13, 20};
+// Block sizes used one after the other, shorter and longer than the cascade
+constexpr size_t kFrameCounts[] = {1, 3, 64, 2, 480, 7, 1024};
+constexpr float kTolerance = 1e-5f;
+
+// Stable sections with poles of radius 0.5 to 0.95
+static std::vector<LVM_BiquadCascade::Coefs> randomSections(size_t sectionCount,
+                                                            std::minstd_rand& gen) {
+    std::uniform_real_distribution<float> numerator(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> radius(0.5f, 0.95f);
+    std::uniform_real_distribution<float> angle(0.0f, M_PI);
+    std::vector<LVM_BiquadCascade::Coefs> sections(sectionCount);
+    for (auto& coefs : sections) {
+        const float r = radius(gen);
+        coefs = {numerator(gen), numerator(gen), numerator(gen), -2.0f * r * cosf(angle(gen)),
+                 r * r};
+    }
+    return sections;
+}
+
+class BiquadCascadeTest : public ::testing::TestWithParam<std::tuple<size_t, size_t, bool>> {
+  public:
+    BiquadCascadeTest()
+        : mChannelCount(std::get<0>(GetParam())),
+          mSectionCount(std::get<1>(GetParam())),
+          mInPlace(std::get<2>(GetParam())) {}
+
+    // Compares the cascade with the sections run one after the other, across blocks.
+    // With gains, each section adds its filter output times the gain to its input.
+    void compareWithSerialBiquads(bool withGains) {
+        std::minstd_rand gen(mChannelCount * 100 + mSectionCount);
+        const auto sections = randomSections(mSectionCount, gen);
+        std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+        std::vector<float> gains(mSectionCount);
+        for (auto& gain : gains) {
+            gain = dis(gen);
+        }
+
+        LVM_BiquadCascade cascade(mChannelCount);
+        cascade.setSections(sections.data(), sections.size(),
+                            withGains ? gains.data() : nullptr);
+        ASSERT_EQ(mSectionCount, cascade.getSectionCount());
+        std::vector<BiquadFilter<float>> reference;
+        for (const auto& coefs : sections) {
+            reference.emplace_back(mChannelCount);
+            reference.back().setCoefficients(coefs);
+        }
+
+        for (size_t frameCount : kFrameCounts) {
+            SCOPED_TRACE(testing::Message() << "frameCount: " << frameCount);
+            const size_t sampleCount = frameCount * mChannelCount;
+            std::vector<float> input(sampleCount);
+            for (auto& in : input) {
+                in = dis(gen);
+            }
+
+            std::vector<float> expected(input);
+            std::vector<float> filtered(sampleCount);
+            for (size_t k = 0; k < mSectionCount; k++) {
+                if (withGains) {
+                    reference[k].process(filtered.data(), expected.data(), frameCount);
+                    for (size_t i = 0; i < sampleCount; i++) {
+                        expected[i] += filtered[i] * gains[k];
+                    }
+                } else {
+                    reference[k].process(expected.data(), expected.data(), frameCount);
+                }
+            }
+
+            std::vector<float> output(sampleCount);
+            if (mInPlace) {
+                output = input;
+                cascade.process(output.data(), output.data(), frameCount);
+            } else {
+                cascade.process(output.data(), input.data(), frameCount);
+            }
+            for (size_t i = 0; i < sampleCount; i++) {
+                ASSERT_NEAR(expected[i], output[i], kTolerance) << "sample " << i;
+            }
+        }
+    }
+
+    const size_t mChannelCount;
+    const size_t mSectionCount;
+    const bool mInPlace;
+};
+
+TEST_P(BiquadCascadeTest, MatchesSerialBiquads) {
+    compareWithSerialBiquads(false);
+}
+
+TEST_P(BiquadCascadeTest, MatchesSerialBiquadsWithGains) {
+    compareWithSerialBiquads(true);
+}
+
+
+// Clearing the history gives the same output as a new cascade
+TEST_P(BiquadCascadeTest, Clear) {
+    std::minstd_rand gen(mChannelCount * 100 + mSectionCount);
+    const auto sections = randomSections(mSectionCount, gen);
+    LVM_BiquadCascade cascade(mChannelCount);
+    cascade.setSections(sections.data(), sections.size());
+    LVM_BiquadCascade fresh(mChannelCount);
+    fresh.setSections(sections.data(), sections.size());
+
+    const size_t frameCount = 256;
+    std::vector<float> input(frameCount * mChannelCount);
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+    for (auto& in : input) {
+        in = dis(gen);
+    }
+    std::vector<float> output(input.size());
+    cascade.process(output.data(), input.data(), frameCount);
+    cascade.clear();
+
+    std::vector<float> expected(input.size());
+    fresh.process(expected.data(), input.data(), frameCount);
+    cascade.process(output.data(), input.data(), frameCount);
+    EXPECT_EQ(expected, output);
+}
+
+INSTANTIATE_TEST_SUITE_P(BiquadCascadeTestAll, BiquadCascadeTest,
+                         ::testing::Combine(::testing::ValuesIn(kChannelCounts),
+                                            ::testing::ValuesIn(kSectionCounts),
+                                            ::testing::Bool()));
+
+// Every channel is filtered the same way whatever the channel count
+TEST(BiquadCascadeChannelsTest, ChannelsMatchMono) {
+    std::minstd_rand gen(42);
+    const auto sections = randomSections(5, gen);
+    const size_t frameCount = 512;
+    std::vector<float> mono(frameCount);
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+    for (auto& in : mono) {
+        in = dis(gen);
+    }
+
+    LVM_BiquadCascade monoCascade(FCC_1);
+    monoCascade.setSections(sections.data(), sections.size());
+    std::vector<float> monoOutput(frameCount);
+    monoCascade.process(monoOutput.data(), mono.data(), frameCount);
+
+    for (size_t channelCount : kChannelCounts) {
+        SCOPED_TRACE(testing::Message() << "channelCount: " << channelCount);
+        LVM_BiquadCascade cascade(channelCount);
+        cascade.setSections(sections.data(), sections.size());
+        std::vector<float> data(frameCount * channelCount);
+        for (size_t i = 0; i < frameCount; i++) {
+            std::fill_n(&data[i * channelCount], channelCount, mono[i]);
+        }
+        cascade.process(data.data(), data.data(), frameCount);
+        for (size_t i = 0; i < data.size(); i++) {
+            ASSERT_EQ(monoOutput[i / channelCount], data[i]) << "sample " << i;
+        }
+    }
+}
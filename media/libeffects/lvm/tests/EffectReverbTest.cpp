@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <cmath>
+
 #include <audio_effects/effect_presetreverb.h>
 #include <VectorArithmetic.h>
 
@@ -231,6 +233,64 @@ INSTANTIATE_TEST_SUITE_P(
                            ::testing::Range(0, (int)kNumEffectUuids),
                            ::testing::Range(0, (int)kNumPresets)));
 
+typedef std::tuple<int, int> PresetChangeTestParam;
+class PresetChangeTest : public ::testing::TestWithParam<PresetChangeTestParam> {
+  public:
+    PresetChangeTest()
+        : mSampleRate(EffectTestHelper::kSampleRates[std::get<0>(GetParam())]),
+          mUuid(&kEffectUuids[std::get<1>(GetParam())]),
+          mInChMask(isAuxMode(mUuid) ? AUDIO_CHANNEL_OUT_MONO : AUDIO_CHANNEL_OUT_STEREO),
+          mInChannelCount(audio_channel_count_from_out_mask(mInChMask)) {}
+
+    static constexpr size_t kFrameCount = 256;
+    static constexpr size_t kLoopCount = 8;
+
+    const size_t mSampleRate;
+    const effect_uuid_t* mUuid;
+    const size_t mInChMask;
+    const size_t mInChannelCount;
+};
+
+// Changes the preset while processing, so that the delay lines grow and shrink with the
+// room size, and checks the output stays valid
+TEST_P(PresetChangeTest, ProcessAcrossPresets) {
+    SCOPED_TRACE(testing::Message() << "sampleRate: " << mSampleRate);
+
+    EffectTestHelper effect(mUuid, mInChMask, AUDIO_CHANNEL_OUT_STEREO, mSampleRate, kFrameCount,
+                            kLoopCount);
+
+    ASSERT_NO_FATAL_FAILURE(effect.createEffect());
+    ASSERT_NO_FATAL_FAILURE(effect.setConfig());
+
+    const size_t totalFrameCount = kFrameCount * kLoopCount;
+    std::vector<float> input(totalFrameCount * mInChannelCount);
+    std::vector<float> output(totalFrameCount * FCC_2);
+    std::minstd_rand gen(mSampleRate);
+    std::uniform_real_distribution<> dis(-1.0f, 1.0f);
+    for (auto& in : input) {
+        in = dis(gen);
+    }
+    // Small to large rooms and back
+    constexpr int kPresetOrder[] = {
+            REVERB_PRESET_SMALLROOM, REVERB_PRESET_MEDIUMROOM, REVERB_PRESET_LARGEHALL,
+            REVERB_PRESET_PLATE,     REVERB_PRESET_SMALLROOM,  REVERB_PRESET_LARGEROOM,
+    };
+    for (int preset : kPresetOrder) {
+        SCOPED_TRACE(testing::Message() << "preset: " << preset);
+        ASSERT_NO_FATAL_FAILURE(effect.setParam(REVERB_PARAM_PRESET, preset));
+        ASSERT_NO_FATAL_FAILURE(effect.process(input.data(), output.data()));
+        for (const float out : output) {
+            ASSERT_TRUE(std::isfinite(out));
+        }
+    }
+    ASSERT_NO_FATAL_FAILURE(effect.releaseEffect());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        EffectReverbTestAll, PresetChangeTest,
+        ::testing::Combine(::testing::Range(0, (int)EffectTestHelper::kNumSampleRates),
+                           ::testing::Range(0, (int)kNumEffectUuids)));
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     int status = RUN_ALL_TESTS();
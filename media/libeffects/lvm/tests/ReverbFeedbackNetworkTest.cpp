@@ -0,0 +1,222 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <audio_utils/BiquadFilter.h>
+#include <gtest/gtest.h>
+#include <system/audio.h>
+#include "LVREV_Private.h"
+
+using android::audio_utils::BiquadFilter;
+
+constexpr LVREV_NumDelayLines_en kNumDelays[] = {LVREV_DELAYLINES_1, LVREV_DELAYLINES_2,
+                                                 LVREV_DELAYLINES_4};
+constexpr LVM_UINT16 kRoomSizes[] = {0, 20, 50, 100};
+// Block sizes used one after the other
+constexpr LVM_INT16 kFrameCounts[] = {1, 3, 64, 2, 480, 7, 512};
+constexpr LVM_UINT16 kMaxBlockSize = 512;
+constexpr float kTolerance = 1e-6f;
+
+// Feedback network of the delay lines one after the other, as ReverbBlock ran it before
+// the lines were processed together: a low pass biquad per line, then the rotation matrix
+// and the stereo output built from the saturating vector functions.
+class ScalarFeedbackNetwork {
+  public:
+    explicit ScalarFeedbackNetwork(const LVREV_Instance_st* pPrivate)
+        : mNumberOfDelayLines(pPrivate->InstanceParams.NumDelays == LVREV_DELAYLINES_4   ? 4
+                              : pPrivate->InstanceParams.NumDelays == LVREV_DELAYLINES_2 ? 2
+                                                                                          : 1) {
+        for (LVM_INT32 j = 0; j < mNumberOfDelayLines; j++) {
+            const std::array<LVM_FLOAT, android::audio_utils::kBiquadNumCoefs> coefs = {
+                    pPrivate->RevLPFCoefs[0][j], pPrivate->RevLPFCoefs[1][j], 0.0f,
+                    -pPrivate->RevLPFCoefs[2][j], 0.0f};
+            mLowPass.emplace_back(FCC_1, coefs);
+            mDelay.emplace_back(pPrivate->pDelay_T[j], pPrivate->pDelay_T[j] + pPrivate->T[j]);
+        }
+    }
+
+    const std::vector<LVM_FLOAT>& delay(LVM_INT32 j) const { return mDelay[j]; }
+
+    // Filters the delay line outputs in place and writes the delay line inputs and the
+    // stereo output
+    void process(std::vector<std::vector<LVM_FLOAT>>& delayLine, const LVM_FLOAT* pInput,
+                 LVM_FLOAT* pOutput, LVM_INT16 NumSamples) {
+        std::vector<LVM_FLOAT> delayLineInput(NumSamples);
+        std::vector<LVM_FLOAT> scratch(NumSamples);
+        LVM_INT32 j;
+
+        for (j = 0; j < mNumberOfDelayLines; j++) {
+            mLowPass[j].process(delayLine[j].data(), delayLine[j].data(), NumSamples);
+        }
+        for (j = 0; j < mNumberOfDelayLines; j++) {
+            Copy_Float(pInput, delayLineInput.data(), NumSamples);
+            switch (j) {
+                case 3:
+                    Mac3s_Sat_Float(delayLine[1].data(), -1.0f, delayLineInput.data(), NumSamples);
+                    Mac3s_Sat_Float(delayLine[2].data(), -1.0f, delayLineInput.data(), NumSamples);
+                    break;
+                case 2:
+                    Mac3s_Sat_Float(delayLine[0].data(), -1.0f, delayLineInput.data(), NumSamples);
+                    Mac3s_Sat_Float(delayLine[3].data(), -1.0f, delayLineInput.data(), NumSamples);
+                    break;
+                case 1:
+                    if (mNumberOfDelayLines == 4) {
+                        Mac3s_Sat_Float(delayLine[0].data(), -1.0f, delayLineInput.data(),
+                                        NumSamples);
+                        Add2_Sat_Float(delayLine[3].data(), delayLineInput.data(), NumSamples);
+                    } else {
+                        Mac3s_Sat_Float(delayLine[0].data(), -1.0f, delayLineInput.data(),
+                                        NumSamples);
+                        Mac3s_Sat_Float(delayLine[1].data(), -1.0f, delayLineInput.data(),
+                                        NumSamples);
+                    }
+                    break;
+                case 0:
+                    if (mNumberOfDelayLines == 4) {
+                        Mac3s_Sat_Float(delayLine[1].data(), -1.0f, delayLineInput.data(),
+                                        NumSamples);
+                        Add2_Sat_Float(delayLine[2].data(), delayLineInput.data(), NumSamples);
+                    } else if (mNumberOfDelayLines == 2) {
+                        Add2_Sat_Float(delayLine[0].data(), delayLineInput.data(), NumSamples);
+                        Mac3s_Sat_Float(delayLine[1].data(), -1.0f, delayLineInput.data(),
+                                        NumSamples);
+                    } else {
+                        Add2_Sat_Float(delayLine[0].data(), delayLineInput.data(), NumSamples);
+                    }
+                    break;
+            }
+            Copy_Float(delayLineInput.data(), &mDelay[j][mDelay[j].size() - NumSamples],
+                       NumSamples);
+        }
+
+        switch (mNumberOfDelayLines) {
+            case 4:
+                Add2_Sat_Float(delayLine[3].data(), delayLine[0].data(), NumSamples);
+                Add2_Sat_Float(delayLine[2].data(), delayLine[1].data(), NumSamples);
+                JoinTo2i_Float(delayLine[0].data(), delayLine[1].data(), pOutput, NumSamples);
+                break;
+            case 2:
+                Copy_Float(delayLine[1].data(), scratch.data(), NumSamples);
+                Mac3s_Sat_Float(delayLine[0].data(), -1.0f, scratch.data(), NumSamples);
+                Add2_Sat_Float(delayLine[1].data(), delayLine[0].data(), NumSamples);
+                JoinTo2i_Float(delayLine[0].data(), scratch.data(), pOutput, NumSamples);
+                break;
+            default:
+                MonoTo2I_Float(delayLine[0].data(), pOutput, NumSamples);
+                break;
+        }
+    }
+
+  private:
+    const LVM_INT32 mNumberOfDelayLines;
+    std::vector<BiquadFilter<LVM_FLOAT>> mLowPass;
+    std::vector<std::vector<LVM_FLOAT>> mDelay;
+};
+
+class ReverbFeedbackNetworkTest
+    : public ::testing::TestWithParam<std::tuple<LVREV_NumDelayLines_en, LVM_UINT16>> {
+  public:
+    ReverbFeedbackNetworkTest()
+        : mNumDelays(std::get<0>(GetParam())), mRoomSize(std::get<1>(GetParam())) {}
+
+    void SetUp() override {
+        LVREV_InstanceParams_st instanceParams{};
+        instanceParams.MaxBlockSize = kMaxBlockSize;
+        instanceParams.SourceFormat = LVM_STEREO;
+        instanceParams.NumDelays = mNumDelays;
+        ASSERT_EQ(LVREV_SUCCESS, LVREV_GetInstanceHandle(&mHandle, &instanceParams));
+
+        LVREV_ControlParams_st controlParams{};
+        controlParams.OperatingMode = LVM_MODE_ON;
+        controlParams.SampleRate = LVM_FS_48000;
+        controlParams.SourceFormat = LVM_STEREO;
+        controlParams.Level = 100;
+        controlParams.LPF = 8000;
+        controlParams.HPF = 50;
+        controlParams.T60 = 1500;
+        controlParams.Density = 100;
+        controlParams.Damping = 40;
+        controlParams.RoomSize = mRoomSize;
+        ASSERT_EQ(LVREV_SUCCESS, LVREV_SetControlParameters(mHandle, &controlParams));
+
+        // Processing no samples applies the settings
+        LVM_FLOAT sample = 0.0f;
+        ASSERT_EQ(LVREV_SUCCESS, LVREV_Process(mHandle, &sample, &sample, 0));
+    }
+
+    void TearDown() override {
+        if (mHandle != LVM_NULL) {
+            EXPECT_EQ(LVREV_SUCCESS, LVREV_FreeInstance(mHandle));
+        }
+    }
+
+  protected:
+    const LVREV_NumDelayLines_en mNumDelays;
+    const LVM_UINT16 mRoomSize;
+    LVREV_Handle_t mHandle = LVM_NULL;
+};
+
+// Compares the vectorized feedback network with the lines run one after the other, across
+// blocks. The delay line outputs go past full scale to exercise the saturation.
+TEST_P(ReverbFeedbackNetworkTest, MatchesScalarDelayLines) {
+    LVREV_Instance_st* pPrivate = (LVREV_Instance_st*)mHandle;
+    const LVM_INT32 numberOfDelayLines = mNumDelays == LVREV_DELAYLINES_4   ? 4
+                                         : mNumDelays == LVREV_DELAYLINES_2 ? 2
+                                                                            : 1;
+    ScalarFeedbackNetwork reference(pPrivate);
+    std::minstd_rand gen(mNumDelays * 1000 + mRoomSize);
+    std::uniform_real_distribution<float> dis(-1.5f, 1.5f);
+
+    for (LVM_INT16 frameCount : kFrameCounts) {
+        SCOPED_TRACE(testing::Message() << "frameCount: " << frameCount);
+        std::vector<LVM_FLOAT> input(frameCount);
+        std::vector<std::vector<LVM_FLOAT>> delayLine(numberOfDelayLines,
+                                                      std::vector<LVM_FLOAT>(frameCount));
+        for (auto& sample : input) {
+            sample = dis(gen);
+        }
+        for (LVM_INT32 j = 0; j < numberOfDelayLines; j++) {
+            for (auto& sample : delayLine[j]) {
+                sample = dis(gen);
+            }
+            Copy_Float(delayLine[j].data(), pPrivate->pScratchDelayLine[j], frameCount);
+        }
+
+        std::vector<LVM_FLOAT> output(frameCount * 2);
+        std::vector<LVM_FLOAT> referenceOutput(frameCount * 2);
+        LVREV_FeedbackNetwork(pPrivate, input.data(), output.data(), frameCount);
+        reference.process(delayLine, input.data(), referenceOutput.data(), frameCount);
+
+        for (size_t i = 0; i < output.size(); i++) {
+            ASSERT_NEAR(referenceOutput[i], output[i], kTolerance) << "sample " << i;
+        }
+        for (LVM_INT32 j = 0; j < numberOfDelayLines; j++) {
+            ASSERT_EQ(reference.delay(j).size(), (size_t)pPrivate->T[j]);
+            for (LVM_INT32 i = 0; i < pPrivate->T[j]; i++) {
+                ASSERT_NEAR(reference.delay(j)[i], pPrivate->pDelay_T[j][i], kTolerance)
+                        << "delay line " << j << " sample " << i;
+            }
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(ReverbFeedbackNetworkTestAll, ReverbFeedbackNetworkTest,
+                         ::testing::Combine(::testing::ValuesIn(kNumDelays),
+                                            ::testing::ValuesIn(kRoomSizes)));
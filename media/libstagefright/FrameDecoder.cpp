@@ -683,6 +683,8 @@ status_t VideoFrameDecoder::onOutputReceived(
     }
 
     ColorConverter converter((OMX_COLOR_FORMATTYPE)srcFormat, dstFormat());
+    // large frames are converted in bands on multiple threads
+    converter.setNumThreads(0);
 
     uint32_t standard, range, transfer;
     if (!outputFormat->findInt32("color-standard", (int32_t*)&standard)) {
@@ -780,7 +782,8 @@ MediaImageDecoder::MediaImageDecoder(
       mTileWidth(0),
       mTileHeight(0),
       mTilesDecoded(0),
-      mTargetTiles(0) {
+      mTargetTiles(0),
+      mConverterSrcFormat(0) {
 }
 
 sp<AMessage> MediaImageDecoder::onGetFormatAndSeekOptions(
@@ -952,7 +955,12 @@ status_t MediaImageDecoder::onOutputReceived(
         setFrame(frameMem);
     }
 
-    ColorConverter converter((OMX_COLOR_FORMATTYPE)srcFormat, dstFormat());
+    if (mConverter == nullptr || mConverterSrcFormat != srcFormat) {
+        mConverter.reset(new ColorConverter((OMX_COLOR_FORMATTYPE)srcFormat, dstFormat()));
+        mConverter->setNumThreads(0);
+        mConverterSrcFormat = srcFormat;
+    }
+    ColorConverter &converter = *mConverter;
 
     uint32_t standard, range, transfer;
     if (!outputFormat->findInt32("color-standard", (int32_t*)&standard)) {
@@ -73,6 +73,8 @@ static const int64_t kInitialDelayTimeUs     = 700000LL;
 static const int64_t kMaxMetadataSize = 0x4000000LL;   // 64MB max per-frame metadata size
 static const int64_t kMaxCttsOffsetTimeUs = 30 * 60 * 1000000LL;  // 30 minutes
 static const size_t kESDSScratchBufferSize = 10;  // kMaxAtomSize in Mpeg4Extractor 64MB
+static const off64_t kWritebackWindowBytes = 8 * 1024 * 1024;
+static const off64_t kMinTailCacheSize = 64 * 1024;
 
 static const char kMetaKey_Version[]    = "com.android.version";
 static const char kMetaKey_Manufacturer[]      = "com.android.manufacturer";
@@ -536,6 +538,11 @@ void MPEG4Writer::initInternal(int fd, bool isFirstSession) {
     mUse4ByteNalLength = true;
     mOffset = 0;
     mMaxOffsetAppend = 0;
+    mNumQueuedIoVecs = 0;
+    mWritebackEnabled = true;
+    mWritebackOffset = 0;
+    mPrevWritebackOffset = 0;
+    mWaitedWritebackOffset = 0;
     mPreAllocateFileEndOffset = 0;
     mMdatOffset = 0;
     mMdatEndOffset = 0;
@@ -954,18 +961,17 @@ status_t MPEG4Writer::start(MetaData *param) {
      * false. When reset() is called at the end of a recording session,
      * file-level meta and/or moov box needs to be constructed.
      *
-     * 1) Right before the box is constructed, mWriteBoxToMemory to set to
-     * mStreamableFile so that if the file is intended to be streamable, it
-     * is set to true; otherwise, it is set to false. When the value is set
-     * to false, all the content of that box is written immediately to
-     * the end of the file. When the value is set to true, all the
-     * content of that box is written to an in-memory cache,
-     * mInMemoryCache, util the following condition happens. Note
-     * that the size of the in-memory cache is the same as the
-     * reserved free space at the beginning of the file.
+     * 1) Right before the box is constructed, mWriteBoxToMemory is set to
+     * true, and all the content of that box is written to an in-memory
+     * cache, mInMemoryCache, util the following condition happens. If the
+     * file is intended to be streamable, the size of the in-memory cache
+     * is the same as the reserved free space at the beginning of the file.
+     * Otherwise the cache grows as needed, and its content is appended to
+     * the end of the file once all the boxes are constructed.
      *
      * 2) While the data of the box is written to an in-memory
-     * cache, the data size is checked against the reserved space.
+     * cache of a streamable file, the data size is checked against the
+     * reserved space.
      * If the data size surpasses the reserved space, subsequent box data
      * could no longer be hold in the in-memory cache. This also
      * indicates that the reserved space was too small. At this point,
@@ -1352,20 +1358,22 @@ status_t MPEG4Writer::reset(bool stopSource, bool waitForAnyPreviousCallToComple
     seekOrPostError(mFd, mOffset, SEEK_SET);
     mMdatEndOffset = mOffset;
 
-    // Construct file-level meta and moov box now
+    // Construct file-level meta and moov box now. They are built in memory
+    // either way: a streamable file gets them in the reserved free box,
+    // otherwise they are appended to the file with a single write instead
+    // of a write per field and a seek per box.
     mInMemoryCacheOffset = 0;
-    mWriteBoxToMemory = mStreamableFile;
-    if (mWriteBoxToMemory) {
-        // There is no need to allocate in-memory cache
-        // if the file is not streamable.
-
-        mInMemoryCache = (uint8_t *) malloc(mInMemoryCacheSize);
-        CHECK(mInMemoryCache != NULL);
+    mWriteBoxToMemory = true;
+    if (!mStreamableFile) {
+        // Only an initial size, the cache grows in MPEG4Writer::write().
+        mInMemoryCacheSize = std::max(mInMemoryCacheSize, kMinTailCacheSize);
     }
+    mInMemoryCache = (uint8_t *) malloc(mInMemoryCacheSize);
+    CHECK(mInMemoryCache != NULL);
 
     if (mHasFileLevelMeta) {
         writeFileLevelMetaBox();
-        if (mWriteBoxToMemory) {
+        if (mWriteBoxToMemory && mStreamableFile) {
             writeCachedBoxToFile("meta");
         } else {
             ALOGI("The file meta box is written at the end.");
@@ -1376,11 +1384,17 @@ status_t MPEG4Writer::reset(bool stopSource, bool waitForAnyPreviousCallToComple
         writeMoovBox(maxDurationUs);
         // mWriteBoxToMemory could be set to false in
         // MPEG4Writer::write() method
-        if (mWriteBoxToMemory) {
+        if (mWriteBoxToMemory && mStreamableFile) {
             writeCachedBoxToFile("moov");
         } else {
             ALOGI("The mp4 file will not be streamable.");
         }
+    }
+    if (mWriteBoxToMemory && !mStreamableFile) {
+        writeOrPostError(mFd, mInMemoryCache, mInMemoryCacheOffset);
+        mOffset += mInMemoryCacheOffset;
+    }
+    if (mHasMoovBox) {
         ALOGI("MOOV atom was written to the file");
     }
     mWriteBoxToMemory = false;
@@ -1606,6 +1620,7 @@ off64_t MPEG4Writer::addSample_l(
         ALOGV("mOffset:%lld, mMaxOffsetAppend:%lld, bytesWritten:%lld", (long long)mOffset,
                   (long long)mMaxOffsetAppend, (long long)*bytesWritten);
         mMaxOffsetAppend = std::max(mOffset, mMaxOffsetAppend);
+        flushSamples_l();
         seekOrPostError(mFd, mMaxOffsetAppend, SEEK_SET);
         return offset;
     }
@@ -1617,12 +1632,12 @@ off64_t MPEG4Writer::addSample_l(
     } else {
         if (tiffHdrOffset > 0) {
             tiffHdrOffset = htonl(tiffHdrOffset);
-            writeOrPostError(mFd, &tiffHdrOffset, 4);  // exif_tiff_header_offset field
+            queueHeader_l((const uint8_t *)&tiffHdrOffset, 4);  // exif_tiff_header_offset field
             mOffset += 4;
         }
 
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(),
-                         buffer->range_length());
+        queueData_l((const uint8_t*)buffer->data() + buffer->range_offset(),
+                    buffer->range_length());
 
         mOffset += buffer->range_length();
     }
@@ -1660,9 +1675,7 @@ void MPEG4Writer::addMultipleLengthPrefixedSamples_l(MediaBuffer *buffer) {
     while (getNextNALUnit(&data, &searchSize, &nextNalStart,
             &nextNalSize, true) == OK) {
         size_t currentNalSize = nextNalStart - currentNalStart - 4 /* strip start-code */;
-        MediaBuffer *nalBuf = new MediaBuffer((void *)currentNalStart, currentNalSize);
-        addLengthPrefixedSample_l(nalBuf);
-        nalBuf->release();
+        addLengthPrefixedSample_l(currentNalStart, currentNalSize);
 
         currentNalStart = nextNalStart;
     }
@@ -1670,12 +1683,12 @@ void MPEG4Writer::addMultipleLengthPrefixedSamples_l(MediaBuffer *buffer) {
     size_t currentNalOffset = currentNalStart - dataStart;
     buffer->set_range(buffer->range_offset() + currentNalOffset,
             buffer->range_length() - currentNalOffset);
-    addLengthPrefixedSample_l(buffer);
+    addLengthPrefixedSample_l(
+            (const uint8_t *)buffer->data() + buffer->range_offset(), buffer->range_length());
 }
 
-void MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
-    ALOGV("alp:buffer->range_length:%lld", (long long)buffer->range_length());
-    size_t length = buffer->range_length();
+void MPEG4Writer::addLengthPrefixedSample_l(const uint8_t *data, size_t length) {
+    ALOGV("alp:length:%zu", length);
     if (mUse4ByteNalLength) {
         ALOGV("mUse4ByteNalLength");
         uint8_t x[4];
@@ -1683,8 +1696,8 @@ void MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
         x[1] = (length >> 16) & 0xff;
         x[2] = (length >> 8) & 0xff;
         x[3] = length & 0xff;
-        writeOrPostError(mFd, &x, 4);
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(), length);
+        queueHeader_l(x, 4);
+        queueData_l(data, length);
         mOffset += length + 4;
     } else {
         ALOGV("mUse2ByteNalLength");
@@ -1693,12 +1706,75 @@ void MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
         uint8_t x[2];
         x[0] = length >> 8;
         x[1] = length & 0xff;
-        writeOrPostError(mFd, &x, 2);
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(), length);
+        queueHeader_l(x, 2);
+        queueData_l(data, length);
         mOffset += length + 2;
     }
 }
 
+void MPEG4Writer::queueHeader_l(const uint8_t *header, size_t size) {
+    CHECK_LE(size, sizeof(mQueuedIoHeaders[0]));
+    if (mNumQueuedIoVecs == kMaxQueuedIoVecs) {
+        flushSamples_l();
+    }
+    uint8_t *dst = mQueuedIoHeaders[mNumQueuedIoVecs];
+    memcpy(dst, header, size);
+    mQueuedIoVecs[mNumQueuedIoVecs].iov_base = dst;
+    mQueuedIoVecs[mNumQueuedIoVecs].iov_len = size;
+    ++mNumQueuedIoVecs;
+}
+
+void MPEG4Writer::queueData_l(const void *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (mNumQueuedIoVecs == kMaxQueuedIoVecs) {
+        flushSamples_l();
+    }
+    mQueuedIoVecs[mNumQueuedIoVecs].iov_base = const_cast<void *>(data);
+    mQueuedIoVecs[mNumQueuedIoVecs].iov_len = size;
+    ++mNumQueuedIoVecs;
+}
+
+void MPEG4Writer::flushSamples_l() {
+    if (mNumQueuedIoVecs == 0) {
+        return;
+    }
+    writevOrPostError(mFd, mQueuedIoVecs, mNumQueuedIoVecs);
+    mNumQueuedIoVecs = 0;
+    startWriteback_l();
+}
+
+void MPEG4Writer::startWriteback_l() {
+    if (!mWritebackEnabled || mWriteSeekErr || mOffset - mWritebackOffset < kWritebackWindowBytes) {
+        return;
+    }
+
+    // Start writing back the window just filled. The wait for the window before it is left to
+    // waitForWriteback(), so that it never happens under mLock.
+    if (sync_file_range(mFd, mWritebackOffset, mOffset - mWritebackOffset,
+                        SYNC_FILE_RANGE_WRITE) != 0) {
+        // e.g. not a regular file. The fsync() at stop will do all the work.
+        ALOGW("sync_file_range err:%s(%d), writeback disabled", std::strerror(errno), errno);
+        mWritebackEnabled = false;
+        return;
+    }
+    mPrevWritebackOffset = mWritebackOffset;
+    mWritebackOffset = mOffset;
+}
+
+void MPEG4Writer::waitForWriteback() {
+    // Wait for the windows before the one last started. This keeps at most two windows of
+    // dirty pages, however long the recording.
+    if (mPrevWritebackOffset <= mWaitedWritebackOffset) {
+        return;
+    }
+    sync_file_range(mFd, mWaitedWritebackOffset, mPrevWritebackOffset - mWaitedWritebackOffset,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                    SYNC_FILE_RANGE_WAIT_AFTER);
+    mWaitedWritebackOffset = mPrevWritebackOffset;
+}
+
 size_t MPEG4Writer::write(
         const void *ptr, size_t size, size_t nmemb) {
 
@@ -1706,6 +1782,16 @@ size_t MPEG4Writer::write(
     if (mWriteBoxToMemory) {
 
         off64_t boxSize = 8 + mInMemoryCacheOffset + bytes;
+        if (boxSize > mInMemoryCacheSize && !mStreamableFile) {
+            // Nothing is reserved for the boxes of a non-streamable file,
+            // they go to the end of the file once complete.
+            off64_t newSize = std::max(boxSize, mInMemoryCacheSize * 2);
+            uint8_t *cache = (uint8_t *) realloc(mInMemoryCache, newSize);
+            if (cache != NULL) {
+                mInMemoryCache = cache;
+                mInMemoryCacheSize = newSize;
+            }
+        }
         if (boxSize > mInMemoryCacheSize) {
             // The reserved free space at the beginning of the file is not big
             // enough. Boxes should be written to the end of the file from now
@@ -1764,6 +1850,63 @@ void MPEG4Writer::writeOrPostError(int fd, const void* buf, size_t count) {
     WARN_UNLESS(msg->post() == OK, "writeOrPostError:error posting ERROR_IO");
 }
 
+void MPEG4Writer::advanceIoVecs(struct iovec **iov, int *iovcnt, size_t bytes) {
+    while (*iovcnt > 0 && bytes >= (*iov)->iov_len) {
+        bytes -= (*iov)->iov_len;
+        ++*iov;
+        --*iovcnt;
+    }
+    if (*iovcnt > 0) {
+        (*iov)->iov_base = (uint8_t *)(*iov)->iov_base + bytes;
+        (*iov)->iov_len -= bytes;
+    }
+}
+
+void MPEG4Writer::writevOrPostError(int fd, struct iovec *iov, int iovcnt) {
+    if (mWriteSeekErr == true)
+        return;
+
+    size_t count = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        count += iov[i].iov_len;
+    }
+
+    size_t totalWritten = 0;
+    ssize_t bytesWritten = 0;
+    auto beforeTP = std::chrono::high_resolution_clock::now();
+    while (iovcnt > 0) {
+        bytesWritten = ::writev(fd, iov, iovcnt);
+        if (bytesWritten < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesWritten <= 0) {
+            break;
+        }
+        // A short write is not an error yet, the rest of the batch is retried from where it
+        // stopped. Whatever keeps it from being written shows up on the retry.
+        totalWritten += bytesWritten;
+        advanceIoVecs(&iov, &iovcnt, bytesWritten);
+    }
+    auto afterTP = std::chrono::high_resolution_clock::now();
+    auto writeDuration =
+            std::chrono::duration_cast<std::chrono::microseconds>(afterTP - beforeTP).count();
+    mWriteDurationPQ.emplace(writeDuration);
+    if (mWriteDurationPQ.size() > kWriteDurationsCount) {
+        mWriteDurationPQ.pop();
+    }
+
+    if (totalWritten == count)
+        return;
+    mWriteSeekErr = true;
+    ALOGE("writevOrPostError bytesWritten:%zu, count:%zu, error:%s(%d)", totalWritten, count,
+          std::strerror(errno), errno);
+
+    // Can't guarantee that file is usable or write would succeed anymore, hence signal to stop.
+    sp<AMessage> msg = new AMessage(kWhatIOError, mReflector);
+    msg->setInt32("err", ERROR_IO);
+    WARN_UNLESS(msg->post() == OK, "writevOrPostError:error posting ERROR_IO");
+}
+
 void MPEG4Writer::seekOrPostError(int fd, off64_t offset, int whence) {
     if (mWriteSeekErr == true)
         return;
@@ -2735,8 +2878,8 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
         chunk->mTimeStampUs, chunk->mTrack->getTrackType());
 
     int32_t isFirstSample = true;
-    while (!chunk->mSamples.empty()) {
-        List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
+    for (List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
+         it != chunk->mSamples.end(); ++it) {
 
         uint32_t tiffHdrOffset;
         if (!(*it)->meta_data().findInt32(
@@ -2755,10 +2898,14 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
             chunk->mTrack->addChunkOffset(offset);
             isFirstSample = false;
         }
+    }
 
+    // The whole chunk goes out in as few writes as possible, after which the samples can go.
+    flushSamples_l();
+    for (List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
+         it != chunk->mSamples.end(); ++it) {
         (*it)->release();
         (*it) = NULL;
-        chunk->mSamples.erase(it);
     }
     chunk->mSamples.clear();
 }
@@ -2844,15 +2991,17 @@ void MPEG4Writer::threadFunc() {
         // In real time recording mode, write without holding the lock in order
         // to reduce the blocking time for media track threads.
         // Otherwise, hold the lock until the existing chunks get written to the
-        // file.
+        // file. Waiting for the writeback of earlier data never holds the lock.
         if (chunkFound) {
             if (mIsRealTimeRecording) {
                 mLock.unlock();
             }
             writeChunkToFile(&chunk);
-            if (mIsRealTimeRecording) {
-                mLock.lock();
+            if (!mIsRealTimeRecording) {
+                mLock.unlock();
             }
+            waitForWriteback();
+            mLock.lock();
         }
     }
 
@@ -3924,6 +4073,8 @@ status_t MPEG4Writer::Track::threadEntry() {
             size_t bytesWritten;
             off64_t offset = mOwner->addSample_l(
                     copy, usePrefix, tiffHdrOffset, &bytesWritten);
+            mOwner->flushSamples_l();
+            mOwner->waitForWriteback();
 
             if (mIsHeic) {
                 addItemOffsetAndSize(offset, bytesWritten, isExif);
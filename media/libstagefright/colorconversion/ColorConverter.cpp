@@ -30,8 +30,16 @@
 #include "libyuv/convert_argb.h"
 #include "libyuv/planar_functions.h"
 #include "libyuv/video_common.h"
+#include <algorithm>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <sys/time.h>
+#include <unistd.h>
+
+#include "ColorConverterKernels.h"
 
 #define USE_LIBYUV
 #define PERF_PROFILING 0
@@ -209,6 +217,99 @@ constexpr int CLIP_RANGE_MAX_8BIT = 552;
 constexpr int CLIP_RANGE_MIN_10BIT = -1175;
 constexpr int CLIP_RANGE_MAX_10BIT = 2218;
 
+// Smallest band worth handing to another thread. Must be even so that every band starts on
+// the first row of a 4:2:0 chroma row pair.
+constexpr size_t kMinRowsPerBand = 64;
+
+// Upper limit for the thread count picked by setNumThreads(0).
+constexpr size_t kMaxAutoThreads = 4;
+
+}
+
+/**
+ * A small fixed-size pool of worker threads. run() hands out a batch of jobs to the workers,
+ * also uses the calling thread to run jobs, and returns once all of them have completed.
+ */
+struct ColorConverter::WorkerPool {
+    explicit WorkerPool(size_t numWorkers);
+    ~WorkerPool();
+
+    void run(std::vector<std::function<void()>> *jobs);
+
+private:
+    std::mutex mLock;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mDoneCondition;
+    std::vector<std::thread> mThreads;
+    std::vector<std::function<void()>> *mJobs;
+    size_t mNextJob;
+    size_t mPendingJobs;
+    bool mQuit;
+
+    void threadLoop();
+
+    // runs the next job of the current batch with mLock released; returns false if there is none
+    bool runNextJob_l(std::unique_lock<std::mutex> &lock);
+
+    WorkerPool(const WorkerPool &);
+    WorkerPool &operator=(const WorkerPool &);
+};
+
+ColorConverter::WorkerPool::WorkerPool(size_t numWorkers)
+    : mJobs(nullptr),
+      mNextJob(0),
+      mPendingJobs(0),
+      mQuit(false) {
+    for (size_t i = 0; i < numWorkers; ++i) {
+        mThreads.emplace_back(&WorkerPool::threadLoop, this);
+    }
+}
+
+ColorConverter::WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mQuit = true;
+    }
+    mWorkCondition.notify_all();
+    for (std::thread &thread : mThreads) {
+        thread.join();
+    }
+}
+
+void ColorConverter::WorkerPool::run(std::vector<std::function<void()>> *jobs) {
+    std::unique_lock<std::mutex> lock(mLock);
+    mJobs = jobs;
+    mNextJob = 0;
+    mPendingJobs = jobs->size();
+    mWorkCondition.notify_all();
+
+    while (runNextJob_l(lock)) {
+    }
+    mDoneCondition.wait(lock, [this] { return mPendingJobs == 0; });
+    mJobs = nullptr;
+}
+
+bool ColorConverter::WorkerPool::runNextJob_l(std::unique_lock<std::mutex> &lock) {
+    if (mJobs == nullptr || mNextJob >= mJobs->size()) {
+        return false;
+    }
+    std::function<void()> &job = (*mJobs)[mNextJob++];
+    lock.unlock();
+    job();
+    lock.lock();
+    if (--mPendingJobs == 0) {
+        mDoneCondition.notify_all();
+    }
+    return true;
+}
+
+void ColorConverter::WorkerPool::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mQuit) {
+        if (!runNextJob_l(lock)) {
+            mWorkCondition.wait(lock);
+        }
+    }
 }
 
 ColorConverter::ColorConverter(
@@ -217,10 +318,13 @@ ColorConverter::ColorConverter(
       mDstFormat(to),
       mSrcColorSpace({0, 0, 0}),
       mClip(NULL),
-      mClip10Bit(NULL) {
+      mClip10Bit(NULL),
+      mNumThreads(1) {
 }
 
 ColorConverter::~ColorConverter() {
+    // stop the workers before the clip tables go away
+    mWorkerPool.reset();
     delete[] mClip;
     mClip = NULL;
     delete[] mClip10Bit;
@@ -275,6 +379,21 @@ void ColorConverter::setSrcColorSpace(
     mSrcColorSpace.mTransfer = transfer;
 }
 
+void ColorConverter::setNumThreads(size_t numThreads) {
+    if (numThreads == 0) {
+        long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = numCpus > 0 ? std::min((size_t)numCpus, kMaxAutoThreads) : 1;
+    }
+    if (numThreads != mNumThreads) {
+        mNumThreads = numThreads;
+        mWorkerPool.reset();
+    }
+}
+
+size_t ColorConverter::getNumBands(size_t cropHeight) const {
+    return std::max((size_t)1, std::min(mNumThreads, cropHeight / kMinRowsPerBand));
+}
+
 /*
  * If stride is non-zero, client's stride will be used. For planar
  * or semi-planar YUV formats, stride must be even numbers.
@@ -375,6 +494,58 @@ status_t ColorConverter::convert(
         return ERROR_UNSUPPORTED;
     }
 
+    size_t numBands = getNumBands(src.cropHeight());
+    if (numBands <= 1) {
+        return convertBand(src, dst);
+    }
+
+    // The clip tables are allocated on first use; do it here so that the bands don't race.
+    initClip();
+    initClip10Bit();
+
+    if (mWorkerPool == nullptr) {
+        mWorkerPool.reset(new WorkerPool(mNumThreads - 1));
+    }
+
+    // Every band but the last has an even number of rows, so each band starts on the first
+    // row of a chroma row pair and the bands produce the same output as a single pass.
+    size_t rowsPerBand = (src.cropHeight() + numBands - 1) / numBands;
+    rowsPerBand = (rowsPerBand + 1) & ~(size_t)1;
+
+    std::vector<status_t> results(numBands, OK);
+    std::vector<std::function<void()>> jobs;
+    for (size_t i = 0; i < numBands; ++i) {
+        size_t top = i * rowsPerBand;
+        if (top >= src.cropHeight()) {
+            break;
+        }
+        size_t bottom = std::min(top + rowsPerBand, src.cropHeight()) - 1;
+
+        BitmapParams srcBand = src;
+        srcBand.mCropTop = src.mCropTop + top;
+        srcBand.mCropBottom = src.mCropTop + bottom;
+
+        BitmapParams dstBand = dst;
+        dstBand.mCropTop = dst.mCropTop + top;
+        dstBand.mCropBottom = dst.mCropTop + bottom;
+
+        status_t *result = &results[i];
+        jobs.emplace_back([this, srcBand, dstBand, result] {
+            *result = convertBand(srcBand, dstBand);
+        });
+    }
+    mWorkerPool->run(&jobs);
+
+    for (status_t result : results) {
+        if (result != OK) {
+            return result;
+        }
+    }
+    return OK;
+}
+
+status_t ColorConverter::convertBand(
+        const BitmapParams &src, const BitmapParams &dst) {
     status_t err;
 
     switch ((int32_t)mSrcFormat) {
@@ -656,6 +827,22 @@ status_t ColorConverter::convertYUV420SemiPlanarUseLibYUV(
    return OK;
 }
 
+// Returns the vector row kernel for this conversion, or nullptr if the CPU has no vector unit
+// we have kernels for, in which case the scalar loops below are used.
+static YuvToRgbRowFn getVectorRowKernel(
+        OMX_COLOR_FORMATTYPE srcFormat, OMX_COLOR_FORMATTYPE dstFormat) {
+    uint32_t cpuFeatures = getColorConverterCpuFeatures();
+    if (cpuFeatures == kColorConverterCpuNone) {
+        return nullptr;
+    }
+    return getYuvToRgbRowKernel(srcFormat, dstFormat, cpuFeatures);
+}
+
+static YuvRowCoeffs getRowCoeffs(const ColorConverter::Coeffs *matrix, signed c16) {
+    return YuvRowCoeffs {
+        matrix->_y, matrix->_r_v, matrix->_g_u, matrix->_g_v, matrix->_b_u, c16 };
+}
+
 std::function<void (void *, void *, void *, size_t,
                     signed *, signed *, signed *, signed *)>
 getReadFromSrc(OMX_COLOR_FORMATTYPE srcFormat) {
@@ -808,6 +995,24 @@ status_t ColorConverter::convertYUV420Planar(
 
     uint8_t *src_v = src_u + (src.mStride / 2) * (src.mHeight / 2);
 
+    YuvToRgbRowFn rowKernel = getVectorRowKernel(mSrcFormat, mDstFormat);
+    if (rowKernel != nullptr) {
+        YuvRowCoeffs coeffs = getRowCoeffs(matrix, _c16);
+        for (size_t y = 0; y < src.cropHeight(); ++y) {
+            rowKernel(src_y, src_u, src_v, dst_ptr, src.cropWidth(), coeffs);
+
+            src_y += src.mStride;
+
+            if (y & 1) {
+                src_u += src.mStride / 2;
+                src_v += src.mStride / 2;
+            }
+
+            dst_ptr += dst.mStride;
+        }
+        return OK;
+    }
+
     for (size_t y = 0; y < src.cropHeight(); ++y) {
         for (size_t x = 0; x < src.cropWidth(); x += 2) {
             signed y1, y2, u, v;
@@ -892,6 +1097,23 @@ status_t ColorConverter::convertYUVP010ToRGBA1010102(
             + src.mStride * src.mHeight
             + (src.mCropTop / 2) * src.mStride + src.mCropLeft * src.mBpp);
 
+    YuvToRgbRowFn rowKernel = getVectorRowKernel(mSrcFormat, mDstFormat);
+    if (rowKernel != nullptr) {
+        YuvRowCoeffs coeffs = getRowCoeffs(matrix, _c16);
+        for (size_t y = 0; y < src.cropHeight(); ++y) {
+            rowKernel(src_y, src_uv, src_uv + 1, dst_ptr, src.cropWidth(), coeffs);
+
+            src_y += src.mStride / 2;
+
+            if (y & 1) {
+                src_uv += src.mStride / 2;
+            }
+
+            dst_ptr += dst.mStride;
+        }
+        return OK;
+    }
+
     for (size_t y = 0; y < src.cropHeight(); ++y) {
         for (size_t x = 0; x < src.cropWidth(); x += 2) {
             signed y1, y2, u, v;
@@ -950,6 +1172,27 @@ status_t ColorConverter::convertYUV420Planar16ToY410(
     const uint8_t *src_v =
         src_u + (src.mStride / 2) * (src.mHeight / 2);
 
+    uint32_t cpuFeatures = getColorConverterCpuFeatures();
+    if (cpuFeatures != kColorConverterCpuNone) {
+        Yuv420p16ToY410RowFn rowKernel = getYuv420p16ToY410RowKernel(cpuFeatures);
+        if (rowKernel != nullptr) {
+            for (size_t y = 0; y < src.cropHeight(); ++y) {
+                rowKernel((const uint16_t *)src_y, (const uint16_t *)src_u,
+                        (const uint16_t *)src_v, (uint32_t *)dst_ptr, src.cropWidth());
+
+                src_y += src.mStride;
+
+                if (y & 1) {
+                    src_u += src.mStride / 2;
+                    src_v += src.mStride / 2;
+                }
+
+                dst_ptr += dst.mStride;
+            }
+            return OK;
+        }
+    }
+
     // Converting two lines at a time, slightly faster
     for (size_t y = 0; y < src.cropHeight(); y += 2) {
         uint32_t *dst_top = (uint32_t *) dst_ptr;
@@ -1167,8 +1410,10 @@ status_t ColorConverter::convertYUV420SemiPlanarBase(const BitmapParams &src,
 
     uint8_t *kAdjustedClip = initClip();
 
-    uint16_t *dst_ptr = (uint16_t *)((uint8_t *)
-            dst.mBits + dst.mCropTop * dst.mStride + dst.mCropLeft * dst.mBpp);
+    auto writeToDst = getWriteToDst(mDstFormat, (void *)kAdjustedClip);
+
+    uint8_t *dst_ptr = (uint8_t *)dst.mBits
+            + dst.mCropTop * dst.mStride + dst.mCropLeft * dst.mBpp;
 
     const uint8_t *src_y =
         (const uint8_t *)src.mBits + src.mCropTop * row_inc + src.mCropLeft;
@@ -1176,6 +1421,25 @@ status_t ColorConverter::convertYUV420SemiPlanarBase(const BitmapParams &src,
     const uint8_t *src_u = (const uint8_t *)src.mBits + src.mHeight * row_inc +
         (src.mCropTop / 2) * row_inc + src.mCropLeft;
 
+    // all semi-planar sources share the NV12 kernels; NV21 just swaps the chroma pointers
+    YuvToRgbRowFn rowKernel = getVectorRowKernel(OMX_COLOR_FormatYUV420SemiPlanar, mDstFormat);
+    if (rowKernel != nullptr) {
+        YuvRowCoeffs coeffs = getRowCoeffs(matrix, _c16);
+        for (size_t y = 0; y < src.cropHeight(); ++y) {
+            rowKernel(src_y, src_u + isNV21, src_u + !isNV21,
+                    dst_ptr, src.cropWidth(), coeffs);
+
+            src_y += row_inc;
+
+            if (y & 1) {
+                src_u += row_inc;
+            }
+
+            dst_ptr += dst.mStride;
+        }
+        return OK;
+    }
+
     for (size_t y = 0; y < src.cropHeight(); ++y) {
         for (size_t x = 0; x < src.cropWidth(); x += 2) {
             signed y1 = (signed)src_y[x] - _c16;
@@ -1199,21 +1463,8 @@ status_t ColorConverter::convertYUV420SemiPlanarBase(const BitmapParams &src,
             signed g2 = (tmp2 + v_g + u_g) / 256;
             signed r2 = (tmp2 + v_r) / 256;
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
-
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
-
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
+            bool uncropped = x + 1 < src.cropWidth();
+            writeToDst(dst_ptr + x * dst.mBpp, uncropped, r1, g1, b1, r2, g2, b2);
         }
 
         src_y += row_inc;
@@ -1222,7 +1473,7 @@ status_t ColorConverter::convertYUV420SemiPlanarBase(const BitmapParams &src,
             src_u += row_inc;
         }
 
-        dst_ptr = (uint16_t*)((uint8_t*)dst_ptr + dst.mStride);
+        dst_ptr += dst.mStride;
     }
 
     return OK;
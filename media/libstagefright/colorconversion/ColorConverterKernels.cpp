@@ -0,0 +1,741 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ColorConverterKernels"
+#include <utils/Log.h>
+
+#include <OMX_Video.h>
+#include <media/stagefright/MediaCodecConstants.h>
+
+#include "ColorConverterKernels.h"
+
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define USE_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define USE_X86_KERNELS 0
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON__)
+#define USE_NEON_KERNELS 1
+#include <arm_neon.h>
+#else
+#define USE_NEON_KERNELS 0
+#endif
+
+namespace android {
+
+namespace {
+
+enum SrcLayout {
+    kSrcPlanar8,        // I420
+    kSrcSemiPlanar8,    // NV12 / NV21
+    kSrcPlanar16,       // 10-bit I420 in 16-bit containers, converted to 8-bit
+    kSrcP010,           // 10-bit MSB aligned NV12
+};
+
+enum DstLayout {
+    kDstRGB565,
+    kDstRGBA8888,
+    kDstBGRA8888,
+    kDstRGBA1010102,
+};
+
+inline uint32_t load32(const void *ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+/*
+ * Scalar reference. This mirrors the per-pixel loops in ColorConverter.cpp and is used for
+ * the tails of the vector kernels.
+ */
+
+template<SrcLayout S>
+inline int32_t readY(const void *srcY, size_t x) {
+    if (S == kSrcPlanar8 || S == kSrcSemiPlanar8) {
+        return ((const uint8_t *)srcY)[x];
+    } else if (S == kSrcPlanar16) {
+        return (uint8_t)(((const uint16_t *)srcY)[x] >> 2);
+    }
+    return ((const uint16_t *)srcY)[x] >> 6;
+}
+
+// returns the centered chroma sample for the pixel pair starting at even pixel |x|
+template<SrcLayout S>
+inline int32_t readChroma(const void *srcC, size_t x) {
+    if (S == kSrcPlanar8) {
+        return (int32_t)((const uint8_t *)srcC)[x / 2] - 128;
+    } else if (S == kSrcSemiPlanar8) {
+        return (int32_t)((const uint8_t *)srcC)[x] - 128;
+    } else if (S == kSrcPlanar16) {
+        return (int32_t)(uint8_t)(((const uint16_t *)srcC)[x / 2] >> 2) - 128;
+    }
+    return (int32_t)(((const uint16_t *)srcC)[x] >> 6) - 512;
+}
+
+template<DstLayout D>
+inline void writePixel(void *dst, size_t x, int32_t r, int32_t g, int32_t b) {
+    const int32_t maxValue = D == kDstRGBA1010102 ? 1023 : 255;
+    r = r < 0 ? 0 : r > maxValue ? maxValue : r;
+    g = g < 0 ? 0 : g > maxValue ? maxValue : g;
+    b = b < 0 ? 0 : b > maxValue ? maxValue : b;
+
+    switch (D) {
+        case kDstRGB565:
+            ((uint16_t *)dst)[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+            break;
+        case kDstRGBA8888:
+            ((uint32_t *)dst)[x] = r | (g << 8) | (b << 16) | (0xFFu << 24);
+            break;
+        case kDstBGRA8888:
+            ((uint32_t *)dst)[x] = b | (g << 8) | (r << 16) | (0xFFu << 24);
+            break;
+        case kDstRGBA1010102:
+            ((uint32_t *)dst)[x] = r | (g << 10) | (b << 20) | (3u << 30);
+            break;
+    }
+}
+
+// converts pixels [start, width) of a row; |start| must be even
+template<SrcLayout S, DstLayout D>
+void convertRowScalarRange(
+        const void *srcY, const void *srcU, const void *srcV,
+        void *dst, size_t start, size_t width, const YuvRowCoeffs &c) {
+    for (size_t x = start; x < width; x += 2) {
+        int32_t u = readChroma<S>(srcU, x);
+        int32_t v = readChroma<S>(srcV, x);
+
+        int32_t u_b = u * c._b_u;
+        int32_t u_g = u * -c._g_u;
+        int32_t v_g = v * -c._g_v;
+        int32_t v_r = v * c._r_v;
+
+        int32_t tmp1 = (readY<S>(srcY, x) - c._c16) * c._y + 128;
+        writePixel<D>(dst, x,
+                (tmp1 + v_r) / 256, (tmp1 + v_g + u_g) / 256, (tmp1 + u_b) / 256);
+
+        if (x + 1 < width) {
+            int32_t tmp2 = (readY<S>(srcY, x + 1) - c._c16) * c._y + 128;
+            writePixel<D>(dst, x + 1,
+                    (tmp2 + v_r) / 256, (tmp2 + v_g + u_g) / 256, (tmp2 + u_b) / 256);
+        }
+    }
+}
+
+template<SrcLayout S, DstLayout D>
+void convertRowScalar(
+        const void *srcY, const void *srcU, const void *srcV,
+        void *dst, size_t width, const YuvRowCoeffs &c) {
+    convertRowScalarRange<S, D>(srcY, srcU, srcV, dst, 0 /* start */, width, c);
+}
+
+void convertY410RowScalarRange(
+        const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV,
+        uint32_t *dst, size_t start, size_t width) {
+    for (size_t x = start; x < width; x += 2) {
+        uint32_t uv = (srcU[x / 2] & 0x3FF) | ((uint32_t)(srcV[x / 2] & 0x3FF) << 20);
+        dst[x] = ((uint32_t)(srcY[x] & 0x3FF) << 10) | uv;
+        if (x + 1 < width) {
+            dst[x + 1] = ((uint32_t)(srcY[x + 1] & 0x3FF) << 10) | uv;
+        }
+    }
+}
+
+void convertY410RowScalar(
+        const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV,
+        uint32_t *dst, size_t width) {
+    convertY410RowScalarRange(srcY, srcU, srcV, dst, 0 /* start */, width);
+}
+
+// For semi-planar sources U and V share a row; returns the start of the interleaved pair.
+inline const void *chromaBase(const void *srcU, const void *srcV) {
+    return srcU < srcV ? srcU : srcV;
+}
+
+#if USE_X86_KERNELS
+
+/*
+ * SSE4.1 kernels, 8 pixels per iteration.
+ */
+
+#define SSE41_TARGET __attribute__((target("sse4.1")))
+
+template<SrcLayout S>
+SSE41_TARGET inline void loadYSse41(const void *srcY, size_t x, __m128i *lo, __m128i *hi) {
+    if (S == kSrcPlanar8 || S == kSrcSemiPlanar8) {
+        __m128i y = _mm_loadl_epi64((const __m128i *)((const uint8_t *)srcY + x));
+        *lo = _mm_cvtepu8_epi32(y);
+        *hi = _mm_cvtepu8_epi32(_mm_srli_si128(y, 4));
+    } else {
+        __m128i y = _mm_loadu_si128((const __m128i *)((const uint16_t *)srcY + x));
+        if (S == kSrcPlanar16) {
+            y = _mm_and_si128(_mm_srli_epi16(y, 2), _mm_set1_epi16(0xFF));
+        } else {
+            y = _mm_srli_epi16(y, 6);
+        }
+        *lo = _mm_cvtepu16_epi32(y);
+        *hi = _mm_cvtepu16_epi32(_mm_srli_si128(y, 8));
+    }
+}
+
+// loads the 4 centered chroma samples for the 8 pixels starting at |x|
+template<SrcLayout S>
+SSE41_TARGET inline void loadChromaSse41(
+        const void *srcU, const void *srcV, size_t x, __m128i *u, __m128i *v) {
+    switch (S) {
+        case kSrcPlanar8:
+            *u = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load32((const uint8_t *)srcU + x / 2)));
+            *v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load32((const uint8_t *)srcV + x / 2)));
+            *u = _mm_sub_epi32(*u, _mm_set1_epi32(128));
+            *v = _mm_sub_epi32(*v, _mm_set1_epi32(128));
+            break;
+        case kSrcPlanar16:
+        {
+            const __m128i mask = _mm_set1_epi16(0xFF);
+            __m128i u16 = _mm_loadl_epi64((const __m128i *)((const uint16_t *)srcU + x / 2));
+            __m128i v16 = _mm_loadl_epi64((const __m128i *)((const uint16_t *)srcV + x / 2));
+            *u = _mm_cvtepu16_epi32(_mm_and_si128(_mm_srli_epi16(u16, 2), mask));
+            *v = _mm_cvtepu16_epi32(_mm_and_si128(_mm_srli_epi16(v16, 2), mask));
+            *u = _mm_sub_epi32(*u, _mm_set1_epi32(128));
+            *v = _mm_sub_epi32(*v, _mm_set1_epi32(128));
+            break;
+        }
+        case kSrcSemiPlanar8:
+        case kSrcP010:
+        {
+            __m128i pairs;
+            if (S == kSrcSemiPlanar8) {
+                const uint8_t *base = (const uint8_t *)chromaBase(srcU, srcV) + x;
+                pairs = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)base));
+            } else {
+                const uint16_t *base = (const uint16_t *)chromaBase(srcU, srcV) + x;
+                pairs = _mm_loadu_si128((const __m128i *)base);
+            }
+            // each 32-bit lane now holds one interleaved pair: first | second << 16
+            __m128i first = _mm_and_si128(pairs, _mm_set1_epi32(0xFFFF));
+            __m128i second = _mm_srli_epi32(pairs, 16);
+            if (S == kSrcP010) {
+                first = _mm_sub_epi32(_mm_srli_epi32(first, 6), _mm_set1_epi32(512));
+                second = _mm_sub_epi32(_mm_srli_epi32(second, 6), _mm_set1_epi32(512));
+            } else {
+                first = _mm_sub_epi32(first, _mm_set1_epi32(128));
+                second = _mm_sub_epi32(second, _mm_set1_epi32(128));
+            }
+            bool swapped = srcV < srcU;
+            *u = swapped ? second : first;
+            *v = swapped ? first : second;
+            break;
+        }
+    }
+}
+
+template<DstLayout D>
+SSE41_TARGET inline __m128i packPixelsSse41(__m128i r, __m128i g, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maxValue = _mm_set1_epi32(D == kDstRGBA1010102 ? 1023 : 255);
+    r = _mm_min_epi32(_mm_max_epi32(r, zero), maxValue);
+    g = _mm_min_epi32(_mm_max_epi32(g, zero), maxValue);
+    b = _mm_min_epi32(_mm_max_epi32(b, zero), maxValue);
+
+    if (D == kDstRGB565) {
+        return _mm_or_si128(_mm_or_si128(
+                _mm_slli_epi32(_mm_srli_epi32(r, 3), 11),
+                _mm_slli_epi32(_mm_srli_epi32(g, 2), 5)),
+                _mm_srli_epi32(b, 3));
+    } else if (D == kDstRGBA8888) {
+        return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                _mm_or_si128(_mm_slli_epi32(b, 16), _mm_set1_epi32(0xFF000000)));
+    } else if (D == kDstBGRA8888) {
+        return _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 8)),
+                _mm_or_si128(_mm_slli_epi32(r, 16), _mm_set1_epi32(0xFF000000)));
+    }
+    return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 10)),
+            _mm_or_si128(_mm_slli_epi32(b, 20), _mm_set1_epi32(0xC0000000)));
+}
+
+template<DstLayout D>
+SSE41_TARGET inline __m128i convertPixelsSse41(
+        __m128i y, __m128i u, __m128i v, const YuvRowCoeffs &c) {
+    __m128i tmp = _mm_add_epi32(
+            _mm_mullo_epi32(_mm_sub_epi32(y, _mm_set1_epi32(c._c16)), _mm_set1_epi32(c._y)),
+            _mm_set1_epi32(128));
+    __m128i r = _mm_add_epi32(tmp, _mm_mullo_epi32(v, _mm_set1_epi32(c._r_v)));
+    __m128i g = _mm_sub_epi32(tmp, _mm_add_epi32(
+            _mm_mullo_epi32(u, _mm_set1_epi32(c._g_u)),
+            _mm_mullo_epi32(v, _mm_set1_epi32(c._g_v))));
+    __m128i b = _mm_add_epi32(tmp, _mm_mullo_epi32(u, _mm_set1_epi32(c._b_u)));
+    return packPixelsSse41<D>(
+            _mm_srai_epi32(r, 8), _mm_srai_epi32(g, 8), _mm_srai_epi32(b, 8));
+}
+
+template<SrcLayout S, DstLayout D>
+SSE41_TARGET void convertRowSse41(
+        const void *srcY, const void *srcU, const void *srcV,
+        void *dst, size_t width, const YuvRowCoeffs &c) {
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i yLo, yHi, u, v;
+        loadYSse41<S>(srcY, x, &yLo, &yHi);
+        loadChromaSse41<S>(srcU, srcV, x, &u, &v);
+
+        __m128i lo = convertPixelsSse41<D>(
+                yLo, _mm_unpacklo_epi32(u, u), _mm_unpacklo_epi32(v, v), c);
+        __m128i hi = convertPixelsSse41<D>(
+                yHi, _mm_unpackhi_epi32(u, u), _mm_unpackhi_epi32(v, v), c);
+
+        if (D == kDstRGB565) {
+            _mm_storeu_si128((__m128i *)((uint16_t *)dst + x), _mm_packus_epi32(lo, hi));
+        } else {
+            _mm_storeu_si128((__m128i *)((uint32_t *)dst + x), lo);
+            _mm_storeu_si128((__m128i *)((uint32_t *)dst + x + 4), hi);
+        }
+    }
+    convertRowScalarRange<S, D>(srcY, srcU, srcV, dst, x, width, c);
+}
+
+SSE41_TARGET void convertY410RowSse41(
+        const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV,
+        uint32_t *dst, size_t width) {
+    const __m128i mask = _mm_set1_epi32(0x3FF);
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i y = _mm_loadu_si128((const __m128i *)(srcY + x));
+        __m128i u = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(srcU + x / 2)));
+        __m128i v = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(srcV + x / 2)));
+        __m128i uv = _mm_or_si128(
+                _mm_and_si128(u, mask), _mm_slli_epi32(_mm_and_si128(v, mask), 20));
+
+        __m128i yLo = _mm_and_si128(_mm_cvtepu16_epi32(y), mask);
+        __m128i yHi = _mm_and_si128(_mm_cvtepu16_epi32(_mm_srli_si128(y, 8)), mask);
+        _mm_storeu_si128((__m128i *)(dst + x),
+                _mm_or_si128(_mm_slli_epi32(yLo, 10), _mm_unpacklo_epi32(uv, uv)));
+        _mm_storeu_si128((__m128i *)(dst + x + 4),
+                _mm_or_si128(_mm_slli_epi32(yHi, 10), _mm_unpackhi_epi32(uv, uv)));
+    }
+    convertY410RowScalarRange(srcY, srcU, srcV, dst, x, width);
+}
+
+/*
+ * AVX2 kernels, 16 pixels per iteration.
+ */
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+template<SrcLayout S>
+AVX2_TARGET inline void loadYAvx2(const void *srcY, size_t x, __m256i *lo, __m256i *hi) {
+    if (S == kSrcPlanar8 || S == kSrcSemiPlanar8) {
+        __m128i y = _mm_loadu_si128((const __m128i *)((const uint8_t *)srcY + x));
+        *lo = _mm256_cvtepu8_epi32(y);
+        *hi = _mm256_cvtepu8_epi32(_mm_srli_si128(y, 8));
+    } else {
+        __m256i y = _mm256_loadu_si256((const __m256i *)((const uint16_t *)srcY + x));
+        if (S == kSrcPlanar16) {
+            y = _mm256_and_si256(_mm256_srli_epi16(y, 2), _mm256_set1_epi16(0xFF));
+        } else {
+            y = _mm256_srli_epi16(y, 6);
+        }
+        *lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(y));
+        *hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(y, 1));
+    }
+}
+
+// loads the 8 centered chroma samples for the 16 pixels starting at |x|
+template<SrcLayout S>
+AVX2_TARGET inline void loadChromaAvx2(
+        const void *srcU, const void *srcV, size_t x, __m256i *u, __m256i *v) {
+    switch (S) {
+        case kSrcPlanar8:
+            *u = _mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((const __m128i *)((const uint8_t *)srcU + x / 2)));
+            *v = _mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((const __m128i *)((const uint8_t *)srcV + x / 2)));
+            *u = _mm256_sub_epi32(*u, _mm256_set1_epi32(128));
+            *v = _mm256_sub_epi32(*v, _mm256_set1_epi32(128));
+            break;
+        case kSrcPlanar16:
+        {
+            const __m128i mask = _mm_set1_epi16(0xFF);
+            __m128i u16 = _mm_loadu_si128((const __m128i *)((const uint16_t *)srcU + x / 2));
+            __m128i v16 = _mm_loadu_si128((const __m128i *)((const uint16_t *)srcV + x / 2));
+            *u = _mm256_cvtepu16_epi32(_mm_and_si128(_mm_srli_epi16(u16, 2), mask));
+            *v = _mm256_cvtepu16_epi32(_mm_and_si128(_mm_srli_epi16(v16, 2), mask));
+            *u = _mm256_sub_epi32(*u, _mm256_set1_epi32(128));
+            *v = _mm256_sub_epi32(*v, _mm256_set1_epi32(128));
+            break;
+        }
+        case kSrcSemiPlanar8:
+        case kSrcP010:
+        {
+            __m256i pairs;
+            if (S == kSrcSemiPlanar8) {
+                const uint8_t *base = (const uint8_t *)chromaBase(srcU, srcV) + x;
+                pairs = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)base));
+            } else {
+                const uint16_t *base = (const uint16_t *)chromaBase(srcU, srcV) + x;
+                pairs = _mm256_loadu_si256((const __m256i *)base);
+            }
+            __m256i first = _mm256_and_si256(pairs, _mm256_set1_epi32(0xFFFF));
+            __m256i second = _mm256_srli_epi32(pairs, 16);
+            if (S == kSrcP010) {
+                first = _mm256_sub_epi32(_mm256_srli_epi32(first, 6), _mm256_set1_epi32(512));
+                second = _mm256_sub_epi32(_mm256_srli_epi32(second, 6), _mm256_set1_epi32(512));
+            } else {
+                first = _mm256_sub_epi32(first, _mm256_set1_epi32(128));
+                second = _mm256_sub_epi32(second, _mm256_set1_epi32(128));
+            }
+            bool swapped = srcV < srcU;
+            *u = swapped ? second : first;
+            *v = swapped ? first : second;
+            break;
+        }
+    }
+}
+
+template<DstLayout D>
+AVX2_TARGET inline __m256i packPixelsAvx2(__m256i r, __m256i g, __m256i b) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maxValue = _mm256_set1_epi32(D == kDstRGBA1010102 ? 1023 : 255);
+    r = _mm256_min_epi32(_mm256_max_epi32(r, zero), maxValue);
+    g = _mm256_min_epi32(_mm256_max_epi32(g, zero), maxValue);
+    b = _mm256_min_epi32(_mm256_max_epi32(b, zero), maxValue);
+
+    if (D == kDstRGB565) {
+        return _mm256_or_si256(_mm256_or_si256(
+                _mm256_slli_epi32(_mm256_srli_epi32(r, 3), 11),
+                _mm256_slli_epi32(_mm256_srli_epi32(g, 2), 5)),
+                _mm256_srli_epi32(b, 3));
+    } else if (D == kDstRGBA8888) {
+        return _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+                _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_set1_epi32(0xFF000000)));
+    } else if (D == kDstBGRA8888) {
+        return _mm256_or_si256(_mm256_or_si256(b, _mm256_slli_epi32(g, 8)),
+                _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_set1_epi32(0xFF000000)));
+    }
+    return _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 10)),
+            _mm256_or_si256(_mm256_slli_epi32(b, 20), _mm256_set1_epi32(0xC0000000)));
+}
+
+template<DstLayout D>
+AVX2_TARGET inline __m256i convertPixelsAvx2(
+        __m256i y, __m256i u, __m256i v, const YuvRowCoeffs &c) {
+    __m256i tmp = _mm256_add_epi32(
+            _mm256_mullo_epi32(
+                    _mm256_sub_epi32(y, _mm256_set1_epi32(c._c16)), _mm256_set1_epi32(c._y)),
+            _mm256_set1_epi32(128));
+    __m256i r = _mm256_add_epi32(tmp, _mm256_mullo_epi32(v, _mm256_set1_epi32(c._r_v)));
+    __m256i g = _mm256_sub_epi32(tmp, _mm256_add_epi32(
+            _mm256_mullo_epi32(u, _mm256_set1_epi32(c._g_u)),
+            _mm256_mullo_epi32(v, _mm256_set1_epi32(c._g_v))));
+    __m256i b = _mm256_add_epi32(tmp, _mm256_mullo_epi32(u, _mm256_set1_epi32(c._b_u)));
+    return packPixelsAvx2<D>(
+            _mm256_srai_epi32(r, 8), _mm256_srai_epi32(g, 8), _mm256_srai_epi32(b, 8));
+}
+
+template<SrcLayout S, DstLayout D>
+AVX2_TARGET void convertRowAvx2(
+        const void *srcY, const void *srcU, const void *srcV,
+        void *dst, size_t width, const YuvRowCoeffs &c) {
+    const __m256i dupLo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i dupHi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i yLo, yHi, u, v;
+        loadYAvx2<S>(srcY, x, &yLo, &yHi);
+        loadChromaAvx2<S>(srcU, srcV, x, &u, &v);
+
+        __m256i lo = convertPixelsAvx2<D>(yLo,
+                _mm256_permutevar8x32_epi32(u, dupLo), _mm256_permutevar8x32_epi32(v, dupLo), c);
+        __m256i hi = convertPixelsAvx2<D>(yHi,
+                _mm256_permutevar8x32_epi32(u, dupHi), _mm256_permutevar8x32_epi32(v, dupHi), c);
+
+        if (D == kDstRGB565) {
+            // packus works within 128-bit lanes, so restore the pixel order afterwards
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+            _mm256_storeu_si256((__m256i *)((uint16_t *)dst + x), packed);
+        } else {
+            _mm256_storeu_si256((__m256i *)((uint32_t *)dst + x), lo);
+            _mm256_storeu_si256((__m256i *)((uint32_t *)dst + x + 8), hi);
+        }
+    }
+    convertRowScalarRange<S, D>(srcY, srcU, srcV, dst, x, width, c);
+}
+
+AVX2_TARGET void convertY410RowAvx2(
+        const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV,
+        uint32_t *dst, size_t width) {
+    const __m256i mask = _mm256_set1_epi32(0x3FF);
+    const __m256i dupLo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i dupHi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i y = _mm256_loadu_si256((const __m256i *)(srcY + x));
+        __m256i u = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(srcU + x / 2)));
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(srcV + x / 2)));
+        __m256i uv = _mm256_or_si256(_mm256_and_si256(u, mask),
+                _mm256_slli_epi32(_mm256_and_si256(v, mask), 20));
+
+        __m256i yLo = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(y)), mask);
+        __m256i yHi = _mm256_and_si256(
+                _mm256_cvtepu16_epi32(_mm256_extracti128_si256(y, 1)), mask);
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_or_si256(
+                _mm256_slli_epi32(yLo, 10), _mm256_permutevar8x32_epi32(uv, dupLo)));
+        _mm256_storeu_si256((__m256i *)(dst + x + 8), _mm256_or_si256(
+                _mm256_slli_epi32(yHi, 10), _mm256_permutevar8x32_epi32(uv, dupHi)));
+    }
+    convertY410RowScalarRange(srcY, srcU, srcV, dst, x, width);
+}
+
+#endif // USE_X86_KERNELS
+
+#if USE_NEON_KERNELS
+
+/*
+ * NEON kernels, 8 pixels per iteration.
+ */
+
+template<SrcLayout S>
+inline void loadYNeon(const void *srcY, size_t x, int32x4_t *lo, int32x4_t *hi) {
+    uint16x8_t y;
+    if (S == kSrcPlanar8 || S == kSrcSemiPlanar8) {
+        y = vmovl_u8(vld1_u8((const uint8_t *)srcY + x));
+    } else {
+        y = vld1q_u16((const uint16_t *)srcY + x);
+        if (S == kSrcPlanar16) {
+            y = vandq_u16(vshrq_n_u16(y, 2), vdupq_n_u16(0xFF));
+        } else {
+            y = vshrq_n_u16(y, 6);
+        }
+    }
+    *lo = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(y)));
+    *hi = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(y)));
+}
+
+// loads the 4 centered chroma samples for the 8 pixels starting at |x|
+template<SrcLayout S>
+inline void loadChromaNeon(
+        const void *srcU, const void *srcV, size_t x, int32x4_t *u, int32x4_t *v) {
+    uint16x4_t u16, v16;
+    int32_t center = 128;
+    switch (S) {
+        case kSrcPlanar8:
+            u16 = vget_low_u16(vmovl_u8(vreinterpret_u8_u32(
+                    vdup_n_u32(load32((const uint8_t *)srcU + x / 2)))));
+            v16 = vget_low_u16(vmovl_u8(vreinterpret_u8_u32(
+                    vdup_n_u32(load32((const uint8_t *)srcV + x / 2)))));
+            break;
+        case kSrcPlanar16:
+            u16 = vand_u16(vshr_n_u16(vld1_u16((const uint16_t *)srcU + x / 2), 2),
+                    vdup_n_u16(0xFF));
+            v16 = vand_u16(vshr_n_u16(vld1_u16((const uint16_t *)srcV + x / 2), 2),
+                    vdup_n_u16(0xFF));
+            break;
+        case kSrcSemiPlanar8:
+        {
+            uint8x8_t pairs = vld1_u8((const uint8_t *)chromaBase(srcU, srcV) + x);
+            uint8x8x2_t split = vuzp_u8(pairs, pairs);
+            bool swapped = srcV < srcU;
+            u16 = vget_low_u16(vmovl_u8(split.val[swapped ? 1 : 0]));
+            v16 = vget_low_u16(vmovl_u8(split.val[swapped ? 0 : 1]));
+            break;
+        }
+        case kSrcP010:
+        {
+            uint16x8_t pairs = vld1q_u16((const uint16_t *)chromaBase(srcU, srcV) + x);
+            uint16x8x2_t split = vuzpq_u16(pairs, pairs);
+            bool swapped = srcV < srcU;
+            u16 = vshr_n_u16(vget_low_u16(split.val[swapped ? 1 : 0]), 6);
+            v16 = vshr_n_u16(vget_low_u16(split.val[swapped ? 0 : 1]), 6);
+            center = 512;
+            break;
+        }
+    }
+    *u = vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(u16)), vdupq_n_s32(center));
+    *v = vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(v16)), vdupq_n_s32(center));
+}
+
+template<DstLayout D>
+inline uint32x4_t convertPixelsNeon(
+        int32x4_t y, int32x4_t u, int32x4_t v, const YuvRowCoeffs &c) {
+    int32x4_t tmp = vmlaq_n_s32(vdupq_n_s32(128), vsubq_s32(y, vdupq_n_s32(c._c16)), c._y);
+    int32x4_t r = vshrq_n_s32(vmlaq_n_s32(tmp, v, c._r_v), 8);
+    int32x4_t g = vshrq_n_s32(vmlsq_n_s32(vmlsq_n_s32(tmp, u, c._g_u), v, c._g_v), 8);
+    int32x4_t b = vshrq_n_s32(vmlaq_n_s32(tmp, u, c._b_u), 8);
+
+    const int32x4_t zero = vdupq_n_s32(0);
+    const int32x4_t maxValue = vdupq_n_s32(D == kDstRGBA1010102 ? 1023 : 255);
+    uint32x4_t ur = vreinterpretq_u32_s32(vminq_s32(vmaxq_s32(r, zero), maxValue));
+    uint32x4_t ug = vreinterpretq_u32_s32(vminq_s32(vmaxq_s32(g, zero), maxValue));
+    uint32x4_t ub = vreinterpretq_u32_s32(vminq_s32(vmaxq_s32(b, zero), maxValue));
+
+    if (D == kDstRGB565) {
+        return vorrq_u32(vorrq_u32(
+                vshlq_n_u32(vshrq_n_u32(ur, 3), 11),
+                vshlq_n_u32(vshrq_n_u32(ug, 2), 5)),
+                vshrq_n_u32(ub, 3));
+    } else if (D == kDstRGBA8888) {
+        return vorrq_u32(vorrq_u32(ur, vshlq_n_u32(ug, 8)),
+                vorrq_u32(vshlq_n_u32(ub, 16), vdupq_n_u32(0xFF000000)));
+    } else if (D == kDstBGRA8888) {
+        return vorrq_u32(vorrq_u32(ub, vshlq_n_u32(ug, 8)),
+                vorrq_u32(vshlq_n_u32(ur, 16), vdupq_n_u32(0xFF000000)));
+    }
+    return vorrq_u32(vorrq_u32(ur, vshlq_n_u32(ug, 10)),
+            vorrq_u32(vshlq_n_u32(ub, 20), vdupq_n_u32(0xC0000000)));
+}
+
+template<SrcLayout S, DstLayout D>
+void convertRowNeon(
+        const void *srcY, const void *srcU, const void *srcV,
+        void *dst, size_t width, const YuvRowCoeffs &c) {
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        int32x4_t yLo, yHi, u, v;
+        loadYNeon<S>(srcY, x, &yLo, &yHi);
+        loadChromaNeon<S>(srcU, srcV, x, &u, &v);
+
+        int32x4x2_t uu = vzipq_s32(u, u);
+        int32x4x2_t vv = vzipq_s32(v, v);
+        uint32x4_t lo = convertPixelsNeon<D>(yLo, uu.val[0], vv.val[0], c);
+        uint32x4_t hi = convertPixelsNeon<D>(yHi, uu.val[1], vv.val[1], c);
+
+        if (D == kDstRGB565) {
+            vst1q_u16((uint16_t *)dst + x, vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+        } else {
+            vst1q_u32((uint32_t *)dst + x, lo);
+            vst1q_u32((uint32_t *)dst + x + 4, hi);
+        }
+    }
+    convertRowScalarRange<S, D>(srcY, srcU, srcV, dst, x, width, c);
+}
+
+#endif // USE_NEON_KERNELS
+
+enum KernelLevel {
+    kLevelScalar,
+    kLevelSse41,
+    kLevelAvx2,
+    kLevelNeon,
+};
+
+template<SrcLayout S, DstLayout D>
+YuvToRgbRowFn selectRowKernel(KernelLevel level) {
+    switch (level) {
+#if USE_X86_KERNELS
+        case kLevelAvx2:
+            return convertRowAvx2<S, D>;
+        case kLevelSse41:
+            return convertRowSse41<S, D>;
+#endif
+#if USE_NEON_KERNELS
+        case kLevelNeon:
+            return convertRowNeon<S, D>;
+#endif
+        case kLevelScalar:
+            return convertRowScalar<S, D>;
+        default:
+            return nullptr;
+    }
+}
+
+template<SrcLayout S>
+YuvToRgbRowFn selectRowKernel(int32_t dstFormat, KernelLevel level) {
+    switch (dstFormat) {
+        case OMX_COLOR_Format16bitRGB565:
+            return selectRowKernel<S, kDstRGB565>(level);
+        case OMX_COLOR_Format32BitRGBA8888:
+            return selectRowKernel<S, kDstRGBA8888>(level);
+        case OMX_COLOR_Format32bitBGRA8888:
+            return selectRowKernel<S, kDstBGRA8888>(level);
+        default:
+            return nullptr;
+    }
+}
+
+KernelLevel getKernelLevel(uint32_t cpuFeatures) {
+    if (cpuFeatures & kColorConverterCpuAvx2) {
+        return kLevelAvx2;
+    } else if (cpuFeatures & kColorConverterCpuSse41) {
+        return kLevelSse41;
+    } else if (cpuFeatures & kColorConverterCpuNeon) {
+        return kLevelNeon;
+    }
+    return kLevelScalar;
+}
+
+}  // namespace
+
+uint32_t getColorConverterCpuFeatures() {
+    static const uint32_t sFeatures = []() {
+        uint32_t features = kColorConverterCpuNone;
+#if USE_X86_KERNELS
+        if (__builtin_cpu_supports("sse4.1")) {
+            features |= kColorConverterCpuSse41;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            features |= kColorConverterCpuAvx2;
+        }
+#endif
+#if USE_NEON_KERNELS
+        features |= kColorConverterCpuNeon;
+#endif
+        ALOGV("cpu features %#x", features);
+        return features;
+    }();
+    return sFeatures;
+}
+
+YuvToRgbRowFn getYuvToRgbRowKernel(
+        int32_t srcFormat, int32_t dstFormat, uint32_t cpuFeatures) {
+    KernelLevel level = getKernelLevel(cpuFeatures);
+    switch (srcFormat) {
+        case OMX_COLOR_FormatYUV420Planar:
+            return selectRowKernel<kSrcPlanar8>(dstFormat, level);
+        case OMX_COLOR_FormatYUV420SemiPlanar:
+            return selectRowKernel<kSrcSemiPlanar8>(dstFormat, level);
+        case OMX_COLOR_FormatYUV420Planar16:
+            return selectRowKernel<kSrcPlanar16>(dstFormat, level);
+        case COLOR_FormatYUVP010:
+            if (dstFormat == COLOR_Format32bitABGR2101010) {
+                return selectRowKernel<kSrcP010, kDstRGBA1010102>(level);
+            }
+            return nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+Yuv420p16ToY410RowFn getYuv420p16ToY410RowKernel(uint32_t cpuFeatures) {
+    switch (getKernelLevel(cpuFeatures)) {
+#if USE_X86_KERNELS
+        case kLevelAvx2:
+            return convertY410RowAvx2;
+        case kLevelSse41:
+            return convertY410RowSse41;
+#endif
+        case kLevelScalar:
+            return convertY410RowScalar;
+        default:
+            // the NEON Y410 conversion lives in ColorConverter.cpp
+            return nullptr;
+    }
+}
+
+}  // namespace android
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COLOR_CONVERTER_KERNELS_H_
+
+#define COLOR_CONVERTER_KERNELS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * Row kernels used by ColorConverter for the conversions that libyuv does not handle (any matrix
+ * other than BT.601 limited, 10-bit sources and RGBA_1010102 output).
+ *
+ * All kernels produce bit-exact results with the scalar loops in ColorConverter.cpp: the math is
+ * done in 32-bit integers using the same 1/256th matrix coefficients, and clamping with min/max
+ * is equivalent to the clip lookup tables.
+ */
+
+// YUV->RGB matrix coefficients in 1/256th units (see ColorConverter::Coeffs).
+struct YuvRowCoeffs {
+    int32_t _y;
+    int32_t _r_v;
+    int32_t _g_u;
+    int32_t _g_v;
+    int32_t _b_u;
+    int32_t _c16;   // luma offset at the source bit depth; 0 for full range
+};
+
+enum {
+    kColorConverterCpuNone  = 0,
+    kColorConverterCpuSse41 = 1 << 0,
+    kColorConverterCpuAvx2  = 1 << 1,
+    kColorConverterCpuNeon  = 1 << 2,
+};
+
+// Returns the kColorConverterCpu* features available on this device.
+uint32_t getColorConverterCpuFeatures();
+
+/**
+ * Converts one row of |width| pixels to RGB.
+ *
+ * For planar sources |srcU| and |srcV| point to the chroma planes. For semi-planar sources (NV12,
+ * NV21 and P010) they point into the same interleaved chroma row, at the first U and the first V
+ * sample respectively, so NV21 is handled by swapping the two pointers.
+ */
+typedef void (*YuvToRgbRowFn)(
+        const void *srcY, const void *srcU, const void *srcV,
+        void *dst, size_t width, const YuvRowCoeffs &coeffs);
+
+// Converts one row of |width| 10-bit YUV420Planar16 pixels to Y410.
+typedef void (*Yuv420p16ToY410RowFn)(
+        const uint16_t *srcY, const uint16_t *srcU, const uint16_t *srcV,
+        uint32_t *dst, size_t width);
+
+/**
+ * Returns the fastest row kernel for converting |srcFormat| to |dstFormat| using only the given
+ * |cpuFeatures|, or nullptr if there is none. With kColorConverterCpuNone the scalar reference
+ * kernel is returned, which the vector kernels are tested against.
+ *
+ * Supported sources are OMX_COLOR_FormatYUV420Planar, OMX_COLOR_FormatYUV420SemiPlanar (also
+ * used for NV21 and the vendor packed semi-planar formats) and OMX_COLOR_FormatYUV420Planar16 to
+ * 8-bit RGB outputs, and COLOR_FormatYUVP010 to COLOR_Format32bitABGR2101010.
+ */
+YuvToRgbRowFn getYuvToRgbRowKernel(
+        int32_t srcFormat, int32_t dstFormat, uint32_t cpuFeatures);
+
+// Same as above for the YUV420Planar16 to Y410 repacking.
+Yuv420p16ToY410RowFn getYuv420p16ToY410RowKernel(uint32_t cpuFeatures);
+
+}  // namespace android
+
+#endif  // COLOR_CONVERTER_KERNELS_H_
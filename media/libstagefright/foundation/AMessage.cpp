@@ -94,6 +94,7 @@ void AMessage::clear() {
         freeItemValue(&item);
     }
     mItems.clear();
+    mItemIndex.clear();
 }
 
 void AMessage::freeItemValue(Item *item) {
@@ -155,15 +156,34 @@ inline size_t AMessage::findItemIndex(const char *name, size_t len) const {
     size_t memchecks = 0;
 #endif
     size_t i = 0;
-    for (; i < mItems.size(); i++) {
-        if (len != mItems[i].mNameLength) {
-            continue;
+    if (!mItemIndex.empty()) {
+        uint32_t hash = AAtomizer::Hash(name);
+        size_t mask = mItemIndex.size() - 1;
+        i = mItems.size();
+        for (size_t slot = hash & mask; mItemIndex[slot] != 0; slot = (slot + 1) & mask) {
+            const Item &item = mItems[mItemIndex[slot] - 1];
+            if (hash != item.mNameHash || len != item.mNameLength) {
+                continue;
+            }
+#ifdef DUMP_STATS
+            ++memchecks;
+#endif
+            if (!memcmp(item.mName, name, len)) {
+                i = mItemIndex[slot] - 1;
+                break;
+            }
         }
+    } else {
+        for (; i < mItems.size(); i++) {
+            if (len != mItems[i].mNameLength) {
+                continue;
+            }
 #ifdef DUMP_STATS
-        ++memchecks;
+            ++memchecks;
 #endif
-        if (!memcmp(mItems[i].mName, name, len)) {
-            break;
+            if (!memcmp(mItems[i].mName, name, len)) {
+                break;
+            }
         }
     }
 #ifdef DUMP_STATS
@@ -179,11 +199,45 @@ inline size_t AMessage::findItemIndex(const char *name, size_t len) const {
     return i;
 }
 
+void AMessage::rebuildItemIndex() {
+    mItemIndex.clear();
+    if (mItems.size() <= kMinNumItemsForIndex) {
+        return;
+    }
+
+    // keep the table at most half full so that probe sequences stay short
+    size_t size = 64;
+    while (size < 2 * mItems.size()) {
+        size *= 2;
+    }
+    mItemIndex.resize(size);
+    for (size_t i = 0; i < mItems.size(); ++i) {
+        addItemToIndex(i);
+    }
+}
+
+void AMessage::addItemToIndex(size_t index) {
+    if (mItemIndex.size() < 2 * mItems.size()) {
+        if (mItems.size() > kMinNumItemsForIndex) {
+            rebuildItemIndex();
+        }
+        return;
+    }
+
+    size_t mask = mItemIndex.size() - 1;
+    size_t slot = mItems[index].mNameHash & mask;
+    while (mItemIndex[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    mItemIndex[slot] = index + 1;
+}
+
 // assumes item's name was uninitialized or NULL
 void AMessage::Item::setName(const char *name, size_t len) {
     mNameLength = len;
     mName = new char[len + 1];
     memcpy((void*)mName, name, len + 1);
+    mNameHash = AAtomizer::Hash(mName);
 }
 
 AMessage::Item::Item(const char *name, size_t len)
@@ -205,6 +259,7 @@ AMessage::Item *AMessage::allocateItem(const char *name) {
         i = mItems.size();
         // place a 'blank' item at the end - this is of type kTypeInt32
         mItems.emplace_back(name, len);
+        addItemToIndex(i);
         item = &mItems[i];
     }
 
@@ -480,6 +535,7 @@ bool AMessage::senderAwaitsResponse(sp<AReplyToken> *replyToken) {
 sp<AMessage> AMessage::dup() const {
     sp<AMessage> msg = new AMessage(mWhat, mHandler.promote());
     msg->mItems = mItems;
+    msg->mItemIndex = mItemIndex;
 
 #ifdef DUMP_STATS
     {
@@ -763,6 +819,7 @@ sp<AMessage> AMessage::FromParcel(const Parcel &parcel, size_t maxNestingLevel)
         item->setName(name, strlen(name));
     }
 
+    msg->rebuildItemIndex();
     return msg;
 }
 
@@ -1013,6 +1070,7 @@ status_t AMessage::setEntryNameAt(size_t index, const char *name) {
     delete[] mItems[index].mName;
     mItems[index].mName = nullptr;
     mItems[index].setName(name, len);
+    rebuildItemIndex();
     return OK;
 }
 
@@ -1087,6 +1145,7 @@ status_t AMessage::removeEntryAt(size_t index) {
         mItems[lastIndex].mType = kTypeInt32;
     }
     mItems.pop_back();
+    rebuildItemIndex();
     return OK;
 }
 
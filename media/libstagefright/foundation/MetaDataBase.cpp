@@ -17,13 +17,16 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MetaDataBase"
 #include <inttypes.h>
-#include <utils/KeyedVector.h>
 #include <utils/Log.h>
 
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <vector>
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AString.h>
@@ -36,42 +39,48 @@
 
 namespace android {
 
-struct MetaDataBase::typed_data {
-    typed_data();
-    ~typed_data();
-
-    typed_data(const MetaDataBase::typed_data &);
-    typed_data &operator=(const MetaDataBase::typed_data &);
+namespace {
+
+// Payloads up to this size are stored in the item itself, larger ones in an arena chunk.
+constexpr size_t kInlineSize = 16;
+
+// Item sizes are 32-bit, so payloads and chunks are capped well below 4GB.
+constexpr size_t kMaxChunkSize = 1 << 30;
+constexpr size_t kMinChunkSize = 256;
+// Slots are allocated in chunks of kMinNumSlots, then twice as many each time.
+constexpr uint32_t kMinNumSlots = 8;
+constexpr uint32_t kNoSlot = UINT32_MAX;
+
+// Payloads larger than kInlineSize are allocated one after the other in a chunk. A chunk is
+// freed once none of its payloads is in use.
+struct ArenaChunk {
+    std::unique_ptr<uint64_t[]> mData;
+    size_t mCapacity = 0;
+    size_t mSize = 0;      // bytes handed out
+    size_t mLiveSize = 0;  // bytes of mSize still used by an item
+};
 
-    void clear();
-    void setData(uint32_t type, const void *data, size_t size);
-    void getData(uint32_t *type, const void **data, size_t *size) const;
-    // may include hexdump of binary data if verbose=true
-    String8 asString(bool verbose) const;
+}  // namespace
 
-private:
+struct MetaDataBase::typed_data {
     uint32_t mType;
-    size_t mSize;
+    uint32_t mSize;
+    // For free slots, the next free slot.
+    uint32_t mNextFreeSlot;
+    // Bytes of the arena chunk used by a payload larger than kInlineSize.
+    uint32_t mCapacity;
 
     union {
-        void *ext_data;
-        float reservoir;
+        uint8_t bytes[kInlineSize];
+        int64_t align;
+        struct {
+            uint8_t *mData;
+            ArenaChunk *mChunk;
+        } arena;
     } u;
 
-    bool usesReservoir() const {
-        return mSize <= sizeof(u.reservoir);
-    }
-
-    void *allocateStorage(size_t size);
-    void freeStorage();
-
-    void *storage() {
-        return usesReservoir() ? &u.reservoir : u.ext_data;
-    }
-
-    const void *storage() const {
-        return usesReservoir() ? &u.reservoir : u.ext_data;
-    }
+    // may include hexdump of binary data if verbose=true
+    String8 asString(const void *data, bool verbose) const;
 };
 
 struct MetaDataBase::Rect {
@@ -80,8 +89,53 @@ struct MetaDataBase::Rect {
 
 
 struct MetaDataBase::MetaDataInternal {
+    struct IndexEntry {
+        uint32_t mKey;
+        uint32_t mSlot;
+    };
+
+    // Neither slots nor payloads move while other keys are added or removed, so that pointers
+    // returned by findData() stay valid as long as the old code kept them valid. Storage that
+    // no item uses any more is freed right away.
+    // Copies of a MetaDataBase share the same store until one of them is modified.
+    struct Store {
+        Store() = default;
+        // copies only the live items, packing their slots and payloads
+        Store(const Store &from);
+
+        typed_data &slot(uint32_t index);
+        const typed_data &slot(uint32_t index) const;
+        const typed_data *find(uint32_t key) const;
+        const void *data(const typed_data &item) const;
+
+        // returns the slot for |key|, adding one if needed
+        typed_data *edit(uint32_t key, bool *added);
+        bool remove(uint32_t key);
+        void clear();
+
+        // returns storage for |size| bytes of payload for |item|, or nullptr if out of space
+        void *allocatePayload(typed_data *item, size_t size);
+
+        std::vector<IndexEntry> mIndex;  // sorted by key
+        // slot chunk c holds kMinNumSlots << c slots
+        std::vector<std::unique_ptr<typed_data[]>> mSlotChunks;
+        uint32_t mNumSlots = 0;
+        uint32_t mFreeSlot = kNoSlot;
+        // the last chunk receives new payloads
+        std::vector<std::unique_ptr<ArenaChunk>> mChunks;
+        size_t mLiveSize = 0;  // bytes of all chunks used by an item
+
+    private:
+        void releasePayload(typed_data *item);
+        ArenaChunk *addChunk(size_t size);
+        Store &operator=(const Store &) = delete;
+    };
+
+    // returns a store that is not shared with any other MetaDataBase
+    Store *editStore();
+
     std::mutex mLock;
-    KeyedVector<uint32_t, MetaDataBase::typed_data> mItems;
+    std::shared_ptr<Store> mStore;
 };
 
 
@@ -91,35 +145,44 @@ MetaDataBase::MetaDataBase()
 
 MetaDataBase::MetaDataBase(const MetaDataBase &from)
     : mInternalData(new MetaDataInternal()) {
-    mInternalData->mItems = from.mInternalData->mItems;
+    std::lock_guard<std::mutex> guard(from.mInternalData->mLock);
+    mInternalData->mStore = from.mInternalData->mStore;
 }
 
 MetaDataBase& MetaDataBase::operator = (const MetaDataBase &rhs) {
-    this->mInternalData->mItems = rhs.mInternalData->mItems;
+    if (this != &rhs) {
+        std::shared_ptr<MetaDataInternal::Store> store;
+        {
+            std::lock_guard<std::mutex> guard(rhs.mInternalData->mLock);
+            store = rhs.mInternalData->mStore;
+        }
+        std::lock_guard<std::mutex> guard(mInternalData->mLock);
+        mInternalData->mStore = std::move(store);
+    }
     return *this;
 }
 
 MetaDataBase::~MetaDataBase() {
-    clear();
     delete mInternalData;
 }
 
 void MetaDataBase::clear() {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    mInternalData->mItems.clear();
+    if (mInternalData->mStore.use_count() == 1) {
+        // keep the buffers so that reused metadata, e.g. of a MediaBuffer, does not reallocate
+        mInternalData->mStore->clear();
+    } else {
+        mInternalData->mStore.reset();
+    }
 }
 
 bool MetaDataBase::remove(uint32_t key) {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    ssize_t i = mInternalData->mItems.indexOfKey(key);
-
-    if (i < 0) {
+    if (mInternalData->mStore == nullptr || mInternalData->mStore->find(key) == nullptr) {
         return false;
     }
 
-    mInternalData->mItems.removeItemsAt(i);
-
-    return true;
+    return mInternalData->editStore()->remove(key);
 }
 
 bool MetaDataBase::setCString(uint32_t key, const char *value) {
@@ -255,138 +318,256 @@ bool MetaDataBase::findRect(
 
 bool MetaDataBase::setData(
         uint32_t key, uint32_t type, const void *data, size_t size) {
-    bool overwrote_existing = true;
-
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    ssize_t i = mInternalData->mItems.indexOfKey(key);
-    if (i < 0) {
-        typed_data item;
-        i = mInternalData->mItems.add(key, item);
-
-        overwrote_existing = false;
-    }
+    MetaDataInternal::Store *store = mInternalData->editStore();
 
-    typed_data &item = mInternalData->mItems.editValueAt(i);
+    bool added;
+    typed_data *item = store->edit(key, &added);
+    item->mType = type;
 
-    item.setData(type, data, size);
+    void *dst = store->allocatePayload(item, size);
+    if (dst) {
+        memcpy(dst, data, size);
+    }
 
-    return overwrote_existing;
+    return !added;
 }
 
 bool MetaDataBase::findData(uint32_t key, uint32_t *type,
                         const void **data, size_t *size) const {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    ssize_t i = mInternalData->mItems.indexOfKey(key);
+    const MetaDataInternal::Store *store = mInternalData->mStore.get();
+    const typed_data *item = store ? store->find(key) : nullptr;
 
-    if (i < 0) {
+    if (item == nullptr) {
         return false;
     }
 
-    const typed_data &item = mInternalData->mItems.valueAt(i);
-
-    item.getData(type, data, size);
+    *type = item->mType;
+    *size = item->mSize;
+    *data = store->data(*item);
 
     return true;
 }
 
 bool MetaDataBase::hasData(uint32_t key) const {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    ssize_t i = mInternalData->mItems.indexOfKey(key);
+    const MetaDataInternal::Store *store = mInternalData->mStore.get();
 
-    if (i < 0) {
-        return false;
+    return store != nullptr && store->find(key) != nullptr;
+}
+
+MetaDataBase::MetaDataInternal::Store *MetaDataBase::MetaDataInternal::editStore() {
+    if (mStore == nullptr) {
+        mStore = std::make_shared<Store>();
+    } else if (mStore.use_count() > 1) {
+        // the other owners only read the shared store, so copy it rather than modify it
+        mStore = std::make_shared<Store>(*mStore);
     }
+    return mStore.get();
+}
 
-    return true;
+MetaDataBase::MetaDataInternal::Store::Store(const Store &from)
+    : mIndex(from.mIndex) {
+    std::unique_ptr<ArenaChunk> chunk;
+    if (from.mLiveSize > 0) {
+        chunk.reset(new ArenaChunk);
+        chunk->mData.reset(new uint64_t[from.mLiveSize / sizeof(uint64_t)]);
+        chunk->mCapacity = from.mLiveSize;
+    }
+
+    for (IndexEntry &entry : mIndex) {
+        if (mNumSlots == kMinNumSlots * ((1u << mSlotChunks.size()) - 1)) {
+            mSlotChunks.emplace_back(new typed_data[kMinNumSlots << mSlotChunks.size()]);
+        }
+        typed_data &item = slot(mNumSlots);
+        item = from.slot(entry.mSlot);
+        entry.mSlot = mNumSlots++;
+        if (item.mCapacity > 0) {
+            uint8_t *data = (uint8_t *)chunk->mData.get() + chunk->mSize;
+            memcpy(data, item.u.arena.mData, item.mCapacity);
+            item.u.arena.mData = data;
+            item.u.arena.mChunk = chunk.get();
+            chunk->mSize += item.mCapacity;
+        }
+    }
+
+    if (chunk != nullptr) {
+        chunk->mLiveSize = chunk->mSize;
+        mLiveSize = chunk->mSize;
+        mChunks.push_back(std::move(chunk));
+    }
 }
 
-MetaDataBase::typed_data::typed_data()
-    : mType(0),
-      mSize(0) {
+MetaDataBase::typed_data &MetaDataBase::MetaDataInternal::Store::slot(uint32_t index) {
+    // slot chunk c starts at slot kMinNumSlots * (2^c - 1)
+    uint32_t chunk = 31 - __builtin_clz(index / kMinNumSlots + 1);
+    return mSlotChunks[chunk][index - kMinNumSlots * ((1u << chunk) - 1)];
 }
 
-MetaDataBase::typed_data::~typed_data() {
-    clear();
+const MetaDataBase::typed_data &MetaDataBase::MetaDataInternal::Store::slot(
+        uint32_t index) const {
+    return const_cast<Store *>(this)->slot(index);
 }
 
-MetaDataBase::typed_data::typed_data(const typed_data &from)
-    : mType(from.mType),
-      mSize(0) {
+const MetaDataBase::typed_data *MetaDataBase::MetaDataInternal::Store::find(uint32_t key) const {
+    auto it = std::lower_bound(
+            mIndex.begin(), mIndex.end(), key,
+            [](const IndexEntry &entry, uint32_t key) { return entry.mKey < key; });
+    if (it == mIndex.end() || it->mKey != key) {
+        return nullptr;
+    }
+    return &slot(it->mSlot);
+}
 
-    void *dst = allocateStorage(from.mSize);
-    if (dst) {
-        memcpy(dst, from.storage(), mSize);
+const void *MetaDataBase::MetaDataInternal::Store::data(const typed_data &item) const {
+    if (item.mSize <= kInlineSize) {
+        return item.u.bytes;
     }
+    return item.u.arena.mData;
 }
 
-MetaDataBase::typed_data &MetaDataBase::typed_data::operator=(
-        const MetaDataBase::typed_data &from) {
-    if (this != &from) {
-        clear();
-        mType = from.mType;
-        void *dst = allocateStorage(from.mSize);
-        if (dst) {
-            memcpy(dst, from.storage(), mSize);
+MetaDataBase::typed_data *MetaDataBase::MetaDataInternal::Store::edit(
+        uint32_t key, bool *added) {
+    auto it = std::lower_bound(
+            mIndex.begin(), mIndex.end(), key,
+            [](const IndexEntry &entry, uint32_t key) { return entry.mKey < key; });
+    *added = it == mIndex.end() || it->mKey != key;
+    if (!*added) {
+        return &slot(it->mSlot);
+    }
+
+    uint32_t index = mFreeSlot;
+    if (index != kNoSlot) {
+        mFreeSlot = slot(index).mNextFreeSlot;
+    } else {
+        if (mNumSlots == kMinNumSlots * ((1u << mSlotChunks.size()) - 1)) {
+            // add a chunk rather than move the slots, which may hold payloads
+            mSlotChunks.emplace_back(new typed_data[kMinNumSlots << mSlotChunks.size()]);
         }
+        index = mNumSlots++;
     }
 
-    return *this;
+    typed_data *item = &slot(index);
+    item->mType = 0;
+    item->mSize = 0;
+    item->mNextFreeSlot = kNoSlot;
+    item->mCapacity = 0;
+    mIndex.insert(it, IndexEntry{key, index});
+    return item;
 }
 
-void MetaDataBase::typed_data::clear() {
-    freeStorage();
+bool MetaDataBase::MetaDataInternal::Store::remove(uint32_t key) {
+    auto it = std::lower_bound(
+            mIndex.begin(), mIndex.end(), key,
+            [](const IndexEntry &entry, uint32_t key) { return entry.mKey < key; });
+    if (it == mIndex.end() || it->mKey != key) {
+        return false;
+    }
 
-    mType = 0;
+    typed_data *item = &slot(it->mSlot);
+    releasePayload(item);
+    item->mSize = 0;
+    item->mNextFreeSlot = mFreeSlot;
+    mFreeSlot = it->mSlot;
+    mIndex.erase(it);
+    return true;
 }
 
-void MetaDataBase::typed_data::setData(
-        uint32_t type, const void *data, size_t size) {
-    clear();
+void MetaDataBase::MetaDataInternal::Store::clear() {
+    mIndex.clear();
+    mNumSlots = 0;
+    mFreeSlot = kNoSlot;
+    // keep the newest chunk so that reused metadata does not reallocate
+    if (!mChunks.empty()) {
+        mChunks.erase(mChunks.begin(), mChunks.end() - 1);
+        mChunks.back()->mSize = 0;
+        mChunks.back()->mLiveSize = 0;
+    }
+    mLiveSize = 0;
+}
 
-    mType = type;
+void *MetaDataBase::MetaDataInternal::Store::allocatePayload(typed_data *item, size_t size) {
+    if (size <= kInlineSize) {
+        releasePayload(item);
+        item->mSize = size;
+        return item->u.bytes;
+    }
 
-    void *dst = allocateStorage(size);
-    if (dst) {
-        memcpy(dst, data, size);
+    if (size > item->mCapacity) {
+        releasePayload(item);
+        // keep payloads 8-byte aligned, like malloc() did for int64_t and pointer values
+        size_t capacity = (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+        ArenaChunk *chunk = mChunks.empty() ? nullptr : mChunks.back().get();
+        if (size > kMaxChunkSize
+                || ((chunk == nullptr || capacity > chunk->mCapacity - chunk->mSize)
+                        && (chunk = addChunk(capacity)) == nullptr)) {
+            ALOGE("Couldn't allocate %zu bytes for item", size);
+            item->mSize = 0;
+            return nullptr;
+        }
+        item->u.arena.mData = (uint8_t *)chunk->mData.get() + chunk->mSize;
+        item->u.arena.mChunk = chunk;
+        item->mCapacity = capacity;
+        chunk->mSize += capacity;
+        chunk->mLiveSize += capacity;
+        mLiveSize += capacity;
     }
-}
 
-void MetaDataBase::typed_data::getData(
-        uint32_t *type, const void **data, size_t *size) const {
-    *type = mType;
-    *size = mSize;
-    *data = storage();
+    item->mSize = size;
+    return item->u.arena.mData;
 }
 
-void *MetaDataBase::typed_data::allocateStorage(size_t size) {
-    mSize = size;
-
-    if (usesReservoir()) {
-        return &u.reservoir;
+void MetaDataBase::MetaDataInternal::Store::releasePayload(typed_data *item) {
+    if (item->mCapacity == 0) {
+        return;
     }
+    ArenaChunk *chunk = item->u.arena.mChunk;
+    if (item->u.arena.mData + item->mCapacity == (uint8_t *)chunk->mData.get() + chunk->mSize) {
+        // the last payload handed out, e.g. of a key set again with a larger value
+        chunk->mSize -= item->mCapacity;
+    }
+    chunk->mLiveSize -= item->mCapacity;
+    mLiveSize -= item->mCapacity;
+    item->mCapacity = 0;
 
-    u.ext_data = malloc(mSize);
-    if (u.ext_data == NULL) {
-        ALOGE("Couldn't allocate %zu bytes for item", size);
-        mSize = 0;
+    if (chunk->mLiveSize == 0) {
+        if (chunk == mChunks.back().get()) {
+            chunk->mSize = 0;
+        } else {
+            mChunks.erase(std::find_if(
+                    mChunks.begin(), mChunks.end(),
+                    [chunk](const std::unique_ptr<ArenaChunk> &c) { return c.get() == chunk; }));
+        }
     }
-    return u.ext_data;
 }
 
-void MetaDataBase::typed_data::freeStorage() {
-    if (!usesReservoir()) {
-        if (u.ext_data) {
-            free(u.ext_data);
-            u.ext_data = NULL;
-        }
+ArenaChunk *MetaDataBase::MetaDataInternal::Store::addChunk(size_t size) {
+    // sized for what is in use rather than for what was ever allocated, like the arena of a
+    // copy, so that setting a key over and over does not grow the chunks
+    size_t capacity = std::max(kMinChunkSize, 2 * (mLiveSize + size));
+    capacity = std::min(capacity, kMaxChunkSize);
+
+    std::unique_ptr<ArenaChunk> chunk(new (std::nothrow) ArenaChunk);
+    if (chunk == nullptr) {
+        return nullptr;
+    }
+    chunk->mData.reset(new (std::nothrow) uint64_t[capacity / sizeof(uint64_t)]);
+    if (chunk->mData == nullptr) {
+        return nullptr;
     }
+    chunk->mCapacity = capacity;
 
-    mSize = 0;
+    // the previous chunk is kept until none of its payloads is in use
+    if (!mChunks.empty() && mChunks.back()->mLiveSize == 0) {
+        mChunks.pop_back();
+    }
+    mChunks.push_back(std::move(chunk));
+    return mChunks.back().get();
 }
 
-String8 MetaDataBase::typed_data::asString(bool verbose) const {
+String8 MetaDataBase::typed_data::asString(const void *data, bool verbose) const {
     String8 out;
-    const void *data = storage();
     switch(mType) {
         case TYPE_NONE:
             out = String8::format("no type, size %zu)", mSize);
@@ -438,12 +619,13 @@ static void MakeFourCCString(uint32_t x, char *s) {
 String8 MetaDataBase::toString() const {
     String8 s;
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    for (int i = mInternalData->mItems.size(); --i >= 0;) {
-        int32_t key = mInternalData->mItems.keyAt(i);
+    const MetaDataInternal::Store *store = mInternalData->mStore.get();
+    for (int i = store ? store->mIndex.size() : 0; --i >= 0;) {
+        int32_t key = store->mIndex[i].mKey;
         char cc[5];
         MakeFourCCString(key, cc);
-        const typed_data &item = mInternalData->mItems.valueAt(i);
-        s.appendFormat("%s: %s", cc, item.asString(false).string());
+        const typed_data &item = store->slot(store->mIndex[i].mSlot);
+        s.appendFormat("%s: %s", cc, item.asString(store->data(item), false).string());
         if (i != 0) {
             s.append(", ");
         }
@@ -453,12 +635,13 @@ String8 MetaDataBase::toString() const {
 
 void MetaDataBase::dumpToLog() const {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    for (int i = mInternalData->mItems.size(); --i >= 0;) {
-        int32_t key = mInternalData->mItems.keyAt(i);
+    const MetaDataInternal::Store *store = mInternalData->mStore.get();
+    for (int i = store ? store->mIndex.size() : 0; --i >= 0;) {
+        int32_t key = store->mIndex[i].mKey;
         char cc[5];
         MakeFourCCString(key, cc);
-        const typed_data &item = mInternalData->mItems.valueAt(i);
-        ALOGI("%s: %s", cc, item.asString(true /* verbose */).string());
+        const typed_data &item = store->slot(store->mIndex[i].mSlot);
+        ALOGI("%s: %s", cc, item.asString(store->data(item), true /* verbose */).string());
     }
 }
 
@@ -466,18 +649,18 @@ void MetaDataBase::dumpToLog() const {
 status_t MetaDataBase::writeToParcel(Parcel &parcel) {
     status_t ret;
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    size_t numItems = mInternalData->mItems.size();
+    const MetaDataInternal::Store *store = mInternalData->mStore.get();
+    size_t numItems = store ? store->mIndex.size() : 0;
     ret = parcel.writeUint32(uint32_t(numItems));
     if (ret) {
         return ret;
     }
     for (size_t i = 0; i < numItems; i++) {
-        int32_t key = mInternalData->mItems.keyAt(i);
-        const typed_data &item = mInternalData->mItems.valueAt(i);
-        uint32_t type;
-        const void *data;
-        size_t size;
-        item.getData(&type, &data, &size);
+        int32_t key = store->mIndex[i].mKey;
+        const typed_data &item = store->slot(store->mIndex[i].mSlot);
+        uint32_t type = item.mType;
+        const void *data = store->data(item);
+        size_t size = item.mSize;
         ret = parcel.writeInt32(key);
         if (ret) {
             return ret;
@@ -31,6 +31,9 @@ namespace android {
 struct AAtomizer {
     static const char *Atomize(const char *name);
 
+    // Hash used to bucket the atoms, also usable for hashing other strings.
+    static uint32_t Hash(const char *s);
+
 private:
     static AAtomizer gAtomizer;
 
@@ -41,8 +44,6 @@ private:
 
     const char *atomize(const char *name);
 
-    static uint32_t Hash(const char *s);
-
     DISALLOW_EVIL_CONSTRUCTORS(AAtomizer);
 };
 
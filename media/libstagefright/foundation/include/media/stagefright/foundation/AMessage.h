@@ -303,17 +303,28 @@ private:
         } u;
         const char *mName;
         size_t      mNameLength;
+        uint32_t    mNameHash;
         Type mType;
         void setName(const char *name, size_t len);
-        Item() : mName(nullptr), mNameLength(0), mType(kTypeInt32) { }
+        Item() : mName(nullptr), mNameLength(0), mNameHash(0), mType(kTypeInt32) { }
         Item(const char *name, size_t length);
     };
 
     enum {
-        kMaxNumItems = 256
+        kMaxNumItems = 256,
+        // messages with more items than this also keep a hash index of the item names
+        kMinNumItemsForIndex = 16,
     };
     std::vector<Item> mItems;
 
+    /**
+     * Open-addressing hash table over the item names. Each slot holds an index into mItems plus
+     * one, or 0 if empty. It is empty for messages with up to kMinNumItemsForIndex items, and
+     * is updated by every method that adds, renames or removes items, so that lookups never
+     * modify the message.
+     */
+    std::vector<uint16_t> mItemIndex;
+
     /**
      * Allocates an item with the given key |name|. If the key already exists, the corresponding
      * item value is freed. Otherwise a new item is added.
@@ -345,6 +356,12 @@ private:
 
     size_t findItemIndex(const char *name, size_t len) const;
 
+    /** Rebuilds mItemIndex after items were renamed, removed or added in bulk. */
+    void rebuildItemIndex();
+
+    /** Adds the item at |index|, which was just appended to mItems, to mItemIndex. */
+    void addItemToIndex(size_t index);
+
     void deliver();
 
     DISALLOW_EVIL_CONSTRUCTORS(AMessage);
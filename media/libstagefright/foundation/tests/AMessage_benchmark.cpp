@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Looks up items in messages of the sizes codec formats and metrics messages reach.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/AMessage_benchmark/AMessage_benchmark
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+using namespace android;
+
+namespace {
+
+// keys share a long prefix, like the "csd-", "android._..." and vendor keys of real formats
+std::vector<std::string> makeKeys(size_t count) {
+    std::vector<std::string> keys;
+    char name[64];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(name, sizeof(name), "vendor.qti-ext-enc-param.%zu", i);
+        keys.push_back(name);
+    }
+    return keys;
+}
+
+sp<AMessage> makeMessage(const std::vector<std::string> &keys) {
+    sp<AMessage> msg = new AMessage();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        msg->setInt32(keys[i].c_str(), i);
+    }
+    return msg;
+}
+
+}  // namespace
+
+// Args: number of items in the message.
+static void BM_AMessageFindInt32(benchmark::State &state) {
+    std::vector<std::string> keys = makeKeys(state.range(0));
+    sp<AMessage> msg = makeMessage(keys);
+
+    size_t i = 0;
+    int32_t value;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg->findInt32(keys[i].c_str(), &value));
+        if (++i == keys.size()) {
+            i = 0;
+        }
+    }
+}
+
+static void BM_AMessageFindMissing(benchmark::State &state) {
+    sp<AMessage> msg = makeMessage(makeKeys(state.range(0)));
+
+    int32_t value;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg->findInt32("vendor.qti-ext-enc-param.missing", &value));
+    }
+}
+
+static void BM_AMessageBuild(benchmark::State &state) {
+    std::vector<std::string> keys = makeKeys(state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(makeMessage(keys));
+    }
+}
+
+BENCHMARK(BM_AMessageFindInt32)->Arg(8)->Arg(32)->Arg(64)->Arg(128);
+BENCHMARK(BM_AMessageFindMissing)->Arg(8)->Arg(32)->Arg(64)->Arg(128);
+BENCHMARK(BM_AMessageBuild)->Arg(8)->Arg(32)->Arg(64)->Arg(128);
+
+BENCHMARK_MAIN();
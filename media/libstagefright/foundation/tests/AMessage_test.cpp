@@ -17,6 +17,8 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "AData_test"
 
+#include <stdio.h>
+
 #include <gtest/gtest.h>
 #include <utils/RefBase.h>
 
@@ -123,3 +125,75 @@ TEST(AMessage_tests, item_manipulation) {
 
 }
 
+
+// messages with many items look up their items through a hash index
+TEST(AMessage_tests, large_message_manipulation) {
+  sp<AMessage> m1 = new AMessage();
+  const size_t kNumItems = 100;
+  char name[32];
+
+  for (size_t i = 0; i < kNumItems; ++i) {
+    snprintf(name, sizeof(name), "key-%zu", i);
+    m1->setInt32(name, i);
+  }
+  ASSERT_EQ(kNumItems, m1->countEntries());
+
+  // insertion order is preserved
+  AMessage::Type type;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    snprintf(name, sizeof(name), "key-%zu", i);
+    EXPECT_STREQ(name, m1->getEntryNameAt(i, &type));
+  }
+
+  int32_t i32;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    snprintf(name, sizeof(name), "key-%zu", i);
+    EXPECT_TRUE(m1->findInt32(name, &i32));
+    EXPECT_EQ((int32_t)i, i32);
+  }
+  EXPECT_FALSE(m1->findInt32("key-", &i32));
+  EXPECT_FALSE(m1->findInt32("key-100", &i32));
+
+  // overwriting keeps the position
+  m1->setInt32("key-7", 1007);
+  EXPECT_EQ(kNumItems, m1->countEntries());
+  EXPECT_EQ(7u, m1->findEntryByName("key-7"));
+  EXPECT_TRUE(m1->findInt32("key-7", &i32));
+  EXPECT_EQ(1007, i32);
+
+  // removal moves the last item into the hole
+  EXPECT_EQ(OK, m1->removeEntryByName("key-3"));
+  EXPECT_FALSE(m1->findInt32("key-3", &i32));
+  EXPECT_EQ(3u, m1->findEntryByName("key-99"));
+  EXPECT_TRUE(m1->findInt32("key-99", &i32));
+  EXPECT_EQ(99, i32);
+
+  EXPECT_EQ(OK, m1->setEntryNameAt(5, "renamed"));
+  EXPECT_FALSE(m1->findInt32("key-5", &i32));
+  EXPECT_TRUE(m1->findInt32("renamed", &i32));
+  EXPECT_EQ(5, i32);
+  EXPECT_EQ(ALREADY_EXISTS, m1->setEntryNameAt(6, "renamed"));
+
+  sp<AMessage> m2 = m1->dup();
+  ASSERT_EQ(m1->countEntries(), m2->countEntries());
+  for (size_t i = 0; i < m2->countEntries(); ++i) {
+    const char *entryName = m2->getEntryNameAt(i, &type);
+    EXPECT_EQ(i, m2->findEntryByName(entryName));
+  }
+
+  // dropping back below the index threshold keeps lookups working
+  while (m2->countEntries() > 4) {
+    EXPECT_EQ(OK, m2->removeEntryAt(0));
+  }
+  for (size_t i = 0; i < m2->countEntries(); ++i) {
+    EXPECT_EQ(i, m2->findEntryByName(m2->getEntryNameAt(i, &type)));
+  }
+
+  sp<AMessage> m3 = new AMessage();
+  m3->setInt32("key-1", 1);
+  m3->extend(m1);
+  EXPECT_EQ(m1->countEntries(), m3->countEntries());
+  EXPECT_STREQ("key-1", m3->getEntryNameAt(0, &type));
+  EXPECT_TRUE(m3->findInt32("renamed", &i32));
+  EXPECT_EQ(5, i32);
+}
@@ -15,10 +15,12 @@
  */
 #include <gtest/gtest.h>
 
+#include <malloc.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <fstream>
+#include <vector>
 
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaDataBase.h>
@@ -43,6 +45,12 @@ constexpr int64_t kDurationUs = 60000000;
 
 constexpr float kCaptureRate = 30.0;
 
+// Keys outside of the kKey* range, for filling metadata with many items
+constexpr uint32_t kFirstTestKey = 'ts00';
+constexpr uint32_t kNumTestKeys = 64;
+constexpr size_t kLargeDataSize = 1000;
+constexpr int kNumRepeatedSets = 100000;
+
 namespace android {
 
 class MetaDataBaseUnitTest : public ::testing::Test {};
@@ -250,6 +258,153 @@ TEST_F(MetaDataBaseUnitTest, RemoveKeyTest) {
     delete (metaData);
 }
 
+TEST_F(MetaDataBaseUnitTest, LargeDataTest) {
+    MetaDataBase *metaData = new MetaDataBase();
+    ASSERT_NE(metaData, nullptr) << "Failed to create meta data";
+
+    // Values above the inline size are stored in the arena, which has to grow for these
+    std::vector<uint8_t> csd(kLargeDataSize);
+    for (size_t i = 0; i < csd.size(); ++i) {
+        csd[i] = i * 7;
+    }
+    for (uint32_t key = kFirstTestKey; key < kFirstTestKey + kNumTestKeys; ++key) {
+        bool status = metaData->setData(key, MetaDataBase::TYPE_NONE, csd.data(), key & 0xff);
+        ASSERT_FALSE(status) << "Initializing a new key, overwrite is expected to be false";
+    }
+
+    // Grow one value past its allocation and shrink another
+    bool status = metaData->setData(kFirstTestKey + 1, MetaDataBase::TYPE_NONE, csd.data(),
+                                    csd.size());
+    ASSERT_TRUE(status) << "Setting an existing key, overwrite is expected to be true";
+    status = metaData->setData(kFirstTestKey + 2, MetaDataBase::TYPE_NONE, csd.data(), 3);
+    ASSERT_TRUE(status) << "Setting an existing key, overwrite is expected to be true";
+    status = metaData->remove(kFirstTestKey + 3);
+    ASSERT_TRUE(status) << "Failed to remove an existing key";
+
+    for (uint32_t key = kFirstTestKey; key < kFirstTestKey + kNumTestKeys; ++key) {
+        size_t expectedSize = key & 0xff;
+        if (key == kFirstTestKey + 1) {
+            expectedSize = csd.size();
+        } else if (key == kFirstTestKey + 2) {
+            expectedSize = 3;
+        } else if (key == kFirstTestKey + 3) {
+            ASSERT_FALSE(metaData->hasData(key)) << "Removed key is still present";
+            continue;
+        }
+        uint32_t type;
+        const void *data;
+        size_t size;
+        status = metaData->findData(key, &type, &data, &size);
+        ASSERT_TRUE(status) << "Key " << key << " does not exists in metadata";
+        ASSERT_EQ(type, MetaDataBase::TYPE_NONE) << "Incorrect type returned";
+        ASSERT_EQ(size, expectedSize) << "Incorrect size returned";
+        ASSERT_EQ(memcmp(data, csd.data(), size), 0) << "Incorrect data returned";
+    }
+
+    delete (metaData);
+}
+
+TEST_F(MetaDataBaseUnitTest, CopyTest) {
+    MetaDataBase *metaData = new MetaDataBase();
+    ASSERT_NE(metaData, nullptr) << "Failed to create meta data";
+
+    std::vector<uint8_t> csd(kLargeDataSize, 0xab);
+    metaData->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_AVC);
+    metaData->setInt32(kKeyWidth, kWidth1);
+    metaData->setData(kKeyAVCC, MetaDataBase::TYPE_NONE, csd.data(), csd.size());
+
+    // Copies share the items until either side is modified
+    MetaDataBase copy(*metaData);
+    MetaDataBase assigned;
+    assigned.setInt32(kKeyHeight, kHeight1);
+    assigned = *metaData;
+    ASSERT_FALSE(assigned.hasData(kKeyHeight)) << "Assignment kept an old key";
+
+    copy.setInt32(kKeyWidth, kWidth2);
+    assigned.remove(kKeyAVCC);
+    metaData->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_HEVC);
+
+    const char *mime;
+    ASSERT_TRUE(copy.findCString(kKeyMIMEType, &mime));
+    ASSERT_STREQ(mime, MEDIA_MIMETYPE_VIDEO_AVC) << "Copy changed with the original";
+    ASSERT_TRUE(metaData->findCString(kKeyMIMEType, &mime));
+    ASSERT_STREQ(mime, MEDIA_MIMETYPE_VIDEO_HEVC) << "Mime value is not overwritten";
+
+    int32_t width;
+    ASSERT_TRUE(metaData->findInt32(kKeyWidth, &width));
+    ASSERT_EQ(width, kWidth1) << "Original changed with the copy";
+    ASSERT_TRUE(copy.findInt32(kKeyWidth, &width));
+    ASSERT_EQ(width, kWidth2) << "Value of width is not overwritten";
+
+    ASSERT_TRUE(metaData->hasData(kKeyAVCC)) << "Original changed with the assigned copy";
+    ASSERT_TRUE(copy.hasData(kKeyAVCC)) << "Copy changed with the assigned copy";
+    ASSERT_FALSE(assigned.hasData(kKeyAVCC)) << "Failed to remove the kKeyAVCC key";
+
+    uint32_t type;
+    const void *data;
+    size_t size;
+    ASSERT_TRUE(copy.findData(kKeyAVCC, &type, &data, &size));
+    ASSERT_EQ(size, csd.size()) << "Incorrect size returned";
+    ASSERT_EQ(memcmp(data, csd.data(), size), 0) << "Incorrect data returned";
+
+    delete (metaData);
+}
+
+TEST_F(MetaDataBaseUnitTest, PointerLifetimeTest) {
+    MetaDataBase *metaData = new MetaDataBase();
+    ASSERT_NE(metaData, nullptr) << "Failed to create meta data";
+
+    metaData->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_AVC);
+    const char *mime;
+    ASSERT_TRUE(metaData->findCString(kKeyMIMEType, &mime));
+
+    // Strings stay valid while other keys are added and removed
+    std::vector<uint8_t> csd(kLargeDataSize);
+    for (uint32_t key = kFirstTestKey; key < kFirstTestKey + kNumTestKeys; ++key) {
+        metaData->setInt32(key, key);
+        metaData->setData(key + kNumTestKeys, MetaDataBase::TYPE_NONE, csd.data(), csd.size());
+    }
+    metaData->remove(kFirstTestKey);
+    MetaDataBase copy(*metaData);
+    metaData->setInt32(kKeyWidth, kWidth1);
+    ASSERT_STREQ(mime, MEDIA_MIMETYPE_VIDEO_AVC) << "Mime value moved";
+
+    delete (metaData);
+}
+
+TEST_F(MetaDataBaseUnitTest, RepeatedSetMemoryTest) {
+    MetaDataBase *metaData = new MetaDataBase();
+    ASSERT_NE(metaData, nullptr) << "Failed to create meta data";
+
+    // Sizes that keep changing leave garbage behind, so the storage has to be replaced
+    std::vector<uint8_t> csd(kLargeDataSize);
+    metaData->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_AVC);
+    auto setRepeatedly = [&](MetaDataBase *meta, int count) {
+        for (int i = 0; i < count; ++i) {
+            meta->setData(kKeyAVCC, MetaDataBase::TYPE_NONE, csd.data(),
+                          kLargeDataSize / 2 + (i * 37) % (kLargeDataSize / 2));
+        }
+    };
+    setRepeatedly(metaData, kNumRepeatedSets / 10);
+
+    size_t initialSize = mallinfo().uordblks;
+    setRepeatedly(metaData, kNumRepeatedSets);
+    for (int i = 0; i < kNumRepeatedSets / 100; ++i) {
+        // a copy shares the storage until it is modified
+        MetaDataBase copy(*metaData);
+        setRepeatedly(&copy, 10);
+        setRepeatedly(metaData, 10);
+    }
+    size_t finalSize = mallinfo().uordblks;
+    ASSERT_LT(finalSize, initialSize + 64 * kLargeDataSize) << "Memory grows with each set";
+
+    const char *mime;
+    ASSERT_TRUE(metaData->findCString(kKeyMIMEType, &mime));
+    ASSERT_STREQ(mime, MEDIA_MIMETYPE_VIDEO_AVC) << "Mime value changed";
+
+    delete (metaData);
+}
+
 TEST_F(MetaDataBaseUnitTest, ConvertToStringTest) {
     MetaDataBase *metaData = new MetaDataBase();
     ASSERT_NE(metaData, nullptr) << "Failed to create meta data";
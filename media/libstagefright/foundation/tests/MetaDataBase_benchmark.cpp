@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Sets and reads the per-sample metadata that MediaTrackCUnwrapper::read() copies from the MP4
+// and Matroska extractors into each MediaBuffer.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/MetaDataBase_benchmark/MetaDataBase_benchmark
+
+#include <string.h>
+
+#include <benchmark/benchmark.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MetaDataBase.h>
+
+using namespace android;
+
+namespace {
+
+constexpr int64_t kFrameDurationUs = 16667;  // 60 fps
+
+// Keys MPEG4Source::read() sets for a clear sample.
+void setMp4SampleMeta(MetaDataBase &meta, int64_t sample) {
+    meta.setInt64(kKeyTime, sample * kFrameDurationUs);
+    meta.setInt64(kKeyDuration, kFrameDurationUs);
+    meta.setInt64(kKeySampleFileOffset, sample * 65536);
+    meta.setInt64(kKeyLastSampleIndexInChunk, sample | 15);
+    meta.setInt32(kKeyIsSyncFrame, sample % 60 == 0);
+}
+
+// Keys MatroskaSource::readBlock() sets for a CENC encrypted sample with subsamples.
+void setMkvEncryptedSampleMeta(MetaDataBase &meta, int64_t sample) {
+    static const uint8_t kKeyId[16] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+    static const uint32_t kPlainSizes[4] = { 32, 16, 16, 16 };
+    static const uint32_t kEncryptedSizes[4] = { 8192, 4096, 4096, 1024 };
+    uint8_t iv[16] = {};
+    memcpy(iv, &sample, sizeof(sample));
+
+    meta.setInt64(kKeyTime, sample * kFrameDurationUs);
+    meta.setInt32(kKeyIsSyncFrame, sample % 60 == 0);
+    meta.setData(kKeyCryptoKey, 0, kKeyId, sizeof(kKeyId));
+    meta.setData(kKeyCryptoIV, 0, iv, sizeof(iv));
+    meta.setData(kKeyPlainSizes, 0, kPlainSizes, sizeof(kPlainSizes));
+    meta.setData(kKeyEncryptedSizes, 0, kEncryptedSizes, sizeof(kEncryptedSizes));
+    meta.setInt32(kKeyCryptoMode, 1);
+}
+
+// What the decoder side reads back for every sample.
+void readSampleMeta(const MetaDataBase &meta) {
+    int64_t timeUs;
+    int32_t isSync;
+    uint32_t type;
+    const void *data;
+    size_t size;
+    benchmark::DoNotOptimize(meta.findInt64(kKeyTime, &timeUs));
+    benchmark::DoNotOptimize(meta.findInt32(kKeyIsSyncFrame, &isSync));
+    benchmark::DoNotOptimize(meta.findData(kKeyCryptoIV, &type, &data, &size));
+    benchmark::DoNotOptimize(meta.findData(kKeyEncryptedSizes, &type, &data, &size));
+}
+
+}  // namespace
+
+// MediaBuffers come from a group and are reset, which clears their metadata, before reuse.
+template <void (*SetSampleMeta)(MetaDataBase &, int64_t)>
+static void BM_ReusedBufferMeta(benchmark::State &state) {
+    MetaDataBase meta;
+    int64_t sample = 0;
+    for (auto _ : state) {
+        meta.clear();
+        SetSampleMeta(meta, sample++);
+        readSampleMeta(meta);
+    }
+}
+
+// MediaBuffer::clone() and the MetaData wrappers copy the metadata of every sample.
+template <void (*SetSampleMeta)(MetaDataBase &, int64_t)>
+static void BM_CopiedBufferMeta(benchmark::State &state) {
+    MetaDataBase meta;
+    int64_t sample = 0;
+    for (auto _ : state) {
+        meta.clear();
+        SetSampleMeta(meta, sample++);
+        MetaDataBase copy(meta);
+        copy.setInt64(kKeyTargetTime, 0);
+        readSampleMeta(copy);
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_ReusedBufferMeta, setMp4SampleMeta);
+BENCHMARK_TEMPLATE(BM_ReusedBufferMeta, setMkvEncryptedSampleMeta);
+BENCHMARK_TEMPLATE(BM_CopiedBufferMeta, setMp4SampleMeta);
+BENCHMARK_TEMPLATE(BM_CopiedBufferMeta, setMkvEncryptedSampleMeta);
+
+BENCHMARK_MAIN();
@@ -22,6 +22,7 @@
 
 #include <media/stagefright/foundation/AString.h>
 #include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/ColorConverter.h>
 #include <media/stagefright/MediaSource.h>
 #include <media/openmax/OMX_Video.h>
 #include <ui/GraphicTypes.h>
@@ -184,6 +185,9 @@ private:
     int32_t mTileHeight;
     int32_t mTilesDecoded;
     int32_t mTargetTiles;
+    // kept across tiles so that its worker threads are reused for the whole grid
+    std::unique_ptr<ColorConverter> mConverter;
+    int32_t mConverterSrcFormat;
 };
 
 }  // namespace android
@@ -23,6 +23,8 @@
 #include <stdint.h>
 #include <utils/Errors.h>
 
+#include <memory>
+
 #include <OMX_Video.h>
 
 namespace android {
@@ -37,6 +39,12 @@ struct ColorConverter {
 
     void setSrcColorSpace(uint32_t standard, uint32_t range, uint32_t transfer);
 
+    // Splits large conversions into horizontal bands that are converted in parallel on up to
+    // |numThreads| threads, including the calling thread. 0 picks a count based on the number
+    // of online CPUs. The default of 1 converts on the calling thread only. The worker threads
+    // are created on the first parallel conversion and live as long as the converter.
+    void setNumThreads(size_t numThreads);
+
     status_t convert(
             const void *srcBits,
             size_t srcWidth, size_t srcHeight, size_t srcStride,
@@ -83,10 +91,14 @@ private:
         size_t mBpp, mStride;
     };
 
+    struct WorkerPool;
+
     OMX_COLOR_FORMATTYPE mSrcFormat, mDstFormat;
     ColorSpace mSrcColorSpace;
     uint8_t *mClip;
     uint16_t *mClip10Bit;
+    size_t mNumThreads;
+    std::unique_ptr<WorkerPool> mWorkerPool;
 
     uint8_t *initClip();
     uint16_t *initClip10Bit();
@@ -94,6 +106,13 @@ private:
     // returns the YUV2RGB matrix coefficients according to the color aspects and bit depth
     const struct Coeffs *getMatrix() const;
 
+    // returns the number of bands to split a conversion of |cropHeight| rows into
+    size_t getNumBands(size_t cropHeight) const;
+
+    // converts one band (or the whole image) on the calling thread
+    status_t convertBand(
+            const BitmapParams &src, const BitmapParams &dst);
+
     status_t convertCbYCrY(
             const BitmapParams &src, const BitmapParams &dst);
 
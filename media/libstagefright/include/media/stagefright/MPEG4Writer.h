@@ -19,6 +19,7 @@
 #define MPEG4_WRITER_H_
 
 #include <stdio.h>
+#include <sys/uio.h>
 
 #include <media/stagefright/MediaWriter.h>
 #include <utils/List.h>
@@ -63,6 +64,11 @@ public:
     inline size_t write(const void *ptr, size_t size, size_t nmemb);
     // Write to file system by calling ::write() or post error message to looper on failure.
     void writeOrPostError(int fd, const void *buf, size_t count);
+    // Same as writeOrPostError(), but gathers the data from |iovcnt| buffers with ::writev().
+    // A short write is resumed from where it stopped, |iov| is consumed in the process.
+    void writevOrPostError(int fd, struct iovec *iov, int iovcnt);
+    // Drops |bytes| from the front of the |iovcnt| buffers at |iov|.
+    static void advanceIoVecs(struct iovec **iov, int *iovcnt, size_t bytes);
     // Seek in the file by calling ::lseek64() or post error message to looper on failure.
     void seekOrPostError(int fd, off64_t offset, int whence);
     void endBox();
@@ -84,6 +90,7 @@ protected:
 private:
     class Track;
     friend struct AHandlerReflector<MPEG4Writer>;
+    friend class MPEG4WriterTest;
 
     enum {
         kWhatSwitch                  = 'swch',
@@ -134,6 +141,20 @@ private:
                         std::greater<std::chrono::microseconds>> mWriteDurationPQ;
     const uint8_t kWriteDurationsCount = 5;
 
+    // Sample data queued by addSample_l() and written with a single writev() by
+    // flushSamples_l(). The buffers the data points to must stay valid until the flush.
+    static const int kMaxQueuedIoVecs = 64;
+    struct iovec mQueuedIoVecs[kMaxQueuedIoVecs];
+    uint8_t mQueuedIoHeaders[kMaxQueuedIoVecs][4];  // NAL length prefixes and exif offsets
+    int mNumQueuedIoVecs;
+
+    // Media data is handed to writeback in windows while recording, so that the fsync() at
+    // stop only has to write out the last couple of windows and the moov box.
+    bool mWritebackEnabled;
+    off64_t mWritebackOffset;        // start of the window currently being filled
+    off64_t mPrevWritebackOffset;    // start of the window last handed to writeback
+    off64_t mWaitedWritebackOffset;  // end of the data known to be written back
+
     sp<ALooper> mLooper;
     sp<AHandlerReflector<MPEG4Writer> > mReflector;
 
@@ -289,11 +310,22 @@ private:
     void initInternal(int fd, bool isFirstSession);
 
     // Acquire lock before calling these methods
+    // Queues the sample for writing. flushSamples_l() must be called before the buffer is
+    // released.
     off64_t addSample_l(
             MediaBuffer *buffer, bool usePrefix,
             uint32_t tiffHdrOffset, size_t *bytesWritten);
-    void addLengthPrefixedSample_l(MediaBuffer *buffer);
+    void addLengthPrefixedSample_l(const uint8_t *data, size_t length);
     void addMultipleLengthPrefixedSamples_l(MediaBuffer *buffer);
+    void queueHeader_l(const uint8_t *header, size_t size);
+    void queueData_l(const void *data, size_t size);
+    // Writes out the samples queued by addSample_l().
+    void flushSamples_l();
+    // Starts writeback of the media data written since the last call once a window is full.
+    void startWriteback_l();
+    // Waits for the writeback of the windows before the one last started. Called by the
+    // thread writing the samples, without holding mLock.
+    void waitForWriteback();
     uint16_t addProperty_l(const ItemProperty &);
     status_t reserveItemId_l(size_t numItems, uint16_t *itemIdBase);
     uint16_t addItem_l(const ItemInfo &);
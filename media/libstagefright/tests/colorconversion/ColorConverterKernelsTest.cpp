@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ColorConverterKernelsTest"
+#include <utils/Log.h>
+
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <OMX_Video.h>
+#include <media/stagefright/MediaCodecConstants.h>
+
+#include "ColorConverterKernels.h"
+
+using namespace android;
+
+namespace {
+
+// matrices from ColorConverter.cpp with the luma offset for 8 and 10-bit sources
+const YuvRowCoeffs kCoeffs8Bit[] = {
+    { 256, 359,  88, 183, 454,  0 },   // BT.601 full
+    { 298, 409, 100, 208, 516, 16 },   // BT.601 limited
+    { 256, 403,  48, 120, 475,  0 },   // BT.709 full
+    { 298, 459,  55, 136, 541, 16 },   // BT.709 limited
+    { 256, 377,  42, 146, 482,  0 },   // BT.2020 full
+    { 298, 430,  48, 167, 548, 16 },   // BT.2020 limited
+};
+
+const YuvRowCoeffs kCoeffs10Bit[] = {
+    { 256, 359,  88, 183, 454,  0 },   // BT.601 full
+    { 299, 410, 101, 209, 518, 64 },   // BT.601 limited
+    { 256, 403,  48, 120, 475,  0 },   // BT.709 full
+    { 290, 460,  55, 137, 542, 64 },   // BT.709 limited
+    { 256, 377,  42, 146, 482,  0 },   // BT.2020 full
+    { 299, 431,  48, 167, 550, 64 },   // BT.2020 limited
+};
+
+// covers full vector blocks as well as odd and even tails for every kernel width
+const size_t kWidths[] = { 1, 2, 7, 8, 15, 16, 17, 31, 32, 33, 62, 64, 97, 1920 };
+
+const uint32_t kCpuLevels[] = {
+    kColorConverterCpuSse41,
+    kColorConverterCpuAvx2,
+    kColorConverterCpuNeon,
+};
+
+size_t bytesPerPixel(int32_t format) {
+    return format == OMX_COLOR_Format16bitRGB565 ? 2 : 4;
+}
+
+}  // namespace
+
+class YuvToRgbRowKernelTest
+    : public ::testing::TestWithParam<std::tuple<int32_t /* src */, int32_t /* dst */, bool>> {
+  public:
+    YuvToRgbRowKernelTest() : mRandom(0x5eed) {}
+
+  protected:
+    virtual void SetUp() override {
+        std::tie(mSrcFormat, mDstFormat, mSwapChroma) = GetParam();
+        mIs10Bit = mSrcFormat == OMX_COLOR_FormatYUV420Planar16
+                || mSrcFormat == COLOR_FormatYUVP010;
+    }
+
+    // fills a buffer with random samples in the layout the source format uses
+    void fill(std::vector<uint16_t> *buf, size_t samples) {
+        buf->resize(samples);
+        std::uniform_int_distribution<uint32_t> dist(0, 1023);
+        for (uint16_t &sample : *buf) {
+            uint32_t value = dist(mRandom);
+            if (mSrcFormat == COLOR_FormatYUVP010) {
+                sample = value << 6;
+            } else if (mSrcFormat == OMX_COLOR_FormatYUV420Planar16) {
+                sample = value;
+            } else {
+                sample = value & 0xFF;
+            }
+        }
+    }
+
+    void runRow(YuvToRgbRowFn kernel, const YuvRowCoeffs &coeffs, size_t width,
+            std::vector<uint8_t> *out) {
+        std::vector<uint8_t> y8(mY.begin(), mY.end());
+        std::vector<uint8_t> u8(mU.begin(), mU.end());
+        std::vector<uint8_t> v8(mV.begin(), mV.end());
+        const void *y = mIs10Bit ? (const void *)mY.data() : (const void *)y8.data();
+        const void *u;
+        const void *v;
+        if (mSrcFormat == OMX_COLOR_FormatYUV420SemiPlanar) {
+            u = u8.data() + mSwapChroma;
+            v = u8.data() + !mSwapChroma;
+        } else if (mSrcFormat == COLOR_FormatYUVP010) {
+            u = mU.data() + mSwapChroma;
+            v = mU.data() + !mSwapChroma;
+        } else if (mIs10Bit) {
+            u = mU.data();
+            v = mV.data();
+        } else {
+            u = u8.data();
+            v = v8.data();
+        }
+        out->assign(width * bytesPerPixel(mDstFormat), 0);
+        kernel(y, u, v, out->data(), width, coeffs);
+    }
+
+    int32_t mSrcFormat;
+    int32_t mDstFormat;
+    bool mSwapChroma;
+    bool mIs10Bit;
+    std::mt19937 mRandom;
+    std::vector<uint16_t> mY, mU, mV;
+};
+
+TEST_P(YuvToRgbRowKernelTest, MatchesScalarReference) {
+    YuvToRgbRowFn reference =
+            getYuvToRgbRowKernel(mSrcFormat, mDstFormat, kColorConverterCpuNone);
+    ASSERT_NE(reference, nullptr) << "no scalar kernel for " << mSrcFormat << " -> " << mDstFormat;
+
+    uint32_t features = getColorConverterCpuFeatures();
+    for (uint32_t level : kCpuLevels) {
+        if (!(features & level)) {
+            continue;
+        }
+        YuvToRgbRowFn kernel = getYuvToRgbRowKernel(mSrcFormat, mDstFormat, level);
+        ASSERT_NE(kernel, nullptr) << "no kernel for cpu level " << level;
+
+        for (const YuvRowCoeffs &coeffs : mIs10Bit ? kCoeffs10Bit : kCoeffs8Bit) {
+            for (size_t width : kWidths) {
+                // semi-planar chroma is interleaved, so both planar layouts need width samples
+                fill(&mY, width + 1);
+                fill(&mU, width + 2);
+                fill(&mV, width + 2);
+
+                std::vector<uint8_t> expected, actual;
+                runRow(reference, coeffs, width, &expected);
+                runRow(kernel, coeffs, width, &actual);
+                ASSERT_EQ(expected, actual) << "cpu level " << level << " width " << width
+                        << " matrix y=" << coeffs._y << " c16=" << coeffs._c16;
+            }
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        ColorConverterKernels, YuvToRgbRowKernelTest,
+        ::testing::Values(
+                std::make_tuple(OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format16bitRGB565, false),
+                std::make_tuple(OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format32BitRGBA8888,
+                                false),
+                std::make_tuple(OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format32bitBGRA8888,
+                                false),
+                std::make_tuple(OMX_COLOR_FormatYUV420SemiPlanar, OMX_COLOR_Format16bitRGB565,
+                                false),
+                std::make_tuple(OMX_COLOR_FormatYUV420SemiPlanar, OMX_COLOR_Format16bitRGB565,
+                                true /* NV21 */),
+                std::make_tuple(OMX_COLOR_FormatYUV420SemiPlanar, OMX_COLOR_Format32BitRGBA8888,
+                                false),
+                std::make_tuple(OMX_COLOR_FormatYUV420SemiPlanar, OMX_COLOR_Format32bitBGRA8888,
+                                true /* NV21 */),
+                std::make_tuple(OMX_COLOR_FormatYUV420Planar16, OMX_COLOR_Format16bitRGB565,
+                                false),
+                std::make_tuple(OMX_COLOR_FormatYUV420Planar16, OMX_COLOR_Format32BitRGBA8888,
+                                false),
+                std::make_tuple(OMX_COLOR_FormatYUV420Planar16, OMX_COLOR_Format32bitBGRA8888,
+                                false),
+                std::make_tuple(COLOR_FormatYUVP010, COLOR_Format32bitABGR2101010, false),
+                std::make_tuple(COLOR_FormatYUVP010, COLOR_Format32bitABGR2101010, true)));
+
+TEST(Yuv420p16ToY410RowKernelTest, MatchesScalarReference) {
+    Yuv420p16ToY410RowFn reference = getYuv420p16ToY410RowKernel(kColorConverterCpuNone);
+    ASSERT_NE(reference, nullptr);
+
+    std::mt19937 random(0x5eed);
+    std::uniform_int_distribution<uint32_t> dist(0, 1023);
+    uint32_t features = getColorConverterCpuFeatures();
+    for (uint32_t level : kCpuLevels) {
+        Yuv420p16ToY410RowFn kernel = getYuv420p16ToY410RowKernel(level);
+        if (!(features & level) || kernel == nullptr) {
+            continue;
+        }
+        for (size_t width : kWidths) {
+            std::vector<uint16_t> y(width + 1), u(width / 2 + 1), v(width / 2 + 1);
+            for (uint16_t &sample : y) sample = dist(random);
+            for (uint16_t &sample : u) sample = dist(random);
+            for (uint16_t &sample : v) sample = dist(random);
+
+            std::vector<uint32_t> expected(width), actual(width);
+            reference(y.data(), u.data(), v.data(), expected.data(), width);
+            kernel(y.data(), u.data(), v.data(), actual.data(), width);
+            ASSERT_EQ(expected, actual) << "cpu level " << level << " width " << width;
+        }
+    }
+}
+
+TEST(YuvToRgbRowKernelTest, ScalarReferenceMatchesKnownValues) {
+    YuvToRgbRowFn kernel = getYuvToRgbRowKernel(
+            OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format32BitRGBA8888, kColorConverterCpuNone);
+    ASSERT_NE(kernel, nullptr);
+
+    // BT.601 limited range: black, white and clipped super-white
+    const uint8_t y[] = { 16, 235, 255, 255 };
+    const uint8_t u[] = { 128, 128 };
+    const uint8_t v[] = { 128, 128 };
+    uint32_t out[4];
+    kernel(y, u, v, out, 4, kCoeffs8Bit[1]);
+    EXPECT_EQ(out[0], 0xFF000000u);
+    EXPECT_EQ(out[1], 0xFFFFFFFFu);
+    EXPECT_EQ(out[2], 0xFFFFFFFFu);
+    EXPECT_EQ(out[3], 0xFFFFFFFFu);
+}
+
+TEST(YuvToRgbRowKernelTest, UnsupportedFormats) {
+    EXPECT_EQ(getYuvToRgbRowKernel(
+            OMX_COLOR_FormatCbYCrY, OMX_COLOR_Format16bitRGB565, kColorConverterCpuNone),
+            nullptr);
+    EXPECT_EQ(getYuvToRgbRowKernel(
+            COLOR_FormatYUVP010, OMX_COLOR_Format32BitRGBA8888, kColorConverterCpuNone),
+            nullptr);
+    EXPECT_EQ(getYuvToRgbRowKernel(
+            OMX_COLOR_FormatYUV420Planar, COLOR_Format32bitABGR2101010, kColorConverterCpuNone),
+            nullptr);
+}
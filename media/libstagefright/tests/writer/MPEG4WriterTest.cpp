@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MPEG4WriterTest"
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/MPEG4Writer.h>
+
+#define OUTPUT_FILE_NAME "/data/local/tmp/MPEG4WriterTest.out"
+
+namespace android {
+
+// Tests the batching of the sample writes. The samples are queued straight into the writer,
+// no track or writer thread is started.
+class MPEG4WriterTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mFd = open(OUTPUT_FILE_NAME, O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+        ASSERT_GE(mFd, 0) << "Failed to open " << OUTPUT_FILE_NAME;
+        mWriter = new MPEG4Writer(mFd);
+    }
+
+    void TearDown() override {
+        mWriter.clear();
+        if (mFd >= 0) {
+            close(mFd);
+        }
+        unlink(OUTPUT_FILE_NAME);
+    }
+
+    void queueHeader(const uint8_t *header, size_t size) {
+        mWriter->queueHeader_l(header, size);
+    }
+
+    void queueData(const void *data, size_t size) {
+        mWriter->queueData_l(data, size);
+    }
+
+    void flushSamples() {
+        mWriter->flushSamples_l();
+    }
+
+    int numQueuedIoVecs() const {
+        return mWriter->mNumQueuedIoVecs;
+    }
+
+    bool writeFailed() const {
+        return mWriter->mWriteSeekErr;
+    }
+
+    static void advanceIoVecs(struct iovec **iov, int *iovcnt, size_t bytes) {
+        MPEG4Writer::advanceIoVecs(iov, iovcnt, bytes);
+    }
+
+    static int maxQueuedIoVecs() {
+        return MPEG4Writer::kMaxQueuedIoVecs;
+    }
+
+    std::vector<uint8_t> readFile() {
+        struct stat st;
+        EXPECT_EQ(0, fstat(mFd, &st));
+        std::vector<uint8_t> data(st.st_size);
+        EXPECT_EQ(st.st_size, pread(mFd, data.data(), data.size(), 0));
+        return data;
+    }
+
+    int mFd = -1;
+    sp<MPEG4Writer> mWriter;
+};
+
+TEST_F(MPEG4WriterTest, QueuedSamplesWaitForFlush) {
+    uint8_t header[4] = {0, 0, 0, 3};
+    const uint8_t payload[3] = {'a', 'b', 'c'};
+    queueHeader(header, sizeof(header));
+    queueData(payload, sizeof(payload));
+    queueData(payload, 0);  // empty data takes no entry
+    EXPECT_EQ(2, numQueuedIoVecs());
+    EXPECT_TRUE(readFile().empty());
+
+    // The header is copied when it is queued.
+    header[3] = 0xff;
+    flushSamples();
+    EXPECT_EQ(0, numQueuedIoVecs());
+    EXPECT_EQ((std::vector<uint8_t>{0, 0, 0, 3, 'a', 'b', 'c'}), readFile());
+}
+
+TEST_F(MPEG4WriterTest, FullQueueIsFlushedInOrder) {
+    // One more sample than fits the queue, each with a 2 byte length prefix.
+    const int numSamples = maxQueuedIoVecs() / 2 + 1;
+    std::vector<std::vector<uint8_t>> samples;
+    std::vector<uint8_t> expected;
+    for (int i = 0; i < numSamples; i++) {
+        samples.emplace_back(i + 1, uint8_t(i));
+    }
+    for (int i = 0; i < numSamples; i++) {
+        const uint8_t prefix[2] = {0, uint8_t(samples[i].size())};
+        queueHeader(prefix, sizeof(prefix));
+        queueData(samples[i].data(), samples[i].size());
+        expected.insert(expected.end(), prefix, prefix + sizeof(prefix));
+        expected.insert(expected.end(), samples[i].begin(), samples[i].end());
+
+        if (i == numSamples - 2) {
+            EXPECT_EQ(maxQueuedIoVecs(), numQueuedIoVecs());
+            EXPECT_TRUE(readFile().empty());
+        }
+    }
+    // Queueing the last sample wrote out the full queue.
+    EXPECT_EQ(2, numQueuedIoVecs());
+    EXPECT_EQ(expected.size() - 2 - samples.back().size(), readFile().size());
+
+    flushSamples();
+    EXPECT_EQ(expected, readFile());
+    EXPECT_FALSE(writeFailed());
+}
+
+TEST_F(MPEG4WriterTest, AdvanceIoVecs) {
+    uint8_t a[4], b[2], c[3];
+    struct iovec vecs[3] = {{a, sizeof(a)}, {b, sizeof(b)}, {c, sizeof(c)}};
+    struct iovec *iov = vecs;
+    int iovcnt = 3;
+
+    // Partially into the first buffer.
+    advanceIoVecs(&iov, &iovcnt, 1);
+    EXPECT_EQ(3, iovcnt);
+    EXPECT_EQ(a + 1, iov->iov_base);
+    EXPECT_EQ(3u, iov->iov_len);
+
+    // Up to the end of a buffer.
+    advanceIoVecs(&iov, &iovcnt, 3);
+    EXPECT_EQ(2, iovcnt);
+    EXPECT_EQ(b, iov->iov_base);
+    EXPECT_EQ(sizeof(b), iov->iov_len);
+
+    // Across a buffer.
+    advanceIoVecs(&iov, &iovcnt, 3);
+    EXPECT_EQ(1, iovcnt);
+    EXPECT_EQ(c + 1, iov->iov_base);
+    EXPECT_EQ(2u, iov->iov_len);
+
+    advanceIoVecs(&iov, &iovcnt, 2);
+    EXPECT_EQ(0, iovcnt);
+}
+
+TEST_F(MPEG4WriterTest, ShortWriteIsRetried) {
+    // Past the file size limit, writev() writes what still fits and fails on the retry.
+    const size_t kLimit = 10;
+    struct rlimit oldLimit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &oldLimit));
+    struct rlimit limit = oldLimit;
+    limit.rlim_cur = kLimit;
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+    sighandler_t oldHandler = signal(SIGXFSZ, SIG_IGN);
+
+    const uint8_t header[4] = {0, 0, 0, 8};
+    const uint8_t payload[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    queueHeader(header, sizeof(header));
+    queueData(payload, sizeof(payload));
+    flushSamples();
+
+    signal(SIGXFSZ, oldHandler);
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &oldLimit));
+
+    EXPECT_TRUE(writeFailed());
+    EXPECT_EQ((std::vector<uint8_t>{0, 0, 0, 8, 1, 2, 3, 4, 5, 6}), readFile());
+
+    // Nothing more is written after the error.
+    queueData(payload, sizeof(payload));
+    flushSamples();
+    EXPECT_EQ(kLimit, readFile().size());
+}
+
+}  // namespace android
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EffectChainWorkers"
+//#define LOG_NDEBUG 0
+
+#include <utils/Log.h>
+#include "EffectChainWorkers.h"
+
+namespace android {
+
+EffectChainWorkers::EffectChainWorkers(size_t workerCount)
+    :   mGeneration(0), mJob(nullptr), mCookie(nullptr), mCount(0), mExit(false),
+        mClaim(0), mRemaining(0)
+{
+    for (size_t i = 0; i < workerCount; i++) {
+        mWorkers.push_back(new Worker(this));
+    }
+}
+
+EffectChainWorkers::~EffectChainWorkers()
+{
+    for (const sp<Worker> &worker : mWorkers) {
+        worker->requestExit();
+    }
+    for (const sp<Worker> &worker : mWorkers) {
+        worker->requestExitAndWait();
+    }
+}
+
+size_t EffectChainWorkers::start(const char *name, int32_t priority)
+{
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        status_t status = mWorkers[i]->run(name, priority);
+        if (status != NO_ERROR) {
+            ALOGE("%s: failed to start worker %zu: %d", __func__, i, status);
+            mWorkers.resize(i);
+            break;
+        }
+    }
+    return mWorkers.size();
+}
+
+void EffectChainWorkers::run(job_t job, void *cookie, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    uint32_t generation;
+    {
+        Mutex::Autolock _l(mLock);
+        generation = ++mGeneration;
+        mJob = job;
+        mCookie = cookie;
+        mCount = count;
+        mRemaining.store(count);
+        mClaim.store(static_cast<uint64_t>(generation) << 32);
+        mWorkAvailable.broadcast();
+    }
+    runJobs(generation, job, cookie, count);
+
+    Mutex::Autolock _l(mLock);
+    while (mRemaining.load() != 0) {
+        mWorkDone.wait(mLock);
+    }
+}
+
+bool EffectChainWorkers::claim(uint32_t generation, size_t count, size_t *index)
+{
+    uint64_t claim = mClaim.load();
+    do {
+        if (static_cast<uint32_t>(claim >> 32) != generation ||
+                static_cast<uint32_t>(claim) >= count) {
+            return false;
+        }
+    } while (!mClaim.compare_exchange_weak(claim, claim + 1));
+    *index = static_cast<uint32_t>(claim);
+    return true;
+}
+
+void EffectChainWorkers::runJobs(uint32_t generation, job_t job, void *cookie, size_t count)
+{
+    size_t index;
+    while (claim(generation, count, &index)) {
+        job(cookie, index);
+        if (mRemaining.fetch_sub(1) == 1) {
+            Mutex::Autolock _l(mLock);
+            mWorkDone.signal();
+        }
+    }
+}
+
+void EffectChainWorkers::Worker::requestExit()
+{
+    Thread::requestExit();
+    Mutex::Autolock _l(mPool->mLock);
+    mPool->mExit = true;
+    mPool->mWorkAvailable.broadcast();
+}
+
+bool EffectChainWorkers::Worker::threadLoop()
+{
+    job_t job;
+    void *cookie;
+    size_t count;
+    {
+        Mutex::Autolock _l(mPool->mLock);
+        while (!mPool->mExit && mPool->mGeneration == mGeneration) {
+            mPool->mWorkAvailable.wait(mPool->mLock);
+        }
+        if (mPool->mExit) {
+            return false;
+        }
+        mGeneration = mPool->mGeneration;
+        job = mPool->mJob;
+        cookie = mPool->mCookie;
+        count = mPool->mCount;
+    }
+    mPool->runJobs(mGeneration, job, cookie, count);
+    return true;
+}
+
+}   // namespace android
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A small pool of threads used by a MixerThread to process the effect chains of
+// independent sessions in parallel, see af.effect_chain_workers.
+
+#ifndef ANDROID_AUDIO_EFFECT_CHAIN_WORKERS_H
+#define ANDROID_AUDIO_EFFECT_CHAIN_WORKERS_H
+
+#include <atomic>
+#include <vector>
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Thread.h>
+
+namespace android {
+
+class EffectChainWorkers {
+
+public:
+    typedef void (*job_t)(void *cookie, size_t index);
+
+    explicit EffectChainWorkers(size_t workerCount);
+    ~EffectChainWorkers();
+
+    // Starts the worker threads, returns the number of threads that could be started.
+    size_t start(const char *name, int32_t priority);
+
+    size_t workerCount() const { return mWorkers.size(); }
+    pid_t getTid(size_t i) const { return mWorkers[i]->getTid(); }
+
+    // Runs job(cookie, index) for each index in [0, count), and returns once all of them
+    // are done: this is the barrier. The calling thread runs jobs too, so this completes
+    // even if none of the workers gets scheduled in time.
+    // Must only be called from one thread at a time.
+    void run(job_t job, void *cookie, size_t count);
+
+private:
+    class Worker : public Thread {
+    public:
+        explicit Worker(EffectChainWorkers *pool)
+            : Thread(false /*canCallJava*/), mPool(pool), mGeneration(0) { }
+        void requestExit() override;
+    private:
+        bool threadLoop() override;
+        EffectChainWorkers * const mPool;
+        uint32_t mGeneration;   // last batch run, accessed by this worker only
+    };
+
+    // Claims the next job index of batch 'generation', false if there is none left.
+    bool claim(uint32_t generation, size_t count, size_t *index);
+    void runJobs(uint32_t generation, job_t job, void *cookie, size_t count);
+
+    std::vector<sp<Worker>> mWorkers;
+
+    Mutex mLock;
+    Condition mWorkAvailable;   // signaled when a new batch is posted or on exit
+    Condition mWorkDone;        // signaled when the last job of a batch is done
+    // the current batch, protected by mLock
+    uint32_t mGeneration;
+    job_t mJob;
+    void *mCookie;
+    size_t mCount;
+    bool mExit;
+
+    // Generation of the current batch in the high 32 bits, and next index to claim in the
+    // low 32 bits, so that a worker which is late for a batch can't claim from the next one.
+    std::atomic<uint64_t> mClaim;
+    // Jobs of the current batch not done yet.
+    std::atomic<size_t> mRemaining;
+};
+
+}   // namespace android
+
+#endif  // ANDROID_AUDIO_EFFECT_CHAIN_WORKERS_H
@@ -2199,6 +2199,13 @@ void AudioFlinger::EffectChain::clearInputBuffer_l()
 
 // Must be called with EffectChain::mLock locked
 void AudioFlinger::EffectChain::process_l()
+{
+    processAudio_l();
+    updateState_l();
+}
+
+// Must be called with EffectChain::mLock locked
+void AudioFlinger::EffectChain::processAudio_l()
 {
     // never process effects when:
     // - on an OFFLOAD thread
@@ -2240,6 +2247,12 @@ void AudioFlinger::EffectChain::process_l()
             mOutBuffer->commit();
         }
     }
+}
+
+// Must be called with EffectChain::mLock locked
+void AudioFlinger::EffectChain::updateState_l()
+{
+    size_t size = mEffects.size();
     bool doResetVolume = false;
     for (size_t i = 0; i < size; i++) {
         doResetVolume = mEffects[i]->updateState() || doResetVolume;
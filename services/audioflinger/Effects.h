@@ -449,6 +449,11 @@ public:
     static const int        kProcessTailDurationMs = 1000;
 
     void process_l();
+    // The two steps of process_l(): processAudio_l() only touches the buffers of the chain
+    // and can run in parallel with other chains, updateState_l() applies effect state
+    // changes and must run on the thread of the chain.
+    void processAudio_l();
+    void updateState_l();
 
     void lock() {
         mLock.lock();
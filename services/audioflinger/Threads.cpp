@@ -23,6 +23,7 @@
 #include "Configuration.h"
 #include <math.h>
 #include <fcntl.h>
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <sstream>
@@ -220,6 +221,17 @@ static const int kPriorityAudioApp = 2;
 static const int kPriorityFastMixer = 3;
 static const int kPriorityFastCapture = 3;
 
+// Effect chains of independent sessions on a MIXER thread can be processed in parallel on up
+// to this many worker threads, as set by property af.effect_chain_workers (0 to disable).
+static const int kMaxEffectChainWorkers = 4;
+// The parallel processing of the effect chains misses its deadline when it takes more than
+// this percentage of the mix period.
+static const int kEffectChainDeadlinePercent = 50;
+// After this many missed deadlines in a row the effect chains are processed serially again,
+// for this many mix cycles before the workers are tried again.
+static const uint32_t kEffectChainMissedDeadlinesMax = 3;
+static const uint32_t kEffectChainSerialFallbackCycles = 2000;
+
 // IAudioFlinger::createTrack() has an in/out parameter 'pFrameCount' for the total size of the
 // track buffer in shared memory.  Zero on input means to use a default value.  For fast tracks,
 // AudioFlinger derives the default from HAL buffer size and 'fast track multiplier'.
@@ -3614,6 +3626,14 @@ status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& c
 #endif
                 ALOGV("addEffectChain_l() creating new input buffer %p session %d",
                         buffer, session);
+                if (mEffectChainWorkers != nullptr) {
+                    // Give the chain its own output buffer, accumulated into the thread
+                    // buffer by processSessionEffectChains_l().
+                    result = mAudioFlinger->mEffectsFactoryHal->allocateBuffer(
+                            numSamples * sizeof(effect_buffer_t),
+                            &halOutBuffer);
+                    if (result != OK) return result;
+                }
             }
         }
     }
@@ -3705,6 +3725,97 @@ size_t AudioFlinger::PlaybackThread::removeEffectChain_l(const sp<EffectChain>&
     return mEffectChains.size();
 }
 
+// Processes the effect chains which have their own output buffer, see addEffectChain_l().
+// These come first in the effect chain list, and don't depend on each other: they are
+// processed together on the effect chain workers, and their outputs are then accumulated
+// into the thread buffer in order, as their last effect would have done.
+// Effect state changes are applied on this thread once all chains are processed.
+size_t AudioFlinger::PlaybackThread::processSessionEffectChains_l(
+        const Vector< sp<EffectChain> >& effectChains, audio_session_t activeHapticSessionId)
+{
+    effect_buffer_t *threadBuffer = reinterpret_cast<effect_buffer_t*>(
+            mEffectBufferEnabled ? mEffectBuffer : mSinkBuffer);
+    size_t count = 0;
+    while (count < effectChains.size()
+            && !audio_is_global_session(effectChains[count]->sessionId())
+            && effectChains[count]->outBuffer() != nullptr
+            && effectChains[count]->outBuffer() != threadBuffer) {
+        count++;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    const uint32_t mixerChannelCount = audio_channel_count_from_out_mask(mMixerChannelMask);
+    const size_t audioSampleCount = mNormalFrameCount * mixerChannelCount;
+    for (size_t i = 0; i < count; i++) {
+        memset(effectChains[i]->outBuffer(), 0, audioSampleCount * sizeof(effect_buffer_t));
+    }
+
+    const bool fallback = mEffectChainSerialCycles > 0;
+    const bool parallel = !fallback && count > 1;
+    const nsecs_t startNs = systemTime();
+    if (parallel) {
+        mEffectChainWorkers->run([](void *cookie, size_t index) {
+                    (*static_cast<const Vector< sp<EffectChain> >*>(cookie))[index]
+                            ->processAudio_l();
+                }, const_cast<Vector< sp<EffectChain> >*>(&effectChains), count);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            effectChains[i]->processAudio_l();
+        }
+    }
+    const nsecs_t processNs = systemTime() - startNs;
+    mEffectChainWorkersStats.mProcessTimeUs.add(processNs * 1e-3);
+
+    if (parallel) {
+        mEffectChainWorkersStats.mParallelCycles++;
+        const nsecs_t deadlineNs =
+                seconds(mNormalFrameCount) / mSampleRate * kEffectChainDeadlinePercent / 100;
+        if (processNs > deadlineNs) {
+            mEffectChainWorkersStats.mMissedDeadlines++;
+            if (++mEffectChainMissedDeadlines >= kEffectChainMissedDeadlinesMax) {
+                ALOGW("%s: effect chains over %d%% of the mix period %u times in a row, "
+                        "processing them serially for %u mix cycles", __func__,
+                        kEffectChainDeadlinePercent, mEffectChainMissedDeadlines,
+                        kEffectChainSerialFallbackCycles);
+                mEffectChainWorkersStats.mFallbacks++;
+                mEffectChainMissedDeadlines = 0;
+                mEffectChainSerialCycles = kEffectChainSerialFallbackCycles;
+            }
+        } else {
+            mEffectChainMissedDeadlines = 0;
+        }
+    } else if (fallback) {
+        mEffectChainWorkersStats.mSerialCycles++;
+        mEffectChainSerialCycles--;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const sp<EffectChain>& chain = effectChains[i];
+        chain->updateState_l();
+#ifdef FLOAT_EFFECT_CHAIN
+        accumulate_float(threadBuffer, chain->outBuffer(), audioSampleCount);
+#else
+        accumulate_i16(threadBuffer, chain->outBuffer(), audioSampleCount);
+#endif
+        if (activeHapticSessionId != AUDIO_SESSION_NONE
+                && activeHapticSessionId == chain->sessionId()) {
+            // Haptic data is active in this case, copy it directly from
+            // in buffer to the thread buffer.
+            const uint32_t hapticSessionChannelCount = mEffectBufferValid ?
+                    mixerChannelCount : mChannelCount;
+            const size_t audioBufferSize = mNormalFrameCount
+                    * audio_bytes_per_frame(hapticSessionChannelCount, EFFECT_BUFFER_FORMAT);
+            memcpy_by_audio_format(
+                    (uint8_t*)threadBuffer + audioBufferSize, EFFECT_BUFFER_FORMAT,
+                    (const uint8_t*)chain->inBuffer() + audioBufferSize, EFFECT_BUFFER_FORMAT,
+                    mNormalFrameCount * mHapticChannelCount);
+        }
+    }
+    return count;
+}
+
 status_t AudioFlinger::PlaybackThread::attachAuxEffect(
         const sp<AudioFlinger::PlaybackThread::Track>& track, int EffectId)
 {
@@ -4084,7 +4195,11 @@ bool AudioFlinger::PlaybackThread::threadLoop()
 
             // only process effects if we're going to write
             if (mSleepTimeUs == 0 && mType != OFFLOAD) {
-                for (size_t i = 0; i < effectChains.size(); i ++) {
+                size_t first = 0;
+                if (mEffectChainWorkers != nullptr) {
+                    first = processSessionEffectChains_l(effectChains, activeHapticSessionId);
+                }
+                for (size_t i = first; i < effectChains.size(); i ++) {
                     effectChains[i]->process_l();
                     // TODO: Write haptic data directly to sink buffer when mixing.
                     if (activeHapticSessionId != AUDIO_SESSION_NONE
@@ -4778,6 +4893,22 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
             mNormalFrameCount);
     mAudioMixer = new AudioMixer(mNormalFrameCount, mSampleRate);
 
+    if (type == MIXER) {
+        const int workers = std::min({property_get_int32("af.effect_chain_workers", 0),
+                kMaxEffectChainWorkers, (int)sysconf(_SC_NPROCESSORS_ONLN) - 1});
+        if (workers > 0) {
+            mEffectChainWorkers = std::make_unique<EffectChainWorkers>(workers);
+            if (mEffectChainWorkers->start("EffectChainWorker", PRIORITY_URGENT_AUDIO) > 0) {
+                for (size_t i = 0; i < mEffectChainWorkers->workerCount(); i++) {
+                    sendPrioConfigEvent(getpid(), mEffectChainWorkers->getTid(i),
+                            kPriorityAudioApp, false /*forApp*/);
+                }
+            } else {
+                mEffectChainWorkers.reset();
+            }
+        }
+    }
+
     if (type == DUPLICATING) {
         // The Duplicating thread uses the AudioMixer and delivers data to OutputTracks
         // (downstream MixerThreads) in DuplicatingThread::threadLoop_write().
@@ -6116,6 +6247,20 @@ void AudioFlinger::MixerThread::dumpInternals_l(int fd, const Vector<String16>&
     dprintf(fd, "  Thread throttle time (msecs): %u\n", mThreadThrottleTimeMs);
     dprintf(fd, "  AudioMixer tracks: %s\n", mAudioMixer->trackNames().c_str());
     dprintf(fd, "  Master mono: %s\n", mMasterMono ? "on" : "off");
+    if (mEffectChainWorkers != nullptr) {
+        const EffectChainWorkersStats &stats = mEffectChainWorkersStats;
+        dprintf(fd, "  Effect chain workers: %zu, parallel cycles: %llu, serial cycles: %llu, "
+                "missed deadlines: %llu, fallbacks: %llu\n",
+                mEffectChainWorkers->workerCount(),
+                (unsigned long long)stats.mParallelCycles,
+                (unsigned long long)stats.mSerialCycles,
+                (unsigned long long)stats.mMissedDeadlines,
+                (unsigned long long)stats.mFallbacks);
+        if (stats.mProcessTimeUs.getN() > 0) {
+            dprintf(fd, "  Effect chain process time us stats: %s\n",
+                    stats.mProcessTimeUs.toString().c_str());
+        }
+    }
     dprintf(fd, "  Master balance: %f (%s)\n", mMasterBalance.load(),
             (hasFastMixer() ? std::to_string(mFastMixer->getMasterBalance())
                             : mBalance.toString()).c_str());
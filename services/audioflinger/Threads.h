@@ -903,6 +903,12 @@ protected:
     virtual     mixer_state prepareTracks_l(Vector< sp<Track> > *tracksToRemove) = 0;
                 void        removeTracks_l(const Vector< sp<Track> >& tracksToRemove);
                 status_t    handleVoipVolume_l(float *volume);
+                // Processes the leading effect chains of non global sessions that have their
+                // own output buffer, on mEffectChainWorkers unless in serial fallback.
+                // Returns the number of chains processed.
+                size_t      processSessionEffectChains_l(
+                                    const Vector< sp<EffectChain> >& effectChains,
+                                    audio_session_t activeHapticSessionId);
 
     // StreamOutHalInterfaceCallback implementation
     virtual     void        onWriteReady();
@@ -1188,6 +1194,25 @@ protected:
 
     audio_channel_mask_t            mMixerChannelMask = AUDIO_CHANNEL_NONE;
 
+    // Only created for MIXER threads when af.effect_chain_workers is set. The effect chains
+    // of non global sessions then get their own output buffer in addEffectChain_l(), so that
+    // they can be processed in parallel and accumulated into the thread buffer afterwards.
+    std::unique_ptr<EffectChainWorkers> mEffectChainWorkers;
+
+    // Updated within the threadLoop() only. dumpInternals_l() reads them without any
+    // synchronization with the threadLoop(), so a dump may show a count that is being updated,
+    // or counts from different mix cycles; that is fine for statistics.
+    struct EffectChainWorkersStats {
+        uint64_t mParallelCycles = 0;   // mix cycles processed on the workers
+        uint64_t mSerialCycles = 0;     // mix cycles processed serially after a fallback
+        uint64_t mMissedDeadlines = 0;  // parallel mix cycles over the deadline
+        uint64_t mFallbacks = 0;        // number of fallbacks to serial processing
+        audio_utils::Statistics<double> mProcessTimeUs{0.995 /* alpha */};
+    };
+    EffectChainWorkersStats         mEffectChainWorkersStats;
+    uint32_t                        mEffectChainMissedDeadlines = 0; // in a row
+    uint32_t                        mEffectChainSerialCycles = 0;    // left before next try
+
 private:
     // mMasterMute is in both PlaybackThread and in AudioFlinger.  When a
     // PlaybackThread needs to find out if master-muted, it checks it's local
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EffectChainWorkersTest"
+
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/ThreadDefs.h>
+
+#include "../EffectChainWorkers.h"
+
+using namespace android;
+
+namespace {
+
+constexpr size_t kWorkerCounts[] = {0, 1, 3, 7};
+constexpr size_t kMaxJobCount = 16;
+constexpr size_t kNumBatches = 20000;
+
+// One batch of jobs. Each job counts its runs, and checks that its batch is still running.
+struct Batch {
+    std::atomic<int> runs[kMaxJobCount] = {};
+    std::atomic<bool> returned{false};
+    std::atomic<int> runsAfterReturn{0};
+
+    static void job(void *cookie, size_t index) {
+        Batch *batch = static_cast<Batch *>(cookie);
+        if (batch->returned.load()) {
+            batch->runsAfterReturn++;
+        }
+        batch->runs[index]++;
+    }
+
+    // Same, and sometimes gives up the CPU so that the workers finish out of order and
+    // some of them are late for the next batch.
+    static void slowJob(void *cookie, size_t index) {
+        job(cookie, index);
+        if (index % 3 == 0) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+void expectBatchDone(const Batch &batch, size_t count) {
+    for (size_t i = 0; i < kMaxJobCount; i++) {
+        ASSERT_EQ(i < count ? 1 : 0, batch.runs[i].load()) << "job " << i << " of " << count;
+    }
+    ASSERT_EQ(0, batch.runsAfterReturn.load());
+}
+
+class EffectChainWorkersTest : public ::testing::TestWithParam<size_t /* workerCount */> {
+protected:
+    void SetUp() override {
+        mWorkers = std::make_unique<EffectChainWorkers>(GetParam());
+        ASSERT_EQ(GetParam(), mWorkers->start("EffectChainWorkersTest", PRIORITY_DEFAULT));
+    }
+
+    std::unique_ptr<EffectChainWorkers> mWorkers;
+};
+
+TEST_P(EffectChainWorkersTest, RunsEachJobOnce) {
+    for (size_t count = 0; count <= kMaxJobCount; count++) {
+        Batch batch;
+        mWorkers->run(Batch::job, &batch, count);
+        ASSERT_NO_FATAL_FAILURE(expectBatchDone(batch, count));
+    }
+}
+
+// With fewer jobs than workers, some workers have nothing to claim.
+TEST_P(EffectChainWorkersTest, FewerJobsThanWorkers) {
+    for (size_t i = 0; i < kNumBatches / 10; i++) {
+        for (size_t count = 1; count <= GetParam(); count++) {
+            Batch batch;
+            mWorkers->run(Batch::slowJob, &batch, count);
+            ASSERT_NO_FATAL_FAILURE(expectBatchDone(batch, count));
+        }
+    }
+}
+
+// Batches follow each other while workers are still returning from the previous one: no
+// job of a batch may run once run() returned for it, even with the index of a later batch.
+TEST_P(EffectChainWorkersTest, LateWorkersDoNotClaimFromNextBatch) {
+    std::minstd_rand gen(GetParam());
+    std::uniform_int_distribution<size_t> countDis(1, kMaxJobCount);
+    std::vector<std::unique_ptr<Batch>> batches(kNumBatches);
+    std::vector<size_t> counts(kNumBatches);
+    for (size_t i = 0; i < kNumBatches; i++) {
+        batches[i] = std::make_unique<Batch>();
+        counts[i] = countDis(gen);
+        mWorkers->run(Batch::slowJob, batches[i].get(), counts[i]);
+        batches[i]->returned.store(true);
+    }
+    // Let late workers, if any, run into an old batch.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (size_t i = 0; i < kNumBatches; i++) {
+        SCOPED_TRACE(testing::Message() << "batch " << i);
+        ASSERT_NO_FATAL_FAILURE(expectBatchDone(*batches[i], counts[i]));
+    }
+}
+
+TEST_P(EffectChainWorkersTest, DestroyWhileIdle) {
+    Batch batch;
+    mWorkers->run(Batch::job, &batch, kMaxJobCount);
+    ASSERT_NO_FATAL_FAILURE(expectBatchDone(batch, kMaxJobCount));
+    // Give the workers time to go back to waiting for a batch.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    mWorkers.reset();
+}
+
+TEST_P(EffectChainWorkersTest, DestroyWithoutBatch) {
+    mWorkers.reset();
+}
+
+INSTANTIATE_TEST_SUITE_P(EffectChainWorkersTestAll, EffectChainWorkersTest,
+        ::testing::ValuesIn(kWorkerCounts));
+
+TEST(EffectChainWorkersNotStartedTest, RunsOnCallingThread) {
+    EffectChainWorkers workers(3);
+    Batch batch;
+    workers.run(Batch::job, &batch, kMaxJobCount);
+    ASSERT_NO_FATAL_FAILURE(expectBatchDone(batch, kMaxJobCount));
+}
+
+}  // namespace
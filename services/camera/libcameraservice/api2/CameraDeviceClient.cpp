@@ -490,12 +490,15 @@ binder::Status CameraDeviceClient::submitRequestList(
                     set_camera_metadata_vendor_id(meta, mDevice->getVendorTagId());
                     filteredParams.unlock(meta);
 
+                    std::vector<camera_metadata_ro_entry> entries;
+                    entries.reserve(mSupportedPhysicalRequestKeys.size());
                     for (const auto& keyIt : mSupportedPhysicalRequestKeys) {
                         camera_metadata_ro_entry entry = it.settings.find(keyIt);
                         if (entry.count > 0) {
-                            filteredParams.update(entry);
+                            entries.push_back(entry);
                         }
                     }
+                    filteredParams.update(entries);
 
                     physicalSettingsList.push_back({it.id, filteredParams,
                             hasTestPatternModePhysicalKey, hasTestPatternDataPhysicalKey});
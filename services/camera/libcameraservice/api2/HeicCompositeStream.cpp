@@ -19,6 +19,7 @@
 #define ALIGN(x, mask) ( ((x) + (mask) - 1) & ~((mask) - 1) )
 //#define LOG_NDEBUG 0
 
+#include <algorithm>
 #include <linux/memfd.h>
 #include <pthread.h>
 #include <sys/syscall.h>
@@ -61,6 +62,7 @@ HeicCompositeStream::HeicCompositeStream(sp<CameraDeviceBase> device,
         mGridRows(1),
         mGridCols(1),
         mUseGrid(false),
+        mActiveCodecCount(0),
         mAppSegmentStreamId(-1),
         mAppSegmentSurfaceId(-1),
         mMainImageStreamId(-1),
@@ -157,7 +159,7 @@ status_t HeicCompositeStream::createInternalStreams(const std::vector<sp<Surface
     }
 
     if (!mUseGrid) {
-        res = mCodec->createInputSurface(&producer);
+        res = mCodecs[0]->createInputSurface(&producer);
         if (res != OK) {
             ALOGE("%s: Failed to create input surface for Heic codec: %s (%d)",
                     __FUNCTION__, strerror(-res), res);
@@ -171,11 +173,13 @@ status_t HeicCompositeStream::createInternalStreams(const std::vector<sp<Surface
     }
     mMainImageSurface = new Surface(producer);
 
-    res = mCodec->start();
-    if (res != OK) {
-        ALOGE("%s: Failed to start codec: %s (%d)", __FUNCTION__,
-                strerror(-res), res);
-        return res;
+    for (auto& codec : mCodecs) {
+        res = codec->start();
+        if (res != OK) {
+            ALOGE("%s: Failed to start codec: %s (%d)", __FUNCTION__,
+                    strerror(-res), res);
+            return res;
+        }
     }
 
     std::vector<int> sourceSurfaceId;
@@ -261,7 +265,10 @@ void HeicCompositeStream::onBufferReleased(const BufferInfo& bufferInfo) {
 
     if (bufferInfo.mStreamId == mMainImageStreamId) {
         mMainImageFrameNumbers.push(bufferInfo.mFrameNumber);
-        mCodecOutputBufferFrameNumbers.push(bufferInfo.mFrameNumber);
+        if (!mUseGrid) {
+            // In YUV input mode, codec outputs are matched by their timestamps instead.
+            mCodecOutputBufferFrameNumbers.push(bufferInfo.mFrameNumber);
+        }
         ALOGV("%s: [%" PRId64 "]: Adding main image frame number (%zu frame numbers in total)",
                 __FUNCTION__, bufferInfo.mFrameNumber, mMainImageFrameNumbers.size());
     } else if (bufferInfo.mStreamId == mAppSegmentStreamId) {
@@ -389,26 +396,39 @@ void HeicCompositeStream::onHeicOutputFrameAvailable(
         const CodecOutputBufferInfo& outputBufferInfo) {
     Mutex::Autolock l(mMutex);
 
-    ALOGV("%s: index %d, offset %d, size %d, time %" PRId64 ", flags 0x%x",
-            __FUNCTION__, outputBufferInfo.index, outputBufferInfo.offset,
-            outputBufferInfo.size, outputBufferInfo.timeUs, outputBufferInfo.flags);
+    ALOGV("%s: codec %zu, index %d, offset %d, size %d, time %" PRId64 ", flags 0x%x",
+            __FUNCTION__, outputBufferInfo.codecIndex, outputBufferInfo.index,
+            outputBufferInfo.offset, outputBufferInfo.size, outputBufferInfo.timeUs,
+            outputBufferInfo.flags);
+
+    if (outputBufferInfo.codecIndex >= mCodecs.size()) {
+        ALOGE("%s: Invalid codec index %zu", __FUNCTION__, outputBufferInfo.codecIndex);
+        return;
+    }
+    const sp<MediaCodec>& codec = mCodecs[outputBufferInfo.codecIndex];
 
     if (!mErrorState) {
         if ((outputBufferInfo.size > 0) &&
                 ((outputBufferInfo.flags & MediaCodec::BUFFER_FLAG_CODECCONFIG) == 0)) {
+            // Probe tiles were never counted as in flight.
+            size_t& tilesInFlight = mCodecTilesInFlight[outputBufferInfo.codecIndex];
+            if (mTilesByTimestamp.find(outputBufferInfo.timeUs) != mTilesByTimestamp.end() &&
+                    tilesInFlight > 0) {
+                tilesInFlight--;
+            }
             mCodecOutputBuffers.push_back(outputBufferInfo);
             mInputReadyCondition.signal();
         } else {
             ALOGV("%s: Releasing output buffer: size %d flags: 0x%x ", __FUNCTION__,
                 outputBufferInfo.size, outputBufferInfo.flags);
-            mCodec->releaseOutputBuffer(outputBufferInfo.index);
+            codec->releaseOutputBuffer(outputBufferInfo.index);
         }
     } else {
-        mCodec->releaseOutputBuffer(outputBufferInfo.index);
+        codec->releaseOutputBuffer(outputBufferInfo.index);
     }
 }
 
-void HeicCompositeStream::onHeicInputFrameAvailable(int32_t index) {
+void HeicCompositeStream::onHeicInputFrameAvailable(int32_t index, size_t codecIndex) {
     Mutex::Autolock l(mMutex);
 
     if (!mUseGrid) {
@@ -416,11 +436,25 @@ void HeicCompositeStream::onHeicInputFrameAvailable(int32_t index) {
         return;
     }
 
-    mCodecInputBuffers.push_back(index);
+    if (codecIndex >= mCodecs.size()) {
+        ALOGE("%s: Invalid codec index %zu", __FUNCTION__, codecIndex);
+        return;
+    }
+    if (mCodecs.size() > 1 && !mCodecProbed[codecIndex]) {
+        // The first input buffer of each codec encodes a blank tile, only to get the
+        // codec config before tiles of an image are spread over the codecs.
+        mCodecProbed[codecIndex] = true;
+        if (queueProbeTileLocked(index, codecIndex) == OK) {
+            return;
+        }
+    }
+
+    CodecInputBufferInfo inputInfo = { index, -1 /*timeUs*/, 0 /*tileIndex*/, codecIndex };
+    mCodecInputBuffers.push_back(inputInfo);
     mInputReadyCondition.signal();
 }
 
-void HeicCompositeStream::onHeicFormatChanged(sp<AMessage>& newFormat) {
+void HeicCompositeStream::onHeicFormatChanged(sp<AMessage>& newFormat, size_t codecIndex) {
     if (newFormat == nullptr) {
         ALOGE("%s: newFormat must not be null!", __FUNCTION__);
         return;
@@ -428,6 +462,20 @@ void HeicCompositeStream::onHeicFormatChanged(sp<AMessage>& newFormat) {
 
     Mutex::Autolock l(mMutex);
 
+    if (codecIndex >= mCodecs.size()) {
+        ALOGE("%s: Invalid codec index %zu", __FUNCTION__, codecIndex);
+        return;
+    }
+    sp<ABuffer> codecConfig;
+    newFormat->findBuffer("csd-0", &codecConfig);
+    mCodecConfigs[codecIndex] = codecConfig;
+    checkCodecConfigsLocked();
+    if (codecIndex > 0) {
+        // The muxed track uses the format of the first codec, the other codecs only
+        // encode tiles.
+        return;
+    }
+
     AString mime;
     AString mimeHeic(MIMETYPE_IMAGE_ANDROID_HEIC);
     newFormat->findString(KEY_MIME, &mime);
@@ -693,6 +741,29 @@ void HeicCompositeStream::compilePendingInputLocked() {
 
     while (!mCodecOutputBuffers.empty()) {
         auto it = mCodecOutputBuffers.begin();
+        if (mUseGrid) {
+            // Tiles may be spread over several codecs and complete out of order, look
+            // up the frame and tile from the timestamp assigned when queuing the tile.
+            auto tile = mTilesByTimestamp.find(it->timeUs);
+            auto frame = (tile != mTilesByTimestamp.end()) ?
+                    mPendingInputFrames.find(tile->second.first) : mPendingInputFrames.end();
+            if (frame == mPendingInputFrames.end()) {
+                ALOGV("%s: Releasing codec output buffer with unknown time %" PRId64,
+                        __FUNCTION__, it->timeUs);
+                mCodecs[it->codecIndex]->releaseOutputBuffer(it->index);
+            } else {
+                it->tileIndex = tile->second.second;
+                frame->second.addCodecOutputBuffer(*it);
+                ALOGV("%s: [%" PRId64 "]: Pushing codecOutputBuffers (tile %zu, codec %zu)",
+                        __FUNCTION__, frame->first, it->tileIndex, it->codecIndex);
+            }
+            if (tile != mTilesByTimestamp.end()) {
+                mTilesByTimestamp.erase(tile);
+            }
+            mCodecOutputBuffers.erase(it);
+            continue;
+        }
+
         // Assume encoder input to output is FIFO, use a queue to look up
         // frameNumber when handling codec outputs.
         int64_t bufferFrameNumber = -1;
@@ -702,13 +773,14 @@ void HeicCompositeStream::compilePendingInputLocked() {
         } else {
             // Direct mapping between camera frame number and codec timestamp (in us).
             bufferFrameNumber = mCodecOutputBufferFrameNumbers.front();
+            it->tileIndex = mCodecOutputCounter;
             mCodecOutputCounter++;
             if (mCodecOutputCounter == mNumOutputTiles) {
                 mCodecOutputBufferFrameNumbers.pop();
                 mCodecOutputCounter = 0;
             }
 
-            mPendingInputFrames[bufferFrameNumber].codecOutputBuffers.push_back(*it);
+            mPendingInputFrames[bufferFrameNumber].addCodecOutputBuffer(*it);
             ALOGV("%s: [%" PRId64 "]: Pushing codecOutputBuffers (frameNumber %" PRId64 ")",
                     __FUNCTION__, bufferFrameNumber, it->timeUs);
         }
@@ -763,16 +835,17 @@ void HeicCompositeStream::compilePendingInputLocked() {
             it != mPendingInputFrames.end() && mCodecInputBuffers.size() > 0; it++) {
         InputFrame& inputFrame(it->second);
         if (inputFrame.codecInputCounter < mGridRows * mGridCols) {
-            // Available input tiles that are required for the current input
-            // image.
-            size_t newInputTiles = std::min(mCodecInputBuffers.size(),
-                    mGridRows * mGridCols - inputFrame.codecInputCounter);
-            for (size_t i = 0; i < newInputTiles; i++) {
-                CodecInputBufferInfo inputInfo =
-                        { mCodecInputBuffers[0], mGridTimestampUs++, inputFrame.codecInputCounter };
+            // Fill the remaining input tiles of the current input image, from
+            // the least busy codecs first.
+            CodecInputBufferInfo inputInfo;
+            while (inputFrame.codecInputCounter < mGridRows * mGridCols &&
+                    takeCodecInputBufferLocked(&inputInfo)) {
+                inputInfo.timeUs = mGridTimestampUs++;
+                inputInfo.tileIndex = inputFrame.codecInputCounter;
                 inputFrame.codecInputBuffers.push_back(inputInfo);
-
-                mCodecInputBuffers.erase(mCodecInputBuffers.begin());
+                mTilesByTimestamp[inputInfo.timeUs] =
+                        std::make_pair(it->first, inputInfo.tileIndex);
+                mCodecTilesInFlight[inputInfo.codecIndex]++;
                 inputFrame.codecInputCounter++;
             }
             break;
@@ -780,6 +853,92 @@ void HeicCompositeStream::compilePendingInputLocked() {
     }
 }
 
+bool HeicCompositeStream::takeCodecInputBufferLocked(CodecInputBufferInfo* inputBuffer) {
+    auto best = mCodecInputBuffers.end();
+    for (auto it = mCodecInputBuffers.begin(); it != mCodecInputBuffers.end(); it++) {
+        if (it->codecIndex >= mActiveCodecCount) {
+            continue;
+        }
+        if (best == mCodecInputBuffers.end() ||
+                mCodecTilesInFlight[it->codecIndex] < mCodecTilesInFlight[best->codecIndex]) {
+            best = it;
+        }
+    }
+    if (best == mCodecInputBuffers.end()) {
+        return false;
+    }
+
+    *inputBuffer = *best;
+    mCodecInputBuffers.erase(best);
+    return true;
+}
+
+status_t HeicCompositeStream::queueProbeTileLocked(int32_t index, size_t codecIndex) {
+    const sp<MediaCodec>& codec = mCodecs[codecIndex];
+    sp<MediaCodecBuffer> buffer;
+    status_t res = codec->getInputBuffer(index, &buffer);
+    if (res != OK || buffer == nullptr) {
+        ALOGE("%s: Error getting codec %zu input buffer %d: %s (%d)", __FUNCTION__,
+                codecIndex, index, strerror(-res), res);
+        return (res != OK) ? res : BAD_VALUE;
+    }
+
+    // Mid gray whatever the YUV layout. The timestamp isn't one of a tile, so the
+    // output is released as soon as it is encoded.
+    memset(buffer->base(), 0x80, buffer->capacity());
+    res = codec->queueInputBuffer(index, 0, buffer->capacity(), mGridTimestampUs++, 0,
+            nullptr /*errorDetailMsg*/);
+    if (res != OK) {
+        ALOGE("%s: Failed to queue probe tile to codec %zu: %s (%d)", __FUNCTION__,
+                codecIndex, strerror(-res), res);
+    }
+    return res;
+}
+
+void HeicCompositeStream::checkCodecConfigsLocked() {
+    if (mCodecConfigs.size() <= 1) {
+        return;
+    }
+
+    bool allKnown = true;
+    const sp<ABuffer>& config = mCodecConfigs[0];
+    for (size_t i = 1; i < mCodecConfigs.size(); i++) {
+        const sp<ABuffer>& other = mCodecConfigs[i];
+        if (config == nullptr || other == nullptr) {
+            allKnown = false;
+            continue;
+        }
+        if (other->size() == config->size() &&
+                memcmp(other->data(), config->data(), config->size()) == 0) {
+            continue;
+        }
+
+        // Tiles from this codec couldn't be decoded with the parameter sets of the
+        // muxed track, keep encoding with the first codec only.
+        ALOGW("%s: Codec %zu config differs from codec 0, disabling parallel tile encoding",
+                __FUNCTION__, i);
+        if (mActiveCodecCount > 1) {
+            // The configs changed after they were checked, the tiles already queued
+            // to the other codecs can't be used.
+            for (auto& it : mPendingInputFrames) {
+                if (it.second.codecInputCounter > 0) {
+                    it.second.error = true;
+                }
+            }
+            mActiveCodecCount = 1;
+            mInputReadyCondition.signal();
+        }
+        return;
+    }
+
+    if (allKnown && mActiveCodecCount == 1) {
+        ALOGV("%s: Codec configs match, encoding tiles with %zu codecs", __FUNCTION__,
+                mCodecs.size());
+        mActiveCodecCount = mCodecs.size();
+        mInputReadyCondition.signal();
+    }
+}
+
 bool HeicCompositeStream::getNextReadyInputLocked(int64_t *frameNumber /*out*/) {
     if (frameNumber == nullptr) {
         return false;
@@ -798,7 +957,10 @@ bool HeicCompositeStream::getNextReadyInputLocked(int64_t *frameNumber /*out*/)
                 (it.second.appSegmentBuffer.data != nullptr || it.second.exifError) &&
                 !it.second.appSegmentWritten && it.second.result != nullptr &&
                 it.second.muxer != nullptr;
-        bool codecOutputReady = !it.second.codecOutputBuffers.empty();
+        // Tiles from parallel codecs may complete out of order, and the muxer
+        // needs the format of the first codec.
+        bool codecOutputReady = it.second.isNextCodecOutputReady() &&
+                (it.second.muxer != nullptr || mFormat != nullptr);
         bool codecInputReady = (it.second.yuvBuffer.data != nullptr) &&
                 (!it.second.codecInputBuffers.empty());
         bool hasOutputBuffer = it.second.muxer != nullptr ||
@@ -839,7 +1001,8 @@ status_t HeicCompositeStream::processInputFrame(int64_t frameNumber,
             (inputFrame.appSegmentBuffer.data != nullptr || inputFrame.exifError) &&
             !inputFrame.appSegmentWritten && inputFrame.result != nullptr &&
             inputFrame.muxer != nullptr;
-    bool codecOutputReady = inputFrame.codecOutputBuffers.size() > 0;
+    bool codecOutputReady = inputFrame.isNextCodecOutputReady() &&
+            (inputFrame.muxer != nullptr || inputFrame.format != nullptr);
     bool codecInputReady = inputFrame.yuvBuffer.data != nullptr &&
             !inputFrame.codecInputBuffers.empty();
     bool hasOutputBuffer = inputFrame.muxer != nullptr ||
@@ -887,7 +1050,7 @@ status_t HeicCompositeStream::processInputFrame(int64_t frameNumber,
     }
 
     // Write media codec bitstream buffers to muxer.
-    while (!inputFrame.codecOutputBuffers.empty()) {
+    while (inputFrame.isNextCodecOutputReady()) {
         res = processOneCodecOutputFrame(frameNumber, inputFrame);
         if (res != OK) {
             ALOGE("%s: Failed to process codec output frame: %s (%d)", __FUNCTION__,
@@ -979,7 +1142,10 @@ status_t HeicCompositeStream::processAppSegment(int64_t frameNumber, InputFrame
         }
     }
 
-    std::unique_ptr<ExifUtils> exifUtils(ExifUtils::create());
+    if (mExifUtils == nullptr) {
+        mExifUtils.reset(ExifUtils::createWithTemplate());
+    }
+    ExifUtils *exifUtils = mExifUtils.get();
     auto exifRes = inputFrame.exifError ?
             exifUtils->initializeEmpty() :
             exifUtils->initialize(inputFrame.appSegmentBuffer.data, app1Size);
@@ -1046,9 +1212,13 @@ status_t HeicCompositeStream::processAppSegment(int64_t frameNumber, InputFrame
 }
 
 status_t HeicCompositeStream::processCodecInputFrame(InputFrame &inputFrame) {
-    for (auto& inputBuffer : inputFrame.codecInputBuffers) {
+    // Each buffer is removed as soon as it is queued, so that on error only the buffers
+    // that were not queued are given back by releaseInputFrameLocked().
+    while (!inputFrame.codecInputBuffers.empty()) {
+        const CodecInputBufferInfo& inputBuffer = inputFrame.codecInputBuffers.front();
         sp<MediaCodecBuffer> buffer;
-        auto res = mCodec->getInputBuffer(inputBuffer.index, &buffer);
+        const sp<MediaCodec>& codec = mCodecs[inputBuffer.codecIndex];
+        auto res = codec->getInputBuffer(inputBuffer.index, &buffer);
         if (res != OK) {
             ALOGE("%s: Error getting codec input buffer: %s (%d)", __FUNCTION__,
                     strerror(-res), res);
@@ -1075,24 +1245,26 @@ status_t HeicCompositeStream::processCodecInputFrame(InputFrame &inputFrame) {
             return res;
         }
 
-        res = mCodec->queueInputBuffer(inputBuffer.index, 0, buffer->capacity(),
+        res = codec->queueInputBuffer(inputBuffer.index, 0, buffer->capacity(),
                 inputBuffer.timeUs, 0, nullptr /*errorDetailMsg*/);
         if (res != OK) {
             ALOGE("%s: Failed to queueInputBuffer to Codec: %s (%d)",
                     __FUNCTION__, strerror(-res), res);
             return res;
         }
+        inputFrame.codecInputBuffers.erase(inputFrame.codecInputBuffers.begin());
     }
 
-    inputFrame.codecInputBuffers.clear();
     return OK;
 }
 
 status_t HeicCompositeStream::processOneCodecOutputFrame(int64_t frameNumber,
         InputFrame &inputFrame) {
     auto it = inputFrame.codecOutputBuffers.begin();
+    const sp<MediaCodec>& codec = mCodecs[it->codecIndex];
+    int32_t index = it->index;
     sp<MediaCodecBuffer> buffer;
-    status_t res = mCodec->getOutputBuffer(it->index, &buffer);
+    status_t res = codec->getOutputBuffer(index, &buffer);
     if (res != OK) {
         ALOGE("%s: Error getting Heic codec output buffer at index %d: %s (%d)",
                 __FUNCTION__, it->index, strerror(-res), res);
@@ -1113,7 +1285,7 @@ status_t HeicCompositeStream::processOneCodecOutputFrame(int64_t frameNumber,
         return res;
     }
 
-    mCodec->releaseOutputBuffer(it->index);
+    codec->releaseOutputBuffer(index);
     if (inputFrame.pendingOutputTiles == 0) {
         ALOGW("%s: Codec generated more tiles than expected!", __FUNCTION__);
     } else {
@@ -1121,9 +1293,10 @@ status_t HeicCompositeStream::processOneCodecOutputFrame(int64_t frameNumber,
     }
 
     inputFrame.codecOutputBuffers.erase(inputFrame.codecOutputBuffers.begin());
+    inputFrame.nextOutputTile++;
 
     ALOGV("%s: [%" PRId64 "]: Output buffer index %d",
-        __FUNCTION__, frameNumber, it->index);
+        __FUNCTION__, frameNumber, index);
     return OK;
 }
 
@@ -1205,7 +1378,7 @@ void HeicCompositeStream::releaseInputFrameLocked(int64_t frameNumber,
     while (!inputFrame->codecOutputBuffers.empty()) {
         auto it = inputFrame->codecOutputBuffers.begin();
         ALOGV("%s: releaseOutputBuffer index %d", __FUNCTION__, it->index);
-        mCodec->releaseOutputBuffer(it->index);
+        mCodecs[it->codecIndex]->releaseOutputBuffer(it->index);
         inputFrame->codecOutputBuffers.erase(it);
     }
 
@@ -1215,8 +1388,14 @@ void HeicCompositeStream::releaseInputFrameLocked(int64_t frameNumber,
         mYuvBufferAcquired = false;
     }
 
+    // Give the input buffers that were not queued back to their codecs' pool.
     while (!inputFrame->codecInputBuffers.empty()) {
         auto it = inputFrame->codecInputBuffers.begin();
+        mTilesByTimestamp.erase(it->timeUs);
+        if (mCodecTilesInFlight[it->codecIndex] > 0) {
+            mCodecTilesInFlight[it->codecIndex]--;
+        }
+        mCodecInputBuffers.push_back(*it);
         inputFrame->codecInputBuffers.erase(it);
     }
 
@@ -1283,32 +1462,8 @@ status_t HeicCompositeStream::initializeCodec(uint32_t width, uint32_t height,
         return BAD_VALUE;
     }
 
-    // Create Looper for MediaCodec.
-    auto desiredMime = mUseHeic ? MIMETYPE_IMAGE_ANDROID_HEIC : MIMETYPE_VIDEO_HEVC;
-    mCodecLooper = new ALooper;
-    mCodecLooper->setName("Camera3-HeicComposite-MediaCodecLooper");
-    status_t res = mCodecLooper->start(
-            false,   // runOnCallingThread
-            false,    // canCallJava
-            PRIORITY_AUDIO);
-    if (res != OK) {
-        ALOGE("%s: Failed to start codec looper: %s (%d)",
-                __FUNCTION__, strerror(-res), res);
-        return NO_INIT;
-    }
-
-    // Create HEIC/HEVC codec.
-    if (mUseHeic) {
-        mCodec = MediaCodec::CreateByType(mCodecLooper, desiredMime, true /*encoder*/);
-    } else {
-        mCodec = MediaCodec::CreateByComponentName(mCodecLooper, hevcName);
-    }
-    if (mCodec == nullptr) {
-        ALOGE("%s: Failed to create codec for %s", __FUNCTION__, desiredMime);
-        return NO_INIT;
-    }
-
     // Create Looper and handler for Codec callback.
+    auto desiredMime = mUseHeic ? MIMETYPE_IMAGE_ANDROID_HEIC : MIMETYPE_VIDEO_HEVC;
     mCodecCallbackHandler = new CodecCallbackHandler(this);
     if (mCodecCallbackHandler == nullptr) {
         ALOGE("%s: Failed to create codec callback handler", __FUNCTION__);
@@ -1316,7 +1471,7 @@ status_t HeicCompositeStream::initializeCodec(uint32_t width, uint32_t height,
     }
     mCallbackLooper = new ALooper;
     mCallbackLooper->setName("Camera3-HeicComposite-MediaCodecCallbackLooper");
-    res = mCallbackLooper->start(
+    status_t res = mCallbackLooper->start(
             false,   // runOnCallingThread
             false,    // canCallJava
             PRIORITY_AUDIO);
@@ -1328,12 +1483,6 @@ status_t HeicCompositeStream::initializeCodec(uint32_t width, uint32_t height,
     mCallbackLooper->registerHandler(mCodecCallbackHandler);
 
     mAsyncNotify = new AMessage(kWhatCallbackNotify, mCodecCallbackHandler);
-    res = mCodec->setCallback(mAsyncNotify);
-    if (res != OK) {
-        ALOGE("%s: Failed to set MediaCodec callback: %s (%d)", __FUNCTION__,
-                strerror(-res), res);
-        return res;
-    }
 
     // Create output format and configure the Codec.
     sp<AMessage> outputFormat = new AMessage();
@@ -1373,13 +1522,28 @@ status_t HeicCompositeStream::initializeCodec(uint32_t width, uint32_t height,
     // This only serves as a hint to encoder when encoding is not real-time.
     outputFormat->setInt32(KEY_OPERATING_RATE, useGrid ? kGridOpRate : kNoGridOpRate);
 
-    res = mCodec->configure(outputFormat, nullptr /*nativeWindow*/,
-            nullptr /*crypto*/, CONFIGURE_FLAG_ENCODE);
-    if (res != OK) {
-        ALOGE("%s: Failed to configure codec: %s (%d)", __FUNCTION__,
-                strerror(-res), res);
-        return res;
+    // Create and configure the HEIC/HEVC codecs. Tiles of large images are
+    // encoded by several HEVC codecs in parallel where the encoder allows it.
+    size_t codecCount = useGrid ?
+            HeicEncoderInfoManager::getInstance().getHevcTileEncoderCount(width, height) : 1;
+    for (size_t i = 0; i < codecCount; i++) {
+        res = addCodec(desiredMime, hevcName, outputFormat);
+        if (res != OK) {
+            if (i == 0) {
+                return res;
+            }
+            ALOGW("%s: Failed to create tile codec %zu, encoding with %zu codecs",
+                    __FUNCTION__, i, i);
+            break;
+        }
     }
+    mCodecTilesInFlight.assign(mCodecs.size(), 0);
+    mCodecConfigs.assign(mCodecs.size(), nullptr);
+    mCodecProbed.assign(mCodecs.size(), false);
+    // The other codecs get tiles once their configs are known to match, see
+    // checkCodecConfigsLocked().
+    mActiveCodecCount = 1;
+    ALOGV("%s: %zu codec(s) for %u x %u", __FUNCTION__, mCodecs.size(), width, height);
 
     mGridWidth = gridWidth;
     mGridHeight = gridHeight;
@@ -1396,18 +1560,85 @@ status_t HeicCompositeStream::initializeCodec(uint32_t width, uint32_t height,
     return OK;
 }
 
+status_t HeicCompositeStream::addCodec(const char* mime, const AString& hevcName,
+        const sp<AMessage>& outputFormat) {
+    size_t codecIndex = mCodecs.size();
+
+    // Create Looper for MediaCodec.
+    sp<ALooper> codecLooper = new ALooper;
+    if (codecIndex == 0) {
+        codecLooper->setName("Camera3-HeicComposite-MediaCodecLooper");
+    } else {
+        codecLooper->setName(String8::format("Camera3-HeicComposite-MediaCodecLooper-%zu",
+                codecIndex).c_str());
+    }
+    status_t res = codecLooper->start(
+            false,   // runOnCallingThread
+            false,    // canCallJava
+            PRIORITY_AUDIO);
+    if (res != OK) {
+        ALOGE("%s: Failed to start codec looper: %s (%d)",
+                __FUNCTION__, strerror(-res), res);
+        return NO_INIT;
+    }
+
+    // Create HEIC/HEVC codec.
+    sp<MediaCodec> codec;
+    if (mUseHeic) {
+        codec = MediaCodec::CreateByType(codecLooper, mime, true /*encoder*/);
+    } else {
+        codec = MediaCodec::CreateByComponentName(codecLooper, hevcName);
+    }
+    if (codec == nullptr) {
+        ALOGE("%s: Failed to create codec for %s", __FUNCTION__, mime);
+        codecLooper->stop();
+        return NO_INIT;
+    }
+
+    // The callbacks of all codecs go to the same handler, tagged with the codec index.
+    sp<AMessage> notify = mAsyncNotify->dup();
+    notify->setInt32("codec-index", codecIndex);
+    res = codec->setCallback(notify);
+    if (res != OK) {
+        ALOGE("%s: Failed to set MediaCodec callback: %s (%d)", __FUNCTION__,
+                strerror(-res), res);
+        codec->release();
+        codecLooper->stop();
+        return res;
+    }
+
+    res = codec->configure(outputFormat->dup(), nullptr /*nativeWindow*/,
+            nullptr /*crypto*/, CONFIGURE_FLAG_ENCODE);
+    if (res != OK) {
+        ALOGE("%s: Failed to configure codec: %s (%d)", __FUNCTION__,
+                strerror(-res), res);
+        codec->release();
+        codecLooper->stop();
+        return res;
+    }
+
+    mCodecs.push_back(codec);
+    mCodecLoopers.push_back(codecLooper);
+    return OK;
+}
+
 void HeicCompositeStream::deinitCodec() {
     ALOGV("%s", __FUNCTION__);
-    if (mCodec != nullptr) {
-        mCodec->stop();
-        mCodec->release();
-        mCodec.clear();
+    for (auto& codec : mCodecs) {
+        codec->stop();
+        codec->release();
     }
+    mCodecs.clear();
 
-    if (mCodecLooper != nullptr) {
-        mCodecLooper->stop();
-        mCodecLooper.clear();
+    for (auto& codecLooper : mCodecLoopers) {
+        codecLooper->stop();
     }
+    mCodecLoopers.clear();
+    mCodecTilesInFlight.clear();
+    mCodecConfigs.clear();
+    mCodecProbed.clear();
+    mTilesByTimestamp.clear();
+    mActiveCodecCount = 0;
 
     if (mCallbackLooper != nullptr) {
         mCallbackLooper->stop();
@@ -1647,11 +1878,16 @@ void HeicCompositeStream::updateCodecQualityLocked(int32_t quality) {
     if (quality != mQuality) {
         sp<AMessage> qualityParams = new AMessage;
         qualityParams->setInt32(PARAMETER_KEY_VIDEO_BITRATE, quality);
-        status_t res = mCodec->setParameters(qualityParams);
-        if (res != OK) {
-            ALOGE("%s: Failed to set codec quality: %s (%d)",
-                    __FUNCTION__, strerror(-res), res);
-        } else {
+        status_t res = OK;
+        for (auto& codec : mCodecs) {
+            res = codec->setParameters(qualityParams);
+            if (res != OK) {
+                ALOGE("%s: Failed to set codec quality: %s (%d)",
+                        __FUNCTION__, strerror(-res), res);
+                break;
+            }
+        }
+        if (res == OK) {
             mQuality = quality;
         }
     }
@@ -1805,6 +2041,9 @@ void HeicCompositeStream::CodecCallbackHandler::onMessageReceived(const sp<AMess
     sp<HeicCompositeStream> parent = mParent.promote();
     if (parent == nullptr) return;
 
+    int32_t codecIndex = 0;
+    msg->findInt32("codec-index", &codecIndex);
+
     switch (msg->what()) {
         case kWhatCallbackNotify: {
              int32_t cbID;
@@ -1822,7 +2061,7 @@ void HeicCompositeStream::CodecCallbackHandler::onMessageReceived(const sp<AMess
                          ALOGE("CB_INPUT_AVAILABLE: index is expected.");
                          break;
                      }
-                     parent->onHeicInputFrameAvailable(index);
+                     parent->onHeicInputFrameAvailable(index, codecIndex);
                      break;
                  }
 
@@ -1859,7 +2098,8 @@ void HeicCompositeStream::CodecCallbackHandler::onMessageReceived(const sp<AMess
                          (int32_t)offset,
                          (int32_t)size,
                          timeUs,
-                         (uint32_t)flags};
+                         (uint32_t)flags,
+                         (size_t)codecIndex};
 
                      parent->onHeicOutputFrameAvailable(bufferInfo);
                      break;
@@ -1877,7 +2117,7 @@ void HeicCompositeStream::CodecCallbackHandler::onMessageReceived(const sp<AMess
                      if (format != nullptr) {
                          formatCopy = format->dup();
                      }
-                     parent->onHeicFormatChanged(formatCopy);
+                     parent->onHeicFormatChanged(formatCopy, codecIndex);
                      break;
                  }
 
@@ -1915,5 +2155,14 @@ void HeicCompositeStream::CodecCallbackHandler::onMessageReceived(const sp<AMess
     }
 }
 
+void HeicCompositeStream::InputFrame::addCodecOutputBuffer(
+        const CodecOutputBufferInfo& bufferInfo) {
+    auto it = std::upper_bound(codecOutputBuffers.begin(), codecOutputBuffers.end(), bufferInfo,
+            [](const CodecOutputBufferInfo& a, const CodecOutputBufferInfo& b) {
+                return a.tileIndex < b.tileIndex;
+            });
+    codecOutputBuffers.insert(it, bufferInfo);
+}
+
 }; // namespace camera3
 }; // namespace android
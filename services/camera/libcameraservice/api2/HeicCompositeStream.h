@@ -24,6 +24,7 @@
 
 #include <media/hardware/VideoAPI.h>
 #include <media/MediaCodecBuffer.h>
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaCodec.h>
@@ -34,6 +35,8 @@
 namespace android {
 namespace camera3 {
 
+class ExifUtils;
+
 class HeicCompositeStream : public CompositeStream, public Thread,
         public CpuConsumer::FrameAvailableListener {
 public:
@@ -86,6 +89,8 @@ protected:
     void onRequestError(const CaptureResultExtras& resultExtras) override;
 
 private:
+    friend class HeicCompositeStreamTest;
+
     //
     // HEIC/HEVC Codec related structures, utility functions, and callbacks
     //
@@ -95,12 +100,15 @@ private:
         int32_t size;
         int64_t timeUs;
         uint32_t flags;
+        size_t codecIndex = 0;
+        size_t tileIndex = 0;
     };
 
     struct CodecInputBufferInfo {
         int32_t index;
         int64_t timeUs;
         size_t tileIndex;
+        size_t codecIndex;
     };
 
     class CodecCallbackHandler : public AHandler {
@@ -118,8 +126,13 @@ private:
     };
 
     bool              mUseHeic;
-    sp<MediaCodec>    mCodec;
-    sp<ALooper>       mCodecLooper, mCallbackLooper;
+    // A single codec, except for framework tiling of large images, where the tiles
+    // are spread over several identical HEVC codecs encoding in parallel. Each codec
+    // runs on its own looper, and reports its index in the "codec-index" field of
+    // its callbacks.
+    std::vector<sp<MediaCodec>> mCodecs;
+    std::vector<sp<ALooper>>    mCodecLoopers;
+    sp<ALooper>       mCallbackLooper;
     sp<CodecCallbackHandler> mCodecCallbackHandler;
     sp<AMessage>      mAsyncNotify;
     sp<AMessage>      mFormat;
@@ -135,14 +148,37 @@ private:
     static const int32_t kNoGridOpRate = 30;
     static const int32_t kGridOpRate = 120;
 
+    // Number of codecs that new tiles may be queued to. Starts at 1, and becomes the
+    // number of codecs once every codec encoded a probe tile with the same codec
+    // config as the first one. Stays at 1 otherwise.
+    size_t            mActiveCodecCount;
+    // Tiles queued to each codec and not yet encoded.
+    std::vector<size_t> mCodecTilesInFlight;
+    // Codec specific data reported by each codec, to check that the tiles of all
+    // codecs can be decoded with the parameter sets of the muxed track.
+    std::vector<sp<ABuffer>> mCodecConfigs;
+    // Whether the probe tile was queued to each codec.
+    std::vector<bool> mCodecProbed;
+    // Frame number and tile index of each tile queued in YUV input mode, by codec
+    // timestamp.
+    std::map<int64_t, std::pair<int64_t, size_t>> mTilesByTimestamp;
+
     void onHeicOutputFrameAvailable(const CodecOutputBufferInfo& bufferInfo);
-    void onHeicInputFrameAvailable(int32_t index);  // Only called for YUV input mode.
-    void onHeicFormatChanged(sp<AMessage>& newFormat);
+    // Only called for YUV input mode.
+    void onHeicInputFrameAvailable(int32_t index, size_t codecIndex);
+    void onHeicFormatChanged(sp<AMessage>& newFormat, size_t codecIndex);
     void onHeicCodecError();
 
     status_t initializeCodec(uint32_t width, uint32_t height,
             const sp<CameraDeviceBase>& cameraDevice);
+    status_t addCodec(const char* mime, const AString& hevcName,
+            const sp<AMessage>& outputFormat);
     void deinitCodec();
+    // Encodes a blank tile, to get the codec config of a codec before it is used.
+    status_t queueProbeTileLocked(int32_t index, size_t codecIndex);
+    void checkCodecConfigsLocked();
+    // Takes an input buffer from the active codec with the fewest tiles in flight.
+    bool takeCodecInputBufferLocked(CodecInputBufferInfo* inputBuffer /*out*/);
 
     //
     // Composite stream related structures, utility functions and callbacks.
@@ -174,11 +210,20 @@ private:
         bool                      appSegmentWritten;
         size_t                    pendingOutputTiles;
         size_t                    codecInputCounter;
+        // Tiles must be written to the muxer in order, codecOutputBuffers is
+        // sorted by tile index.
+        size_t                    nextOutputTile;
 
         InputFrame() : orientation(0), quality(kDefaultJpegQuality), error(false),
                        exifError(false), timestamp(-1), requestId(-1), fenceFd(-1),
                        fileFd(-1), trackIndex(-1), anb(nullptr), appSegmentWritten(false),
-                       pendingOutputTiles(0), codecInputCounter(0) { }
+                       pendingOutputTiles(0), codecInputCounter(0), nextOutputTile(0) { }
+
+        bool isNextCodecOutputReady() const {
+            return !codecOutputBuffers.empty() &&
+                    codecOutputBuffers.front().tileIndex == nextOutputTile;
+        }
+        void addCodecOutputBuffer(const CodecOutputBufferInfo& bufferInfo);
     };
 
     void compilePendingInputLocked();
@@ -223,6 +268,9 @@ private:
     size_t            mAppSegmentMaxSize;
     std::queue<int64_t> mAppSegmentFrameNumbers;
     CameraMetadata    mStaticInfo;
+    // Reused across captures so that the static part of the APP1 segment is
+    // only serialized once per session.
+    std::unique_ptr<ExifUtils> mExifUtils;
 
     int               mMainImageStreamId, mMainImageSurfaceId;
     sp<Surface>       mMainImageSurface;
@@ -265,7 +313,7 @@ private:
     // Keep all incoming Yuv buffer pending tiling and encoding (for HEVC YUV tiling only)
     std::vector<int64_t> mInputYuvBuffers;
     // Keep all codec input buffers ready to be filled out (for HEVC YUV tiling only)
-    std::vector<int32_t> mCodecInputBuffers;
+    std::vector<CodecInputBufferInfo> mCodecInputBuffers;
 
     // Artificial strictly incremental YUV grid timestamp to make encoder happy.
     int64_t mGridTimestampUs;
@@ -17,7 +17,9 @@
 #define LOG_TAG "HeicEncoderInfoManager"
 //#define LOG_NDEBUG 0
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <regex>
 
 #include <cutils/properties.h>
@@ -39,6 +41,8 @@ HeicEncoderInfoManager::HeicEncoderInfoManager() :
         mMaxSizeHeic(INT32_MAX, INT32_MAX),
         mHasHEVC(false),
         mHasHEIC(false),
+        mHevcMaxInstances(kDefaultMaxCodecInstances),
+        mMaxTileEncoders(1),
         mDisableGrid(false) {
     if (initialize() == OK) {
         mIsInited = true;
@@ -109,8 +113,22 @@ bool HeicEncoderInfoManager::isSizeSupported(int32_t width, int32_t height, bool
     return true;
 }
 
+size_t HeicEncoderInfoManager::getHevcTileEncoderCount(int32_t width, int32_t height) const {
+    if (!mIsInited || !mHasHEVC || width <= 0 || height <= 0) return 1;
+
+    size_t tileCount = static_cast<size_t>((width + kGridWidth - 1) / kGridWidth) *
+            ((height + kGridHeight - 1) / kGridHeight);
+    // Leave one instance for other clients, such as a concurrent video recording.
+    size_t count = std::min({tileCount / kMinTilesPerEncoder,
+            static_cast<size_t>(std::max(mHevcMaxInstances - 1, 1)),
+            static_cast<size_t>(std::max(mMaxTileEncoders, 1))});
+    return std::max(count, static_cast<size_t>(1));
+}
+
 status_t HeicEncoderInfoManager::initialize() {
     mDisableGrid = property_get_bool("camera.heic.disable_grid", false);
+    mMaxTileEncoders = property_get_int32("camera.heic.max_tile_encoders",
+            kDefaultMaxTileEncoders);
     sp<IMediaCodecList> codecsList = MediaCodecList::getInstance();
     if (codecsList == nullptr) {
         // No media codec available.
@@ -332,6 +350,17 @@ bool HeicEncoderInfoManager::getHevcCodecDetails(
             continue; // move on to next encoder
         }
 
+        // The limit is "max-concurrent-instances" when declared in the codec list,
+        // or "max-supported-instances" when measured.
+        AString maxInstances;
+        if (details->findString("max-concurrent-instances", &maxInstances) ||
+                details->findString("max-supported-instances", &maxInstances)) {
+            int32_t instances = atoi(maxInstances.c_str());
+            if (instances > 0) {
+                mHevcMaxInstances = instances;
+            }
+        }
+
         // Found: save name, size, frame rate
         mHevcName = info->getCodecName();
         mMinSizeHevc = minSizeHevc;
@@ -38,9 +38,23 @@ public:
     bool isSizeSupported(int32_t width, int32_t height,
             bool* useHeic, bool* useGrid, int64_t* stall, AString* hevcName) const;
 
+    // Number of HEVC encoder instances that may encode the grid tiles of one
+    // width x height image in parallel. Only applicable when the image is
+    // tiled by the framework, i.e. when isSizeSupported() sets useGrid.
+    size_t getHevcTileEncoderCount(int32_t width, int32_t height) const;
+
     // kGridWidth and kGridHeight should be 2^n
     static const auto kGridWidth = 512;
     static const auto kGridHeight = 512;
+
+    // Each tile encoder must have at least that many tiles per image to be worth
+    // starting, so only images of 8MP or more are encoded in parallel.
+    static const size_t kMinTilesPerEncoder = 32;
+    // Default upper bound of tile encoders, can be changed with the
+    // camera.heic.max_tile_encoders property. 1 disables parallel encoding.
+    static const int32_t kDefaultMaxTileEncoders = 4;
+    // Concurrent instance count assumed when the HEVC encoder doesn't advertise one.
+    static const int32_t kDefaultMaxCodecInstances = 32;
 private:
     struct SizePairHash {
         std::size_t operator () (const std::pair<int32_t,int32_t> &p) const {
@@ -69,6 +83,8 @@ private:
     std::pair<int32_t, int32_t> mMinSizeHevc, mMaxSizeHevc;
     bool mHasHEVC, mHasHEIC;
     AString mHevcName;
+    int32_t mHevcMaxInstances;
+    int32_t mMaxTileEncoders;
     FrameRateMaps mHeicFrameRateMaps, mHevcFrameRateMaps;
     bool mDisableGrid;
 
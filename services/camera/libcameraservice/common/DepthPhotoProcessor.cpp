@@ -35,7 +35,10 @@
 #include <libexif/exif-data.h>
 #include <libexif/exif-system.h>
 #include <math.h>
+#include <algorithm>
 #include <sstream>
+#include <thread>
+#include <vector>
 #include <utils/Errors.h>
 #include <utils/ExifUtils.h>
 #include <utils/Log.h>
@@ -206,7 +209,8 @@ status_t encodeGrayscaleJpeg(size_t width, size_t height, uint8_t *in, void *out
     jpeg_start_compress(cinfo.get(), TRUE);
 
     if (exifOrientation != ExifOrientation::ORIENTATION_UNDEFINED) {
-        std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+        // The same tags are written for every map, so each thread keeps a template.
+        static thread_local std::unique_ptr<ExifUtils> utils(ExifUtils::createWithTemplate());
         utils->initializeEmpty();
         utils->setImageWidth(width);
         utils->setImageHeight(height);
@@ -239,100 +243,221 @@ status_t encodeGrayscaleJpeg(size_t width, size_t height, uint8_t *in, void *out
     return ret;
 }
 
-inline void unpackDepth16(uint16_t value, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    // Android densely packed depth map. The units for the range are in
-    // millimeters and need to be scaled to meters.
-    // The confidence value is encoded in the 3 most significant bits.
-    // The confidence data needs to be additionally normalized with
-    // values 1.0f, 0.0f representing maximum and minimum confidence
-    // respectively.
-    auto point = static_cast<float>(value & 0x1FFF) / 1000.f;
-    points->push_back(point);
+// Android densely packed depth map. The units for the range are in
+// millimeters and need to be scaled to meters.
+// The confidence value is encoded in the 3 most significant bits.
+// The confidence data needs to be additionally normalized with
+// values 1.0f, 0.0f representing maximum and minimum confidence
+// respectively.
+static const uint16_t DEPTH16_RANGE_MASK = 0x1FFF;
+static const size_t DEPTH16_RANGE_COUNT = DEPTH16_RANGE_MASK + 1;
+static const int DEPTH16_CONFIDENCE_SHIFT = 13;
+static const size_t DEPTH16_CONFIDENCE_COUNT = 8;
+
+// Depth maps are split in bands of rows processed in parallel, each band having at
+// least this many pixels.
+static const size_t MIN_PIXELS_PER_THREAD = 64 * 1024;
+static const size_t MAX_THREADS = 4;
+// Depth maps rotated by 90 or 270 degrees are processed in square tiles of this size,
+// so that the columns read from the source stay in cache.
+static const size_t ROTATION_TILE_SIZE = 32;
+
+inline float depth16ToMeters(uint16_t range) {
+    return static_cast<float>(range) / 1000.f;
+}
+
+inline float normalizeConfidence(uint16_t conf) {
+    return (conf == 0) ? 1.f : (static_cast<float>(conf) - 1) / 7.f;
+}
+
+// Confidence values ordered from the lowest to the highest normalized confidence, i.e.
+// 1 to 7 and then 0.
+inline uint16_t getConfidenceRank(uint16_t value) {
+    return ((value >> DEPTH16_CONFIDENCE_SHIFT) + DEPTH16_CONFIDENCE_COUNT - 1) &
+            (DEPTH16_CONFIDENCE_COUNT - 1);
+}
 
-    auto conf = (value >> 13) & 0x7;
-    float normConfidence = (conf == 0) ? 1.f : (static_cast<float>(conf) - 1) / 7.f;
-    confidence->push_back(normConfidence);
-    if (normConfidence < CONFIDENCE_THRESHOLD) {
-        return;
+// Lowest confidence rank of the samples that count towards the near/far range.
+inline uint16_t getMinConfidentRank() {
+    uint16_t rank = 0;
+    while ((rank < DEPTH16_CONFIDENCE_COUNT - 1) &&
+            (normalizeConfidence((rank + 1) % DEPTH16_CONFIDENCE_COUNT) < CONFIDENCE_THRESHOLD)) {
+        rank++;
     }
+    return rank;
+}
+
+// Range of the confident samples of a depth map, in millimeters.
+struct Depth16Range {
+    uint16_t near = UINT16_MAX;
+    uint16_t far = 0;
+
+    bool isEmpty() const { return near > far; }
 
-    if (*near > point) {
-        *near = point;
+    // Without any confident sample, the range is kept at its initial value.
+    float nearMeters() const { return isEmpty() ? UINT16_MAX : depth16ToMeters(near); }
+    float farMeters() const { return isEmpty() ? .0f : depth16ToMeters(far); }
+
+    void merge(const Depth16Range &other) {
+        near = std::min(near, other.near);
+        far = std::max(far, other.far);
     }
-    if (*far < point) {
-        *far = point;
+};
+
+// Written without branches so that the compiler can vectorize the loop.
+Depth16Range findDepthRange(const uint16_t *row, size_t width, uint16_t minConfidentRank) {
+    uint16_t near = UINT16_MAX;
+    uint16_t far = 0;
+    for (size_t j = 0; j < width; j++) {
+        uint16_t value = row[j];
+        uint16_t range = value & DEPTH16_RANGE_MASK;
+        // All ones for confident samples, zero otherwise
+        uint16_t mask = -static_cast<uint16_t>(getConfidenceRank(value) >= minConfidentRank);
+        near = std::min<uint16_t>(near, range | ~mask);
+        far = std::max<uint16_t>(far, range & mask);
     }
+    Depth16Range ret;
+    ret.near = near;
+    ret.far = far;
+    return ret;
 }
 
-// Trivial case, read forward from top,left corner.
-void rotate0AndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    for (size_t i = 0; i < inputFrame.mDepthMapHeight; i++) {
-        for (size_t j = 0; j < inputFrame.mDepthMapWidth; j++) {
-            unpackDepth16(inputFrame.mDepthMapBuffer[i*inputFrame.mDepthMapStride + j], points,
-                    confidence, near, far);
+// Maps DEPTH16 samples to the 8-bit range inverse depth and confidence values.
+// Since the confident samples all lie within the near/far range, clamping every sample
+// to it only changes the low confidence ones, so that the depth only depends on the range
+// bits and can be looked up.
+struct Depth16Quantizer {
+    uint16_t clampLow, clampHigh;
+    uint8_t depth[DEPTH16_RANGE_COUNT];
+    uint8_t confidence[DEPTH16_CONFIDENCE_COUNT];
+
+    Depth16Quantizer(const Depth16Range &range) {
+        float near = range.nearMeters();
+        float far = range.farMeters();
+        if (range.isEmpty()) {
+            // Every sample is clamped to the near value.
+            clampLow = 0;
+            clampHigh = DEPTH16_RANGE_MASK;
+            memset(depth, quantizeDepth(near, near, far), sizeof(depth));
+        } else {
+            clampLow = range.near;
+            clampHigh = range.far;
+            for (uint16_t i = clampLow; i <= clampHigh; i++) {
+                depth[i] = quantizeDepth(depth16ToMeters(i), near, far);
+            }
+        }
+        for (uint16_t conf = 0; conf < DEPTH16_CONFIDENCE_COUNT; conf++) {
+            confidence[conf] = floorf(normalizeConfidence(conf) * 255.0f);
         }
     }
-}
 
-// 90 degrees CW rotation can be applied by starting to read from bottom, left corner
-// transposing rows and columns.
-void rotate90AndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    for (size_t i = 0; i < inputFrame.mDepthMapWidth; i++) {
-        for (ssize_t j = inputFrame.mDepthMapHeight-1; j >= 0; j--) {
-            unpackDepth16(inputFrame.mDepthMapBuffer[j*inputFrame.mDepthMapStride + i], points,
-                    confidence, near, far);
-        }
+    static uint8_t quantizeDepth(float point, float near, float far) {
+        return floorf(((far * (point - near)) / (point * (far - near))) * 255.0f);
     }
-}
 
-// 180 CW degrees rotation can be applied by starting to read backwards from bottom, right corner.
-void rotate180AndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    for (ssize_t i = inputFrame.mDepthMapHeight-1; i >= 0; i--) {
-        for (ssize_t j = inputFrame.mDepthMapWidth-1; j >= 0; j--) {
-            unpackDepth16(inputFrame.mDepthMapBuffer[i*inputFrame.mDepthMapStride + j], points,
-                    confidence, near, far);
+    inline void quantize(uint16_t value, uint8_t *depthOut, uint8_t *confidenceOut) const {
+        uint16_t range = std::clamp(static_cast<uint16_t>(value & DEPTH16_RANGE_MASK),
+                clampLow, clampHigh);
+        *depthOut = depth[range];
+        *confidenceOut = confidence[value >> DEPTH16_CONFIDENCE_SHIFT];
+    }
+};
+
+// Quantizes the rows [rowBegin, rowEnd) of the depth and confidence maps after rotating
+// the depth map clockwise by the given orientation.
+void rotateAndQuantizeRows(const DepthPhotoInputFrame &inputFrame,
+        DepthPhotoOrientation orientation, const Depth16Quantizer &quantizer, size_t rowBegin,
+        size_t rowEnd, uint8_t *depthOut /*out*/, uint8_t *confidenceOut /*out*/) {
+    const uint16_t *in = inputFrame.mDepthMapBuffer;
+    size_t stride = inputFrame.mDepthMapStride;
+    size_t inWidth = inputFrame.mDepthMapWidth;
+    size_t inHeight = inputFrame.mDepthMapHeight;
+
+    switch (orientation) {
+        case DepthPhotoOrientation::DEPTH_ORIENTATION_180_DEGREES:
+            // Read backwards from the bottom, right corner.
+            for (size_t i = rowBegin; i < rowEnd; i++) {
+                const uint16_t *row = in + (inHeight - 1 - i) * stride + inWidth - 1;
+                for (size_t j = 0; j < inWidth; j++) {
+                    quantizer.quantize(*(row - j), depthOut + i * inWidth + j,
+                            confidenceOut + i * inWidth + j);
+                }
+            }
+            break;
+        case DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES:
+        case DepthPhotoOrientation::DEPTH_ORIENTATION_270_DEGREES: {
+            // Output row i is input column i read from the bottom up for 90 degrees, and
+            // input column (width - 1 - i) read from the top down for 270 degrees.
+            bool is90 = orientation == DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES;
+            size_t outWidth = inHeight;
+            for (size_t i0 = rowBegin; i0 < rowEnd; i0 += ROTATION_TILE_SIZE) {
+                size_t i1 = std::min(i0 + ROTATION_TILE_SIZE, rowEnd);
+                for (size_t j0 = 0; j0 < outWidth; j0 += ROTATION_TILE_SIZE) {
+                    size_t j1 = std::min(j0 + ROTATION_TILE_SIZE, outWidth);
+                    for (size_t j = j0; j < j1; j++) {
+                        size_t inRow = is90 ? inHeight - 1 - j : j;
+                        for (size_t i = i0; i < i1; i++) {
+                            size_t inColumn = is90 ? i : inWidth - 1 - i;
+                            quantizer.quantize(in[inRow * stride + inColumn],
+                                    depthOut + i * outWidth + j, confidenceOut + i * outWidth + j);
+                        }
+                    }
+                }
+            }
+            break;
         }
+        default:
+            // Trivial case, read forward from top,left corner.
+            for (size_t i = rowBegin; i < rowEnd; i++) {
+                const uint16_t *row = in + i * stride;
+                for (size_t j = 0; j < inWidth; j++) {
+                    quantizer.quantize(row[j], depthOut + i * inWidth + j,
+                            confidenceOut + i * inWidth + j);
+                }
+            }
     }
 }
 
-// 270 degrees CW rotation can be applied by starting to read from top, right corner
-// transposing rows and columns.
-void rotate270AndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    for (ssize_t i = inputFrame.mDepthMapWidth-1; i >= 0; i--) {
-        for (size_t j = 0; j < inputFrame.mDepthMapHeight; j++) {
-            unpackDepth16(inputFrame.mDepthMapBuffer[j*inputFrame.mDepthMapStride + i], points,
-                    confidence, near, far);
-        }
+// Splits [0, rowCount) in bands and calls work(band, rowBegin, rowEnd) for each of them, on
+// separate threads when the image is large enough. Returns the number of bands.
+template<typename Work>
+size_t forEachRowBand(size_t rowCount, size_t width, Work work) {
+    size_t bandCount = std::min(std::max<size_t>(rowCount * width / MIN_PIXELS_PER_THREAD, 1),
+            std::min<size_t>(MAX_THREADS, std::max<size_t>(rowCount, 1)));
+    size_t rowsPerBand = (rowCount + bandCount - 1) / bandCount;
+    std::vector<std::thread> threads;
+    threads.reserve(bandCount - 1);
+    for (size_t band = 1; band < bandCount; band++) {
+        size_t rowBegin = std::min(band * rowsPerBand, rowCount);
+        size_t rowEnd = std::min(rowBegin + rowsPerBand, rowCount);
+        threads.emplace_back(work, band, rowBegin, rowEnd);
+    }
+    work(0, 0, std::min(rowsPerBand, rowCount));
+    for (auto &thread : threads) {
+        thread.join();
     }
+    return bandCount;
 }
 
-bool rotateAndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    switch (inputFrame.mOrientation) {
+// Physical rotation of depth and confidence maps may be needed in case
+// the EXIF orientation is set to 0 degrees and the depth photo orientation
+// (source color image) has some different value.
+DepthPhotoOrientation getPhysicalRotation(DepthPhotoOrientation orientation,
+        ExifOrientation exifOrientation) {
+    if (exifOrientation != ExifOrientation::ORIENTATION_0_DEGREES) {
+        return DepthPhotoOrientation::DEPTH_ORIENTATION_0_DEGREES;
+    }
+    switch (orientation) {
         case DepthPhotoOrientation::DEPTH_ORIENTATION_0_DEGREES:
-            rotate0AndUnpack(inputFrame, points, confidence, near, far);
-            return false;
         case DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES:
-            rotate90AndUnpack(inputFrame, points, confidence, near, far);
-            return true;
         case DepthPhotoOrientation::DEPTH_ORIENTATION_180_DEGREES:
-            rotate180AndUnpack(inputFrame, points, confidence, near, far);
-            return false;
         case DepthPhotoOrientation::DEPTH_ORIENTATION_270_DEGREES:
-            rotate270AndUnpack(inputFrame, points, confidence, near, far);
-            return true;
+            return orientation;
         default:
             ALOGE("%s: Unsupported depth photo rotation: %d, default to 0", __FUNCTION__,
-                    inputFrame.mOrientation);
-            rotate0AndUnpack(inputFrame, points, confidence, near, far);
+                    orientation);
+            return DepthPhotoOrientation::DEPTH_ORIENTATION_0_DEGREES;
     }
-
-    return false;
 }
 
 std::unique_ptr<dynamic_depth::DepthMap> processDepthMapFrame(DepthPhotoInputFrame inputFrame,
@@ -342,23 +467,11 @@ std::unique_ptr<dynamic_depth::DepthMap> processDepthMapFrame(DepthPhotoInputFra
         return nullptr;
     }
 
-    std::vector<float> points, confidence;
-
-    size_t pointCount = inputFrame.mDepthMapWidth * inputFrame.mDepthMapHeight;
-    points.reserve(pointCount);
-    confidence.reserve(pointCount);
-    float near = UINT16_MAX;
-    float far = .0f;
-    *switchDimensions = false;
-    // Physical rotation of depth and confidence maps may be needed in case
-    // the EXIF orientation is set to 0 degrees and the depth photo orientation
-    // (source color image) has some different value.
-    if (exifOrientation == ExifOrientation::ORIENTATION_0_DEGREES) {
-        *switchDimensions = rotateAndUnpack(inputFrame, &points, &confidence, &near, &far);
-    } else {
-        rotate0AndUnpack(inputFrame, &points, &confidence, &near, &far);
-    }
-
+    DepthPhotoOrientation rotation = getPhysicalRotation(inputFrame.mOrientation,
+            exifOrientation);
+    *switchDimensions =
+            (rotation == DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES) ||
+            (rotation == DepthPhotoOrientation::DEPTH_ORIENTATION_270_DEGREES);
     size_t width = inputFrame.mDepthMapWidth;
     size_t height = inputFrame.mDepthMapHeight;
     if (*switchDimensions) {
@@ -366,25 +479,36 @@ std::unique_ptr<dynamic_depth::DepthMap> processDepthMapFrame(DepthPhotoInputFra
         height = inputFrame.mDepthMapWidth;
     }
 
-    if (near == far) {
+    // The near/far range does not depend on the rotation, scan the input in place.
+    uint16_t minConfidentRank = getMinConfidentRank();
+    Depth16Range bandRanges[MAX_THREADS];
+    size_t bandCount = forEachRowBand(inputFrame.mDepthMapHeight, inputFrame.mDepthMapWidth,
+            [&](size_t band, size_t rowBegin, size_t rowEnd) {
+                for (size_t i = rowBegin; i < rowEnd; i++) {
+                    bandRanges[band].merge(findDepthRange(
+                            inputFrame.mDepthMapBuffer + i * inputFrame.mDepthMapStride,
+                            inputFrame.mDepthMapWidth, minConfidentRank));
+                }
+            });
+    Depth16Range range;
+    for (size_t band = 0; band < bandCount; band++) {
+        range.merge(bandRanges[band]);
+    }
+
+    if (range.near == range.far) {
         ALOGE("%s: Near and far range values must not match!", __FUNCTION__);
         return nullptr;
     }
+    float near = range.nearMeters();
+    float far = range.farMeters();
 
-    std::vector<uint8_t> pointsQuantized, confidenceQuantized;
-    pointsQuantized.reserve(pointCount); confidenceQuantized.reserve(pointCount);
-    auto pointIt = points.begin();
-    auto confidenceIt = confidence.begin();
-    while ((pointIt != points.end()) && (confidenceIt != confidence.end())) {
-        auto point = *pointIt;
-        if ((*confidenceIt) < CONFIDENCE_THRESHOLD) {
-            point = std::clamp(point, near, far);
-        }
-        pointsQuantized.push_back(floorf(((far * (point - near)) /
-                (point * (far - near))) * 255.0f));
-        confidenceQuantized.push_back(floorf(*confidenceIt * 255.0f));
-        confidenceIt++; pointIt++;
-    }
+    size_t pointCount = inputFrame.mDepthMapWidth * inputFrame.mDepthMapHeight;
+    std::vector<uint8_t> pointsQuantized(pointCount), confidenceQuantized(pointCount);
+    Depth16Quantizer quantizer(range);
+    forEachRowBand(height, width, [&](size_t /*band*/, size_t rowBegin, size_t rowEnd) {
+        rotateAndQuantizeRows(inputFrame, rotation, quantizer, rowBegin, rowEnd,
+                pointsQuantized.data(), confidenceQuantized.data());
+    });
 
     DepthMapParams depthParams(DepthFormat::kRangeInverse, near, far, DepthUnits::kMeters,
             "android/depthmap");
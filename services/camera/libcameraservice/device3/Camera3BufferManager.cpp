@@ -18,6 +18,9 @@
 #define LOG_TAG "Camera3-BufferManager"
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 
+#include <algorithm>
+#include <cmath>
+
 #include <gui/ISurfaceComposer.h>
 #include <private/gui/ComposerService.h>
 #include <utils/Log.h>
@@ -104,6 +107,9 @@ status_t Camera3BufferManager::registerStream(wp<Camera3OutputStream>& stream,
     currentStreamSet.streamInfoMap.add(streamId, streamInfo);
     currentStreamSet.handoutBufferCountMap.add(streamId, 0);
     currentStreamSet.attachedBufferCountMap.add(streamId, 0);
+    StreamBufferStats stats;
+    stats.bufferBytes = estimateBufferBytes(streamInfo);
+    currentStreamSet.bufferStatsMap.add(streamId, stats);
     mStreamMap.add(streamId, stream);
 
     // The max allowed buffer count should be the max of buffer count of each stream inside a stream
@@ -136,6 +142,8 @@ status_t Camera3BufferManager::unregisterStream(int streamId, int streamSetId, b
     InfoMap& infoMap = currentSet.streamInfoMap;
     handOutBufferCounts.removeItem(streamId);
     attachedBufferCounts.removeItem(streamId);
+    currentSet.bufferStatsMap.removeItem(streamId);
+    updateAllocatedBytesLocked(currentSet);
 
     // Remove the stream info from info map and recalculate the buffer count water mark.
     infoMap.removeItem(streamId);
@@ -166,6 +174,7 @@ void Camera3BufferManager::notifyBufferRemoved(int streamId, int streamSetId, bo
     size_t& attachedBufferCount =
             streamSet.attachedBufferCountMap.editValueFor(streamId);
     attachedBufferCount--;
+    updateAllocatedBytesLocked(streamSet);
 }
 
 status_t Camera3BufferManager::checkAndFreeBufferOnOtherStreamsLocked(
@@ -236,6 +245,7 @@ status_t Camera3BufferManager::checkAndFreeBufferOnOtherStreamsLocked(
             size_t& otherAttachedBufferCount =
                     streamSet.attachedBufferCountMap.editValueFor(firstOtherStreamId);
             otherAttachedBufferCount--;
+            updateAllocatedBytesLocked(streamSet);
         }
     }
 
@@ -264,7 +274,10 @@ status_t Camera3BufferManager::getBufferForStream(int streamId, int streamSetId,
     size_t& attachedBufferCount = attachedBufferCounts.editValueFor(streamId);
 
     if (noFreeBufferAtConsumer) {
+        // The stream timed out waiting for a free buffer.
         attachedBufferCount = bufferCount;
+        onStreamStallLocked(streamSet, streamId);
+        updateAllocatedBytesLocked(streamSet);
     }
 
     if (bufferCount >= streamSet.maxAllowedBufferCount) {
@@ -305,6 +318,7 @@ status_t Camera3BufferManager::getBufferForStream(int streamId, int streamSetId,
         // Increase the hand-out and attached buffer counts for tracking purposes.
         bufferCount++;
         attachedBufferCount++;
+        updateAllocatedBytesLocked(streamSet);
         // Update the water mark to be the max hand-out buffer count + 1. An additional buffer is
         // added to reduce the chance of buffer allocation during stream steady state, especially
         // for cases where one stream is active, the other stream may request some buffers randomly.
@@ -364,6 +378,7 @@ status_t Camera3BufferManager::onBufferReleased(
         StreamSet& streamSet = mStreamSetMap.editValueFor(streamSetKey);
         BufferCountMap& handOutBufferCounts = streamSet.handoutBufferCountMap;
         size_t& bufferCount = handOutBufferCounts.editValueFor(streamId);
+        updateStatsOnReleaseLocked(streamSet, streamId, bufferCount);
         bufferCount--;
         ALOGV("%s: Stream %d set %d(%d): Buffer count now %zu", __FUNCTION__, streamId,
                 streamSetId, isMultiRes, bufferCount);
@@ -375,7 +390,8 @@ status_t Camera3BufferManager::onBufferReleased(
             totalHandOutBufferCount += streamSet.handoutBufferCountMap[i];
         }
 
-        size_t newWaterMark = totalHandOutBufferCount + BUFFER_WATERMARK_DEC_THRESHOLD;
+        // Keep room for the spare buffers the streams of this set currently want.
+        size_t newWaterMark = totalHandOutBufferCount + maxFreeThresholdLocked(streamSet);
         if (totalAllocatedBufferCount > newWaterMark &&
                     streamSet.allocatedBufferWaterMark > newWaterMark) {
             // BufferManager got more than enough buffers, so decrease watermark
@@ -392,9 +408,10 @@ status_t Camera3BufferManager::onBufferReleased(
         }
 
         bool freeBufferIsAttached = (attachedBufferCount > bufferCount);
+        size_t freeThreshold = streamSet.bufferStatsMap.valueFor(streamId).freeThreshold;
         if (freeBufferIsAttached &&
                 totalAllocatedBufferCount > streamSet.allocatedBufferWaterMark &&
-                attachedBufferCount > bufferCount + BUFFER_FREE_THRESHOLD) {
+                attachedBufferCount > bufferCount + freeThreshold) {
             ALOGV("%s: free a buffer from stream %d", __FUNCTION__, streamId);
             *shouldFreeBuffer = true;
         }
@@ -440,6 +457,7 @@ status_t Camera3BufferManager::onBuffersRemoved(int streamId, int streamSetId,
 
         totalHandoutCount -= count;
         totalAttachedCount -= count;
+        updateAllocatedBytesLocked(streamSet);
         ALOGV("%s: Stream %d set %d(%d): Buffer count now %zu, attached buffer count now %zu",
                 __FUNCTION__, streamId, streamSetId, isMultiRes, totalHandoutCount,
                 totalAttachedCount);
@@ -481,10 +499,138 @@ void Camera3BufferManager::dump(int fd, const Vector<String16>& args) const {
             lines.appendFormat("            stream id: %d, attached buffer count: %zu.\n",
                     streamId, bufferCount);
         }
+        lines.appendFormat("          Adaptive buffer counts:\n");
+        for (size_t m = 0; m < mStreamSetMap[i].bufferStatsMap.size(); m++) {
+            int streamId = mStreamSetMap[i].bufferStatsMap.keyAt(m);
+            const StreamBufferStats& stats = mStreamSetMap[i].bufferStatsMap.valueAt(m);
+            lines.appendFormat("            stream id: %d, free threshold: %zu, buffer bytes: %zu,"
+                    " avg in flight: %.1f, turnaround: %.2f ms, stalls: %zu.\n",
+                    streamId, stats.freeThreshold, stats.bufferBytes, stats.avgInFlight,
+                    stats.turnaroundNs() / 1e6, stats.stallCount);
+        }
+
+        const StreamSet& streamSet = mStreamSetMap[i];
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        double byteNs = streamSet.allocatedByteNs +
+                static_cast<double>(streamSet.allocatedBytes) *
+                (now - streamSet.lastBytesUpdateTime);
+        nsecs_t lifetime = now - streamSet.createTime;
+        size_t averageBytes = lifetime > 0 ? static_cast<size_t>(byteNs / lifetime) :
+                streamSet.allocatedBytes;
+        lines.appendFormat("          Allocated bytes: current %zu, peak %zu, average %zu\n",
+                streamSet.allocatedBytes, streamSet.peakAllocatedBytes, averageBytes);
     }
     write(fd, lines.string(), lines.size());
 }
 
+void Camera3BufferManager::onStreamStallLocked(StreamSet& streamSet, int streamId) {
+    StreamBufferStats& stats = streamSet.bufferStatsMap.editValueFor(streamId);
+    stats.stallCount++;
+    stats.freeThreshold = std::min(stats.freeThreshold + STALL_FREE_THRESHOLD_INC,
+            static_cast<size_t>(MAX_FREE_THRESHOLD));
+    // Start a new window so the threshold isn't lowered again right away.
+    stats.windowReleases = 0;
+    stats.windowPeakInFlight = 0;
+    ALOGV("%s: Stream %d stalled, free threshold now %zu", __FUNCTION__, streamId,
+            stats.freeThreshold);
+}
+
+void Camera3BufferManager::updateStatsOnReleaseLocked(StreamSet& streamSet, int streamId,
+        size_t handoutCount) {
+    // Weight of a new sample in the moving averages
+    const double kAlpha = 1.0 / ADAPT_WINDOW_RELEASES;
+
+    StreamBufferStats& stats = streamSet.bufferStatsMap.editValueFor(streamId);
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (stats.lastReleaseTime == 0) {
+        stats.avgInFlight = handoutCount;
+    } else {
+        stats.avgInFlight += kAlpha * (handoutCount - stats.avgInFlight);
+        double interval = now - stats.lastReleaseTime;
+        stats.avgReleaseIntervalNs = stats.avgReleaseIntervalNs == 0 ? interval :
+                stats.avgReleaseIntervalNs + kAlpha * (interval - stats.avgReleaseIntervalNs);
+    }
+    stats.lastReleaseTime = now;
+    stats.windowPeakInFlight = std::max(stats.windowPeakInFlight, handoutCount);
+
+    if (++stats.windowReleases < ADAPT_WINDOW_RELEASES) {
+        return;
+    }
+
+    // A whole window without a stall. Keep enough spare buffers to cover the bursts seen in
+    // it above the average depth, and one more.
+    double burst = stats.windowPeakInFlight - stats.avgInFlight;
+    size_t needed = static_cast<size_t>(std::max(0.0, std::ceil(burst))) + 1;
+    size_t target = std::max(needed, static_cast<size_t>(MIN_FREE_THRESHOLD));
+    if (stats.freeThreshold > target) {
+        stats.freeThreshold--;
+        ALOGV("%s: Stream %d steady, free threshold now %zu", __FUNCTION__, streamId,
+                stats.freeThreshold);
+    }
+    stats.windowReleases = 0;
+    stats.windowPeakInFlight = 0;
+}
+
+size_t Camera3BufferManager::maxFreeThresholdLocked(const StreamSet& streamSet) {
+    size_t threshold = MIN_FREE_THRESHOLD;
+    for (size_t i = 0; i < streamSet.bufferStatsMap.size(); i++) {
+        threshold = std::max(threshold, streamSet.bufferStatsMap[i].freeThreshold);
+    }
+    return threshold;
+}
+
+void Camera3BufferManager::updateAllocatedBytesLocked(StreamSet& streamSet) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    streamSet.allocatedByteNs += static_cast<double>(streamSet.allocatedBytes) *
+            (now - streamSet.lastBytesUpdateTime);
+    streamSet.lastBytesUpdateTime = now;
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < streamSet.attachedBufferCountMap.size(); i++) {
+        ssize_t idx = streamSet.bufferStatsMap.indexOfKey(
+                streamSet.attachedBufferCountMap.keyAt(i));
+        if (idx >= 0) {
+            bytes += streamSet.attachedBufferCountMap[i] * streamSet.bufferStatsMap[idx].bufferBytes;
+        }
+    }
+    streamSet.allocatedBytes = bytes;
+    streamSet.peakAllocatedBytes = std::max(streamSet.peakAllocatedBytes, bytes);
+}
+
+size_t Camera3BufferManager::estimateBufferBytes(const StreamInfo& info) {
+    size_t pixels = static_cast<size_t>(info.width) * info.height;
+    switch (info.format) {
+        case HAL_PIXEL_FORMAT_BLOB:
+            // Width is the buffer size in bytes
+            return info.width;
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+        case HAL_PIXEL_FORMAT_RGBA_1010102:
+            return pixels * 4;
+        case HAL_PIXEL_FORMAT_RGBA_FP16:
+            return pixels * 8;
+        case HAL_PIXEL_FORMAT_RGB_888:
+        case HAL_PIXEL_FORMAT_YCBCR_P010:
+            return pixels * 3;
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_RAW16:
+        case HAL_PIXEL_FORMAT_Y16:
+        case HAL_PIXEL_FORMAT_YCBCR_422_I:
+        case HAL_PIXEL_FORMAT_YCBCR_422_SP:
+            return pixels * 2;
+        case HAL_PIXEL_FORMAT_RAW12:
+            return pixels * 3 / 2;
+        case HAL_PIXEL_FORMAT_RAW10:
+            return pixels * 5 / 4;
+        case HAL_PIXEL_FORMAT_Y8:
+            return pixels;
+        default:
+            // YUV 4:2:0 and implementation defined formats
+            return pixels * 3 / 2;
+    }
+}
+
 bool Camera3BufferManager::checkIfStreamRegisteredLocked(int streamId,
         StreamSetKey streamSetKey) const {
     ssize_t setIdx = mStreamSetMap.indexOfKey(streamSetKey);
@@ -41,6 +41,9 @@ class Camera3OutputStream;
  * In doing so, it reduces the memory footprint unless it is already minimal without impacting
  * performance.
  *
+ * The number of spare buffers each stream keeps adapts to the stream: it shrinks while the
+ * stream runs steadily and grows again when the stream stalls waiting for a buffer.
+ *
  */
 class Camera3BufferManager: public virtual RefBase {
 public:
@@ -187,16 +190,27 @@ public:
 
 private:
     // allocatedBufferWaterMark will be decreased when:
-    //   numAllocatedBuffersThisSet > numHandoutBuffersThisSet + BUFFER_WATERMARK_DEC_THRESHOLD
-    // This allows the watermark go back down after a burst of buffer requests
-    static const int BUFFER_WATERMARK_DEC_THRESHOLD = 3;
-
+    //   numAllocatedBuffersThisSet > numHandoutBuffersThisSet + the largest free threshold of
+    //   the streams of the set (see BUFFER_FREE_THRESHOLD)
+    // This allows the watermark go back down after a burst of buffer requests.
+    //
     // onBufferReleased will set shouldFreeBuffer to true when:
     //   numAllocatedBuffersThisSet > allocatedBufferWaterMark AND
     //   numAllocatedBuffersThisStream > numHandoutBuffersThisStream + BUFFER_FREE_THRESHOLD
     // So after a burst of buffer requests and back to steady state, the buffer queue should have
     // (BUFFER_FREE_THRESHOLD + steady state handout buffer count) buffers.
+    //
+    // BUFFER_FREE_THRESHOLD is only the initial value of a per stream threshold: after every
+    // ADAPT_WINDOW_RELEASES buffer releases without a stall, the threshold of a stream is lowered
+    // by one, down to the spare buffers its bursts have needed and at least MIN_FREE_THRESHOLD.
+    // A stall, i.e. a dequeue that timed out waiting for a free buffer, raises it by
+    // STALL_FREE_THRESHOLD_INC, up to MAX_FREE_THRESHOLD, and starts a new window. Allocations
+    // that did not wait, like those of a growing pipeline, are not stalls.
     static const int BUFFER_FREE_THRESHOLD = 3;
+    static const size_t MIN_FREE_THRESHOLD = 1;
+    static const size_t MAX_FREE_THRESHOLD = 8;
+    static const size_t STALL_FREE_THRESHOLD_INC = 2;
+    static const size_t ADAPT_WINDOW_RELEASES = 30;
 
     /**
      * Lock to synchronize the access to the methods of this class.
@@ -237,6 +251,30 @@ private:
      */
     typedef KeyedVector<StreamId, size_t> BufferCountMap;
 
+    /**
+     * Buffer usage statistics of one stream, driving its adaptive free threshold.
+     */
+    struct StreamBufferStats {
+        // Spare attached buffers this stream may keep before onBufferReleased frees one.
+        size_t freeThreshold = BUFFER_FREE_THRESHOLD;
+        // Estimated size of one buffer of this stream, in bytes.
+        size_t bufferBytes = 0;
+        // Moving averages of the hand-out buffer count, sampled on each release, and of the
+        // time between releases.
+        double avgInFlight = 0;
+        double avgReleaseIntervalNs = 0;
+        nsecs_t lastReleaseTime = 0;
+        // Largest hand-out buffer count in the current adaptation window.
+        size_t windowPeakInFlight = 0;
+        // Releases in the current adaptation window.
+        size_t windowReleases = 0;
+        size_t stallCount = 0;
+
+        // Average time from hand-out to release, by Little's law.
+        double turnaroundNs() const { return avgInFlight * avgReleaseIntervalNs; }
+    };
+    typedef KeyedVector<StreamId, StreamBufferStats> BufferStatsMap;
+
     /**
      * StreamSet keeps track of the stream info, free buffer list and hand-out buffer counts for
      * each stream set.
@@ -283,10 +321,29 @@ private:
          * An attached buffer may be free or handed out
          */
         BufferCountMap attachedBufferCountMap;
+        /**
+         * The adaptive buffer count statistics of the streams of this set.
+         */
+        BufferStatsMap bufferStatsMap;
+
+        /**
+         * Memory held by the attached buffers of this set: current and peak byte counts, and the
+         * integral of the byte count over time since the set was created, for the average.
+         */
+        size_t allocatedBytes;
+        size_t peakAllocatedBytes;
+        double allocatedByteNs;
+        nsecs_t createTime;
+        nsecs_t lastBytesUpdateTime;
 
         StreamSet() {
             allocatedBufferWaterMark = 0;
             maxAllowedBufferCount = 0;
+            allocatedBytes = 0;
+            peakAllocatedBytes = 0;
+            allocatedByteNs = 0;
+            createTime = systemTime(SYSTEM_TIME_MONOTONIC);
+            lastBytesUpdateTime = createTime;
         }
     };
 
@@ -324,6 +381,33 @@ private:
      * free one if so.
      */
     status_t checkAndFreeBufferOnOtherStreamsLocked(int streamId, StreamSetKey streamSetKey);
+
+    /**
+     * Record that a stream timed out waiting for a free buffer on dequeue, and let it keep more
+     * spare buffers. Allocations that did not wait are not recorded.
+     */
+    void onStreamStallLocked(StreamSet& streamSet, int streamId);
+
+    /**
+     * Update the buffer statistics of a stream after it released a buffer, and lower its free
+     * threshold if it has been running steadily for a whole window.
+     */
+    void updateStatsOnReleaseLocked(StreamSet& streamSet, int streamId, size_t handoutCount);
+
+    /**
+     * The largest free threshold of the streams in a stream set.
+     */
+    static size_t maxFreeThresholdLocked(const StreamSet& streamSet);
+
+    /**
+     * Recompute the memory held by a stream set after its attached buffer counts changed.
+     */
+    static void updateAllocatedBytesLocked(StreamSet& streamSet);
+
+    /**
+     * Estimate the size of one buffer of a stream.
+     */
+    static size_t estimateBufferBytes(const StreamInfo& info);
 };
 
 } // namespace camera3
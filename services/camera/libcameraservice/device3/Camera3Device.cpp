@@ -597,6 +597,7 @@ status_t Camera3Device::dump(int fd, const Vector<String16> &args) {
     if (mRequestThread != NULL) {
         mRequestThread->dumpCaptureRequestLatency(fd,
                 "    ProcessCaptureRequest latency histogram:");
+        mRequestThread->dumpSettingsReuse(fd, "    Request settings:");
     }
 
     {
@@ -1363,16 +1364,19 @@ status_t Camera3Device::filterParamsAndConfigureLocked(const CameraMetadata& ses
     filteredParams.unlock(meta);
     if (availableSessionKeys.count > 0) {
         bool rotateAndCropSessionKey = false;
+        std::vector<camera_metadata_ro_entry> entries;
+        entries.reserve(availableSessionKeys.count);
         for (size_t i = 0; i < availableSessionKeys.count; i++) {
             camera_metadata_ro_entry entry = params.find(
                     availableSessionKeys.data.i32[i]);
             if (entry.count > 0) {
-                filteredParams.update(entry);
+                entries.push_back(entry);
             }
             if (ANDROID_SCALER_ROTATE_AND_CROP == availableSessionKeys.data.i32[i]) {
                 rotateAndCropSessionKey = true;
             }
         }
+        filteredParams.update(entries);
 
         if (rotateAndCropSessionKey) {
             sp<CaptureRequest> request = new CaptureRequest();
@@ -2951,6 +2955,10 @@ Camera3Device::RequestThread::RequestThread(wp<Camera3Device> parent,
         mDoPause(false),
         mPaused(true),
         mNotifyPipelineDrain(false),
+        mPrevSettingsFingerprint(0),
+        mSettingsSentCount(0),
+        mSettingsReusedCount(0),
+        mSettingsFingerprintMatchCount(0),
         mFrameNumber(0),
         mLatestRequestId(NAME_NOT_FOUND),
         mCurrentAfTriggerId(0),
@@ -3775,10 +3783,38 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
              * The request should be presorted so accesses in HAL
              *   are O(logn). Sidenote, sorting a sorted metadata is nop.
              */
-            captureRequest->mSettingsList.begin()->metadata.sort();
-            halRequest->settings = captureRequest->mSettingsList.begin()->metadata.getAndLock();
+            for (auto& settings : captureRequest->mSettingsList) {
+                settings.metadata.sort();
+            }
+
+            // A different request whose settings match the last ones sent doesn't need them
+            // sent again. Triggers and overrides always go out, as above, and so do requests
+            // that carry their own AF or precapture trigger.
+            const CameraMetadata& settings = captureRequest->mSettingsList.begin()->metadata;
+            camera_metadata_ro_entry_t afTrigger = settings.find(ANDROID_CONTROL_AF_TRIGGER);
+            camera_metadata_ro_entry_t aeTrigger =
+                    settings.find(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER);
+            bool hasTrigger = (afTrigger.count > 0 &&
+                            afTrigger.data.u8[0] != ANDROID_CONTROL_AF_TRIGGER_IDLE) ||
+                    (aeTrigger.count > 0 &&
+                            aeTrigger.data.u8[0] != ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE);
+            uint64_t fingerprint = settingsFingerprint(captureRequest->mSettingsList);
+            bool settingsUnchanged = mPrevRequest != nullptr && mPrevRequest != captureRequest &&
+                    !triggersMixedIn && !hasTrigger && !captureRequest->mRotateAndCropChanged &&
+                    !testPatternChanged && fingerprint == mPrevSettingsFingerprint &&
+                    settingsIdentical(captureRequest->mSettingsList, mPrevRequest->mSettingsList);
             mPrevRequest = captureRequest;
             mPrevCameraIdsWithZoom = cameraIdsWithZoom;
+            mPrevSettingsFingerprint = fingerprint;
+            if (settingsUnchanged) {
+                newRequest = false;
+                mSettingsFingerprintMatchCount++;
+            }
+        }
+
+        if (newRequest) {
+            halRequest->settings = captureRequest->mSettingsList.begin()->metadata.getAndLock();
+            mSettingsSentCount++;
             ALOGVV("%s: Request settings are NEW", __FUNCTION__);
 
             IF_ALOGV() {
@@ -3797,6 +3833,7 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
             }
         } else {
             // leave request.settings NULL to indicate 'reuse latest given'
+            mSettingsReusedCount++;
             ALOGVV("%s: Request settings are REUSED",
                    __FUNCTION__);
         }
@@ -4106,6 +4143,80 @@ void Camera3Device::RequestThread::resetPipelineDrain() {
     mStreamIdsToBeDrained.clear();
 }
 
+uint64_t Camera3Device::RequestThread::settingsFingerprint(
+        const PhysicalCameraSettingsList& settingsList) {
+    // 64-bit FNV-1a over the camera ids and the sorted entries, so that the result doesn't
+    // depend on the capacity or the data layout of the metadata buffers.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        }
+    };
+
+    for (const auto& settings : settingsList) {
+        mix(settings.cameraId.c_str(), settings.cameraId.size() + 1);
+        const camera_metadata_t* metadata = settings.metadata.getAndLock();
+        size_t entryCount = (metadata != nullptr) ? get_camera_metadata_entry_count(metadata) : 0;
+        mix(&entryCount, sizeof(entryCount));
+        for (size_t i = 0; i < entryCount; i++) {
+            camera_metadata_ro_entry_t entry;
+            if (get_camera_metadata_ro_entry(metadata, i, &entry) != OK) {
+                continue;
+            }
+            mix(&entry.tag, sizeof(entry.tag));
+            mix(&entry.type, sizeof(entry.type));
+            mix(&entry.count, sizeof(entry.count));
+            mix(entry.data.u8, entry.count * camera_metadata_type_size[entry.type]);
+        }
+        settings.metadata.unlock(metadata);
+    }
+    return hash;
+}
+
+bool Camera3Device::RequestThread::settingsIdentical(
+        const PhysicalCameraSettingsList& settingsList,
+        const PhysicalCameraSettingsList& prevSettingsList) {
+    if (settingsList.size() != prevSettingsList.size()) {
+        return false;
+    }
+    for (auto it = settingsList.begin(), prevIt = prevSettingsList.begin();
+            it != settingsList.end(); it++, prevIt++) {
+        if (it->cameraId != prevIt->cameraId) {
+            return false;
+        }
+        const camera_metadata_t* metadata = it->metadata.getAndLock();
+        const camera_metadata_t* prevMetadata = prevIt->metadata.getAndLock();
+        bool identical;
+        if (metadata == nullptr || prevMetadata == nullptr) {
+            identical = (metadata == prevMetadata);
+        } else {
+            size_t size = get_camera_metadata_size(metadata);
+            identical = size == get_camera_metadata_size(prevMetadata) &&
+                    memcmp(metadata, prevMetadata, size) == 0;
+        }
+        it->metadata.unlock(metadata);
+        prevIt->metadata.unlock(prevMetadata);
+        if (!identical) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Camera3Device::RequestThread::dumpSettingsReuse(int fd, const char* name) {
+    uint64_t sent = mSettingsSentCount;
+    uint64_t reused = mSettingsReusedCount;
+    uint64_t total = sent + reused;
+    String8 lines = String8::format("%s\n", name);
+    lines.appendFormat("      Sent to HAL: %" PRIu64 ", reused: %" PRIu64 " (%.1f%%),"
+            " matched by fingerprint: %" PRIu64 "\n", sent, reused,
+            total > 0 ? 100.0 * reused / total : 0.0,
+            mSettingsFingerprintMatchCount.load());
+    write(fd, lines.string(), lines.size());
+}
+
 void Camera3Device::RequestThread::clearPreviousRequest() {
     Mutex::Autolock l(mRequestLock);
     mPrevRequest.clear();
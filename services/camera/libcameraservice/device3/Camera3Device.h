@@ -20,6 +20,7 @@
 #include <utility>
 #include <unordered_map>
 #include <set>
+#include <atomic>
 
 #include <utils/Condition.h>
 #include <utils/Errors.h>
@@ -80,6 +81,7 @@ class Camera3Device :
             public camera3::FlushBufferInterface {
   friend class HidlCamera3Device;
   friend class AidlCamera3Device;
+  friend class Camera3DeviceTest;
   public:
 
     explicit Camera3Device(const String8& id, bool overrideForPerfClass, bool overrideToPortrait,
@@ -894,6 +896,9 @@ class Camera3Device :
             mRequestLatency.dump(fd, name);
         }
 
+        // dump how often request settings were sent to HAL or reused
+        void dumpSettingsReuse(int fd, const char* name);
+
         void signalPipelineDrain(const std::vector<int>& streamIds);
         void resetPipelineDrain();
 
@@ -908,6 +913,7 @@ class Camera3Device :
         status_t setHalInterface(sp<HalInterface> newHalInterface);
 
       protected:
+        friend class Camera3DeviceTest;
 
         virtual bool threadLoop();
 
@@ -1044,6 +1050,21 @@ class Camera3Device :
         int32_t            mPrevTriggers;
         std::set<std::string> mPrevCameraIdsWithZoom;
 
+        // Fingerprint of the settings last sent to HAL. A different request with the same
+        // fingerprint and the same settings bytes as mPrevRequest, such as the next request of
+        // a repeating burst, is sent with NULL settings. Only valid while mPrevRequest is set.
+        static uint64_t    settingsFingerprint(const PhysicalCameraSettingsList& settingsList);
+        // Whether both lists hold the same camera ids and byte-identical metadata. Rules out a
+        // fingerprint collision; settings laid out differently in memory never match.
+        static bool        settingsIdentical(const PhysicalCameraSettingsList& settingsList,
+                                             const PhysicalCameraSettingsList& prevSettingsList);
+        uint64_t           mPrevSettingsFingerprint;
+
+        // Counters for dumpSettingsReuse(), updated by the request thread only
+        std::atomic<uint64_t> mSettingsSentCount;
+        std::atomic<uint64_t> mSettingsReusedCount;
+        std::atomic<uint64_t> mSettingsFingerprintMatchCount;
+
         uint32_t           mFrameNumber;
 
         mutable Mutex      mLatestRequestMutex;
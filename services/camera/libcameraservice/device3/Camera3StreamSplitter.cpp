@@ -348,15 +348,10 @@ status_t Camera3StreamSplitter::removeOutputLocked(size_t surfaceId) {
 }
 
 status_t Camera3StreamSplitter::outputBufferLocked(const sp<IGraphicBufferProducer>& output,
-        const BufferItem& bufferItem, size_t surfaceId) {
+        const BufferItem& bufferItem,
+        const IGraphicBufferProducer::QueueBufferInput& queueInput, size_t surfaceId) {
     ATRACE_CALL();
     status_t res;
-    IGraphicBufferProducer::QueueBufferInput queueInput(
-            bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
-            bufferItem.mDataSpace, bufferItem.mCrop,
-            static_cast<int32_t>(bufferItem.mScalingMode),
-            bufferItem.mTransform, bufferItem.mFence);
-
     IGraphicBufferProducer::QueueBufferOutput queueOutput;
 
     uint64_t bufferId = bufferItem.mGraphicBuffer->getId();
@@ -535,6 +530,13 @@ void Camera3StreamSplitter::onFrameAvailable(const BufferItem& /*item*/) {
 
     // Attach and queue the buffer to each of the outputs
     BufferTracker& tracker = *(mBuffers[bufferId]);
+    tracker.setInputSlot(bufferItem.mSlot);
+
+    IGraphicBufferProducer::QueueBufferInput queueInput(
+            bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
+            bufferItem.mDataSpace, bufferItem.mCrop,
+            static_cast<int32_t>(bufferItem.mScalingMode),
+            bufferItem.mTransform, bufferItem.mFence);
 
     SP_LOGV("%s: BufferTracker for buffer %" PRId64 ", number of requests %zu",
            __FUNCTION__, bufferItem.mGraphicBuffer->getId(), tracker.requestedSurfaces().size());
@@ -545,7 +547,7 @@ void Camera3StreamSplitter::onFrameAvailable(const BufferItem& /*item*/) {
             continue;
         }
 
-        res = outputBufferLocked(mOutputs[id], bufferItem, id);
+        res = outputBufferLocked(mOutputs[id], bufferItem, queueInput, id);
         if (res != OK) {
             SP_LOGE("%s: outputBufferLocked failed %d", __FUNCTION__, res);
             mOnFrameAvailableRes.store(res);
@@ -566,11 +568,12 @@ void Camera3StreamSplitter::onFrameReplaced(const BufferItem& item) {
 void Camera3StreamSplitter::decrementBufRefCountLocked(uint64_t id, size_t surfaceId) {
     ATRACE_CALL();
 
-    if (mBuffers[id] == nullptr) {
+    auto it = mBuffers.find(id);
+    if (it == mBuffers.end() || it->second == nullptr) {
         return;
     }
 
-    size_t referenceCount = mBuffers[id]->decrementReferenceCountLocked(surfaceId);
+    size_t referenceCount = it->second->decrementReferenceCountLocked(surfaceId);
     if (referenceCount > 0) {
         return;
     }
@@ -580,20 +583,27 @@ void Camera3StreamSplitter::decrementBufRefCountLocked(uint64_t id, size_t surfa
     // releaseBuffer, to avoid the case where the same bufferId is acquired in
     // attachBufferToOutputs resulting in a new BufferTracker with same bufferId
     // overwrites the current one.
-    std::unique_ptr<BufferTracker> tracker_ptr = std::move(mBuffers[id]);
-    mBuffers.erase(id);
+    std::unique_ptr<BufferTracker> tracker_ptr = std::move(it->second);
+    mBuffers.erase(it);
 
     uint64_t bufferId = tracker_ptr->getBuffer()->getId();
     int consumerSlot = -1;
     uint64_t frameNumber;
-    auto inputSlot = mInputSlots.begin();
-    for (; inputSlot != mInputSlots.end(); inputSlot++) {
-        if (inputSlot->second.mGraphicBuffer->getId() == bufferId) {
-            consumerSlot = inputSlot->second.mSlot;
-            frameNumber = inputSlot->second.mFrameNumber;
-            break;
+    // The tracker knows the input slot once the buffer has been acquired from the input,
+    // which saves searching the input slots on every release.
+    auto inputSlot = mInputSlots.find(tracker_ptr->getInputSlot());
+    if (inputSlot == mInputSlots.end() ||
+            inputSlot->second.mGraphicBuffer->getId() != bufferId) {
+        for (inputSlot = mInputSlots.begin(); inputSlot != mInputSlots.end(); inputSlot++) {
+            if (inputSlot->second.mGraphicBuffer->getId() == bufferId) {
+                break;
+            }
         }
     }
+    if (inputSlot != mInputSlots.end()) {
+        consumerSlot = inputSlot->second.mSlot;
+        frameNumber = inputSlot->second.mFrameNumber;
+    }
     if (consumerSlot == -1) {
         SP_LOGE("%s: Buffer missing inside input slots!", __FUNCTION__);
         return;
@@ -698,13 +708,18 @@ void Camera3StreamSplitter::returnOutputBufferLocked(const sp<Fence>& fence,
         return;
     }
 
-    auto outputSlots = *mOutputSlots[from];
+    auto& outputSlots = *mOutputSlots[from];
     buffer = outputSlots[slot];
-    BufferTracker& tracker = *(mBuffers[buffer->getId()]);
-    // Merge the release fence of the incoming buffer so that the fence we send
+    if (buffer == nullptr) {
+        SP_LOGE("%s: No buffer attached to slot %d", __FUNCTION__, slot);
+        return;
+    }
+    auto it = mBuffers.find(buffer->getId());
+    // Keep the release fence of the incoming buffer so that the fence we send
     // back to the input includes all of the outputs' fences
-    if (fence != nullptr && fence->isValid()) {
-        tracker.mergeFence(fence);
+    if (it != mBuffers.end() && it->second != nullptr && fence != nullptr &&
+            fence->isValid()) {
+        it->second->addReleaseFence(fence);
     }
 
     auto detachBuffer = mDetachedBuffers.find(buffer->getId());
@@ -795,11 +810,25 @@ void Camera3StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who
 
 Camera3StreamSplitter::BufferTracker::BufferTracker(
         const sp<GraphicBuffer>& buffer, const std::vector<size_t>& requestedSurfaces)
-      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mRequestedSurfaces(requestedSurfaces),
-        mReferenceCount(requestedSurfaces.size()) {}
+      : mBuffer(buffer), mRequestedSurfaces(requestedSurfaces),
+        mReferenceCount(requestedSurfaces.size()) {
+    mReleaseFences.reserve(requestedSurfaces.size());
+}
+
+void Camera3StreamSplitter::BufferTracker::addReleaseFence(const sp<Fence>& fence) {
+    mReleaseFences.push_back(fence);
+}
 
-void Camera3StreamSplitter::BufferTracker::mergeFence(const sp<Fence>& with) {
-    mMergedFence = Fence::merge(String8("Camera3StreamSplitter"), mMergedFence, with);
+sp<Fence> Camera3StreamSplitter::BufferTracker::getMergedFence() const {
+    // A single fence is passed on as is; merging creates a new sync file for every pair.
+    if (mReleaseFences.empty()) {
+        return Fence::NO_FENCE;
+    }
+    sp<Fence> merged = mReleaseFences[0];
+    for (size_t i = 1; i < mReleaseFences.size(); i++) {
+        merged = Fence::merge("Camera3StreamSplitter", merged, mReleaseFences[i]);
+    }
+    return merged;
 }
 
 size_t Camera3StreamSplitter::BufferTracker::decrementReferenceCountLocked(size_t surfaceId) {
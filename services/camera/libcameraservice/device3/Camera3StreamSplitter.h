@@ -21,7 +21,9 @@
 
 #include <camera/CameraMetadata.h>
 
+#include <gui/BufferItem.h>
 #include <gui/IConsumerListener.h>
+#include <gui/IGraphicBufferProducer.h>
 #include <gui/IProducerListener.h>
 #include <gui/BufferItemConsumer.h>
 
@@ -182,9 +184,18 @@ private:
         ~BufferTracker() = default;
 
         const sp<GraphicBuffer>& getBuffer() const { return mBuffer; }
-        const sp<Fence>& getMergedFence() const { return mMergedFence; }
 
-        void mergeFence(const sp<Fence>& with);
+        // Keep the release fence of one output. The fences are only merged
+        // by getMergedFence, once all outputs have released the buffer.
+        void addReleaseFence(const sp<Fence>& fence);
+
+        // Returns a fence that signals once all of the outputs' release
+        // fences have signaled.
+        sp<Fence> getMergedFence() const;
+
+        // Input queue slot the buffer was acquired at
+        void setInputSlot(int slot) { mInputSlot = slot; }
+        int getInputSlot() const { return mInputSlot; }
 
         // Returns the new value
         // Only called while mMutex is held
@@ -199,7 +210,9 @@ private:
         BufferTracker& operator=(const BufferTracker& other);
 
         sp<GraphicBuffer> mBuffer; // One instance that holds this native handle
-        sp<Fence> mMergedFence;
+        std::vector<sp<Fence>> mReleaseFences;
+
+        int mInputSlot = BufferItem::INVALID_BUFFER_SLOT;
 
         // Request surfaces for a particular buffer. And when the buffer becomes
         // available from the input queue, the registered surfaces are used to decide
@@ -217,9 +230,11 @@ private:
 
     // Send a buffer to particular output, and increment the reference count
     // of the buffer. If this output is abandoned, the buffer's reference count
-    // won't be incremented.
+    // won't be incremented. The queue input is the same for every output, so
+    // it is built once per frame by the caller.
     status_t outputBufferLocked(const sp<IGraphicBufferProducer>& output,
-            const BufferItem& bufferItem, size_t surfaceId);
+            const BufferItem& bufferItem,
+            const IGraphicBufferProducer::QueueBufferInput& queueInput, size_t surfaceId);
 
     // Get unique name for the buffer queue consumer
     String8 getUniqueConsumerName();
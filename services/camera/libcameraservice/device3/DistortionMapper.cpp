@@ -28,6 +28,30 @@ namespace android {
 
 namespace camera3 {
 
+namespace {
+
+// Apply the distortion model to a point in active array coordinates, giving the point in
+// pre-correction active array coordinates
+void correctedToRaw(const DistortionMapper::DistortionMapperInfo &info, float x, float y,
+        float *xr, float *yr) {
+    float activeCx = info.mCx - info.mArrayDiffX;
+    float activeCy = info.mCy - info.mArrayDiffY;
+    // Move to normalized space from active array space
+    float ywi = (y - activeCy) * info.mInvFy;
+    float xwi = (x - activeCx - info.mS * ywi) * info.mInvFx;
+    // Apply distortion model to calculate raw image coordinates
+    const std::array<float, 5> &kK = info.mK;
+    float rSq = xwi * xwi + ywi * ywi;
+    float Fr = 1.f + (kK[0] * rSq) + (kK[1] * rSq * rSq) + (kK[2] * rSq * rSq * rSq);
+    float xc = xwi * Fr + (kK[3] * 2 * xwi * ywi) + kK[4] * (rSq + 2 * xwi * xwi);
+    float yc = ywi * Fr + (kK[4] * 2 * xwi * ywi) + kK[3] * (rSq + 2 * ywi * ywi);
+    // Move back to image space
+    *xr = info.mFx * xc + info.mS * yc + info.mCx;
+    *yr = info.mFy * yc + info.mCy;
+}
+
+} // namespace
+
 
 DistortionMapper::DistortionMapper() {
     initRemappedKeys();
@@ -277,6 +301,21 @@ status_t DistortionMapper::mapRawToCorrected(int32_t *coordPairs, int coordCount
         if (res != OK) return res;
     }
 
+    if (mapperInfo->mValidLut) {
+        return mapRawToCorrectedLut(coordPairs, coordCount, mapperInfo, clamp);
+    }
+    return mapRawToCorrectedWithGrids(coordPairs, coordCount, mapperInfo, clamp);
+}
+
+status_t DistortionMapper::mapRawToCorrectedWithGrids(int32_t *coordPairs, int coordCount,
+        DistortionMapperInfo *mapperInfo, bool clamp) {
+    if (!mapperInfo->mValidMapping) return INVALID_OPERATION;
+
+    if (!mapperInfo->mValidGrids) {
+        status_t res = buildGrids(mapperInfo);
+        if (res != OK) return res;
+    }
+
     for (int i = 0; i < coordCount * 2; i += 2) {
         const GridQuad *quad = findEnclosingQuad(coordPairs + i, mapperInfo->mDistortedGrid);
         if (quad == nullptr) {
@@ -325,6 +364,65 @@ status_t DistortionMapper::mapRawToCorrected(int32_t *coordPairs, int coordCount
     return OK;
 }
 
+status_t DistortionMapper::mapRawToCorrectedLut(int32_t *coordPairs, int coordCount,
+        DistortionMapperInfo *mapperInfo, bool clamp) {
+    // Points are processed in blocks: finding the cells and interpolating are straight-line
+    // loops over the block, leaving only the table reads as gathers.
+    constexpr int kBlockSize = 16;
+    constexpr size_t kStride = kLutSize + 1;
+    const float *lutX = mapperInfo->mLutCorrectedX.data();
+    const float *lutY = mapperInfo->mLutCorrectedY.data();
+    const float maxX = mapperInfo->mActiveWidth - 1;
+    const float maxY = mapperInfo->mActiveHeight - 1;
+
+    for (int start = 0; start < coordCount; start += kBlockSize) {
+        const int count = std::min(kBlockSize, coordCount - start);
+        int32_t *pts = coordPairs + start * 2;
+        float fracX[kBlockSize], fracY[kBlockSize];
+        int32_t cell[kBlockSize];
+        bool inside[kBlockSize];
+
+        for (int k = 0; k < count; k++) {
+            float gx = (pts[2 * k] - mapperInfo->mLutOriginX) * mapperInfo->mLutInvSpacingX;
+            float gy = (pts[2 * k + 1] - mapperInfo->mLutOriginY) * mapperInfo->mLutInvSpacingY;
+            inside[k] = gx >= 0 && gx < kLutSize && gy >= 0 && gy < kLutSize;
+            float cx = std::min(std::max(std::floor(gx), 0.f), kLutSize - 1.f);
+            float cy = std::min(std::max(std::floor(gy), 0.f), kLutSize - 1.f);
+            fracX[k] = gx - cx;
+            fracY[k] = gy - cy;
+            cell[k] = static_cast<int32_t>(cy) * kStride + static_cast<int32_t>(cx);
+        }
+
+        for (int k = 0; k < count; k++) {
+            if (!inside[k]) {
+                // Far outside of the pre-correction array; search the grids instead
+                status_t res = mapRawToCorrectedWithGrids(pts + 2 * k, 1, mapperInfo, clamp);
+                if (res != OK) return res;
+                continue;
+            }
+            const float *x0 = lutX + cell[k], *x1 = x0 + kStride;
+            const float *y0 = lutY + cell[k], *y1 = y0 + kStride;
+            float top = x0[0] + fracX[k] * (x0[1] - x0[0]);
+            float bottom = x1[0] + fracX[k] * (x1[1] - x1[0]);
+            float corrX = top + fracY[k] * (bottom - top);
+            top = y0[0] + fracX[k] * (y0[1] - y0[0]);
+            bottom = y1[0] + fracX[k] * (y1[1] - y1[0]);
+            float corrY = top + fracY[k] * (bottom - top);
+
+            // Clamp to within active array
+            if (clamp) {
+                corrX = std::min(maxX, std::max(0.f, corrX));
+                corrY = std::min(maxY, std::max(0.f, corrY));
+            }
+
+            pts[2 * k] = static_cast<int32_t>(std::round(corrX));
+            pts[2 * k + 1] = static_cast<int32_t>(std::round(corrY));
+        }
+    }
+
+    return OK;
+}
+
 status_t DistortionMapper::mapRawToCorrectedSimple(int32_t *coordPairs, int coordCount,
        const DistortionMapperInfo *mapperInfo, bool clamp) const {
     if (!mapperInfo->mValidMapping) return INVALID_OPERATION;
@@ -383,21 +481,9 @@ status_t DistortionMapper::mapCorrectedToRawImpl(T *coordPairs, int coordCount,
 
     if (simple) return mapCorrectedToRawImplSimple(coordPairs, coordCount, mapperInfo, clamp);
 
-    float activeCx = mapperInfo->mCx - mapperInfo->mArrayDiffX;
-    float activeCy = mapperInfo->mCy - mapperInfo->mArrayDiffY;
     for (int i = 0; i < coordCount * 2; i += 2) {
-        // Move to normalized space from active array space
-        float ywi = (coordPairs[i + 1] - activeCy) * mapperInfo->mInvFy;
-        float xwi = (coordPairs[i] - activeCx - mapperInfo->mS * ywi) * mapperInfo->mInvFx;
-        // Apply distortion model to calculate raw image coordinates
-        const std::array<float, 5> &kK = mapperInfo->mK;
-        float rSq = xwi * xwi + ywi * ywi;
-        float Fr = 1.f + (kK[0] * rSq) + (kK[1] * rSq * rSq) + (kK[2] * rSq * rSq * rSq);
-        float xc = xwi * Fr + (kK[3] * 2 * xwi * ywi) + kK[4] * (rSq + 2 * xwi * xwi);
-        float yc = ywi * Fr + (kK[4] * 2 * xwi * ywi) + kK[3] * (rSq + 2 * ywi * ywi);
-        // Move back to image space
-        float xr = mapperInfo->mFx * xc + mapperInfo->mS * yc + mapperInfo->mCx;
-        float yr = mapperInfo->mFy * yc + mapperInfo->mCy;
+        float xr, yr;
+        correctedToRaw(*mapperInfo, coordPairs[i], coordPairs[i + 1], &xr, &yr);
         // Clamp to within pre-correction active array
         if (clamp) {
             xr = std::min(mapperInfo->mArrayWidth - 1, std::max(0.f, xr));
@@ -488,10 +574,94 @@ status_t DistortionMapper::buildGrids(DistortionMapperInfo *mapperInfo) {
         }
     }
 
+    buildLut(mapperInfo);
+
     mapperInfo->mValidGrids = true;
     return OK;
 }
 
+void DistortionMapper::buildLut(DistortionMapperInfo *mapperInfo) {
+    constexpr size_t kStride = kLutSize + 1;
+    mapperInfo->mValidLut = false;
+    mapperInfo->mLutCorrectedX.resize(kStride * kStride);
+    mapperInfo->mLutCorrectedY.resize(kStride * kStride);
+
+    // Same domain as the grids
+    float margin = mapperInfo->mArrayWidth * kGridMargin;
+    mapperInfo->mLutOriginX = -margin;
+    mapperInfo->mLutOriginY = -margin;
+    mapperInfo->mLutSpacingX = (mapperInfo->mArrayWidth + 2 * margin) / kLutSize;
+    mapperInfo->mLutSpacingY = (mapperInfo->mArrayHeight + 2 * margin) / kLutSize;
+    mapperInfo->mLutInvSpacingX = 1 / mapperInfo->mLutSpacingX;
+    mapperInfo->mLutInvSpacingY = 1 / mapperInfo->mLutSpacingY;
+
+    // Invert the distortion model at each node with Newton's method. The first guess is
+    // extrapolated from the two previous nodes of the row, so usually one step is enough.
+    // Neighboring nodes have nearly the same Jacobian, so it is only recomputed when the
+    // iteration stops converging quickly.
+    float j00 = 1, j01 = 0, j10 = 0, j11 = 1;
+    for (size_t j = 0; j < kStride; j++) {
+        float rawY = mapperInfo->mLutOriginY + j * mapperInfo->mLutSpacingY;
+        float *rowX = &mapperInfo->mLutCorrectedX[j * kStride];
+        float *rowY = &mapperInfo->mLutCorrectedY[j * kStride];
+        bool updateJacobian = true;
+        for (size_t i = 0; i < kStride; i++) {
+            float rawX = mapperInfo->mLutOriginX + i * mapperInfo->mLutSpacingX;
+            float x, y;
+            if (i >= 2) {
+                x = 2 * rowX[i - 1] - rowX[i - 2];
+                y = 2 * rowY[i - 1] - rowY[i - 2];
+            } else if (i == 1) {
+                x = rowX[0] + mapperInfo->mLutSpacingX;
+                y = rowY[0];
+            } else if (j > 0) {
+                x = mapperInfo->mLutCorrectedX[(j - 1) * kStride];
+                y = mapperInfo->mLutCorrectedY[(j - 1) * kStride] + mapperInfo->mLutSpacingY;
+            } else {
+                x = rawX - mapperInfo->mArrayDiffX;
+                y = rawY - mapperInfo->mArrayDiffY;
+            }
+            bool converged = false;
+            for (int iteration = 0; iteration < kLutMaxIterations; iteration++) {
+                float xr, yr;
+                correctedToRaw(*mapperInfo, x, y, &xr, &yr);
+                float errX = xr - rawX;
+                float errY = yr - rawY;
+                if (std::fabs(errX) < kLutMaxResidual && std::fabs(errY) < kLutMaxResidual) {
+                    converged = true;
+                    break;
+                }
+
+                if (updateJacobian || iteration >= 2) {
+                    // Forward differences of one pixel
+                    float dxX, dxY, dyX, dyY;
+                    correctedToRaw(*mapperInfo, x + 1, y, &dxX, &dxY);
+                    correctedToRaw(*mapperInfo, x, y + 1, &dyX, &dyY);
+                    j00 = dxX - xr;
+                    j10 = dxY - yr;
+                    j01 = dyX - xr;
+                    j11 = dyY - yr;
+                    updateJacobian = false;
+                }
+                float det = j00 * j11 - j01 * j10;
+                if (!std::isfinite(det) || std::fabs(det) < kFloatFuzz) break;
+
+                x -= (j11 * errX - j01 * errY) / det;
+                y -= (j00 * errY - j10 * errX) / det;
+            }
+            if (!converged) {
+                ALOGW("Unable to invert distortion model at raw (%f, %f); not using lookup table",
+                        rawX, rawY);
+                return;
+            }
+            rowX[i] = x;
+            rowY[i] = y;
+        }
+    }
+
+    mapperInfo->mValidLut = true;
+}
+
 const DistortionMapper::GridQuad* DistortionMapper::findEnclosingQuad(
         const int32_t pt[2], const std::vector<GridQuad>& grid) {
     const float x = pt[0];
@@ -91,6 +91,13 @@ class DistortionMapper : public CoordinateMapper {
     status_t mapRawToCorrected(int32_t *coordPairs, int coordCount,
             DistortionMapperInfo *mapperInfo, bool clamp, bool simple = true);
 
+    /**
+     * Same as mapRawToCorrected with simple == false, but always searches the quad grids
+     * instead of using the lookup table. Slow; kept as the reference for the table.
+     */
+    status_t mapRawToCorrectedWithGrids(int32_t *coordPairs, int coordCount,
+            DistortionMapperInfo *mapperInfo, bool clamp);
+
     /**
      * Transform from distorted (original) to corrected (warped) coordinates.
      * Coordinates are transformed in-place
@@ -155,6 +162,16 @@ class DistortionMapper : public CoordinateMapper {
 
         std::vector<GridQuad> mCorrectedGrid;
         std::vector<GridQuad> mDistortedGrid;
+
+        // Corrected coordinates sampled on a regular (kLutSize + 1)^2 grid of raw coordinates
+        // covering the pre-correction array plus a margin; bilinearly interpolated in between.
+        // Built with the grids; invalid if the distortion model could not be inverted.
+        bool mValidLut = false;
+        float mLutOriginX, mLutOriginY;
+        float mLutSpacingX, mLutSpacingY;
+        float mLutInvSpacingX, mLutInvSpacingY;
+        std::vector<float> mLutCorrectedX;
+        std::vector<float> mLutCorrectedY;
     };
 
     // Find which grid quad encloses the point; returns null if none do
@@ -188,6 +205,11 @@ class DistortionMapper : public CoordinateMapper {
     constexpr static float kGridMargin = 0.05f;
     // Fuzziness for float inequality tests
     constexpr static float kFloatFuzz = 1e-4;
+    // Number of cells in each dimension of the raw to corrected lookup table
+    constexpr static size_t kLutSize = 128;
+    // Maximum residual, in pixels, when inverting the distortion model for the table
+    constexpr static float kLutMaxResidual = 1e-2;
+    constexpr static int kLutMaxIterations = 20;
 
     bool mMaxResolution = false;
 
@@ -206,9 +228,17 @@ class DistortionMapper : public CoordinateMapper {
     status_t mapRawToCorrectedSimple(int32_t *coordPairs, int coordCount,
             const DistortionMapperInfo *mapperInfo, bool clamp) const;
 
+    // Lookup table implementation of mapRawToCorrected; falls back to the grids for points
+    // outside of the table
+    status_t mapRawToCorrectedLut(int32_t *coordPairs, int coordCount,
+            DistortionMapperInfo *mapperInfo, bool clamp);
+
     // Utility to create reverse mapping grids
     status_t buildGrids(DistortionMapperInfo *mapperInfo);
 
+    // Utility to create the raw to corrected lookup table; called by buildGrids
+    static void buildLut(DistortionMapperInfo *mapperInfo);
+
     DistortionMapperInfo mDistortionMapperInfo;
     DistortionMapperInfo mDistortionMapperInfoMaximumResolution;
 
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "Camera3BufferManagerTest"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+
+#include <ui/GraphicBuffer.h>
+#include <ui/PixelFormat.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
+
+#include "../device3/Camera3BufferManager.h"
+#include "../device3/Camera3OutputStream.h"
+
+using namespace android;
+using namespace android::camera3;
+
+namespace {
+
+const int kStreamId = 1;
+const int kStreamSetId = 1;
+const uint32_t kWidth = 64;
+const uint32_t kHeight = 48;
+const size_t kTotalBufferCount = 8;
+
+// Mirrors the private constants of Camera3BufferManager.
+const size_t kInitialFreeThreshold = 3;
+const size_t kMinFreeThreshold = 1;
+const size_t kMaxFreeThreshold = 8;
+const size_t kStallFreeThresholdInc = 2;
+const size_t kAdaptWindowReleases = 30;
+
+class Camera3BufferManagerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mManager = new Camera3BufferManager();
+        StreamInfo info(kStreamId, kStreamSetId, kWidth, kHeight, PIXEL_FORMAT_RGBA_8888,
+                HAL_DATASPACE_UNKNOWN, GraphicBuffer::USAGE_SW_READ_OFTEN, kTotalBufferCount,
+                /*configured*/ true);
+        wp<Camera3OutputStream> stream;
+        ASSERT_EQ(OK, mManager->registerStream(stream, info));
+    }
+
+    void TearDown() override {
+        EXPECT_EQ(OK, mManager->unregisterStream(kStreamId, kStreamSetId, /*isMultiRes*/ false));
+    }
+
+    // Hands out one buffer, as the stream does when it dequeues. timedOut tells that the
+    // stream waited for a free buffer in vain.
+    void getBuffer(bool timedOut = false) {
+        sp<GraphicBuffer> buffer;
+        int fenceFd = -1;
+        status_t res = mManager->getBufferForStream(kStreamId, kStreamSetId,
+                /*isMultiRes*/ false, &buffer, &fenceFd, timedOut);
+        ASSERT_TRUE(res == OK || res == ALREADY_EXISTS) << "getBufferForStream: " << res;
+        if (fenceFd >= 0) {
+            close(fenceFd);
+        }
+    }
+
+    // Returns one buffer, and frees it if the manager asks to, like the stream does.
+    void releaseBuffer() {
+        bool shouldFreeBuffer = false;
+        ASSERT_EQ(OK, mManager->onBufferReleased(kStreamId, kStreamSetId,
+                /*isMultiRes*/ false, &shouldFreeBuffer));
+        if (shouldFreeBuffer) {
+            mManager->notifyBufferRemoved(kStreamId, kStreamSetId, /*isMultiRes*/ false);
+        }
+    }
+
+    // One buffer in flight at a time, the steady state of a stream.
+    void cycleBuffers(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            ASSERT_NO_FATAL_FAILURE(getBuffer());
+            ASSERT_NO_FATAL_FAILURE(releaseBuffer());
+        }
+    }
+
+    // The adaptive state isn't exposed, so read it back from the dump.
+    size_t freeThreshold() { return dumpedValue("free threshold: "); }
+    size_t stallCount() { return dumpedValue("stalls: "); }
+
+    size_t dumpedValue(const std::string& label) {
+        TemporaryFile file;
+        mManager->dump(file.fd, Vector<String16>());
+        std::string dump;
+        EXPECT_TRUE(base::ReadFileToString(file.path, &dump));
+        std::string key = "stream id: " + std::to_string(kStreamId) + ", free threshold";
+        size_t pos = dump.find(key);
+        EXPECT_NE(std::string::npos, pos) << dump;
+        pos = dump.find(label, pos);
+        EXPECT_NE(std::string::npos, pos) << dump;
+        if (pos == std::string::npos) {
+            return 0;
+        }
+        return std::stoul(dump.substr(pos + label.size()));
+    }
+
+    sp<Camera3BufferManager> mManager;
+};
+
+TEST_F(Camera3BufferManagerTest, ThresholdDecaysOncePerWindow) {
+    ASSERT_EQ(kInitialFreeThreshold, freeThreshold());
+
+    ASSERT_NO_FATAL_FAILURE(cycleBuffers(kAdaptWindowReleases - 1));
+    EXPECT_EQ(kInitialFreeThreshold, freeThreshold());
+    ASSERT_NO_FATAL_FAILURE(cycleBuffers(1));
+    EXPECT_EQ(kInitialFreeThreshold - 1, freeThreshold());
+
+    ASSERT_NO_FATAL_FAILURE(cycleBuffers(kAdaptWindowReleases - 1));
+    EXPECT_EQ(kInitialFreeThreshold - 1, freeThreshold());
+    ASSERT_NO_FATAL_FAILURE(cycleBuffers(1));
+    EXPECT_EQ(kInitialFreeThreshold - 2, freeThreshold());
+}
+
+TEST_F(Camera3BufferManagerTest, ThresholdStopsAtMin) {
+    ASSERT_NO_FATAL_FAILURE(cycleBuffers(kAdaptWindowReleases * (kInitialFreeThreshold + 5)));
+    EXPECT_EQ(kMinFreeThreshold, freeThreshold());
+    EXPECT_EQ(0u, stallCount());
+}
+
+TEST_F(Camera3BufferManagerTest, ThresholdGrowsOnStall) {
+    ASSERT_NO_FATAL_FAILURE(getBuffer(/*timedOut*/ true));
+    EXPECT_EQ(kInitialFreeThreshold + kStallFreeThresholdInc, freeThreshold());
+    EXPECT_EQ(1u, stallCount());
+    ASSERT_NO_FATAL_FAILURE(releaseBuffer());
+
+    // A stall starts a new window.
+    ASSERT_NO_FATAL_FAILURE(cycleBuffers(kAdaptWindowReleases - 2));
+    EXPECT_EQ(kInitialFreeThreshold + kStallFreeThresholdInc, freeThreshold());
+    ASSERT_NO_FATAL_FAILURE(cycleBuffers(1));
+    EXPECT_EQ(kInitialFreeThreshold + kStallFreeThresholdInc - 1, freeThreshold());
+}
+
+TEST_F(Camera3BufferManagerTest, ThresholdStopsAtMax) {
+    size_t stalls = 0;
+    for (size_t expected = kInitialFreeThreshold; expected < kMaxFreeThreshold;
+            expected += kStallFreeThresholdInc) {
+        ASSERT_NO_FATAL_FAILURE(getBuffer(/*timedOut*/ true));
+        ASSERT_NO_FATAL_FAILURE(releaseBuffer());
+        stalls++;
+    }
+    EXPECT_EQ(kMaxFreeThreshold, freeThreshold());
+
+    ASSERT_NO_FATAL_FAILURE(getBuffer(/*timedOut*/ true));
+    ASSERT_NO_FATAL_FAILURE(releaseBuffer());
+    stalls++;
+    EXPECT_EQ(kMaxFreeThreshold, freeThreshold());
+    EXPECT_EQ(stalls, stallCount());
+}
+
+TEST_F(Camera3BufferManagerTest, AllocationWithoutWaitIsNotAStall) {
+    ASSERT_NO_FATAL_FAILURE(cycleBuffers(kAdaptWindowReleases * (kInitialFreeThreshold + 5)));
+    ASSERT_EQ(kMinFreeThreshold, freeThreshold());
+
+    // The pipeline deepens once warmed up: the extra buffers are allocated right away.
+    ASSERT_NO_FATAL_FAILURE(getBuffer());
+    ASSERT_NO_FATAL_FAILURE(getBuffer());
+    ASSERT_NO_FATAL_FAILURE(getBuffer());
+    EXPECT_EQ(kMinFreeThreshold, freeThreshold());
+    EXPECT_EQ(0u, stallCount());
+    ASSERT_NO_FATAL_FAILURE(releaseBuffer());
+    ASSERT_NO_FATAL_FAILURE(releaseBuffer());
+    ASSERT_NO_FATAL_FAILURE(releaseBuffer());
+    EXPECT_EQ(kMinFreeThreshold, freeThreshold());
+}
+
+}  // namespace
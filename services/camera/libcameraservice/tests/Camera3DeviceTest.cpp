@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "Camera3DeviceTest"
+
+#include <gtest/gtest.h>
+
+#include "../device3/Camera3Device.h"
+
+namespace android {
+
+typedef CameraDeviceBase::PhysicalCameraSettingsList SettingsList;
+
+// Tests how the request thread decides that the settings of a new request are the ones last
+// sent to HAL, and can be reused.
+class Camera3DeviceTest : public ::testing::Test {
+  protected:
+    static uint64_t fingerprint(const SettingsList& settingsList) {
+        return Camera3Device::RequestThread::settingsFingerprint(settingsList);
+    }
+
+    static bool identical(const SettingsList& settingsList, const SettingsList& prevSettingsList) {
+        return Camera3Device::RequestThread::settingsIdentical(settingsList, prevSettingsList);
+    }
+
+    // Whether the request thread would send |settingsList| with NULL settings after
+    // |prevSettingsList|.
+    static bool reused(const SettingsList& settingsList, const SettingsList& prevSettingsList) {
+        return fingerprint(settingsList) == fingerprint(prevSettingsList) &&
+                identical(settingsList, prevSettingsList);
+    }
+
+    static void addSettings(SettingsList* settingsList, const std::string& cameraId,
+            int32_t exposureCompensation, size_t entryCapacity = 10) {
+        // Filled in place, a copy of the metadata would be trimmed to its size.
+        settingsList->push_back(CameraDeviceBase::PhysicalCameraSettings());
+        CameraDeviceBase::PhysicalCameraSettings& settings = *(--settingsList->end());
+        settings.cameraId = cameraId;
+        settings.metadata = CameraMetadata(entryCapacity, 100 /*dataCapacity*/);
+        uint8_t afMode = ANDROID_CONTROL_AF_MODE_CONTINUOUS_PICTURE;
+        settings.metadata.update(ANDROID_CONTROL_AF_MODE, &afMode, 1);
+        settings.metadata.update(ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION,
+                &exposureCompensation, 1);
+        int32_t cropRegion[4] = {0, 0, 4000, 3000};
+        settings.metadata.update(ANDROID_SCALER_CROP_REGION, cropRegion, 4);
+        settings.metadata.sort();
+    }
+};
+
+TEST_F(Camera3DeviceTest, IdenticalSettingsAreReused) {
+    SettingsList prev, next;
+    addSettings(&prev, "0", 1);
+    addSettings(&prev, "2", 1);
+    addSettings(&next, "0", 1);
+    addSettings(&next, "2", 1);
+
+    EXPECT_TRUE(reused(next, prev));
+}
+
+TEST_F(Camera3DeviceTest, ChangedSettingsAreSent) {
+    SettingsList prev;
+    addSettings(&prev, "0", 1);
+    addSettings(&prev, "2", 1);
+
+    // A changed value in a physical camera's settings.
+    SettingsList changedValue;
+    addSettings(&changedValue, "0", 1);
+    addSettings(&changedValue, "2", 2);
+    EXPECT_NE(fingerprint(prev), fingerprint(changedValue));
+    EXPECT_FALSE(identical(changedValue, prev));
+
+    // The same settings for another physical camera.
+    SettingsList changedCamera;
+    addSettings(&changedCamera, "0", 1);
+    addSettings(&changedCamera, "3", 1);
+    EXPECT_FALSE(reused(changedCamera, prev));
+
+    // Settings for fewer cameras.
+    SettingsList fewerCameras;
+    addSettings(&fewerCameras, "0", 1);
+    EXPECT_FALSE(reused(fewerCameras, prev));
+}
+
+TEST_F(Camera3DeviceTest, MatchingFingerprintIsCheckedAgainstBytes) {
+    SettingsList prev, next;
+    addSettings(&prev, "0", 1, 10 /*entryCapacity*/);
+    addSettings(&next, "0", 1, 20 /*entryCapacity*/);
+
+    // The fingerprint only covers the entries, the buffers differ in capacity.
+    EXPECT_EQ(fingerprint(prev), fingerprint(next));
+    EXPECT_FALSE(identical(next, prev));
+
+    // A settings update in place is caught too.
+    SettingsList updated;
+    addSettings(&updated, "0", 1);
+    EXPECT_TRUE(reused(updated, prev));
+    int32_t exposureCompensation = 3;
+    updated.begin()->metadata.update(ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION,
+            &exposureCompensation, 1);
+    EXPECT_FALSE(reused(updated, prev));
+}
+
+}  // namespace android
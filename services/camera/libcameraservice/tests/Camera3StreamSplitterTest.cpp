@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "Camera3StreamSplitterTest"
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <gui/BufferItemConsumer.h>
+#include <gui/BufferQueue.h>
+#include <gui/Surface.h>
+#include <system/window.h>
+#include <ui/GraphicBuffer.h>
+#include <ui/PixelFormat.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include "../device3/Camera3StreamSplitter.h"
+
+using namespace android;
+
+namespace {
+
+const uint32_t kWidth = 64;
+const uint32_t kHeight = 48;
+const PixelFormat kFormat = PIXEL_FORMAT_RGBA_8888;
+const size_t kHalMaxBuffers = 4;
+const int kWarmupFrames = 16;
+const int kMeasuredFrames = 500;
+
+// One output of the splitter, consumed in-process like a preview or video consumer would.
+struct FakeConsumer {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    sp<BufferItemConsumer> itemConsumer;
+    sp<Surface> surface;
+
+    FakeConsumer() {
+        BufferQueue::createBufferQueue(&producer, &consumer);
+        itemConsumer = new BufferItemConsumer(consumer, GraphicBuffer::USAGE_SW_READ_OFTEN,
+                /*maxAcquiredBufferCount*/ 1);
+        surface = new Surface(producer);
+    }
+};
+
+}  // namespace
+
+// Feeds frames through a splitter with 2, 3 and 4 outputs, the way
+// Camera3SharedOutputStream does, and reports the time spent per frame.
+class Camera3StreamSplitterTest : public ::testing::TestWithParam<size_t> {
+  protected:
+    void SetUp() override {
+        size_t consumerCount = GetParam();
+        std::unordered_map<size_t, sp<Surface>> surfaces;
+        for (size_t i = 0; i < consumerCount; i++) {
+            mConsumers.emplace_back();
+            surfaces[i] = mConsumers.back().surface;
+            mSurfaceIds.push_back(i);
+        }
+
+        mSplitter = new Camera3StreamSplitter();
+        ASSERT_EQ(OK, mSplitter->connect(surfaces, GraphicBuffer::USAGE_SW_READ_OFTEN,
+                GraphicBuffer::USAGE_SW_WRITE_OFTEN, kHalMaxBuffers, kWidth, kHeight, kFormat,
+                &mInput, ANDROID_REQUEST_AVAILABLE_DYNAMIC_RANGE_PROFILES_MAP_STANDARD));
+        ASSERT_NE(nullptr, mInput.get());
+
+        ANativeWindow *anw = mInput.get();
+        ASSERT_EQ(OK, native_window_api_connect(anw, NATIVE_WINDOW_API_CAMERA));
+        ASSERT_EQ(OK, native_window_set_buffers_dimensions(anw, kWidth, kHeight));
+        ASSERT_EQ(OK, native_window_set_buffers_format(anw, kFormat));
+        ASSERT_EQ(OK, native_window_set_usage(anw, GraphicBuffer::USAGE_SW_WRITE_OFTEN));
+    }
+
+    void TearDown() override {
+        if (mInput != nullptr) {
+            native_window_api_disconnect(mInput.get(), NATIVE_WINDOW_API_CAMERA);
+        }
+        if (mSplitter != nullptr) {
+            mSplitter->disconnect();
+        }
+    }
+
+    // Produces one frame and has every output consume and release it.
+    void runFrame(nsecs_t timestamp) {
+        ANativeWindow *anw = mInput.get();
+        ANativeWindowBuffer *anb;
+        int fenceFd = -1;
+        ASSERT_EQ(OK, anw->dequeueBuffer(anw, &anb, &fenceFd));
+        if (fenceFd >= 0) {
+            close(fenceFd);
+        }
+        ASSERT_EQ(OK, mSplitter->attachBufferToOutputs(anb, mSurfaceIds));
+        ASSERT_EQ(OK, native_window_set_buffers_timestamp(anw, timestamp));
+        ASSERT_EQ(OK, anw->queueBuffer(anw, anb, /*fenceFd*/ -1));
+        ASSERT_EQ(OK, mSplitter->getOnFrameAvailableResult());
+
+        for (auto &output : mConsumers) {
+            BufferItem item;
+            ASSERT_EQ(OK, output.itemConsumer->acquireBuffer(&item, /*presentWhen*/ 0));
+            EXPECT_EQ(timestamp, item.mTimestamp);
+            ASSERT_EQ(OK, output.itemConsumer->releaseBuffer(item));
+        }
+    }
+
+    sp<Camera3StreamSplitter> mSplitter;
+    std::vector<FakeConsumer> mConsumers;
+    std::vector<size_t> mSurfaceIds;
+    sp<Surface> mInput;
+};
+
+TEST_P(Camera3StreamSplitterTest, FanOutOverhead) {
+    nsecs_t timestamp = 0;
+    for (int i = 0; i < kWarmupFrames; i++) {
+        ASSERT_NO_FATAL_FAILURE(runFrame(++timestamp));
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kMeasuredFrames; i++) {
+        ASSERT_NO_FATAL_FAILURE(runFrame(++timestamp));
+    }
+    nsecs_t perFrame = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / kMeasuredFrames;
+
+    ALOGI("%zu consumers: %" PRId64 " ns per frame", GetParam(), perFrame);
+    RecordProperty("ns_per_frame", static_cast<int>(perFrame));
+}
+
+INSTANTIATE_TEST_SUITE_P(Consumers, Camera3StreamSplitterTest,
+        ::testing::Values(2, 3, 4));
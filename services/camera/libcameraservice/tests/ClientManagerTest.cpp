@@ -22,6 +22,9 @@
 #include "../utils/ClientManager.h"
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <thread>
+
 using namespace android::resource_policy;
 using namespace android;
 
@@ -143,3 +146,106 @@ TEST(ClientManagerTest, SingleOwnerMultipleCamera) {
     ASSERT_EQ(wouldBeEvicted.size(), 1u);
     ASSERT_EQ(wouldBeEvicted[0],cam0Desc) << "less important cam0 must be evicted";
 }
+
+// Test that clients contributing to the cost are evicted in LRU order, and only until the
+// incoming client fits.
+TEST(ClientManagerTest, CostEvictionOrder) {
+
+    TestClientManager cm;
+    std::vector<TestDescriptorPtr> descs;
+    for (int id = 0; id < 4; id++) {
+        TestClient client(id, /*cost*/25, /*conflicts*/{}, /*ownerId*/ 1000 + id,
+                PERCEPTIBLE_APP_ADJ, ActivityManager::PROCESS_STATE_PERSISTENT_UI,
+                /*isVendorClient*/ false);
+        descs.push_back(makeDescFromTestClient(client));
+        ASSERT_EQ(cm.addAndEvict(descs.back()).size(), 0u) << "Evicted list must be empty";
+    }
+
+    // At the max cost of 100, a 50 cost client needs the two LRU clients gone
+    TestClient fgClient(/*ID*/4, /*cost*/50, /*conflicts*/{}, /*ownerId*/ 2000,
+            FOREGROUND_APP_ADJ, ActivityManager::PROCESS_STATE_TOP, /*isVendorClient*/ false);
+    auto fgDesc = makeDescFromTestClient(fgClient);
+    auto wouldBeEvicted = cm.wouldEvict(fgDesc);
+    ASSERT_EQ(wouldBeEvicted.size(), 2u) << "Evicted list length must be 2";
+    for (size_t i = 0; i < wouldBeEvicted.size(); i++) {
+        ASSERT_EQ(wouldBeEvicted[i], descs[i]) << "Clients must be evicted in LRU order";
+    }
+
+    // A background client is blocked by all the clients with a cost
+    TestClient bgClient(/*ID*/5, /*cost*/50, /*conflicts*/{}, /*ownerId*/ 3000,
+            CACHED_APP_MAX_ADJ, ActivityManager::PROCESS_STATE_PERSISTENT_UI,
+            /*isVendorClient*/ false);
+    auto bgDesc = makeDescFromTestClient(bgClient);
+    wouldBeEvicted = cm.wouldEvict(bgDesc);
+    ASSERT_EQ(wouldBeEvicted.size(), 1u) << "Evicted list length must be 1";
+    ASSERT_EQ(wouldBeEvicted[0], bgDesc) << "bg client must be evicted";
+    auto incompatible = cm.getIncompatibleClients(bgDesc);
+    ASSERT_EQ(incompatible, descs) << "All clients must be incompatible, in LRU order";
+
+    // Once the other clients have a higher priority, the fg client can't make room anymore
+    std::map<int32_t, ClientPriority> priorities;
+    for (int id = 0; id < 4; id++) {
+        priorities.emplace(1000 + id, ClientPriority(NATIVE_ADJ,
+                ActivityManager::PROCESS_STATE_PERSISTENT, /*isVendorClient*/ false));
+    }
+    cm.updatePriorities(priorities);
+    wouldBeEvicted = cm.wouldEvict(fgDesc);
+    ASSERT_EQ(wouldBeEvicted.size(), 1u) << "Evicted list length must be 1";
+    ASSERT_EQ(wouldBeEvicted[0], fgDesc) << "fg client must be evicted";
+
+    auto evicted = cm.addAndEvict(fgDesc);
+    ASSERT_EQ(evicted.size(), 1u) << "Evicted list length must be 1";
+    ASSERT_EQ(cm.getAll(), descs) << "Active clients must not change";
+    ASSERT_EQ(cm.get(3), descs[3]);
+    ASSERT_EQ(cm.get(4), nullptr);
+}
+
+// Test that lookups and eviction queries see a consistent set of clients while another
+// thread connects and disconnects clients.
+TEST(ClientManagerTest, ConcurrentQueries) {
+
+    TestClientManager cm;
+    const int kKeys = 16;
+    const int kIterations = 2000;
+    std::atomic<bool> done(false);
+
+    std::thread writer([&]() {
+        for (int i = 0; i < kIterations; i++) {
+            int key = i % kKeys;
+            TestClient client(key, /*cost*/(i % 3) * 25, /*conflicts*/{(key + 1) % kKeys},
+                    /*ownerId*/ 1000 + i % 5, PERCEPTIBLE_APP_ADJ + (i % 4) * 100,
+                    ActivityManager::PROCESS_STATE_PERSISTENT_UI, /*isVendorClient*/ false);
+            cm.addAndEvict(makeDescFromTestClient(client));
+            if (i % 7 == 0) {
+                cm.remove((key + 3) % kKeys);
+            }
+        }
+        done = true;
+    });
+
+    size_t queries = 0;
+    while (!done) {
+        int key = queries % kKeys;
+        auto desc = cm.get(key);
+        if (desc != nullptr) {
+            ASSERT_EQ(desc->getKey(), key);
+        }
+        TestClient client(key, /*cost*/50, /*conflicts*/{}, /*ownerId*/ 3000,
+                FOREGROUND_APP_ADJ, ActivityManager::PROCESS_STATE_TOP,
+                /*isVendorClient*/ false);
+        auto incoming = makeDescFromTestClient(client);
+        for (const auto& i : cm.wouldEvict(incoming)) {
+            ASSERT_NE(i, nullptr);
+        }
+        auto all = cm.getAll();
+        std::set<int> keys;
+        for (const auto& i : all) {
+            ASSERT_TRUE(keys.insert(i->getKey()).second) << "Keys must be unique";
+        }
+        queries++;
+    }
+    writer.join();
+
+    ASSERT_GT(queries, 0u);
+    ASSERT_LE(cm.getAll().size(), static_cast<size_t>(kKeys));
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Builds depth photos from a DEPTH16 map of various sizes and orientations.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/cameraservice_depth_benchmark/cameraservice_depth_benchmark
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "../common/DepthPhotoProcessor.h"
+#include "../utils/ExifUtils.h"
+#include "NV12Compressor.h"
+
+using namespace android;
+using namespace android::camera3;
+
+namespace {
+
+const size_t kColorWidth = 640;
+const size_t kColorHeight = 480;
+const int kJpegQuality = 95;
+const size_t kSeed = 1234;
+
+// Main color image with a 0 degree EXIF orientation, so that the depth map gets rotated
+// physically.
+const std::vector<uint8_t> &getColorJpeg() {
+    static const std::vector<uint8_t> jpeg = [] {
+        std::vector<uint8_t> nv12(kColorWidth * kColorHeight * 3 / 2);
+        std::default_random_engine gen(kSeed);
+        std::uniform_int_distribution<int> uniDist(0, UINT8_MAX - 1);
+        for (auto &value : nv12) {
+            value = uniDist(gen);
+        }
+        NV12Compressor compressor;
+        if (!compressor.compressWithExifOrientation(nv12.data(), kColorWidth, kColorHeight,
+                kJpegQuality, ExifOrientation::ORIENTATION_0_DEGREES)) {
+            abort();
+        }
+        return compressor.getCompressedData();
+    }();
+    return jpeg;
+}
+
+// A smooth depth ramp with a few low confidence samples, closer to a real depth map than
+// random values, which matters for the JPEG encoding time.
+std::vector<uint16_t> generateDepth16(size_t width, size_t height) {
+    std::vector<uint16_t> depth(width * height);
+    std::default_random_engine gen(kSeed + 1);
+    std::uniform_int_distribution<int> confidenceDist(0, 7);
+    for (size_t i = 0; i < height; i++) {
+        for (size_t j = 0; j < width; j++) {
+            uint16_t range = 300 + (i * 4000) / height + (j * 1000) / width;
+            depth[i * width + j] = range | (confidenceDist(gen) << 13);
+        }
+    }
+    return depth;
+}
+
+}  // namespace
+
+// Args: depth map width (with a 4:3 aspect ratio), depth photo orientation.
+static void BM_ProcessDepthPhotoFrame(benchmark::State &state) {
+    size_t width = state.range(0);
+    size_t height = width * 3 / 4;
+    const std::vector<uint8_t> &colorJpeg = getColorJpeg();
+    std::vector<uint16_t> depth16 = generateDepth16(width, height);
+
+    DepthPhotoInputFrame inputFrame;
+    inputFrame.mMainJpegBuffer = reinterpret_cast<const char*> (colorJpeg.data());
+    inputFrame.mMainJpegSize = colorJpeg.size();
+    inputFrame.mMaxJpegSize = colorJpeg.size() + width * height * 2;
+    inputFrame.mMainJpegWidth = kColorWidth;
+    inputFrame.mMainJpegHeight = kColorHeight;
+    inputFrame.mJpegQuality = kJpegQuality;
+    inputFrame.mDepthMapBuffer = depth16.data();
+    inputFrame.mDepthMapWidth = inputFrame.mDepthMapStride = width;
+    inputFrame.mDepthMapHeight = height;
+    inputFrame.mOrientation = static_cast<DepthPhotoOrientation>(state.range(1));
+
+    std::vector<uint8_t> depthPhoto(inputFrame.mMaxJpegSize * 3);
+    for (auto _ : state) {
+        size_t actualSize = 0;
+        if (processDepthPhotoFrame(inputFrame, depthPhoto.size(), depthPhoto.data(),
+                &actualSize) != 0) {
+            state.SkipWithError("processDepthPhotoFrame failed");
+            break;
+        }
+        benchmark::DoNotOptimize(actualSize);
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+
+static void DepthPhotoArgs(benchmark::internal::Benchmark *b) {
+    for (int width : { 320, 640, 1280 }) {
+        for (int orientation : { 0, 90, 180, 270 }) {
+            b->Args({width, orientation});
+        }
+    }
+}
+
+BENCHMARK(BM_ProcessDepthPhotoFrame)->Apply(DepthPhotoArgs)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
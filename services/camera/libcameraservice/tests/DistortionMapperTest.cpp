@@ -307,7 +307,7 @@ void RandomTransformTest(::testing::Test *test,
 
 // Test a realistic distortion function with matching calibration values, enforcing
 // clamping.
-TEST(DistortionMapperTest, DISABLED_SmallTransform) {
+TEST(DistortionMapperTest, SmallTransform) {
     int32_t activeArray[] = {0, 8, 3278, 2450};
     int32_t preCorrectionActiveArray[] = {0, 0, 3280, 2464};
 
@@ -381,3 +381,115 @@ TEST(DistortionMapperTest, CompareToOpenCV) {
                 << expCoords[i] << ", " << expCoords[i + 1] << ")";
     }
 }
+
+// Map random raw points through the lookup table, then back through the distortion model, and
+// check that they land where they started. Also time the grid search the table replaces.
+void LutAccuracyTest(::testing::Test *test, float distortion[5], float intrinsics[5],
+        int32_t* activeArray, int32_t* preCorrectionActiveArray) {
+    constexpr int maxAllowedSqError = 2; // Within sqrt(2) pixels, as for OpenCV comparison
+    const size_t coordCount = 1e5;
+
+    DistortionMapper m;
+    setupTestMapper(&m, distortion, intrinsics, activeArray, preCorrectionActiveArray);
+    DistortionMapperInfo *mapperInfo = m.getMapperInfo();
+
+    std::default_random_engine gen(1234);
+    std::uniform_int_distribution<int> x_dist(0, preCorrectionActiveArray[2] - 1);
+    std::uniform_int_distribution<int> y_dist(0, preCorrectionActiveArray[3] - 1);
+    std::vector<int32_t> origCoords(coordCount * 2);
+    for (size_t i = 0; i < origCoords.size(); i += 2) {
+        origCoords[i] = x_dist(gen);
+        origCoords[i + 1] = y_dist(gen);
+    }
+
+    auto lutCoords = origCoords;
+    base::Timer lutTimer;
+    status_t res = m.mapRawToCorrected(lutCoords.data(), coordCount, mapperInfo,
+            /*clamp*/false, /*simple*/false);
+    auto lutDuration = lutTimer.duration();
+    ASSERT_EQ(res, OK);
+    ASSERT_TRUE(mapperInfo->mValidLut);
+
+    // The grid search can fail for points near the corners of strongly distorted arrays
+    auto gridCoords = origCoords;
+    base::Timer gridTimer;
+    res = m.mapRawToCorrectedWithGrids(gridCoords.data(), coordCount, mapperInfo,
+            /*clamp*/false);
+    auto gridDuration = gridTimer.duration();
+    test->RecordProperty("GridSearchSucceeded", res == OK);
+
+    res = m.mapCorrectedToRaw(lutCoords.data(), coordCount, mapperInfo, /*clamp*/false,
+            /*simple*/false);
+    ASSERT_EQ(res, OK);
+
+    float totalErrorSq = 0;
+    for (size_t i = 0; i < origCoords.size(); i += 2) {
+        int32_t errorX = lutCoords[i] - origCoords[i];
+        int32_t errorY = lutCoords[i + 1] - origCoords[i + 1];
+        int32_t errorSq = errorX * errorX + errorY * errorY;
+        EXPECT_LE(errorSq, maxAllowedSqError) << "(" << origCoords[i] << ", "
+                << origCoords[i + 1] << ") -> (" << lutCoords[i] << ", " << lutCoords[i + 1] << ")";
+        totalErrorSq += errorSq;
+    }
+
+    auto perCoordUs = [coordCount](auto duration) {
+        return (std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(
+                duration) / coordCount).count();
+    };
+    test->RecordProperty("GridDurationPerCoordUs",
+            base::StringPrintf("%f", perCoordUs(gridDuration)));
+    test->RecordProperty("LutDurationPerCoordUs",
+            base::StringPrintf("%f", perCoordUs(lutDuration)));
+    test->RecordProperty("RmsError",
+            base::StringPrintf("%f", std::sqrt(totalErrorSq / coordCount)));
+}
+
+TEST(DistortionMapperTest, LutSmallTransform) {
+    int32_t activeArray[] = {0, 8, 3278, 2450};
+    int32_t preCorrectionActiveArray[] = {0, 0, 3280, 2464};
+
+    float distortion[] = {0.06875723, -0.13922249, 0.02818312, -0.00032781, -0.00025431};
+    float intrinsics[] = {1812.50000000, 1812.50000000, 1645.59533691, 1229.23229980, 0.00000000};
+
+    LutAccuracyTest(this, distortion, intrinsics, activeArray, preCorrectionActiveArray);
+}
+
+TEST(DistortionMapperTest, LutLargeTransform) {
+    float bigDistortion[] = {0.1, -0.003, 0.004, 0.02, 0.01};
+
+    LutAccuracyTest(this, bigDistortion, testICal, testActiveArray, testPreCorrActiveArray);
+}
+
+TEST(DistortionMapperTest, LutRebuiltOnCalibrationChange) {
+    float bigDistortion[] = {0.1, -0.003, 0.004, 0.02, 0.01};
+
+    DistortionMapper m;
+    setupTestMapper(&m, identityDistortion, testICal,
+            /*activeArray*/testActiveArray,
+            /*preCorrectionActiveArray*/testActiveArray);
+    DistortionMapperInfo *mapperInfo = m.getMapperInfo();
+
+    std::array<int32_t, 12> coords = basicCoords;
+    ASSERT_EQ(m.mapRawToCorrected(coords.data(), 6, mapperInfo, /*clamp*/false,
+            /*simple*/false), OK);
+    ASSERT_TRUE(mapperInfo->mValidLut);
+    for (size_t i = 0; i < coords.size(); i++) {
+        EXPECT_EQ(coords[i], basicCoords[i]);
+    }
+
+    CameraMetadata captureResult;
+    captureResult.update(ANDROID_LENS_INTRINSIC_CALIBRATION, testICal, 5);
+    captureResult.update(ANDROID_LENS_DISTORTION, bigDistortion, 5);
+    ASSERT_EQ(m.updateCalibration(captureResult), OK);
+    ASSERT_FALSE(mapperInfo->mValidGrids);
+
+    // Points must now go through the new model
+    coords = basicCoords;
+    auto gridCoords = basicCoords;
+    ASSERT_EQ(m.mapRawToCorrected(coords.data(), 6, mapperInfo, /*clamp*/false,
+            /*simple*/false), OK);
+    ASSERT_EQ(m.mapRawToCorrectedWithGrids(gridCoords.data(), 6, mapperInfo, /*clamp*/false), OK);
+    for (size_t i = 0; i < coords.size(); i++) {
+        EXPECT_NEAR(coords[i], gridCoords[i], 1);
+    }
+}
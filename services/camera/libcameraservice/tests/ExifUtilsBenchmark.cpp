@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Generates the APP1 segment of a burst of captures, with libexif and with the template
+// writer.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/cameraservice_exif_benchmark/cameraservice_exif_benchmark
+
+#include <time.h>
+
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "../utils/ExifUtils.h"
+
+using namespace android::camera3;
+
+namespace {
+
+const uint32_t kImageWidth = 4032;
+const uint32_t kImageHeight = 3024;
+
+// The tags HeicCompositeStream sets for each capture, with the values that change from one
+// capture to the next.
+bool setCaptureTags(ExifUtils *utils, uint32_t frame, bool gps) {
+    time_t now = 1600000000 + frame;
+    struct tm time;
+    gmtime_r(&now, &time);
+    bool ok = utils->setImageWidth(kImageWidth) && utils->setImageHeight(kImageHeight) &&
+            utils->setDateTime(time) && utils->setSubsecTime(std::to_string(frame % 1000)) &&
+            utils->setFocalLength(4.38f) && utils->setFocalLengthIn35mmFilm(4.38f, 5.6f, 4.2f) &&
+            utils->setDigitalZoomRatio(kImageWidth, kImageHeight, kImageWidth, kImageHeight);
+    if (gps) {
+        ok = ok && utils->setGpsLatitude(37.42 + frame * 1e-6) &&
+                utils->setGpsLongitude(-122.08 - frame * 1e-6) &&
+                utils->setGpsAltitude(30.0) && utils->setGpsProcessingMethod("GPS") &&
+                utils->setGpsTimestamp(time);
+    }
+    return ok && utils->setExposureBias(0, 1, 3) && utils->setOrientation(90) &&
+            utils->setExposureTime(1.0f / (30 + frame % 100)) &&
+            utils->setShutterSpeed(1.0f / (30 + frame % 100)) &&
+            utils->setSubjectDistance(0.5f) && utils->setIsoSpeedRating(100 + frame % 700) &&
+            utils->setFNumber(1.8f) && utils->setAperture(1.8f) && utils->setMaxAperture(1.8f) &&
+            utils->setColorSpace(1) && utils->setFlash(1, 0, 1) && utils->setWhiteBalance(0) &&
+            utils->setExposureMode(0);
+}
+
+}  // namespace
+
+// Args: use the template writer, set the GPS tags.
+static void BM_GenerateApp1(benchmark::State &state) {
+    std::unique_ptr<ExifUtils> utils(state.range(0) ? ExifUtils::createWithTemplate() :
+            ExifUtils::create());
+    bool gps = state.range(1);
+    uint32_t frame = 0;
+    for (auto _ : state) {
+        if (!utils->initializeEmpty() || !setCaptureTags(utils.get(), frame++, gps) ||
+                !utils->generateApp1()) {
+            state.SkipWithError("Generating the APP1 segment failed");
+            break;
+        }
+        benchmark::DoNotOptimize(utils->getApp1Buffer());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_GenerateApp1)->ArgsProduct({{0, 1}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -21,6 +21,13 @@
 #include "../utils/ExifUtils.h"
 #include <gtest/gtest.h>
 
+#include <string.h>
+#include <time.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
 using android::camera3::ExifUtils;
 using android::camera3::ExifOrientation;
 using android::CameraMetadata;
@@ -53,3 +60,123 @@ TEST(ExifUtilsTest, SetFromMetadataTest) {
     size_t exifBufferSize = utils->getApp1Length();
     ASSERT_TRUE(exifBufferSize != 0);
 }
+
+// Sets the tags of one capture, with values that change from one capture to the next and
+// optional GPS tags.
+static void setCaptureTags(ExifUtils *utils, std::default_random_engine &gen, bool gps,
+        size_t processingMethodLength) {
+    std::uniform_int_distribution<int> dist(0, 999);
+    struct tm time = {};
+    time.tm_year = 120 + dist(gen) % 5;
+    time.tm_mon = dist(gen) % 12;
+    time.tm_mday = 1 + dist(gen) % 28;
+    time.tm_hour = dist(gen) % 24;
+    time.tm_min = dist(gen) % 60;
+    time.tm_sec = dist(gen) % 60;
+
+    ASSERT_TRUE(utils->setImageWidth(kImageWidth));
+    ASSERT_TRUE(utils->setImageHeight(kImageHeight));
+    ASSERT_TRUE(utils->setDateTime(time));
+    ASSERT_TRUE(utils->setSubsecTime(std::to_string(dist(gen))));
+    ASSERT_TRUE(utils->setFocalLength(4.38f));
+    ASSERT_TRUE(utils->setFocalLengthIn35mmFilm(4.38f, 5.6f, 4.2f));
+    ASSERT_TRUE(utils->setDigitalZoomRatio(kImageWidth, kImageHeight,
+            kImageWidth + dist(gen), kImageHeight + dist(gen)));
+    if (gps) {
+        ASSERT_TRUE(utils->setGpsLatitude(dist(gen) * 0.18 - 90));
+        ASSERT_TRUE(utils->setGpsLongitude(dist(gen) * 0.36 - 180));
+        ASSERT_TRUE(utils->setGpsAltitude(dist(gen) - 500.0));
+        ASSERT_TRUE(utils->setGpsProcessingMethod(std::string(processingMethodLength, 'G')));
+        ASSERT_TRUE(utils->setGpsTimestamp(time));
+    }
+    ASSERT_TRUE(utils->setExposureBias(dist(gen) % 7 - 3, 1, 3));
+    ASSERT_TRUE(utils->setOrientation((dist(gen) % 4) * 90));
+    ASSERT_TRUE(utils->setExposureTime(1.0f / (1 + dist(gen))));
+    ASSERT_TRUE(utils->setShutterSpeed(1.0f / (1 + dist(gen))));
+    ASSERT_TRUE(utils->setSubjectDistance(dist(gen) / 100.0f));
+    ASSERT_TRUE(utils->setIsoSpeedRating(100 + dist(gen)));
+    ASSERT_TRUE(utils->setFNumber(1.8f));
+    ASSERT_TRUE(utils->setAperture(1.8f));
+    ASSERT_TRUE(utils->setMaxAperture(1.8f));
+    ASSERT_TRUE(utils->setColorSpace(1));
+    ASSERT_TRUE(utils->setFlash(1, dist(gen) % 4, dist(gen) % 6));
+    ASSERT_TRUE(utils->setWhiteBalance(dist(gen) % 2));
+    ASSERT_TRUE(utils->setExposureMode(dist(gen) % 2));
+}
+
+static void expectSameApp1(ExifUtils *expected, ExifUtils *actual) {
+    ASSERT_EQ(expected->getApp1Length(), actual->getApp1Length());
+    EXPECT_EQ(0, memcmp(expected->getApp1Buffer(), actual->getApp1Buffer(),
+            expected->getApp1Length()));
+}
+
+// Test that the template writer produces the same APP1 segments as libexif, including when
+// the set of tags or the length of a string changes between captures.
+TEST(ExifUtilsTest, TemplateMatchesLibexifTest) {
+    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    std::unique_ptr<ExifUtils> templateUtils(ExifUtils::createWithTemplate());
+    for (int i = 0; i < 200; i++) {
+        bool gps = (i / 10) % 2 == 1;
+        size_t processingMethodLength = 3 + (i / 40) % 3;
+        std::default_random_engine gen(i), templateGen(i);
+
+        ASSERT_TRUE(utils->initializeEmpty());
+        ASSERT_NO_FATAL_FAILURE(setCaptureTags(utils.get(), gen, gps, processingMethodLength));
+        ASSERT_TRUE(utils->generateApp1());
+
+        ASSERT_TRUE(templateUtils->initializeEmpty());
+        ASSERT_NO_FATAL_FAILURE(setCaptureTags(templateUtils.get(), templateGen, gps,
+                processingMethodLength));
+        ASSERT_TRUE(templateUtils->generateApp1());
+
+        ASSERT_NO_FATAL_FAILURE(expectSameApp1(utils.get(), templateUtils.get()));
+    }
+}
+
+// Generates an APP1 segment like a HAL would, with its own values for the tags the capture sets
+// and GPS tags the capture doesn't set.
+static void makeHalApp1(std::default_random_engine &gen, bool gps, bool jpegMarker,
+        std::vector<uint8_t> *halApp1) {
+    std::unique_ptr<ExifUtils> halUtils(ExifUtils::create());
+    ASSERT_TRUE(halUtils->initializeEmpty());
+    ASSERT_NO_FATAL_FAILURE(setCaptureTags(halUtils.get(), gen, gps, 4));
+    ASSERT_TRUE(halUtils->generateApp1());
+    halApp1->clear();
+    if (jpegMarker) {
+        size_t length = halUtils->getApp1Length() + 2;
+        *halApp1 = {0xFF, 0xE1, static_cast<uint8_t>(length >> 8),
+                static_cast<uint8_t>(length & 0xFF)};
+    }
+    halApp1->insert(halApp1->end(), halUtils->getApp1Buffer(),
+            halUtils->getApp1Buffer() + halUtils->getApp1Length());
+}
+
+// Test that the template writer produces the same APP1 segments as libexif for APP1 segments
+// from the HAL, whose values change from one capture to the next, and when the tags of the HAL
+// segment change or captures without one come in between.
+TEST(ExifUtilsTest, TemplateWithAppSegmentTest) {
+    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    std::unique_ptr<ExifUtils> templateUtils(ExifUtils::createWithTemplate());
+    std::vector<uint8_t> halApp1;
+    for (int i = 0; i < 120; i++) {
+        bool useAppSegment = i % 7 != 6;
+        bool halGps = (i / 15) % 3 != 1;
+        std::default_random_engine halGen(1000 + i), gen(i), templateGen(i);
+        ASSERT_NO_FATAL_FAILURE(makeHalApp1(halGen, halGps, /*jpegMarker*/i % 2 == 0,
+                &halApp1));
+
+        ASSERT_TRUE(useAppSegment ? utils->initialize(halApp1.data(), halApp1.size()) :
+                utils->initializeEmpty());
+        ASSERT_NO_FATAL_FAILURE(setCaptureTags(utils.get(), gen, /*gps*/false, 4));
+        ASSERT_TRUE(utils->generateApp1());
+
+        ASSERT_TRUE(useAppSegment ?
+                templateUtils->initialize(halApp1.data(), halApp1.size()) :
+                templateUtils->initializeEmpty());
+        ASSERT_NO_FATAL_FAILURE(setCaptureTags(templateUtils.get(), templateGen, /*gps*/false,
+                4));
+        ASSERT_TRUE(templateUtils->generateApp1());
+
+        ASSERT_NO_FATAL_FAILURE(expectSameApp1(utils.get(), templateUtils.get()));
+    }
+}
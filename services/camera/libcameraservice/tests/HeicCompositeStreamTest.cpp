@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "HeicCompositeStreamTest"
+
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+
+#include "../api2/HeicCompositeStream.h"
+
+namespace android {
+namespace camera3 {
+
+namespace {
+
+const size_t kCodecCount = 3;
+const size_t kGridRows = 2;
+const size_t kGridCols = 3;
+const int64_t kFrameNumber = 1;
+
+}  // namespace
+
+// Tests how the tiles of an image are spread over the codecs. The codecs themselves are
+// not created, the test plays their callbacks instead, so the codec objects are never
+// touched.
+class HeicCompositeStreamTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mStream = new HeicCompositeStream(nullptr /*device*/, nullptr /*cb*/);
+        Mutex::Autolock l(mStream->mMutex);
+        mStream->mUseGrid = true;
+        mStream->mGridRows = kGridRows;
+        mStream->mGridCols = kGridCols;
+        mStream->mCodecs.resize(kCodecCount);
+        mStream->mCodecTilesInFlight.assign(kCodecCount, 0);
+        mStream->mCodecConfigs.assign(kCodecCount, nullptr);
+        // Skip the probe tiles, they would be queued to the codecs.
+        mStream->mCodecProbed.assign(kCodecCount, true);
+        mStream->mActiveCodecCount = 1;
+    }
+
+    void TearDown() override {
+        Mutex::Autolock l(mStream->mMutex);
+        mStream->mCodecs.clear();
+    }
+
+    // Every codec gives |count| input buffers.
+    void offerInputBuffers(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            for (size_t codec = 0; codec < kCodecCount; codec++) {
+                mStream->onHeicInputFrameAvailable(mNextInputIndex++, codec);
+            }
+        }
+    }
+
+    void setCodecConfig(size_t codecIndex, uint8_t value) {
+        sp<ABuffer> config = new ABuffer(16);
+        memset(config->data(), value, config->size());
+        Mutex::Autolock l(mStream->mMutex);
+        mStream->mCodecConfigs[codecIndex] = config;
+        mStream->checkCodecConfigsLocked();
+    }
+
+    // Assigns the free input buffers to the pending frame.
+    HeicCompositeStream::InputFrame& distributeTiles() {
+        Mutex::Autolock l(mStream->mMutex);
+        mStream->mPendingInputFrames[kFrameNumber];
+        mStream->compilePendingInputLocked();
+        return mStream->mPendingInputFrames[kFrameNumber];
+    }
+
+    std::vector<size_t> tilesInFlight() {
+        Mutex::Autolock l(mStream->mMutex);
+        return mStream->mCodecTilesInFlight;
+    }
+
+    void encodeTile(int64_t timeUs, size_t codecIndex) {
+        HeicCompositeStream::CodecOutputBufferInfo info = {};
+        info.index = mNextOutputIndex++;
+        info.size = 100;
+        info.timeUs = timeUs;
+        info.codecIndex = codecIndex;
+        mStream->onHeicOutputFrameAvailable(info);
+    }
+
+    sp<HeicCompositeStream> mStream;
+    int32_t mNextInputIndex = 0;
+    int32_t mNextOutputIndex = 0;
+};
+
+TEST_F(HeicCompositeStreamTest, TilesSpreadOnceConfigsMatch) {
+    offerInputBuffers(2);
+
+    // Until every codec reported the same config, only the first codec gets tiles.
+    HeicCompositeStream::InputFrame& frame = distributeTiles();
+    ASSERT_EQ(2u, frame.codecInputBuffers.size());
+    for (const auto& tile : frame.codecInputBuffers) {
+        EXPECT_EQ(0u, tile.codecIndex);
+    }
+    EXPECT_EQ((std::vector<size_t>{2, 0, 0}), tilesInFlight());
+
+    setCodecConfig(0, 1);
+    setCodecConfig(1, 1);
+    distributeTiles();
+    EXPECT_EQ(2u, frame.codecInputBuffers.size());
+    setCodecConfig(2, 1);
+
+    // The remaining tiles go to the idle codecs.
+    distributeTiles();
+    ASSERT_EQ(kGridRows * kGridCols, frame.codecInputBuffers.size());
+    EXPECT_EQ((std::vector<size_t>{2, 2, 2}), tilesInFlight());
+
+    std::set<size_t> tileIndices;
+    std::set<int64_t> timestamps;
+    for (const auto& tile : frame.codecInputBuffers) {
+        tileIndices.insert(tile.tileIndex);
+        timestamps.insert(tile.timeUs);
+    }
+    EXPECT_EQ(kGridRows * kGridCols, tileIndices.size());
+    EXPECT_EQ(kGridRows * kGridCols, timestamps.size());
+    Mutex::Autolock l(mStream->mMutex);
+    EXPECT_EQ(kGridRows * kGridCols, mStream->mTilesByTimestamp.size());
+}
+
+TEST_F(HeicCompositeStreamTest, TilesStayOnFirstCodecIfConfigsDiffer) {
+    setCodecConfig(0, 1);
+    setCodecConfig(1, 1);
+    setCodecConfig(2, 2);
+    offerInputBuffers(kGridRows * kGridCols);
+
+    HeicCompositeStream::InputFrame& frame = distributeTiles();
+    ASSERT_EQ(kGridRows * kGridCols, frame.codecInputBuffers.size());
+    for (const auto& tile : frame.codecInputBuffers) {
+        EXPECT_EQ(0u, tile.codecIndex);
+    }
+    EXPECT_EQ((std::vector<size_t>{kGridRows * kGridCols, 0, 0}), tilesInFlight());
+}
+
+TEST_F(HeicCompositeStreamTest, TilesGoToLeastBusyCodec) {
+    for (size_t codec = 0; codec < kCodecCount; codec++) {
+        setCodecConfig(codec, 1);
+    }
+    {
+        Mutex::Autolock l(mStream->mMutex);
+        mStream->mCodecTilesInFlight = {3, 0, 1};
+    }
+    offerInputBuffers(kGridRows * kGridCols);
+
+    // The 6 tiles first fill codecs 1 and 2 up to the 3 tiles of codec 0, then the last
+    // one goes to any of them.
+    distributeTiles();
+    std::vector<size_t> inFlight = tilesInFlight();
+    for (size_t tiles : inFlight) {
+        EXPECT_TRUE(tiles == 3 || tiles == 4) << tiles;
+    }
+    EXPECT_EQ(10u, inFlight[0] + inFlight[1] + inFlight[2]);
+}
+
+TEST_F(HeicCompositeStreamTest, OnlyTileOutputsLeaveFlight) {
+    for (size_t codec = 0; codec < kCodecCount; codec++) {
+        setCodecConfig(codec, 1);
+    }
+    offerInputBuffers(2);
+    HeicCompositeStream::InputFrame& frame = distributeTiles();
+    ASSERT_EQ(kGridRows * kGridCols, frame.codecInputBuffers.size());
+    EXPECT_EQ((std::vector<size_t>{2, 2, 2}), tilesInFlight());
+
+    // The output of a probe tile has a timestamp that isn't one of a tile.
+    encodeTile(-1, 1);
+    EXPECT_EQ((std::vector<size_t>{2, 2, 2}), tilesInFlight());
+
+    const auto& tile = frame.codecInputBuffers[0];
+    encodeTile(tile.timeUs, tile.codecIndex);
+    std::vector<size_t> expected = {2, 2, 2};
+    expected[tile.codecIndex]--;
+    EXPECT_EQ(expected, tilesInFlight());
+}
+
+}  // namespace camera3
+}  // namespace android
@@ -318,6 +318,12 @@ void DefaultEventListener<KEY, VALUE>::onClientRemoved(
  *     than the max cost, or all descriptors meeting this criteria have been evicted and the
  *     incoming descriptor has the highest priority.  Otherwise, the incoming descriptor is
  *     removed instead.
+ *
+ * The active clients are kept in an immutable snapshot, indexed by key, by conflicting key and
+ * by priority.  Changes build a new snapshot under the ClientManager's lock and publish it
+ * atomically, while lookups and eviction queries only load the current snapshot and never wait
+ * on the lock.  The priority of a ClientDescriptor must only be changed through
+ * updatePriorities() while it is managed by a ClientManager, so that the index stays in sync.
  */
 template<class KEY, class VALUE, class LISTENER=DefaultEventListener<KEY, VALUE>>
 class ClientManager {
@@ -427,36 +433,146 @@ protected:
     ~ClientManager();
 
 private:
+    typedef std::shared_ptr<ClientDescriptor<KEY, VALUE>> DescriptorPtr;
 
     /**
-     * Return a vector of the ClientDescriptors that would be evicted by adding the given
-     * ClientDescriptor.  If returnIncompatibleClients is set to true, instead, return the
-     * vector of ClientDescriptors that are higher priority than the incoming client and
+     * Snapshot of the active clients.  Each client is identified by the sequence number it was
+     * given when added, so ordering by sequence number is the LRU order.
+     */
+    struct ClientSet {
+        struct Entry {
+            DescriptorPtr client;
+            // Priority the client was indexed with
+            ClientPriority priority;
+        };
+
+        // Highest priority first, ties ordered from the most recently used
+        struct PriorityOrder {
+            bool operator()(const std::pair<ClientPriority, uint64_t>& a,
+                    const std::pair<ClientPriority, uint64_t>& b) const {
+                if (a.first == b.first) {
+                    return a.second > b.second;
+                }
+                return a.first < b.first;
+            }
+        };
+
+        // All clients, LRU ordered, most recent at end
+        std::map<uint64_t, Entry> entries;
+        std::map<KEY, uint64_t> byKey;
+        // Clients listing each key as conflicting
+        std::map<KEY, std::set<uint64_t>> byConflictingKey;
+        std::set<std::pair<ClientPriority, uint64_t>, PriorityOrder> byPriority;
+        // Clients with a non-zero cost, LRU ordered
+        std::set<uint64_t> withCost;
+        int64_t totalCost = 0;
+
+        void add(uint64_t seq, const DescriptorPtr& client);
+        void remove(uint64_t seq);
+        void updatePriority(uint64_t seq);
+        // Return the sequence number of the given client, or false if it isn't in this set.
+        bool find(const DescriptorPtr& client, uint64_t* seq) const;
+    };
+
+    /**
+     * Return a vector of the ClientDescriptors in the given set that would be evicted by adding
+     * the given ClientDescriptor.  If returnIncompatibleClients is set to true, instead, return
+     * the vector of ClientDescriptors that are higher priority than the incoming client and
      * either conflict with this client, or contribute to the resource cost if that would
      * prevent the incoming client from being added.
      *
      * This may return the ClientDescriptor passed in.
      */
-    std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>> wouldEvictLocked(
+    std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>> wouldEvictFrom(
+            const ClientSet& clients,
             const std::shared_ptr<ClientDescriptor<KEY, VALUE>>& client,
             bool returnIncompatibleClients = false) const;
 
-    int64_t getCurrentCostLocked() const;
+    std::shared_ptr<const ClientSet> loadClients() const;
+    // Publish a new snapshot, mLock must be held.
+    void storeClientsLocked(std::shared_ptr<const ClientSet> clients);
 
     mutable Mutex mLock;
     mutable Condition mRemovedCondition;
     int32_t mMaxCost;
-    // LRU ordered, most recent at end
-    std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>> mClients;
+    // Only accessed with std::atomic_load/std::atomic_store
+    std::shared_ptr<const ClientSet> mClients;
+    // Sequence number of the next client added, guarded by mLock
+    uint64_t mNextSequence;
     std::shared_ptr<LISTENER> mListener;
 }; // class ClientManager
 
+template<class KEY, class VALUE, class LISTENER>
+void ClientManager<KEY, VALUE, LISTENER>::ClientSet::add(uint64_t seq,
+        const DescriptorPtr& client) {
+    ClientPriority priority = client->getPriority();
+    entries.emplace(seq, Entry{client, priority});
+    byKey[client->getKey()] = seq;
+    for (const auto& k : client->getConflicting()) {
+        byConflictingKey[k].insert(seq);
+    }
+    byPriority.emplace(priority, seq);
+    if (client->getCost() > 0) {
+        withCost.insert(seq);
+    }
+    totalCost += client->getCost();
+}
+
+template<class KEY, class VALUE, class LISTENER>
+void ClientManager<KEY, VALUE, LISTENER>::ClientSet::remove(uint64_t seq) {
+    auto it = entries.find(seq);
+    if (it == entries.end()) return;
+    const DescriptorPtr& client = it->second.client;
+
+    auto keyIt = byKey.find(client->getKey());
+    if (keyIt != byKey.end() && keyIt->second == seq) {
+        byKey.erase(keyIt);
+    }
+    for (const auto& k : client->getConflicting()) {
+        auto conflictIt = byConflictingKey.find(k);
+        if (conflictIt == byConflictingKey.end()) continue;
+        conflictIt->second.erase(seq);
+        if (conflictIt->second.empty()) {
+            byConflictingKey.erase(conflictIt);
+        }
+    }
+    byPriority.erase(std::make_pair(it->second.priority, seq));
+    withCost.erase(seq);
+    totalCost -= client->getCost();
+    entries.erase(it);
+}
+
+template<class KEY, class VALUE, class LISTENER>
+void ClientManager<KEY, VALUE, LISTENER>::ClientSet::updatePriority(uint64_t seq) {
+    auto it = entries.find(seq);
+    if (it == entries.end()) return;
+    ClientPriority priority = it->second.client->getPriority();
+    if (priority == it->second.priority) return;
+
+    byPriority.erase(std::make_pair(it->second.priority, seq));
+    byPriority.emplace(priority, seq);
+    it->second.priority = priority;
+}
+
+template<class KEY, class VALUE, class LISTENER>
+bool ClientManager<KEY, VALUE, LISTENER>::ClientSet::find(const DescriptorPtr& client,
+        uint64_t* seq) const {
+    if (client == nullptr) return false;
+    auto keyIt = byKey.find(client->getKey());
+    if (keyIt == byKey.end() || entries.at(keyIt->second).client != client) {
+        return false;
+    }
+    *seq = keyIt->second;
+    return true;
+}
+
 template<class KEY, class VALUE, class LISTENER>
 ClientManager<KEY, VALUE, LISTENER>::ClientManager() :
         ClientManager(DEFAULT_MAX_COST) {}
 
 template<class KEY, class VALUE, class LISTENER>
-ClientManager<KEY, VALUE, LISTENER>::ClientManager(int32_t totalCost) : mMaxCost(totalCost) {}
+ClientManager<KEY, VALUE, LISTENER>::ClientManager(int32_t totalCost) : mMaxCost(totalCost),
+        mClients(std::make_shared<const ClientSet>()), mNextSequence(0) {}
 
 template<class KEY, class VALUE, class LISTENER>
 ClientManager<KEY, VALUE, LISTENER>::~ClientManager() {}
@@ -465,21 +581,20 @@ template<class KEY, class VALUE, class LISTENER>
 std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>>
 ClientManager<KEY, VALUE, LISTENER>::wouldEvict(
         const std::shared_ptr<ClientDescriptor<KEY, VALUE>>& client) const {
-    Mutex::Autolock lock(mLock);
-    return wouldEvictLocked(client);
+    return wouldEvictFrom(*loadClients(), client);
 }
 
 template<class KEY, class VALUE, class LISTENER>
 std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>>
 ClientManager<KEY, VALUE, LISTENER>::getIncompatibleClients(
         const std::shared_ptr<ClientDescriptor<KEY, VALUE>>& client) const {
-    Mutex::Autolock lock(mLock);
-    return wouldEvictLocked(client, /*returnIncompatibleClients*/true);
+    return wouldEvictFrom(*loadClients(), client, /*returnIncompatibleClients*/true);
 }
 
 template<class KEY, class VALUE, class LISTENER>
 std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>>
-ClientManager<KEY, VALUE, LISTENER>::wouldEvictLocked(
+ClientManager<KEY, VALUE, LISTENER>::wouldEvictFrom(
+        const ClientSet& clients,
         const std::shared_ptr<ClientDescriptor<KEY, VALUE>>& client,
         bool returnIncompatibleClients) const {
 
@@ -496,81 +611,103 @@ ClientManager<KEY, VALUE, LISTENER>::wouldEvictLocked(
     ClientPriority priority = client->getPriority();
     int32_t owner = client->getOwnerId();
 
-    int64_t totalCost = getCurrentCostLocked() + cost;
+    int64_t totalCost = clients.totalCost + cost;
 
-    // Determine the MRU of the owners tied for having the highest priority
+    // Determine the MRU of the owners tied for having the highest priority, or the incoming
+    // client if it ties with them, as it is MRU
     int32_t highestPriorityOwner = owner;
-    ClientPriority highestPriority = priority;
-    for (const auto& i : mClients) {
-        ClientPriority curPriority = i->getPriority();
-        if (curPriority <= highestPriority) {
-            highestPriority = curPriority;
-            highestPriorityOwner = i->getOwnerId();
+    auto highest = clients.byPriority.begin();
+    if (highest != clients.byPriority.end() && highest->first < priority) {
+        highestPriorityOwner = clients.entries.at(highest->second).client->getOwnerId();
+    }
+
+    // Find the conflicting clients: the one with the same key, the ones listing the incoming
+    // key as conflicting, and the ones with a key the incoming client lists as conflicting
+    std::set<uint64_t> conflicting;
+    auto keyIt = clients.byKey.find(key);
+    if (keyIt != clients.byKey.end()) {
+        conflicting.insert(keyIt->second);
+    }
+    auto conflictIt = clients.byConflictingKey.find(key);
+    if (conflictIt != clients.byConflictingKey.end()) {
+        conflicting.insert(conflictIt->second.begin(), conflictIt->second.end());
+    }
+    for (const auto& k : client->getConflicting()) {
+        keyIt = clients.byKey.find(k);
+        if (keyIt != clients.byKey.end()) {
+            conflicting.insert(keyIt->second);
         }
     }
 
-    if (highestPriority == priority) {
-        // Switch back owner if the incoming client has the highest priority, as it is MRU
-        highestPriorityOwner = owner;
-    }
-
-    // Build eviction list of clients to remove
-    for (const auto& i : mClients) {
-        const KEY& curKey = i->getKey();
-        int32_t curCost = i->getCost();
-        ClientPriority curPriority = i->getPriority();
-        int32_t curOwner = i->getOwnerId();
-
-        bool conflicting = (curKey == key || i->isConflicting(key) ||
-                client->isConflicting(curKey));
-
-        if (!returnIncompatibleClients) {
-            // Find evicted clients
-
-            if (conflicting && owner == curOwner) {
-                // Pre-existing conflicting client with the same client owner exists
-                // Open the same device twice -> most recent open wins
-                // Otherwise let the existing client wins to avoid behaviors difference
-                // due to how HAL advertising conflicting devices (which is hidden from
-                // application)
-                if (curKey == key) {
-                    evictList.push_back(i);
-                    totalCost -= curCost;
-                } else {
-                    evictList.clear();
-                    evictList.push_back(client);
-                    return evictList;
-                }
-            } else if (conflicting && curPriority < priority) {
-                // Pre-existing conflicting client with higher priority exists
-                evictList.clear();
+    if (returnIncompatibleClients) {
+        // Find clients preventing the incoming client from being added, among the clients
+        // with a higher priority, then return them in LRU order
+        std::vector<uint64_t> incompatible;
+        for (auto i = clients.byPriority.begin();
+                i != clients.byPriority.end() && i->first < priority; i++) {
+            if (conflicting.count(i->second) > 0 || (totalCost > mMaxCost &&
+                    clients.entries.at(i->second).client->getCost() > 0)) {
+                incompatible.push_back(i->second);
+            }
+        }
+        std::sort(incompatible.begin(), incompatible.end());
+        for (uint64_t seq : incompatible) {
+            evictList.push_back(clients.entries.at(seq).client);
+        }
+        return evictList;
+    }
+
+    for (uint64_t seq : conflicting) {
+        const auto& entry = clients.entries.at(seq);
+        if (entry.client->getOwnerId() == owner) {
+            // Pre-existing conflicting client with the same client owner exists
+            // Open the same device twice -> most recent open wins
+            // Otherwise let the existing client wins to avoid behaviors difference
+            // due to how HAL advertising conflicting devices (which is hidden from
+            // application)
+            if (!(entry.client->getKey() == key)) {
                 evictList.push_back(client);
                 return evictList;
-            } else if (conflicting || ((totalCost > mMaxCost && curCost > 0) &&
-                    (curPriority >= priority) &&
-                    !(highestPriorityOwner == owner && owner == curOwner))) {
-                // Add a pre-existing client to the eviction list if:
-                // - We are adding a client with higher priority that conflicts with this one.
-                // - The total cost including the incoming client's is more than the allowable
-                //   maximum, and the client has a non-zero cost, lower priority, and a different
-                //   owner than the incoming client when the incoming client has the
-                //   highest priority.
-                evictList.push_back(i);
-                totalCost -= curCost;
             }
-        } else {
-            // Find clients preventing the incoming client from being added
+        } else if (entry.priority < priority) {
+            // Pre-existing conflicting client with higher priority exists
+            evictList.push_back(client);
+            return evictList;
+        }
+    }
 
-            if (curPriority < priority && (conflicting || (totalCost > mMaxCost && curCost > 0))) {
-                // Pre-existing conflicting client with higher priority exists
-                evictList.push_back(i);
+    // Build eviction list of clients to remove, walking the conflicting clients and the clients
+    // with a non-zero cost together in LRU order. Add a pre-existing client to the eviction
+    // list if:
+    // - We are adding a client with higher priority that conflicts with this one.
+    // - The total cost including the incoming client's is more than the allowable
+    //   maximum, and the client has a non-zero cost, lower priority, and a different
+    //   owner than the incoming client when the incoming client has the
+    //   highest priority.
+    auto nextConflicting = conflicting.begin();
+    auto nextWithCost = clients.withCost.begin();
+    while (nextConflicting != conflicting.end() ||
+            (totalCost > mMaxCost && nextWithCost != clients.withCost.end())) {
+        if (totalCost > mMaxCost && nextWithCost != clients.withCost.end() &&
+                (nextConflicting == conflicting.end() || *nextWithCost < *nextConflicting)) {
+            const auto& entry = clients.entries.at(*nextWithCost);
+            nextWithCost++;
+            if (entry.priority >= priority &&
+                    !(highestPriorityOwner == owner && owner == entry.client->getOwnerId())) {
+                evictList.push_back(entry.client);
+                totalCost -= entry.client->getCost();
             }
+            continue;
         }
-    }
 
-    // Immediately return the incompatible clients if we are calculating these instead
-    if (returnIncompatibleClients) {
-        return evictList;
+        uint64_t seq = *nextConflicting;
+        nextConflicting++;
+        if (nextWithCost != clients.withCost.end() && *nextWithCost <= seq) {
+            nextWithCost = clients.withCost.upper_bound(seq);
+        }
+        const auto& entry = clients.entries.at(seq);
+        evictList.push_back(entry.client);
+        totalCost -= entry.client->getCost();
     }
 
     // If the total cost is too high, return the input unless the input has the highest priority
@@ -589,12 +726,15 @@ std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>>
 ClientManager<KEY, VALUE, LISTENER>::addAndEvict(
         const std::shared_ptr<ClientDescriptor<KEY, VALUE>>& client) {
     Mutex::Autolock lock(mLock);
-    auto evicted = wouldEvictLocked(client);
+    std::shared_ptr<const ClientSet> current = loadClients();
+    auto evicted = wouldEvictFrom(*current, client);
     auto it = evicted.begin();
     if (it != evicted.end() && *it == client) {
         return evicted;
     }
 
+    auto clients = std::make_shared<ClientSet>(*current);
+
     auto iter = evicted.cbegin();
 
     if (iter != evicted.cend()) {
@@ -602,18 +742,14 @@ ClientManager<KEY, VALUE, LISTENER>::addAndEvict(
         if (mListener != nullptr) mListener->onClientRemoved(**iter);
 
         // Remove evicted clients from list
-        mClients.erase(std::remove_if(mClients.begin(), mClients.end(),
-            [&iter] (std::shared_ptr<ClientDescriptor<KEY, VALUE>>& curClientPtr) {
-                if (curClientPtr->getKey() == (*iter)->getKey()) {
-                    iter++;
-                    return true;
-                }
-                return false;
-            }), mClients.end());
+        for (; iter != evicted.cend(); iter++) {
+            clients->remove(clients->byKey.at((*iter)->getKey()));
+        }
     }
 
     if (mListener != nullptr) mListener->onClientAdded(*client);
-    mClients.push_back(client);
+    clients->add(mNextSequence++, client);
+    storeClientsLocked(std::move(clients));
     mRemovedCondition.broadcast();
 
     return evicted;
@@ -622,26 +758,31 @@ ClientManager<KEY, VALUE, LISTENER>::addAndEvict(
 template<class KEY, class VALUE, class LISTENER>
 std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>>
 ClientManager<KEY, VALUE, LISTENER>::getAll() const {
-    Mutex::Autolock lock(mLock);
-    return mClients;
+    std::shared_ptr<const ClientSet> clients = loadClients();
+    std::vector<std::shared_ptr<ClientDescriptor<KEY, VALUE>>> all;
+    all.reserve(clients->entries.size());
+    for (const auto& i : clients->entries) {
+        all.push_back(i.second.client);
+    }
+    return all;
 }
 
 template<class KEY, class VALUE, class LISTENER>
 std::vector<KEY> ClientManager<KEY, VALUE, LISTENER>::getAllKeys() const {
-    Mutex::Autolock lock(mLock);
-    std::vector<KEY> keys(mClients.size());
-    for (const auto& i : mClients) {
-        keys.push_back(i->getKey());
+    std::shared_ptr<const ClientSet> clients = loadClients();
+    std::vector<KEY> keys(clients->entries.size());
+    for (const auto& i : clients->entries) {
+        keys.push_back(i.second.client->getKey());
     }
     return keys;
 }
 
 template<class KEY, class VALUE, class LISTENER>
 std::vector<int32_t> ClientManager<KEY, VALUE, LISTENER>::getAllOwners() const {
-    Mutex::Autolock lock(mLock);
+    std::shared_ptr<const ClientSet> clients = loadClients();
     std::set<int32_t> owners;
-    for (const auto& i : mClients) {
-        owners.emplace(i->getOwnerId());
+    for (const auto& i : clients->entries) {
+        owners.emplace(i.second.client->getOwnerId());
     }
     return std::vector<int32_t>(owners.begin(), owners.end());
 }
@@ -650,21 +791,23 @@ template<class KEY, class VALUE, class LISTENER>
 void ClientManager<KEY, VALUE, LISTENER>::updatePriorities(
         const std::map<int32_t,ClientPriority>& ownerPriorityList) {
     Mutex::Autolock lock(mLock);
-    for (auto& i : mClients) {
-        auto j = ownerPriorityList.find(i->getOwnerId());
+    auto clients = std::make_shared<ClientSet>(*loadClients());
+    for (const auto& i : clients->entries) {
+        auto j = ownerPriorityList.find(i.second.client->getOwnerId());
         if (j != ownerPriorityList.end()) {
-            i->setPriority(j->second);
+            i.second.client->setPriority(j->second);
+            clients->updatePriority(i.first);
         }
     }
+    storeClientsLocked(std::move(clients));
 }
 
 template<class KEY, class VALUE, class LISTENER>
 std::shared_ptr<ClientDescriptor<KEY, VALUE>> ClientManager<KEY, VALUE, LISTENER>::get(
         const KEY& key) const {
-    Mutex::Autolock lock(mLock);
-    for (const auto& i : mClients) {
-        if (i->getKey() == key) return i;
-    }
+    std::shared_ptr<const ClientSet> clients = loadClients();
+    auto i = clients->byKey.find(key);
+    if (i != clients->byKey.end()) return clients->entries.at(i->second).client;
     return std::shared_ptr<ClientDescriptor<KEY, VALUE>>(nullptr);
 }
 
@@ -672,11 +815,11 @@ template<class KEY, class VALUE, class LISTENER>
 void ClientManager<KEY, VALUE, LISTENER>::removeAll() {
     Mutex::Autolock lock(mLock);
     if (mListener != nullptr) {
-        for (const auto& i : mClients) {
-            mListener->onClientRemoved(*i);
+        for (const auto& i : loadClients()->entries) {
+            mListener->onClientRemoved(*i.second.client);
         }
     }
-    mClients.clear();
+    storeClientsLocked(std::make_shared<const ClientSet>());
     mRemovedCondition.broadcast();
 }
 
@@ -687,16 +830,15 @@ std::shared_ptr<ClientDescriptor<KEY, VALUE>> ClientManager<KEY, VALUE, LISTENER
 
     std::shared_ptr<ClientDescriptor<KEY, VALUE>> ret;
 
-    // Remove evicted clients from list
-    mClients.erase(std::remove_if(mClients.begin(), mClients.end(),
-        [this, &key, &ret] (std::shared_ptr<ClientDescriptor<KEY, VALUE>>& curClientPtr) {
-            if (curClientPtr->getKey() == key) {
-                if (mListener != nullptr) mListener->onClientRemoved(*curClientPtr);
-                ret = curClientPtr;
-                return true;
-            }
-            return false;
-        }), mClients.end());
+    std::shared_ptr<const ClientSet> current = loadClients();
+    auto i = current->byKey.find(key);
+    if (i != current->byKey.end()) {
+        ret = current->entries.at(i->second).client;
+        if (mListener != nullptr) mListener->onClientRemoved(*ret);
+        auto clients = std::make_shared<ClientSet>(*current);
+        clients->remove(i->second);
+        storeClientsLocked(std::move(clients));
+    }
 
     mRemovedCondition.broadcast();
     return ret;
@@ -715,12 +857,8 @@ status_t ClientManager<KEY, VALUE, LISTENER>::waitUntilRemoved(
     nsecs_t failTime = systemTime(SYSTEM_TIME_MONOTONIC) + timeout;
 
     while (!isRemoved) {
-        isRemoved = true;
-        for (const auto& i : mClients) {
-            if (i == client) {
-                isRemoved = false;
-            }
-        }
+        uint64_t seq;
+        isRemoved = !loadClients()->find(client, &seq);
 
         if (!isRemoved) {
             ret = mRemovedCondition.waitRelative(mLock, timeout);
@@ -744,25 +882,27 @@ template<class KEY, class VALUE, class LISTENER>
 void ClientManager<KEY, VALUE, LISTENER>::remove(
         const std::shared_ptr<ClientDescriptor<KEY, VALUE>>& value) {
     Mutex::Autolock lock(mLock);
-    // Remove evicted clients from list
-    mClients.erase(std::remove_if(mClients.begin(), mClients.end(),
-        [this, &value] (std::shared_ptr<ClientDescriptor<KEY, VALUE>>& curClientPtr) {
-            if (curClientPtr == value) {
-                if (mListener != nullptr) mListener->onClientRemoved(*curClientPtr);
-                return true;
-            }
-            return false;
-        }), mClients.end());
+    std::shared_ptr<const ClientSet> current = loadClients();
+    uint64_t seq;
+    if (current->find(value, &seq)) {
+        if (mListener != nullptr) mListener->onClientRemoved(*value);
+        auto clients = std::make_shared<ClientSet>(*current);
+        clients->remove(seq);
+        storeClientsLocked(std::move(clients));
+    }
     mRemovedCondition.broadcast();
 }
 
 template<class KEY, class VALUE, class LISTENER>
-int64_t ClientManager<KEY, VALUE, LISTENER>::getCurrentCostLocked() const {
-    int64_t totalCost = 0;
-    for (const auto& x : mClients) {
-            totalCost += x->getCost();
-    }
-    return totalCost;
+std::shared_ptr<const typename ClientManager<KEY, VALUE, LISTENER>::ClientSet>
+ClientManager<KEY, VALUE, LISTENER>::loadClients() const {
+    return std::atomic_load(&mClients);
+}
+
+template<class KEY, class VALUE, class LISTENER>
+void ClientManager<KEY, VALUE, LISTENER>::storeClientsLocked(
+        std::shared_ptr<const ClientSet> clients) {
+    std::atomic_store(&mClients, std::move(clients));
 }
 
 // --------------------------------------------------------------------------------
@@ -23,6 +23,7 @@
 #include <inttypes.h>
 #include <math.h>
 #include <stdint.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -220,6 +221,13 @@ public:
     virtual bool setString(ExifIfd ifd, ExifTag tag, ExifFormat format,
             const std::string& buffer, const std::string& msg);
 
+    // Sets the raw data of a variable length tag, already in the Exif byte order.
+    virtual bool setData(ExifIfd ifd, ExifTag tag, ExifFormat format, uint64_t components,
+            const void* data, unsigned int size, const std::string& msg);
+
+    // Removes the entry of |tag| if it exists.
+    virtual void removeEntry(ExifIfd ifd, ExifTag tag);
+
     float convertToApex(float val) {
         return 2.0f * log2f(val);
     }
@@ -239,6 +247,130 @@ public:
     const static int kRationalPrecision = 10000;
 };
 
+struct ExifValueLocation {
+    ExifIfd ifd;
+    ExifTag tag;
+    ExifFormat format;
+    uint64_t components;
+    // Where the value bytes of the entry are in the APP1 segment.
+    size_t offset;
+    size_t size;
+};
+
+// ExifUtilsImpl that records the tag values of an image, and patches them into
+// a copy of the APP1 segment generated by libexif for an earlier image with the
+// same tags. The values of an APP1 segment from the HAL are patched in the same
+// way, if the segment has the same tags as the one of the earlier image.
+class ExifTemplateImpl : public ExifUtilsImpl {
+public:
+    ExifTemplateImpl();
+
+    virtual ~ExifTemplateImpl();
+
+    virtual bool initialize(const unsigned char *app1Segment, size_t app1SegmentSize);
+    virtual bool initializeEmpty();
+
+    virtual bool generateApp1();
+    virtual const uint8_t* getApp1Buffer();
+    virtual unsigned int getApp1Length();
+
+  protected:
+    virtual bool setShort(ExifIfd ifd, ExifTag tag, uint16_t value, const std::string& msg);
+
+    virtual bool setLong(ExifIfd ifd, ExifTag tag, uint32_t value, const std::string& msg);
+
+    virtual bool setRational(ExifIfd ifd, ExifTag tag, uint32_t numerator,
+            uint32_t denominator, const std::string& msg);
+
+    virtual bool setSRational(ExifIfd ifd, ExifTag tag, int32_t numerator,
+            int32_t denominator, const std::string& msg);
+
+    virtual bool setData(ExifIfd ifd, ExifTag tag, ExifFormat format, uint64_t components,
+            const void* data, unsigned int size, const std::string& msg);
+
+    virtual void removeEntry(ExifIfd ifd, ExifTag tag);
+
+  private:
+    // The setter used for a value, to set it again with libexif.
+    enum class ValueType { SHORT, LONG, RATIONAL, SRATIONAL, DATA };
+
+    struct Value {
+        ExifIfd ifd;
+        ExifTag tag;
+        ValueType type;
+        // Only used by DATA values.
+        ExifFormat format;
+        uint64_t components;
+        // The bytes written to the entry, in Intel byte order.
+        std::vector<uint8_t> data;
+    };
+
+    struct TemplateEntry {
+        ExifIfd ifd;
+        ExifTag tag;
+        ValueType type;
+        ExifFormat format;
+        uint64_t components;
+        size_t size;
+        // Where the value bytes are in |template_|.
+        size_t offset;
+    };
+
+    bool isRecording() const { return use_template_ && !building_template_; }
+
+    // Collects the values of an APP1 segment from the HAL into |hal_values_|.
+    // Returns false if the segment can't be templated, because it can't be
+    // parsed or libexif could change its values.
+    bool parseHalApp1(const unsigned char* app1Segment, size_t app1SegmentSize);
+
+    // Returns the recorded value of |tag|, replacing any earlier one, with room
+    // for |size| bytes of data.
+    Value& recordValue(ExifIfd ifd, ExifTag tag, ValueType type, size_t size);
+
+    // Whether the recorded values fit the template, they must be sorted.
+    bool matchesTemplate() const;
+
+    // Generates the APP1 segment of the recorded values with libexif, and keeps
+    // it as the new template.
+    bool buildTemplate();
+
+    bool setWithLibexif(const Value& value);
+
+    // Whether the current image goes through the template.
+    bool use_template_;
+    // Whether the recorded values are being set with libexif.
+    bool building_template_;
+
+    // The recorded values. Only the first |value_count_| are valid, the others
+    // are kept to reuse their buffers.
+    std::vector<Value> values_;
+    size_t value_count_;
+
+    // The APP1 segment from the HAL of the current image, empty if it was
+    // initialized with initializeEmpty().
+    std::vector<uint8_t> hal_app1_;
+    // The values in |hal_app1_|, sorted.
+    std::vector<ExifValueLocation> hal_values_;
+    // The tags removed from |hal_app1_|, sorted.
+    std::vector<std::pair<ExifIfd, ExifTag>> removed_tags_;
+
+    std::vector<uint8_t> template_;
+    // One entry for each recorded value, in the same order. Empty if the value
+    // locations couldn't be found in |template_|.
+    std::vector<TemplateEntry> template_entries_;
+    // The values of the HAL APP1 segment |template_| was generated from, and
+    // where each of them is in |template_|. The location is SIZE_MAX for the
+    // values that are not copied, because they were removed, replaced by a
+    // recorded value, or are pointers.
+    bool template_from_hal_;
+    std::vector<ExifValueLocation> template_hal_values_;
+    std::vector<size_t> template_hal_offsets_;
+    std::vector<std::pair<ExifIfd, ExifTag>> template_removed_tags_;
+
+    // The APP1 segment of the current image.
+    std::vector<uint8_t> app1_;
+};
+
 #define SET_SHORT(ifd, tag, value)                      \
     do {                                                \
         if (setShort(ifd, tag, value, #tag) == false)   \
@@ -288,6 +420,10 @@ ExifUtils *ExifUtils::create() {
     return new ExifUtilsImpl();
 }
 
+ExifUtils *ExifUtils::createWithTemplate() {
+    return new ExifTemplateImpl();
+}
+
 ExifUtils::~ExifUtils() {
 }
 
@@ -478,85 +614,76 @@ bool ExifUtilsImpl::setFocalLengthIn35mmFilm(
 
 bool ExifUtilsImpl::setGpsAltitude(double altitude) {
     ExifTag refTag = static_cast<ExifTag>(EXIF_TAG_GPS_ALTITUDE_REF);
-    std::unique_ptr<ExifEntry> refEntry =
-            addVariableLengthEntry(EXIF_IFD_GPS, refTag, EXIF_FORMAT_BYTE, 1, 1);
-    if (!refEntry) {
-        ALOGE("%s: Adding GPSAltitudeRef exif entry failed", __FUNCTION__);
-        return false;
-    }
+    uint8_t ref;
     if (altitude >= 0) {
-        *refEntry->data = 0;
+        ref = 0;
     } else {
-        *refEntry->data = 1;
+        ref = 1;
         altitude *= -1;
     }
+    if (!setData(EXIF_IFD_GPS, refTag, EXIF_FORMAT_BYTE, 1, &ref, 1, "GPSAltitudeRef")) {
+        return false;
+    }
 
     ExifTag tag = static_cast<ExifTag>(EXIF_TAG_GPS_ALTITUDE);
-    std::unique_ptr<ExifEntry> entry = addVariableLengthEntry(
-            EXIF_IFD_GPS, tag, EXIF_FORMAT_RATIONAL, 1, sizeof(ExifRational));
-    if (!entry) {
-        exif_content_remove_entry(exif_data_->ifd[EXIF_IFD_GPS], refEntry.get());
-        ALOGE("%s: Adding GPSAltitude exif entry failed", __FUNCTION__);
+    unsigned char data[sizeof(ExifRational)];
+    exif_set_rational(data, EXIF_BYTE_ORDER_INTEL,
+            {static_cast<ExifLong>(altitude * 1000), 1000});
+    if (!setData(EXIF_IFD_GPS, tag, EXIF_FORMAT_RATIONAL, 1, data, sizeof(data),
+            "GPSAltitude")) {
+        removeEntry(EXIF_IFD_GPS, refTag);
         return false;
     }
-    exif_set_rational(entry->data, EXIF_BYTE_ORDER_INTEL,
-            {static_cast<ExifLong>(altitude * 1000), 1000});
 
     return true;
 }
 
 bool ExifUtilsImpl::setGpsLatitude(double latitude) {
     const ExifTag refTag = static_cast<ExifTag>(EXIF_TAG_GPS_LATITUDE_REF);
-    std::unique_ptr<ExifEntry> refEntry =
-            addVariableLengthEntry(EXIF_IFD_GPS, refTag, EXIF_FORMAT_ASCII, 2, 2);
-    if (!refEntry) {
-        ALOGE("%s: Adding GPSLatitudeRef exif entry failed", __FUNCTION__);
-        return false;
-    }
+    const char* ref;
     if (latitude >= 0) {
-        memcpy(refEntry->data, "N", sizeof("N"));
+        ref = "N";
     } else {
-        memcpy(refEntry->data, "S", sizeof("S"));
+        ref = "S";
         latitude *= -1;
     }
+    if (!setData(EXIF_IFD_GPS, refTag, EXIF_FORMAT_ASCII, 2, ref, 2, "GPSLatitudeRef")) {
+        return false;
+    }
 
     const ExifTag tag = static_cast<ExifTag>(EXIF_TAG_GPS_LATITUDE);
-    std::unique_ptr<ExifEntry> entry = addVariableLengthEntry(
-            EXIF_IFD_GPS, tag, EXIF_FORMAT_RATIONAL, 3, 3 * sizeof(ExifRational));
-    if (!entry) {
-        exif_content_remove_entry(exif_data_->ifd[EXIF_IFD_GPS], refEntry.get());
-        ALOGE("%s: Adding GPSLatitude exif entry failed", __FUNCTION__);
+    unsigned char data[3 * sizeof(ExifRational)];
+    setLatitudeOrLongitudeData(data, latitude);
+    if (!setData(EXIF_IFD_GPS, tag, EXIF_FORMAT_RATIONAL, 3, data, sizeof(data),
+            "GPSLatitude")) {
+        removeEntry(EXIF_IFD_GPS, refTag);
         return false;
     }
-    setLatitudeOrLongitudeData(entry->data, latitude);
 
     return true;
 }
 
 bool ExifUtilsImpl::setGpsLongitude(double longitude) {
     ExifTag refTag = static_cast<ExifTag>(EXIF_TAG_GPS_LONGITUDE_REF);
-    std::unique_ptr<ExifEntry> refEntry =
-            addVariableLengthEntry(EXIF_IFD_GPS, refTag, EXIF_FORMAT_ASCII, 2, 2);
-    if (!refEntry) {
-        ALOGE("%s: Adding GPSLongitudeRef exif entry failed", __FUNCTION__);
-        return false;
-    }
+    const char* ref;
     if (longitude >= 0) {
-        memcpy(refEntry->data, "E", sizeof("E"));
+        ref = "E";
     } else {
-        memcpy(refEntry->data, "W", sizeof("W"));
+        ref = "W";
         longitude *= -1;
     }
+    if (!setData(EXIF_IFD_GPS, refTag, EXIF_FORMAT_ASCII, 2, ref, 2, "GPSLongitudeRef")) {
+        return false;
+    }
 
     ExifTag tag = static_cast<ExifTag>(EXIF_TAG_GPS_LONGITUDE);
-    std::unique_ptr<ExifEntry> entry = addVariableLengthEntry(
-            EXIF_IFD_GPS, tag, EXIF_FORMAT_RATIONAL, 3, 3 * sizeof(ExifRational));
-    if (!entry) {
-        exif_content_remove_entry(exif_data_->ifd[EXIF_IFD_GPS], refEntry.get());
-        ALOGE("%s: Adding GPSLongitude exif entry failed", __FUNCTION__);
+    unsigned char data[3 * sizeof(ExifRational)];
+    setLatitudeOrLongitudeData(data, longitude);
+    if (!setData(EXIF_IFD_GPS, tag, EXIF_FORMAT_RATIONAL, 3, data, sizeof(data),
+            "GPSLongitude")) {
+        removeEntry(EXIF_IFD_GPS, refTag);
         return false;
     }
-    setLatitudeOrLongitudeData(entry->data, longitude);
 
     return true;
 }
@@ -572,32 +699,30 @@ bool ExifUtilsImpl::setGpsProcessingMethod(const std::string& method) {
 bool ExifUtilsImpl::setGpsTimestamp(const struct tm& t) {
     const ExifTag dateTag = static_cast<ExifTag>(EXIF_TAG_GPS_DATE_STAMP);
     const size_t kGpsDateStampSize = 11;
-    std::unique_ptr<ExifEntry> entry = addVariableLengthEntry(EXIF_IFD_GPS,
-            dateTag, EXIF_FORMAT_ASCII, kGpsDateStampSize, kGpsDateStampSize);
-    if (!entry) {
-        ALOGE("%s: Adding GPSDateStamp exif entry failed", __FUNCTION__);
-        return false;
-    }
-    int result = snprintf(reinterpret_cast<char*>(entry->data), kGpsDateStampSize,
+    char dateStamp[kGpsDateStampSize];
+    int result = snprintf(dateStamp, kGpsDateStampSize,
             "%04i:%02i:%02i", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
     if (result != kGpsDateStampSize - 1) {
         ALOGW("%s: Input time is invalid", __FUNCTION__);
         return false;
     }
-
-    const ExifTag timeTag = static_cast<ExifTag>(EXIF_TAG_GPS_TIME_STAMP);
-    entry = addVariableLengthEntry(EXIF_IFD_GPS, timeTag, EXIF_FORMAT_RATIONAL, 3,
-            3 * sizeof(ExifRational));
-    if (!entry) {
-        ALOGE("%s: Adding GPSTimeStamp exif entry failed", __FUNCTION__);
+    if (!setData(EXIF_IFD_GPS, dateTag, EXIF_FORMAT_ASCII, kGpsDateStampSize, dateStamp,
+            kGpsDateStampSize, "GPSDateStamp")) {
         return false;
     }
-    exif_set_rational(entry->data, EXIF_BYTE_ORDER_INTEL,
+
+    const ExifTag timeTag = static_cast<ExifTag>(EXIF_TAG_GPS_TIME_STAMP);
+    unsigned char timeStamp[3 * sizeof(ExifRational)];
+    exif_set_rational(timeStamp, EXIF_BYTE_ORDER_INTEL,
             {static_cast<ExifLong>(t.tm_hour), 1});
-    exif_set_rational(entry->data + sizeof(ExifRational), EXIF_BYTE_ORDER_INTEL,
+    exif_set_rational(timeStamp + sizeof(ExifRational), EXIF_BYTE_ORDER_INTEL,
             {static_cast<ExifLong>(t.tm_min), 1});
-    exif_set_rational(entry->data + 2 * sizeof(ExifRational), EXIF_BYTE_ORDER_INTEL,
+    exif_set_rational(timeStamp + 2 * sizeof(ExifRational), EXIF_BYTE_ORDER_INTEL,
             {static_cast<ExifLong>(t.tm_sec), 1});
+    if (!setData(EXIF_IFD_GPS, timeTag, EXIF_FORMAT_RATIONAL, 3, timeStamp,
+            sizeof(timeStamp), "GPSTimeStamp")) {
+        return false;
+    }
 
     return true;
 }
@@ -854,16 +979,26 @@ bool ExifUtilsImpl::setString(ExifIfd ifd, ExifTag tag, ExifFormat format,
     if (format == EXIF_FORMAT_ASCII) {
         entry_size++;
     }
+    return setData(ifd, tag, format, entry_size, buffer.c_str(), entry_size, msg);
+}
+
+bool ExifUtilsImpl::setData(ExifIfd ifd, ExifTag tag, ExifFormat format, uint64_t components,
+        const void* data, unsigned int size, const std::string& msg) {
     std::unique_ptr<ExifEntry> entry =
-            addVariableLengthEntry(ifd, tag, format, entry_size, entry_size);
+            addVariableLengthEntry(ifd, tag, format, components, size);
     if (!entry) {
         ALOGE("%s: Adding '%s' entry failed", __FUNCTION__, msg.c_str());
         return false;
     }
-    memcpy(entry->data, buffer.c_str(), entry_size);
+    memcpy(entry->data, data, size);
     return true;
 }
 
+void ExifUtilsImpl::removeEntry(ExifIfd ifd, ExifTag tag) {
+    exif_content_remove_entry(exif_data_->ifd[ifd],
+            exif_content_get_entry(exif_data_->ifd[ifd], tag));
+}
+
 void ExifUtilsImpl::destroyApp1() {
     /*
      * Since there is no API to access ExifMem in ExifData->priv, we use free
@@ -1114,5 +1249,455 @@ bool ExifUtilsImpl::setFromMetadata(const CameraMetadata& metadata,
     return true;
 }
 
+// The offset of the TIFF header in an APP1 segment saved by libexif, after the
+// "Exif\0\0" identifier.
+static const size_t kTiffHeaderOffset = 6;
+
+// Collects the value locations of the entries of an IFD in an APP1 segment in
+// Intel byte order, whose TIFF header starts at |tiffOffset|. Follows the
+// pointers to the Exif and GPS IFDs from IFD 0, and to the interoperability IFD
+// from the Exif IFD. |nextIfdOffset|, if not null, receives the offset of the
+// IFD linked after this one.
+static bool findExifValueLocations(const std::vector<uint8_t>& app1, size_t tiffOffset,
+        ExifIfd ifd, uint64_t ifdOffset, std::vector<ExifValueLocation>* locations,
+        uint64_t* nextIfdOffset = nullptr) {
+    uint64_t pos = tiffOffset + ifdOffset;
+    if (pos + 2 > app1.size()) {
+        return false;
+    }
+    unsigned int count = exif_get_short(&app1[pos], EXIF_BYTE_ORDER_INTEL);
+    pos += 2;
+    if (pos + 12 * count + 4 > app1.size()) {
+        return false;
+    }
+    if (nextIfdOffset != nullptr) {
+        *nextIfdOffset = exif_get_long(&app1[pos + 12 * count], EXIF_BYTE_ORDER_INTEL);
+    }
+
+    for (unsigned int i = 0; i < count; i++, pos += 12) {
+        ExifTag tag = static_cast<ExifTag>(exif_get_short(&app1[pos], EXIF_BYTE_ORDER_INTEL));
+        ExifFormat format = static_cast<ExifFormat>(
+                exif_get_short(&app1[pos + 2], EXIF_BYTE_ORDER_INTEL));
+        uint64_t components = exif_get_long(&app1[pos + 4], EXIF_BYTE_ORDER_INTEL);
+        uint64_t size = components * exif_format_get_size(format);
+        uint64_t offset = (size <= 4) ? pos + 8 :
+                tiffOffset + exif_get_long(&app1[pos + 8], EXIF_BYTE_ORDER_INTEL);
+        if (offset + size > app1.size()) {
+            return false;
+        }
+        locations->push_back({ifd, tag, format, components, static_cast<size_t>(offset),
+                static_cast<size_t>(size)});
+
+        ExifIfd subIfd;
+        if (ifd == EXIF_IFD_0 && tag == EXIF_TAG_EXIF_IFD_POINTER) {
+            subIfd = EXIF_IFD_EXIF;
+        } else if (ifd == EXIF_IFD_0 && tag == EXIF_TAG_GPS_INFO_IFD_POINTER) {
+            subIfd = EXIF_IFD_GPS;
+        } else if (ifd == EXIF_IFD_EXIF && tag == EXIF_TAG_INTEROPERABILITY_IFD_POINTER) {
+            subIfd = EXIF_IFD_INTEROPERABILITY;
+        } else {
+            continue;
+        }
+        if (size != 4 || !findExifValueLocations(app1, tiffOffset, subIfd,
+                exif_get_long(&app1[offset], EXIF_BYTE_ORDER_INTEL), locations)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isIfdPointer(ExifTag tag) {
+    return tag == EXIF_TAG_EXIF_IFD_POINTER || tag == EXIF_TAG_GPS_INFO_IFD_POINTER ||
+            tag == EXIF_TAG_INTEROPERABILITY_IFD_POINTER;
+}
+
+static bool compareLocations(const ExifValueLocation& a, const ExifValueLocation& b) {
+    return (a.ifd == b.ifd) ? a.tag < b.tag : a.ifd < b.ifd;
+}
+
+ExifTemplateImpl::ExifTemplateImpl()
+        : use_template_(false), building_template_(false), value_count_(0),
+          template_from_hal_(false) {}
+
+ExifTemplateImpl::~ExifTemplateImpl() {}
+
+bool ExifTemplateImpl::initialize(const unsigned char *app1Segment, size_t app1SegmentSize) {
+    reset();
+    value_count_ = 0;
+    removed_tags_.clear();
+    app1_.clear();
+    if (!parseHalApp1(app1Segment, app1SegmentSize)) {
+        use_template_ = false;
+        hal_app1_.clear();
+        return ExifUtilsImpl::initialize(app1Segment, app1SegmentSize);
+    }
+    use_template_ = true;
+
+    // set exif version to 2.2.
+    return setExifVersion("0220");
+}
+
+bool ExifTemplateImpl::initializeEmpty() {
+    reset();
+    use_template_ = true;
+    value_count_ = 0;
+    hal_app1_.clear();
+    hal_values_.clear();
+    removed_tags_.clear();
+    app1_.clear();
+
+    // set exif version to 2.2.
+    return setExifVersion("0220");
+}
+
+bool ExifTemplateImpl::parseHalApp1(const unsigned char* app1Segment, size_t app1SegmentSize) {
+    static const uint8_t kExifHeader[] = {'E', 'x', 'i', 'f', 0, 0};
+    static const uint8_t kApp1Marker[] = {0xFF, 0xE1};
+    hal_values_.clear();
+    if (app1Segment == nullptr) {
+        return false;
+    }
+
+    // The segment starts with the Exif header, possibly after the APP1 marker
+    // and the segment length.
+    size_t tiffOffset = sizeof(kExifHeader);
+    if (app1SegmentSize >= sizeof(kApp1Marker) + 2 &&
+            memcmp(app1Segment, kApp1Marker, sizeof(kApp1Marker)) == 0) {
+        tiffOffset += sizeof(kApp1Marker) + 2;
+    }
+    if (app1SegmentSize < tiffOffset + 8 ||
+            memcmp(app1Segment + tiffOffset - sizeof(kExifHeader), kExifHeader,
+                    sizeof(kExifHeader)) != 0 ||
+            memcmp(app1Segment + tiffOffset, "II", 2) != 0) {
+        return false;
+    }
+    hal_app1_.assign(app1Segment, app1Segment + app1SegmentSize);
+
+    // A thumbnail in IFD 1 isn't templated.
+    uint64_t nextIfdOffset = 0;
+    if (!findExifValueLocations(hal_app1_, tiffOffset, EXIF_IFD_0,
+                exif_get_long(&hal_app1_[tiffOffset + 4], EXIF_BYTE_ORDER_INTEL),
+                &hal_values_, &nextIfdOffset) || nextIfdOffset != 0) {
+        return false;
+    }
+    std::sort(hal_values_.begin(), hal_values_.end(), compareLocations);
+    for (size_t i = 0; i < hal_values_.size(); i++) {
+        const ExifValueLocation& value = hal_values_[i];
+        if (i > 0 && value.ifd == hal_values_[i - 1].ifd && value.tag == hal_values_[i - 1].tag) {
+            return false;
+        }
+        // libexif rewrites these depending on their contents.
+        if (value.tag == EXIF_TAG_MAKER_NOTE || value.tag == EXIF_TAG_USER_COMMENT ||
+                exif_format_get_size(value.format) == 0) {
+            return false;
+        }
+        if (value.format == EXIF_FORMAT_ASCII &&
+                (value.size == 0 || hal_app1_[value.offset + value.size - 1] != '\0')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ExifTemplateImpl::generateApp1() {
+    if (!use_template_) {
+        return ExifUtilsImpl::generateApp1();
+    }
+    app1_.clear();
+
+    std::sort(values_.begin(), values_.begin() + value_count_,
+            [](const Value& a, const Value& b) {
+                return (a.ifd == b.ifd) ? a.tag < b.tag : a.ifd < b.ifd;
+            });
+    if (!matchesTemplate()) {
+        ALOGV("%s: Tags changed, building a new template", __FUNCTION__);
+        if (!buildTemplate()) {
+            return false;
+        }
+    }
+
+    app1_ = template_;
+    for (size_t i = 0; i < template_hal_offsets_.size(); i++) {
+        if (template_hal_offsets_[i] != SIZE_MAX) {
+            memcpy(app1_.data() + template_hal_offsets_[i],
+                    hal_app1_.data() + hal_values_[i].offset, hal_values_[i].size);
+        }
+    }
+    for (size_t i = 0; i < template_entries_.size(); i++) {
+        const std::vector<uint8_t>& data = values_[i].data;
+        memcpy(app1_.data() + template_entries_[i].offset, data.data(), data.size());
+    }
+    return true;
+}
+
+const uint8_t* ExifTemplateImpl::getApp1Buffer() {
+    if (!use_template_) {
+        return ExifUtilsImpl::getApp1Buffer();
+    }
+    return app1_.empty() ? nullptr : app1_.data();
+}
+
+unsigned int ExifTemplateImpl::getApp1Length() {
+    if (!use_template_) {
+        return ExifUtilsImpl::getApp1Length();
+    }
+    return app1_.size();
+}
+
+bool ExifTemplateImpl::setShort(ExifIfd ifd, ExifTag tag, uint16_t value,
+        const std::string& msg) {
+    if (!isRecording()) {
+        return ExifUtilsImpl::setShort(ifd, tag, value, msg);
+    }
+    Value& v = recordValue(ifd, tag, ValueType::SHORT, sizeof(value));
+    exif_set_short(v.data.data(), EXIF_BYTE_ORDER_INTEL, value);
+    return true;
+}
+
+bool ExifTemplateImpl::setLong(ExifIfd ifd, ExifTag tag, uint32_t value,
+        const std::string& msg) {
+    if (!isRecording()) {
+        return ExifUtilsImpl::setLong(ifd, tag, value, msg);
+    }
+    Value& v = recordValue(ifd, tag, ValueType::LONG, sizeof(value));
+    exif_set_long(v.data.data(), EXIF_BYTE_ORDER_INTEL, value);
+    return true;
+}
+
+bool ExifTemplateImpl::setRational(ExifIfd ifd, ExifTag tag, uint32_t numerator,
+        uint32_t denominator, const std::string& msg) {
+    if (!isRecording()) {
+        return ExifUtilsImpl::setRational(ifd, tag, numerator, denominator, msg);
+    }
+    Value& v = recordValue(ifd, tag, ValueType::RATIONAL, sizeof(ExifRational));
+    exif_set_rational(v.data.data(), EXIF_BYTE_ORDER_INTEL, {numerator, denominator});
+    return true;
+}
+
+bool ExifTemplateImpl::setSRational(ExifIfd ifd, ExifTag tag, int32_t numerator,
+        int32_t denominator, const std::string& msg) {
+    if (!isRecording()) {
+        return ExifUtilsImpl::setSRational(ifd, tag, numerator, denominator, msg);
+    }
+    Value& v = recordValue(ifd, tag, ValueType::SRATIONAL, sizeof(ExifSRational));
+    exif_set_srational(v.data.data(), EXIF_BYTE_ORDER_INTEL, {numerator, denominator});
+    return true;
+}
+
+bool ExifTemplateImpl::setData(ExifIfd ifd, ExifTag tag, ExifFormat format,
+        uint64_t components, const void* data, unsigned int size, const std::string& msg) {
+    if (!isRecording()) {
+        return ExifUtilsImpl::setData(ifd, tag, format, components, data, size, msg);
+    }
+    Value& v = recordValue(ifd, tag, ValueType::DATA, size);
+    v.format = format;
+    v.components = components;
+    memcpy(v.data.data(), data, size);
+    return true;
+}
+
+void ExifTemplateImpl::removeEntry(ExifIfd ifd, ExifTag tag) {
+    if (!isRecording()) {
+        ExifUtilsImpl::removeEntry(ifd, tag);
+        return;
+    }
+    for (size_t i = 0; i < value_count_; i++) {
+        if (values_[i].ifd == ifd && values_[i].tag == tag) {
+            std::swap(values_[i], values_[value_count_ - 1]);
+            value_count_--;
+            break;
+        }
+    }
+    if (!hal_app1_.empty()) {
+        // the tag may also be in the HAL APP1 segment
+        auto removed = std::make_pair(ifd, tag);
+        auto it = std::lower_bound(removed_tags_.begin(), removed_tags_.end(), removed);
+        if (it == removed_tags_.end() || *it != removed) {
+            removed_tags_.insert(it, removed);
+        }
+    }
+}
+
+ExifTemplateImpl::Value& ExifTemplateImpl::recordValue(ExifIfd ifd, ExifTag tag,
+        ValueType type, size_t size) {
+    size_t i = 0;
+    while (i < value_count_ && (values_[i].ifd != ifd || values_[i].tag != tag)) {
+        i++;
+    }
+    if (i == value_count_) {
+        if (value_count_ == values_.size()) {
+            values_.emplace_back();
+        }
+        value_count_++;
+    }
+
+    auto removed = std::find(removed_tags_.begin(), removed_tags_.end(),
+            std::make_pair(ifd, tag));
+    if (removed != removed_tags_.end()) {
+        removed_tags_.erase(removed);
+    }
+
+    Value& v = values_[i];
+    v.ifd = ifd;
+    v.tag = tag;
+    v.type = type;
+    v.format = EXIF_FORMAT_UNDEFINED;
+    v.components = 0;
+    v.data.resize(size);
+    return v;
+}
+
+bool ExifTemplateImpl::matchesTemplate() const {
+    if (template_entries_.empty() || template_entries_.size() != value_count_) {
+        return false;
+    }
+    if (template_from_hal_ != !hal_app1_.empty() ||
+            template_hal_values_.size() != hal_values_.size() ||
+            template_removed_tags_ != removed_tags_) {
+        return false;
+    }
+    for (size_t i = 0; i < hal_values_.size(); i++) {
+        const ExifValueLocation& templateValue = template_hal_values_[i];
+        const ExifValueLocation& value = hal_values_[i];
+        if (templateValue.ifd != value.ifd || templateValue.tag != value.tag ||
+                templateValue.format != value.format ||
+                templateValue.components != value.components) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < value_count_; i++) {
+        const TemplateEntry& entry = template_entries_[i];
+        const Value& v = values_[i];
+        if (entry.ifd != v.ifd || entry.tag != v.tag || entry.type != v.type ||
+                entry.size != v.data.size()) {
+            return false;
+        }
+        if (v.type == ValueType::DATA &&
+                (entry.format != v.format || entry.components != v.components)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ExifTemplateImpl::buildTemplate() {
+    template_.clear();
+    template_entries_.clear();
+    template_hal_values_.clear();
+    template_hal_offsets_.clear();
+    template_removed_tags_.clear();
+
+    building_template_ = true;
+    template_from_hal_ = !hal_app1_.empty();
+    bool res = template_from_hal_ ?
+            ExifUtilsImpl::initialize(hal_app1_.data(), hal_app1_.size()) :
+            ExifUtilsImpl::initializeEmpty();
+    for (size_t i = 0; res && i < removed_tags_.size(); i++) {
+        ExifUtilsImpl::removeEntry(removed_tags_[i].first, removed_tags_[i].second);
+    }
+    for (size_t i = 0; res && i < value_count_; i++) {
+        res = setWithLibexif(values_[i]);
+    }
+    res = res && ExifUtilsImpl::generateApp1();
+    building_template_ = false;
+    if (!res) {
+        reset();
+        return false;
+    }
+    template_.assign(app1_buffer_, app1_buffer_ + app1_length_);
+    reset();
+
+    // Find where each value was written, so that the next images only need to
+    // patch them. The template can still be used as is for this image if that
+    // fails.
+    std::vector<ExifValueLocation> locations;
+    if (template_.size() < kTiffHeaderOffset + 8 ||
+            memcmp(&template_[kTiffHeaderOffset], "II", 2) != 0 ||
+            !findExifValueLocations(template_, kTiffHeaderOffset, EXIF_IFD_0,
+                    exif_get_long(&template_[kTiffHeaderOffset + 4], EXIF_BYTE_ORDER_INTEL),
+                    &locations)) {
+        ALOGW("%s: Unable to parse the generated APP1 segment", __FUNCTION__);
+        return true;
+    }
+    for (size_t i = 0; i < value_count_; i++) {
+        const Value& v = values_[i];
+        auto location = std::find_if(locations.begin(), locations.end(),
+                [&v](const ExifValueLocation& l) { return l.ifd == v.ifd && l.tag == v.tag; });
+        // Fixed size setters only write the start of the entry, the rest of it
+        // keeps the default value from libexif.
+        if (location == locations.end() || location->size < v.data.size() ||
+                (v.type == ValueType::DATA && location->size != v.data.size())) {
+            ALOGW("%s: Unable to find tag 0x%x in the generated APP1 segment", __FUNCTION__,
+                    static_cast<unsigned int>(v.tag));
+            template_entries_.clear();
+            return true;
+        }
+        template_entries_.push_back({v.ifd, v.tag, v.type, v.format, v.components,
+                v.data.size(), location->offset});
+    }
+
+    // The HAL values must have been copied as is, to be copied into the
+    // template for the next images. Values libexif dropped stay dropped.
+    for (const ExifValueLocation& halValue : hal_values_) {
+        size_t offset = SIZE_MAX;
+        bool replaced = isIfdPointer(halValue.tag) ||
+                std::binary_search(removed_tags_.begin(), removed_tags_.end(),
+                        std::make_pair(halValue.ifd, halValue.tag)) ||
+                std::any_of(values_.begin(), values_.begin() + value_count_,
+                        [&halValue](const Value& v) {
+                            return v.ifd == halValue.ifd && v.tag == halValue.tag;
+                        });
+        auto location = std::find_if(locations.begin(), locations.end(),
+                [&halValue](const ExifValueLocation& l) {
+                    return l.ifd == halValue.ifd && l.tag == halValue.tag;
+                });
+        if (!replaced && location != locations.end()) {
+            if (location->format != halValue.format ||
+                    location->components != halValue.components ||
+                    memcmp(&template_[location->offset], &hal_app1_[halValue.offset],
+                            halValue.size) != 0) {
+                ALOGV("%s: libexif changed tag 0x%x of the HAL APP1 segment", __FUNCTION__,
+                        static_cast<unsigned int>(halValue.tag));
+                template_entries_.clear();
+                template_hal_offsets_.clear();
+                return true;
+            }
+            offset = location->offset;
+        }
+        template_hal_offsets_.push_back(offset);
+    }
+    template_hal_values_ = hal_values_;
+    template_removed_tags_ = removed_tags_;
+    return true;
+}
+
+bool ExifTemplateImpl::setWithLibexif(const Value& value) {
+    const char* name = exif_tag_get_name_in_ifd(value.tag, value.ifd);
+    std::string msg = (name != nullptr) ? name : "unknown";
+    const uint8_t* data = value.data.data();
+    switch (value.type) {
+        case ValueType::SHORT:
+            return ExifUtilsImpl::setShort(value.ifd, value.tag,
+                    exif_get_short(data, EXIF_BYTE_ORDER_INTEL), msg);
+        case ValueType::LONG:
+            return ExifUtilsImpl::setLong(value.ifd, value.tag,
+                    exif_get_long(data, EXIF_BYTE_ORDER_INTEL), msg);
+        case ValueType::RATIONAL: {
+            ExifRational r = exif_get_rational(data, EXIF_BYTE_ORDER_INTEL);
+            return ExifUtilsImpl::setRational(value.ifd, value.tag, r.numerator,
+                    r.denominator, msg);
+        }
+        case ValueType::SRATIONAL: {
+            ExifSRational r = exif_get_srational(data, EXIF_BYTE_ORDER_INTEL);
+            return ExifUtilsImpl::setSRational(value.ifd, value.tag, r.numerator,
+                    r.denominator, msg);
+        }
+        case ValueType::DATA:
+            return ExifUtilsImpl::setData(value.ifd, value.tag, value.format,
+                    value.components, data, value.data.size(), msg);
+    }
+    return false;
+}
+
 } // namespace camera3
 } // namespace android
@@ -64,6 +64,16 @@ public:
 
     static ExifUtils* create();
 
+    // Creates an ExifUtils meant to be reused for every image of a session.
+    // The APP1 segment generated for an image is kept as a template: for the
+    // following images with the same set of tags, generateApp1() only patches
+    // the new tag values into a copy of it, instead of building the Exif data
+    // and serializing it with libexif again. The values of an APP1 segment passed
+    // to initialize() are patched the same way, as long as the segment keeps the
+    // same tags. Segments libexif would edit, like ones with a thumbnail or in
+    // Motorola byte order, always go through libexif.
+    static ExifUtils* createWithTemplate();
+
     // Initialize() can be called multiple times. The setting of Exif tags will be
     // cleared.
     virtual bool initialize(const unsigned char *app1Segment, size_t app1SegmentSize) = 0;
@@ -20,6 +20,8 @@
 
 #include <utils/Vector.h>
 
+#include <algorithm>
+
 #include <datasource/DataSourceFactory.h>
 #include <media/DataSource.h>
 #include <media/stagefright/InterfaceUtils.h>
@@ -43,7 +45,10 @@ MediaExtractorService::~MediaExtractorService() {
         ::android::sp<::android::IMediaExtractor>* _aidl_return) {
     ALOGV("@@@ MediaExtractorService::makeExtractor for %s", mime ? mime->c_str() : nullptr);
 
-    sp<DataSource> localSource = CreateDataSourceFromIDataSource(remoteSource);
+    sp<DataSource> localSource = findLocalSource(remoteSource);
+    if (localSource == nullptr) {
+        localSource = CreateDataSourceFromIDataSource(remoteSource);
+    }
 
     MediaBuffer::useSharedMemory();
     sp<IMediaExtractor> extractor = MediaExtractorFactory::CreateFromService(
@@ -67,10 +72,36 @@ MediaExtractorService::~MediaExtractorService() {
         int64_t length,
         ::android::sp<::android::IDataSource>* _aidl_return) {
     sp<DataSource> source = DataSourceFactory::getInstance()->CreateFromFd(fd.release(), offset, length);
-    *_aidl_return = CreateIDataSourceFromDataSource(source);
+    sp<IDataSource> remoteSource = CreateIDataSourceFromDataSource(source);
+    if (remoteSource != nullptr) {
+        Mutex::Autolock lock(mLock);
+        mLocalSources.erase(std::remove_if(mLocalSources.begin(), mLocalSources.end(),
+                [](const auto &entry) { return entry.first.promote() == nullptr; }),
+                mLocalSources.end());
+        mLocalSources.emplace_back(IInterface::asBinder(remoteSource), source);
+    }
+    *_aidl_return = remoteSource;
     return binder::Status::ok();
 }
 
+sp<DataSource> MediaExtractorService::findLocalSource(const sp<IDataSource> &remoteSource) {
+    if (remoteSource == nullptr) {
+        return nullptr;
+    }
+    sp<IBinder> binder = IInterface::asBinder(remoteSource);
+    if (binder->localBinder() == nullptr) {
+        return nullptr;
+    }
+    Mutex::Autolock lock(mLock);
+    for (const auto &entry : mLocalSources) {
+        if (entry.first.promote() == binder) {
+            // a mapped FileSource, reading it directly skips the copy through IMemory
+            return entry.second.promote();
+        }
+    }
+    return nullptr;
+}
+
 ::android::binder::Status MediaExtractorService::getSupportedTypes(
         ::std::vector<::std::string>* _aidl_return) {
     *_aidl_return = MediaExtractorFactory::getSupportedTypes();
@@ -20,6 +20,10 @@
 #include <binder/BinderService.h>
 #include <android/BnMediaExtractorService.h>
 #include <android/IMediaExtractor.h>
+#include <media/DataSource.h>
+
+#include <utility>
+#include <vector>
 
 namespace android {
 
@@ -47,7 +51,13 @@ public:
     virtual status_t dump(int fd, const Vector<String16>& args);
 
 private:
+    // Returns the source behind |remoteSource| if makeIDataSource() made it.
+    sp<DataSource> findLocalSource(const sp<IDataSource> &remoteSource);
+
     Mutex               mLock;
+    // Sources made by makeIDataSource() and the IDataSources wrapping them, so that an
+    // extractor for one of them reads the source directly instead of through binder.
+    std::vector<std::pair<wp<IBinder>, wp<DataSource>>> mLocalSources;
 };
 
 }   // namespace android